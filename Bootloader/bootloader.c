@@ -2,34 +2,107 @@
 
 /* Global Variable Declarations ----------------------------------------------*/
 
-static uint8_t uartHostBuffer[HOST_BUFFER_LEN];
 void jump_To_Application(void);
 
+/*	write position of the running stream session, advanced by the sinks as data reaches flash	*/
+static uint32_t streamWriteAddress = 0;
+static uint32_t streamImageEnd = 0;
+static uint32_t streamImageLength = 0;
+static uint32_t streamImageCrc = 0;
+static uint8_t streamEraseAhead = 0;
+static uint8_t streamJournal = 0;
+static uint32_t streamJournalBase = 0;
+
+/*	ACK or NACK that last went out for the current frame, what the benchmark records as its status	*/
+static uint8_t replyStatus = BL_NACK;
+
+/*	history window lives in main SRAM, SRAM2 is taken by the receive frame slots, the image is never buffered as a whole	*/
+static BL_LZ_ContextTypeDef streamLZ;
+
 /* Static Software Interface Declarations ------------------------------------*/
-static BL_StatusTypeDef BootLoader_Get_Version                    (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Get_Help                       (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Get_Chip_Identification_Number (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Read_Protection_Level          (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Jump_To_Address                (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Erase_Flash                    (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Memory_Write                   (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Enable_RW_Protection           (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Memory_Read                    (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Get_Sector_Protection_Status   (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Read_OTP                       (uint8_t *hostBuffer);
-static BL_StatusTypeDef BootLoader_Disable_RW_Protection					(uint8_t *hostBuffer);
-
-static uint8_t verify_CRC(uint8_t *hostBuffer, uint8_t frameLength, uint32_t crcHost);
+static BL_StatusTypeDef BootLoader_Get_Version                    (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Get_Help                       (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Get_Chip_Identification_Number (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Read_Protection_Level          (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Jump_To_Address                (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Erase_Flash                    (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Memory_Write                   (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Enable_RW_Protection           (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Memory_Read                    (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Get_Sector_Protection_Status   (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Read_OTP                       (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Disable_RW_Protection					(const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Stream_Write                   (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Compressed_Write               (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Image_Hash                     (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Delta_Write                    (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Slot_Info                      (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Set_Active_Slot                (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Memory_Hash                    (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Set_Baud                       (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Set_Protocol                   (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Bench_Read                     (const BL_FrameTypeDef *hostFrame);
+static BL_StatusTypeDef BootLoader_Journal_Query                  (const BL_FrameTypeDef *hostFrame);
+
+static uint8_t verify_CRC(uint8_t *hostBuffer, uint16_t frameLength, uint32_t crcHost);
 static uint8_t verify_Address(uint32_t hostAddress);
+static uint8_t verify_Memory_Region(uint32_t baseAddress, uint32_t length);
 static uint8_t verify_Application_Doesnot_Overwrite_Bootloader(uint32_t hostAddress);
 static uint8_t write_Application_on_Flash(uint32_t host_Start_Address, uint16_t data_Number_Bytes, uint8_t *pToStartData)	;
 static void jump_To_Address(uint32_t hostAddress);
 static uint8_t verify_Sectors(uint8_t sector, uint8_t numberOfSectors);
-static uint8_t verify_Mass_Erase(uint8_t sector, uint8_t numberOfSectors);
+static uint8_t verify_Erase_Sectors(uint8_t sector, uint8_t numberOfSectors);
 static uint8_t verify_Accurate_Remaining_Sectors(uint8_t sector, uint8_t numberOfSectors);
 static BL_StatusTypeDef BootLoader_Send_ACK(uint8_t replyLen);
 static BL_StatusTypeDef BootLoader_Send_NACK(void);
-static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint8_t dataLen);
+static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint16_t dataLen);
+static uint8_t verify_Image_Destination(uint32_t baseAddress, uint32_t imageLength);
+static uint8_t verify_Slot_Destination(uint32_t baseAddress, uint32_t length);
+static uint8_t verify_Booting_Slot(void);
+static uint8_t stream_Run_Session(uint8_t streamSID, uint32_t totalLength, uint8_t windowSize, uint8_t blockAlignment, streamSinkFunction blockSink);
+static uint8_t stream_Sink_Flash(uint8_t *data, uint16_t length, uint8_t lastBlock);
+static uint8_t stream_Sink_Decompress(uint8_t *data, uint16_t length, uint8_t lastBlock);
+static uint8_t stream_LZ_Output(const uint8_t *data, uint16_t length);
+static uint8_t stream_Sink_Delta(uint8_t *data, uint16_t length, uint8_t lastBlock);
+static uint8_t frame_Decode(uint8_t *rawFrame, BL_FrameTypeDef *hostFrame);
+static const BL_CommandTypeDef *frame_Find_Command(uint8_t SID);
+static uint8_t baud_Test_Link(void);
+
+/* Command Table -------------------------------------------------------------*/
+
+/*	SID, payload length range and handler : length and CRC are checked once before dispatching	*/
+static const BL_CommandTypeDef bootLoaderCommands[] = {
+	{	CBL_GET_VER_CMD,						0,	0,											BootLoader_Get_Version										},
+	{	CBL_GET_HELP_CMD,						0,	0,											BootLoader_Get_Help												},
+	{	CBL_GET_CID_CMD,						0,	0,											BootLoader_Get_Chip_Identification_Number	},
+	{	CBL_GET_RDP_STATUS_CMD,			0,	0,											BootLoader_Read_Protection_Level					},
+	{	CBL_GO_TO_ADDR_CMD,					4,	4,											BootLoader_Jump_To_Address								},
+	{	CBL_FLASH_ERASE_CMD,				2,	2,											BootLoader_Erase_Flash										},
+	{	CBL_MEM_WRITE_CMD,					5,	FRAME_MAX_PAYLOAD_LEN,	BootLoader_Memory_Write										},
+	{	CBL_EN_R_W_PROTECT_CMD,			0,	FRAME_MAX_PAYLOAD_LEN,	NULL																			},
+	{	CBL_MEM_READ_CMD,						8,	8,											BootLoader_Memory_Read										},
+	{	CBL_READ_SECTOR_STATUS_CMD,	2,	2,											BootLoader_Get_Sector_Protection_Status		},
+	{	CBL_OTP_READ_CMD,						0,	FRAME_MAX_PAYLOAD_LEN,	NULL																			},
+	{	CBL_CHANGE_ROP_LEVEL_CMD,		0,	FRAME_MAX_PAYLOAD_LEN,	NULL																			},
+	{	CBL_STREAM_WRITE_CMD,				9,	STREAM_JOURNAL_SESSION_LEN,	BootLoader_Stream_Write								},
+	{	CBL_COMPRESSED_WRITE_CMD,		13,	13,											BootLoader_Compressed_Write								},
+	{	CBL_IMAGE_HASH_CMD,					8,	8,											BootLoader_Image_Hash											},
+	{	CBL_DELTA_WRITE_CMD,				25,	25,											BootLoader_Delta_Write										},
+	{	CBL_SLOT_INFO_CMD,					0,	0,											BootLoader_Slot_Info											},
+	{	CBL_SET_ACTIVE_SLOT_CMD,		13,	13,											BootLoader_Set_Active_Slot								},
+	{	CBL_MEM_HASH_CMD,						8,	8,											BootLoader_Memory_Hash										},
+	{	CBL_SET_BAUD_CMD,						4,	4,											BootLoader_Set_Baud												},
+	{	CBL_SET_PROTOCOL_CMD,				1,	1,											BootLoader_Set_Protocol										},
+	{	CBL_BENCH_READ_CMD,					1,	1,											BootLoader_Bench_Read											},
+	{	CBL_JOURNAL_QUERY_CMD,			0,	0,											BootLoader_Journal_Query									},
+};
+#define BL_COMMAND_COUNT						(sizeof(bootLoaderCommands) / sizeof(bootLoaderCommands[0]))
+
+static BL_CommandProfileTypeDef commandProfile[BL_COMMAND_COUNT];
+
+/*	known pattern exchanged at a candidate rate : long runs, single edges and every bit position toggled	*/
+static const uint8_t baudTestPattern[BAUD_TEST_PATTERN_LEN] = {	0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+																																0x01, 0x80, 0x7E, 0x81, 0x5A, 0xA5, 0x96, 0x69	};
 
 /* Software Interface Defintions ---------------------------------------------*/
 /*----------------------------------------------------------------------------*/
@@ -37,115 +110,127 @@ static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint8_t dataLen);
 /*----------------------------------------------------------------------------*/
 BL_StatusTypeDef bootloader_Receive_From_Host(void)
 {
-	/*	initialize bootloaderStatusVar, uartStatusVar , variable for message length, SID	*/
+	/*	initialize bootloaderStatusVar, pointer to received frame, decoded view and matching table entry	*/
 	BL_StatusTypeDef blStatus = BL_OK;
-	HAL_StatusTypeDef uartStatus = HAL_OK;
-	uint8_t dataLen = 0, SID = 0;
+	uint8_t *rawFrame = NULL;
+	BL_FrameTypeDef hostFrame;
+	const BL_CommandTypeDef *command = NULL;
 	
-	/*	re-initialize the data buffer	*/
-	memset(uartHostBuffer, 0, HOST_BUFFER_LEN);
+	/*	push out whatever the log ring still holds before going idle	*/
+	BL_Log_Drain();
 	
-	/*	receive one byte for number of incoming bytes after it	*/
-	uartStatus |= HAL_UART_Receive(BL_HOST_COMM_UART, uartHostBuffer, 1, HAL_MAX_DELAY); 
-	
-	/*	if receiving failed, return error status	else store length of incoming bytes	*/
-	if(uartStatus){ return BL_ERROR; }
-	else { dataLen = uartHostBuffer[0];}
-	
-	/*	receive specified number of bytes in buffer	*/
-	uartStatus |= HAL_UART_Receive(BL_HOST_COMM_UART, uartHostBuffer+1 , dataLen, HAL_MAX_DELAY); 
+	/*	wait for the receive engine to hand over a complete frame (length field + specified number of bytes)	*/
+	rawFrame = BL_RX_Get_Frame(HAL_MAX_DELAY);
 	
 	/*	if receiving failed, return error status else send 2 frames */
 	/*	1 frame for ACK + reply Length */
 	/*	1 frame for actual reply according to SID */
-	if(uartStatus){ return BL_ERROR; }
-	SID = uartHostBuffer[1];
-	switch(SID)
+	if(NULL == rawFrame){ return BL_ERROR; }
+	
+	/*	stage stamps of this frame, the benchmark read out itself is left out of them	*/
+	if(CBL_BENCH_READ_CMD != rawFrame[BL_RX_Header_Len()])
 	{
-		case( CBL_GET_VER_CMD						):
-			blStatus |= BootLoader_Get_Version(uartHostBuffer);
-			break;
-		
-		case( CBL_GET_HELP_CMD					):
-			blStatus |= BootLoader_Get_Help(uartHostBuffer);
-			break;
-		
-		case( CBL_GET_CID_CMD						):
-			blStatus |= BootLoader_Get_Chip_Identification_Number(uartHostBuffer);
-			break;
-		
-		case( CBL_GET_RDP_STATUS_CMD		):
-			blStatus |= BootLoader_Read_Protection_Level(uartHostBuffer);
-			break;
-		
-		case( CBL_GO_TO_ADDR_CMD				):
-			blStatus |= BootLoader_Jump_To_Address(uartHostBuffer);
-			break;
-		
-		case( CBL_FLASH_ERASE_CMD				):
-			blStatus |= BootLoader_Erase_Flash(uartHostBuffer);
-			break;
-		
-		case( CBL_MEM_WRITE_CMD					):
-			blStatus |= BootLoader_Memory_Write(uartHostBuffer);
-			break;
-		
-		case( CBL_EN_R_W_PROTECT_CMD		):
-			break;
-		
-		case( CBL_MEM_READ_CMD					):
-			break;
+		BL_Bench_Open(BL_BENCH_KIND_COMMAND, BL_RX_Frame_Cycles(rawFrame), BL_RX_Frame_Length(rawFrame));
+	}
+	
+	/*	a write session lasts over consecutive memory write frames, any other command locks flash again	*/
+	if(CBL_MEM_WRITE_CMD != rawFrame[BL_RX_Header_Len()])
+	{
+		BL_Flash_End();
+	}
+	
+	/*	a handler that never answers (a jump that returns) counts as refused	*/
+	replyStatus = BL_NACK;
+	
+	/*	length and CRC are verified once here, handlers only ever see a valid frame	*/
+	if(FRAME_VERIFIED == frame_Decode(rawFrame, &hostFrame))
+	{
+		command = frame_Find_Command(hostFrame.SID);
+		BL_Baud_Link_Event(1);
+	}
+	else
+	{
+		BL_Baud_Link_Event(0);
+	}
+	
+	if( (NULL != command) && (NULL != command->handler)							&&
+			(hostFrame.payloadLength >= command->minPayloadLength)			&&
+			(hostFrame.payloadLength <= command->maxPayloadLength) )
+	{
+		BL_CommandProfileTypeDef *profile = &commandProfile[command - bootLoaderCommands];
+		uint32_t startCycles = DWT->CYCCNT;
 		
-		case( CBL_READ_SECTOR_STATUS_CMD):
-			break;
+		blStatus |= command->handler(&hostFrame);
 		
-		default:
+		uint32_t spentCycles = DWT->CYCCNT - startCycles;
+		profile->calls++;
+		profile->totalCycles += spentCycles;
+		if(spentCycles > profile->maxCycles)
+		{
+			profile->maxCycles = spentCycles;
+		}
+#ifdef SWO_DEBUGGING
+		BL_LOG("SID 0x%X took %u cycles \r\n", hostFrame.SID, spentCycles);
+#endif
+	}
+	else
+	{
 #ifdef SWO_DEBUGGING
-		printf("Wrong input Default switch case \r\n");
+		BL_LOG("Bad frame, unknown or unimplemented SID 0x%X : Send to Host NACK \r\n", rawFrame[BL_RX_Header_Len()]);
 #endif
-			break;		
+		/*	bad length or CRC, unknown SID and unimplemented commands all get the same NACK	*/
+		blStatus |= BootLoader_Send_NACK();
 	}
-	blStatus = (BL_StatusTypeDef)uartStatus;
+	
+	BL_Bench_Close(BL_BENCH_KIND_COMMAND, rawFrame[BL_RX_Header_Len()], 0, replyStatus);
+	
+	/*	give the slot back so the engine can assemble the frame after next into it	*/
+	BL_RX_Release_Frame(rawFrame);
 	
 #ifdef BootLoader_LED_STATUS_Debugging
 if(blStatus)
 	LED_Turn_On(LED_RED);
 #endif
-
+	
 	return blStatus;
 }
 
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const BL_CommandProfileTypeDef *bootloader_Get_Command_Profile(uint8_t SID)
+{
+	const BL_CommandTypeDef *command = frame_Find_Command(SID);
+	return (NULL == command) ? NULL : &commandProfile[command - bootLoaderCommands];
+}
+
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 BL_StatusTypeDef bootloader_Debug_Display(char* formatStr, ...)
 {
-	HAL_StatusTypeDef uartStatus= HAL_OK;
 #if BOOTLOADER_DEBUGGING == ENABLED
-	char sentence[300] = {0};
-	uint8_t charCount = 0;
-	
+	/*	no formatting on target : the format and its arguments go to the log ring and out in the background	*/
 	va_list listarg;
 	va_start(listarg, formatStr);
-	
-	charCount = vsprintf(sentence, formatStr, listarg);
-	
-	uartStatus |= HAL_UART_Transmit(BL_DEBUG_UART, (const unsigned char*)sentence, charCount, HAL_MAX_DELAY);
+	BL_Log_VWrite(formatStr, listarg);
 	va_end(listarg); 
 #endif
-	return (BL_StatusTypeDef)uartStatus;
+	return BL_OK;
 }
 
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint8_t dataLen)
+static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint16_t dataLen)
 {
-	HAL_StatusTypeDef uartStatus= HAL_OK;
-	uartStatus |= HAL_UART_Transmit(BL_HOST_COMM_UART, data, dataLen , HAL_MAX_DELAY);	
-	return (BL_StatusTypeDef)uartStatus;
+	HAL_StatusTypeDef linkStatus= HAL_OK;
+	linkStatus |= BL_Transport_Send(data, dataLen);
+	BL_Bench_Stamp(BL_BENCH_STAGE_TX);
+	return (BL_StatusTypeDef)linkStatus;
 	
 }
 
@@ -156,11 +241,12 @@ static BL_StatusTypeDef BootLoader_Send_To_Host(uint8_t *data, uint8_t dataLen)
 static BL_StatusTypeDef BootLoader_Send_ACK(uint8_t replyLen)
 {
 	/*	send two bytes : ACK and length of next reply frame from BL to host	*/
-	HAL_StatusTypeDef uartStatus= HAL_OK;
-	uint8_t BL_ACK_Var = BL_ACK;												
-	uartStatus |= HAL_UART_Transmit(BL_HOST_COMM_UART, &BL_ACK_Var, 1 , HAL_MAX_DELAY);
-	uartStatus |= HAL_UART_Transmit(BL_HOST_COMM_UART, &replyLen, 	1 , HAL_MAX_DELAY);
-	return (BL_StatusTypeDef)uartStatus;
+	HAL_StatusTypeDef linkStatus= HAL_OK;
+	uint8_t ackFrame[2] = { BL_ACK, replyLen };
+	linkStatus |= BL_Transport_Send(ackFrame, 2);
+	BL_Bench_Stamp(BL_BENCH_STAGE_TX);
+	replyStatus = BL_ACK;
+	return (BL_StatusTypeDef)linkStatus;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -169,38 +255,144 @@ static BL_StatusTypeDef BootLoader_Send_ACK(uint8_t replyLen)
 /*----------------------------------------------------------------------------*/
 static BL_StatusTypeDef BootLoader_Send_NACK(void)
 {
-	HAL_StatusTypeDef uartStatus= HAL_OK;
+	HAL_StatusTypeDef linkStatus= HAL_OK;
 	uint8_t nack = BL_NACK;
-	uartStatus |= HAL_UART_Transmit(BL_HOST_COMM_UART, (const unsigned char*)&nack, 1 , HAL_MAX_DELAY);
-	return (BL_StatusTypeDef)uartStatus;
+	linkStatus |= BL_Transport_Send(&nack, 1);
+	BL_Bench_Stamp(BL_BENCH_STAGE_TX);
+	replyStatus = BL_NACK;
+	return (BL_StatusTypeDef)linkStatus;
 }
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static uint8_t verify_CRC(uint8_t *hostBuffer, uint8_t frameLength, uint32_t crcHost)
+static uint8_t verify_CRC(uint8_t *hostBuffer, uint16_t frameLength, uint32_t crcHost)
 {
 	uint16_t dataLength = frameLength - 4;																		/*	var for length of data	*/
-	uint32_t calculatedCrc = 0;																								/*	var for calculated CRC Buffer	*/
-				
-	uint32_t data = 0;																												/*	host data is uint8 , we need uint32, transform type to give to CRC function	*/
-				
-	for(int i = 0; i < dataLength; i++)	
-	{ 
-		data = (uint32_t)(hostBuffer[i]);
-		calculatedCrc = HAL_CRC_Accumulate(BL_CRC, &data, 1);										/*	calculate CRC on data and return result in CRC buffer	*/
-	}	
 	
-	__HAL_CRC_DR_RESET(BL_CRC);																								/*	remove accumulated data in CRC Buffer by resetting data register	*/																								/*	free allocated memory in heap	*/
+	/*	CRC-32/MPEG-2 over the raw frame bytes, the CRC unit takes them a word at a time	*/
+	uint32_t calculatedCrc = BL_CRC_Calculate(hostBuffer, dataLength);
+	BL_Bench_Stamp(BL_BENCH_STAGE_CRC);
+	
 #ifdef SWO_DEBUGGING
-	printf("CRC Sent by Host is:      0x%X\r\n", crcHost);
-	printf("CRC Calculated by MCU is: 0x%X\r\n", calculatedCrc);
+	BL_LOG("CRC Sent by Host is:      0x%X\r\n", crcHost);
+	BL_LOG("CRC Calculated by MCU is: 0x%X\r\n", calculatedCrc);
 #endif
 	if( crcHost == calculatedCrc )	{ return CRC_VERIFIED; }									/*	return boolean of success or failure	*/
 	else { return CRC_VERIFAILED; }							
 }
 
 
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t frame_Decode(uint8_t *rawFrame, BL_FrameTypeDef *hostFrame)
+{
+	/*	calculate frame length from the length field (1 byte in v1, 2 in v2) and add the field itself	*/
+	uint8_t headerLength = BL_RX_Header_Len();
+	uint16_t frameLength = BL_RX_Frame_Length(rawFrame);
+	
+	if((frameLength - headerLength) < FRAME_MIN_LEN_FIELD)
+	{
+		return FRAME_VERIFAILED;
+	}
+	
+	/*	extract CRC from Frame : it is the last 4 bytes	*/
+	uint32_t crc_Host = *((uint32_t*)(rawFrame + frameLength - FRAME_CRC_LEN));
+	if(CRC_VERIFIED != verify_CRC(rawFrame, frameLength, crc_Host))
+	{
+		return FRAME_VERIFAILED;
+	}
+	
+	hostFrame->frame = rawFrame;
+	hostFrame->SID = rawFrame[headerLength];
+	hostFrame->payload = &rawFrame[FRAME_HEADER_LEN];
+	hostFrame->payloadLength = frameLength - FRAME_HEADER_LEN - FRAME_CRC_LEN;
+	
+	return FRAME_VERIFIED;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static const BL_CommandTypeDef *frame_Find_Command(uint8_t SID)
+{
+	for(uint8_t command = 0; command < BL_COMMAND_COUNT; command++)
+	{
+		if(bootLoaderCommands[command].SID == SID)
+		{
+			return &bootLoaderCommands[command];
+		}
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t baud_Test_Link(void)
+{
+	uint8_t *rawFrame = NULL;
+	BL_FrameTypeDef testFrame;
+	uint8_t linkStatus = BAUD_REJECTED;
+	uint32_t startTick = HAL_GetTick();
+	
+	/*	host -> device : wait for the pattern, noise from the switch-over is dropped as bad frames	*/
+	while((BAUD_REJECTED == linkStatus) && ((HAL_GetTick() - startTick) < BAUD_TEST_TIMEOUT_MS))
+	{
+		rawFrame = BL_RX_Get_Frame(BAUD_TEST_TIMEOUT_MS);
+		if(NULL == rawFrame)
+		{
+			return BAUD_REJECTED;
+		}
+		if( (FRAME_VERIFIED == frame_Decode(rawFrame, &testFrame))		&&
+				(CBL_SET_BAUD_CMD == testFrame.SID)												&&
+				(BAUD_TEST_PATTERN_LEN == testFrame.payloadLength)				&&
+				(0 == memcmp(testFrame.payload, baudTestPattern, BAUD_TEST_PATTERN_LEN)) )
+		{
+			linkStatus = BAUD_SWITCHING;
+		}
+		BL_RX_Release_Frame(rawFrame);
+	}
+	if(BAUD_SWITCHING != linkStatus)
+	{
+		return BAUD_REJECTED;
+	}
+	
+	/*	device -> host : echo the pattern, the host only confirms if it read it back intact	*/
+	if( (BL_OK != BootLoader_Send_ACK( BAUD_TEST_PATTERN_LEN ))																			||
+			(BL_OK != BootLoader_Send_To_Host( (uint8_t *)baudTestPattern, BAUD_TEST_PATTERN_LEN )) )
+	{
+		return BAUD_REJECTED;
+	}
+	
+	rawFrame = BL_RX_Get_Frame(BAUD_TEST_TIMEOUT_MS);
+	if(NULL == rawFrame)
+	{
+		return BAUD_REJECTED;
+	}
+	if( (FRAME_VERIFIED == frame_Decode(rawFrame, &testFrame))	&&
+			(CBL_SET_BAUD_CMD == testFrame.SID)											&&
+			(0 == testFrame.payloadLength) )
+	{
+		linkStatus = BAUD_NEGOTIATED;
+	}
+	BL_RX_Release_Frame(rawFrame);
+	
+	if(BAUD_NEGOTIATED == linkStatus)
+	{
+		if( (BL_OK != BootLoader_Send_ACK( 1 ))							||
+				(BL_OK != BootLoader_Send_To_Host( &linkStatus, 1 )) )
+		{
+			linkStatus = BAUD_REJECTED;
+		}
+	}
+	return linkStatus;
+}
+
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
@@ -208,7 +400,7 @@ static uint8_t verify_CRC(uint8_t *hostBuffer, uint8_t frameLength, uint32_t crc
 static uint8_t verify_Address(uint32_t hostAddress)
 {
 	uint8_t isAddressVerified = ADDRESS_VERIFAILED;
-
+	
 	if(ADD_FLASH_START <= hostAddress && hostAddress <= ADD_FLASH_END)
 	{
 		isAddressVerified = ADDRESS_VERIFIED;
@@ -232,6 +424,31 @@ static uint8_t verify_Address(uint32_t hostAddress)
 	
 	return isAddressVerified;
 }
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t verify_Memory_Region(uint32_t baseAddress, uint32_t length)
+{
+	uint32_t lastAddress = baseAddress + length - 1;
+	
+	/*	empty and wrapping regions are rejected	*/
+	if((0 == length) || (lastAddress < baseAddress))
+	{
+		return ADDRESS_VERIFAILED;
+	}
+	
+	/*	flash, CCM and SRAM sit in different 16MB blocks with holes between them, so a region whose	*/
+	/*	both ends are valid and inside the same block is valid all the way through	*/
+	if( (ADDRESS_VERIFIED == verify_Address(baseAddress))		&&
+			(ADDRESS_VERIFIED == verify_Address(lastAddress))		&&
+			((baseAddress & ADD_BLOCK_MASK) == (lastAddress & ADD_BLOCK_MASK)) )
+	{
+		return ADDRESS_VERIFIED;
+	}
+	return ADDRESS_VERIFAILED;
+}
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
@@ -260,12 +477,26 @@ static uint8_t verify_Sectors(uint8_t sector, uint8_t numberOfSectors)
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static uint8_t verify_Mass_Erase(uint8_t sector, uint8_t numberOfSectors)
+static uint8_t verify_Erase_Sectors(uint8_t sector, uint8_t numberOfSectors)
 {
-	if( sector == 0 && numberOfSectors == 12 )
-		return 1;
-	else
-		return 0;
+	uint8_t bootSlot = verify_Booting_Slot();
+	uint32_t eraseStart = BL_Flash_Sector_Start(sector);
+	uint32_t eraseEnd = 0;
+	
+	/*	the bootloader's own sectors, scratch and the slot table are never erased from the host, so neither is the chip	*/
+	if( (numberOfSectors == 0) || (sector >= BL_SLOT_STAGE_SECTOR)												||
+			(eraseStart < SECTOR2_START_ADDRESS)																							||
+			((sector + numberOfSectors) > BL_SLOT_STAGE_SECTOR) )
+		return SECTORS_NOT_VALIDATED;
+	
+	/*	nor is the slot that boots, the same rule as for writes	*/
+	eraseEnd = BL_Flash_Sector_Start(sector + numberOfSectors - 1) + BL_Flash_Sector_Size(sector + numberOfSectors - 1);
+	if( (BL_SLOT_NONE != bootSlot)																												&&
+			(eraseStart < (BL_SLOT_ADDRESS(bootSlot) + BL_SLOT_LENGTH(bootSlot)))							&&
+			(eraseEnd > BL_SLOT_ADDRESS(bootSlot)) )
+		return SECTORS_NOT_VALIDATED;
+	
+	return SECTORS_VALIDATED;
 }
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
@@ -289,44 +520,24 @@ static uint8_t verify_Accurate_Remaining_Sectors(uint8_t sector, uint8_t numberO
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Get_Version(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Get_Version(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint8_t frameLength = hostBuffer[0] + 1;
-	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
-	
 	/*	array for bootloader reply --version data	*/
 	uint8_t blVersionData[] = {	(uint8_t)BL_VENDOR_ID,
 															(uint8_t)MAJOR_VERSION,
 															(uint8_t)MINOR_VERSION,
 															(uint8_t)PATCH_VERSION	};
+	(void)hostFrame;
 #ifdef SWO_DEBUGGING
-		printf("==========================================================================================\r\n");
-		printf( "Bootloader Get Version Number\r\n");
-#endif
-	/*	verify CRC	*/
-	if(verify_CRC(hostBuffer, frameLength, crc_Host) == CRC_VERIFIED)
-	{					
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Passed \r\n");
-#endif		
-		/*	send ACK and data, then send version data	*/
-		blStatus |= BootLoader_Send_ACK( sizeof(blVersionData)/sizeof(blVersionData[0])  );
-		blStatus |= BootLoader_Send_To_Host( blVersionData, 4 );
-		
-	}
-	else 
-	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Failed \r\n");
+		BL_LOG("==========================================================================================\r\n");
+		BL_LOG( "Bootloader Get Version Number\r\n");
 #endif
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
-	}
+	/*	send ACK and data, then send version data	*/
+	blStatus |= BootLoader_Send_ACK( sizeof(blVersionData)/sizeof(blVersionData[0])  );
+	blStatus |= BootLoader_Send_To_Host( blVersionData, 4 );
+	
 	
 #ifdef BootLoader_LED_STATUS_Debugging
 if(blStatus)
@@ -340,57 +551,27 @@ if(blStatus)
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Get_Help(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Get_Help(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
+	(void)hostFrame;
 	
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint8_t frameLength = hostBuffer[0] + 1;
 #ifdef SWO_DEBUGGING
-		printf("==========================================================================================\r\n");
-		printf( "Bootloader Get Help Menu \r\n");
+		BL_LOG("==========================================================================================\r\n");
+		BL_LOG( "Bootloader Get Help Menu \r\n");
 #endif
 	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
-	
-	/*	array for commands 	*/
-	uint8_t bootLoaderCommandsArray[12] = {
-																CBL_GET_VER_CMD							
-																, CBL_GET_HELP_CMD						
-																, CBL_GET_CID_CMD							
-																, CBL_GET_RDP_STATUS_CMD			
-																, CBL_GO_TO_ADDR_CMD					
-																, CBL_FLASH_ERASE_CMD					
-																, CBL_MEM_WRITE_CMD						
-																, CBL_EN_R_W_PROTECT_CMD			
-																, CBL_MEM_READ_CMD						
-																, CBL_READ_SECTOR_STATUS_CMD	
-																, CBL_OTP_READ_CMD						
-																, CBL_CHANGE_ROP_LEVEL_CMD		
-																};
-																
-	/*	verify CRC	*/
-	if( CRC_VERIFIED == verify_CRC( hostBuffer, frameLength, crc_Host) )
-	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Passed \r\n");
-#endif
-		
-		/*	send ACK and data, then a list of bootloader commands that acts as a help menu*/
-		blStatus |= BootLoader_Send_ACK( 12 );
-		blStatus |= BootLoader_Send_To_Host(bootLoaderCommandsArray, 12);
-	}	
-	else
+	/*	array for commands, taken from the dispatch table so the menu never goes stale	*/
+	uint8_t bootLoaderCommandsArray[BL_COMMAND_COUNT];
+	for(uint8_t command = 0; command < BL_COMMAND_COUNT; command++)
 	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Failed \r\n");
-#endif
-		
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
+		bootLoaderCommandsArray[command] = bootLoaderCommands[command].SID;
 	}
 	
+	/*	send ACK and data, then a list of bootloader commands that acts as a help menu*/
+	blStatus |= BootLoader_Send_ACK( sizeof(bootLoaderCommandsArray) );
+	blStatus |= BootLoader_Send_To_Host(bootLoaderCommandsArray, sizeof(bootLoaderCommandsArray));
+	
 #ifdef BootLoader_LED_STATUS_Debugging
 	if(blStatus)
 			LED_Turn_On(LED_RED);
@@ -403,44 +584,24 @@ static BL_StatusTypeDef BootLoader_Get_Help(uint8_t *hostBuffer)
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Get_Chip_Identification_Number (uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Get_Chip_Identification_Number(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint8_t frameLength = hostBuffer[0] + 1;
-	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t CRC_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
-	
 	/* chip Identification number fetched from certain CPU address in Macro	*/
 	uint16_t chip_Id_Data = ID_CODE;\
+	(void)hostFrame;
 	
 #ifdef SWO_DEBUGGING
-	printf("==========================================================================================\r\n");
-	printf( "Bootloader Get Chip Identification Number\r\n");
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG( "Bootloader Get Chip Identification Number\r\n");
 #endif
 	
-	/*	verify CRC	*/
-	if(CRC_VERIFIED == verify_CRC(hostBuffer, frameLength, CRC_Host))
-	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Passed \r\n");
-#endif
-		
-		/*	send ACK and data, then send chip identification number data	*/
-		blStatus |= BootLoader_Send_ACK(2);
-		blStatus |= BootLoader_Send_To_Host( (uint8_t*)(&chip_Id_Data), 2);
-	}
-	else
-	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Failed \r\n");
-#endif
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
-	}
-
+	
+	/*	send ACK and data, then send chip identification number data	*/
+	blStatus |= BootLoader_Send_ACK(2);
+	blStatus |= BootLoader_Send_To_Host( (uint8_t*)(&chip_Id_Data), 2);
+	
 #ifdef BootLoader_LED_STATUS_Debugging
 	if(blStatus)
 		LED_Turn_On(LED_RED);
@@ -452,43 +613,31 @@ static BL_StatusTypeDef BootLoader_Get_Chip_Identification_Number (uint8_t *host
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Jump_To_Address(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Jump_To_Address(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint8_t frameLength = hostBuffer[0] + 1;
-	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
-	
 	/*	extract address from host frame	*/
-	uint32_t hostDesiredAddress = *((uint32_t *)(&hostBuffer[2]));
+	uint32_t hostDesiredAddress = *((uint32_t *)(&hostFrame->payload[0]));
 	
 	uint8_t isAddressVerified = ADDRESS_VERIFAILED;
 	
-	if(verify_CRC(hostBuffer, frameLength, crc_Host) == CRC_VERIFIED)
-	{							
-			/*	send ACK and data, then send version data	*/
-			blStatus |= BootLoader_Send_ACK( 1 );
-			
-			/*	check validity of Address	*/
-			isAddressVerified = verify_Address(hostDesiredAddress);
-			if(ADDRESS_VERIFIED == isAddressVerified)
-			{
-				blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
-				jump_To_Address(hostDesiredAddress + THUMB_INSTRUCTION_ADDITIVE );
-			}
-			else
-			{
-				blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
-			}
+	/*	send ACK and data, then send version data	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	/*	check validity of Address	*/
+	isAddressVerified = verify_Address(hostDesiredAddress);
+	if(ADDRESS_VERIFIED == isAddressVerified)
+	{
+		blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
 		
+		/*	a queued reply would be lost with the link, it has to be out before the jump	*/
+		blStatus |= (BL_StatusTypeDef)BL_Transport_Flush();
+		jump_To_Address(hostDesiredAddress + THUMB_INSTRUCTION_ADDITIVE );
 	}
-	else 
+	else
 	{
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
+		blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
 	}
 	
 #ifdef BootLoader_LED_STATUS_Debugging
@@ -503,138 +652,108 @@ static BL_StatusTypeDef BootLoader_Jump_To_Address(uint8_t *hostBuffer)
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Erase_Flash(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Erase_Flash(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	HAL_StatusTypeDef halStatus = HAL_OK;
 	uint32_t sectorErrorStatus = 0xAA;
 	uint8_t EraseProcessResult;
-	uint8_t frameLength;
-	uint32_t crc_Host;
 	uint8_t isSectorVerified;
 	
 #ifdef SWO_DEBUGGING
-	printf("==========================================================================================\r\n");
-	printf("Bootloader Erase Flash \r\n");
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Erase Flash \r\n");
 #endif
-	/*	calculate frame length from first byte of frame and add one	*/
-	frameLength = hostBuffer[0] + 1;
+	/*	send ACK and data, then a list of bootloader commands that acts as a help menu*/
+	blStatus |= BootLoader_Send_ACK( 12 );
 	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
+#ifdef SWO_DEBUGGING
+	BL_LOG("sector Number is %d , Number of sectors is %d \r\n",hostFrame->payload[0], hostFrame->payload[1] );
+#endif	
 	
-		/*	verify CRC	*/
-	if( CRC_VERIFIED == verify_CRC( hostBuffer, frameLength, crc_Host) )
-	{
+	/*	Verify Sector Numbers are in Actual Range	*/
+	isSectorVerified = verify_Sectors(hostFrame->payload[0], hostFrame->payload[1]);
+	
+	/*	verify reamining Sectors doesnot exceed last sector, else the function returns a maximum correct number	*/
+	hostFrame->payload[1] = verify_Accurate_Remaining_Sectors(hostFrame->payload[0], hostFrame->payload[1]);
 #ifdef SWO_DEBUGGING
-		printf("CRC Verification Pased \r\n");
+	BL_LOG("Actual Accurate Remaining Sectors is %d\r\n" ,hostFrame->payload[1] );
 #endif		
-		/*	send ACK and data, then a list of bootloader commands that acts as a help menu*/
-		blStatus |= BootLoader_Send_ACK( 12 );
-		
-#ifdef SWO_DEBUGGING
-		printf("sector Number is %d , Number of sectors is %d \r\n",hostBuffer[2], hostBuffer[3] );
-#endif	
+	
+	/*	sectors 2..9 outside the boot slot only : a mass erase or an erase reaching the bootloader, scratch,	*/
+	/*	the slot table or the boot slot is refused as a whole																						*/
+	if(isSectorVerified)
+	{
+		isSectorVerified = verify_Erase_Sectors(hostFrame->payload[0], hostFrame->payload[1]);
+	}
+	if(isSectorVerified)
+	{
 		
-		/*	Verify Sector Numbers are in Actual Range	*/
-		isSectorVerified = verify_Sectors(hostBuffer[2], hostBuffer[3]);
+		/*	struct for configuration param of erase function	*/
+		FLASH_EraseInitTypeDef erase_cfg;
+		erase_cfg.Banks = FLASH_BANK_1;
+		erase_cfg.VoltageRange = BL_FLASH_VOLTAGE_RANGE;
+		erase_cfg.Sector = hostFrame->payload[0];
+		erase_cfg.NbSectors = hostFrame->payload[1];
+		erase_cfg.TypeErase = FLASH_TYPEERASE_SECTORS;
 		
-		/*	verify reamining Sectors doesnot exceed last sector, else the function returns a maximum correct number	*/
-		hostBuffer[3] = verify_Accurate_Remaining_Sectors(hostBuffer[2], hostBuffer[3]);
-#ifdef SWO_DEBUGGING
-		printf("Actual Accurate Remaining Sectors is %d\r\n" ,hostBuffer[3] );
-#endif		
-		if(isSectorVerified)
-		{
-			
-			/*	struct for configuration param of erase function	*/
-			FLASH_EraseInitTypeDef erase_cfg;
-			erase_cfg.Banks = FLASH_BANK_1;
-			erase_cfg.VoltageRange = FLASH_VOLTAGE_RANGE_3;
-			erase_cfg.Sector = hostBuffer[2];
-			
-			uint8_t isThisMassErase = verify_Mass_Erase(hostBuffer[2], hostBuffer[3]);
-			if(isThisMassErase)
-			{
-#ifdef SWO_DEBUGGING
-				printf("This Erase is a mass erase\r\n");
-#endif	
-				erase_cfg.TypeErase = FLASH_TYPEERASE_MASSERASE;
-			}
-			else
-			{
-#ifdef SWO_DEBUGGING
-				printf("This Erase is sector erase\r\n");
-#endif	
-				erase_cfg.TypeErase = FLASH_TYPEERASE_SECTORS;
-			}
-			
-			/*	unlock flash for erasing sectors	*/
-			halStatus |= HAL_FLASH_Unlock();
+		/*	unlock flash for erasing sectors	*/
+		halStatus |= HAL_FLASH_Unlock();
 #ifdef SWO_DEBUGGING
-			if(0 == halStatus)
-				printf("HAL Status after unlocking flash is OK \r\n");
-			else 
-				printf("HAL Status after unlocking flash is ERROR \r\n");
+		if(0 == halStatus)
+			BL_LOG("HAL Status after unlocking flash is OK \r\n");
+		else 
+			BL_LOG("HAL Status after unlocking flash is ERROR \r\n");
 #endif			
-			
-			halStatus |= HAL_FLASHEx_Erase( &erase_cfg, &sectorErrorStatus);
+		
+		halStatus |= HAL_FLASHEx_Erase( &erase_cfg, &sectorErrorStatus);
+		BL_Bench_Stamp(BL_BENCH_STAGE_FLASH);
 #ifdef SWO_DEBUGGING
-			if(0 == halStatus)
-				printf("HAL Status after erasing flash is OK \r\n");
-			else 
-				printf("HAL Status after erasing flash is ERROR \r\n");
-			printf("Sector Status before Erase = 0xAA, After Erase = 0x%X\r\n", sectorErrorStatus);
+		if(0 == halStatus)
+			BL_LOG("HAL Status after erasing flash is OK \r\n");
+		else 
+			BL_LOG("HAL Status after erasing flash is ERROR \r\n");
+		BL_LOG("Sector Status before Erase = 0xAA, After Erase = 0x%X\r\n", sectorErrorStatus);
 #endif	
-			/*	unlock flash for erasing sectors	*/
-			halStatus |= HAL_FLASH_Lock();
+		/*	unlock flash for erasing sectors	*/
+		halStatus |= HAL_FLASH_Lock();
 #ifdef SWO_DEBUGGING
-			if(0 == halStatus)
-				printf("HAL Status after locking flash is OK \r\n");
-			else 
-				printf("HAL Status after locking flash is ERROR \r\n");
+		if(0 == halStatus)
+			BL_LOG("HAL Status after locking flash is OK \r\n");
+		else 
+			BL_LOG("HAL Status after locking flash is ERROR \r\n");
 #endif				
-			
-			
-			/*	return erase status to user	as true(0x03) / false(0x02)	*/
-			if(sectorErrorStatus == 0xFFFFFFFFU)
-			{
-				EraseProcessResult = 0x03;
-			}
-			else
-			{
-				EraseProcessResult = 0x02;
-			}
-			
-			/*	send result back to host	*/
-			blStatus |= BootLoader_Send_To_Host( &EraseProcessResult , 1);
-#ifdef SWO_DEBUGGING
-			printf("Send to host: Erase Process Result is %d \r\n", EraseProcessResult);
-#endif	
+		
+		
+		/*	return erase status to user	as true(0x03) / false(0x02)	*/
+		if(sectorErrorStatus == 0xFFFFFFFFU)
+		{
+			EraseProcessResult = 0x03;
 		}
 		else
 		{
 			EraseProcessResult = 0x02;
-			
-			/*	send result back to host	*/
-			blStatus |= BootLoader_Send_To_Host( &EraseProcessResult , 1);
-			
-#ifdef SWO_DEBUGGING
-			printf("Sectors Not Verified Send to host: Erase Process Result is %d \r\n", EraseProcessResult);
-#endif
 		}
 		
-	}	
+		/*	send result back to host	*/
+		blStatus |= BootLoader_Send_To_Host( &EraseProcessResult , 1);
+#ifdef SWO_DEBUGGING
+		BL_LOG("Send to host: Erase Process Result is %d \r\n", EraseProcessResult);
+#endif	
+	}
 	else
 	{
+		EraseProcessResult = 0x02;
+		
+		/*	send result back to host	*/
+		blStatus |= BootLoader_Send_To_Host( &EraseProcessResult , 1);
+		
 #ifdef SWO_DEBUGGING
-	printf("CRC Verification Failed \r\n");
+		BL_LOG("Sectors Not Verified Send to host: Erase Process Result is %d \r\n", EraseProcessResult);
 #endif
-		
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
 	}
 	
+	
 #ifdef BootLoader_LED_STATUS_Debugging
 	if(blStatus)
 			LED_Turn_On(LED_RED);
@@ -650,99 +769,1029 @@ static BL_StatusTypeDef BootLoader_Erase_Flash(uint8_t *hostBuffer)
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static uint8_t Bootloader_CRC_Verify(uint8_t *pData, uint32_t Data_Len, uint32_t Host_CRC);
-/*----------------------------------------------------------------------------*/
-/*----------------------------------------------------------------------------*/
-/*----------------------------------------------------------------------------*/
-/*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Memory_Write(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Memory_Write(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	uint8_t isAddressVerified = ADDRESS_VERIFAILED;
 	uint8_t writingStatus = WRITING_SUCCESS;
 #ifdef SWO_DEBUGGING
-	printf("==========================================================================================\r\n");
-	printf("Bootloader Write Flash \r\n");
-#endif
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint16_t frameLength = hostBuffer[0] + 1;
-	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
-#ifdef SWO_DEBUGGING
-	printf("Order of CRC byte in frame is %d\r\n", frameLength - 4 );
-	printf("CRC Sent from HOST is 0x%X\r\n", crc_Host);
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Write Flash \r\n");
 #endif
-	
 	/*	extract address from host frame	*/
-	uint32_t hostDesiredAddress = *((uint32_t *)(&hostBuffer[2]));
+	uint32_t hostDesiredAddress = *((uint32_t *)(&hostFrame->payload[0]));
 	
-	/*	how many bytes stored in this frame to be written in memory	*/
-	uint16_t hostNumberOfBytesToWrite = hostBuffer[6];
+	/*	how many bytes stored in this frame to be written in memory, a v2 frame carries more than the count byte	*/
+	/*	can hold : the length comes from the frame and the count byte has to match its low byte	*/
+	uint16_t hostNumberOfBytesToWrite = hostFrame->payload[4];
+	if(BL_RX_FORMAT_V2 == BL_RX_Get_Format())
+	{
+		hostNumberOfBytesToWrite = hostFrame->payloadLength - 5;
+	}
 	
 	/*	start address of data to be written	*/
-	uint8_t *pToData = &(hostBuffer[7]);
-
+	uint8_t *pToData = &(hostFrame->payload[5]);
 	
-	/*	verify CRC	*/	
-	uint8_t calculatedCRC = verify_CRC(hostBuffer, frameLength, crc_Host);
-	
-	if( calculatedCRC == CRC_VERIFIED) 
-	{			
 #ifdef SWO_DEBUGGING
-			printf("Send ACK to Host \r\n");
+	BL_LOG("Send ACK to Host \r\n");
 #endif			
-			/*	send ACK and data, then send version data	*/
-			blStatus |= BootLoader_Send_ACK( 1 );
-		
+	/*	send ACK and data, then send version data	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	/*	check validity of Address and that the announced data is really inside the frame	*/
+	isAddressVerified = verify_Address(hostDesiredAddress);
+	if( (hostNumberOfBytesToWrite > hostFrame->payloadLength - 5)					||
+			((uint8_t)hostNumberOfBytesToWrite != hostFrame->payload[4]) )
+	{
+		isAddressVerified = ADDRESS_VERIFAILED;
+	}
+	
+	/*	the bytes have to land in the slot the device does not boot : bootloader, scratch, slot table	*/
+	/*	and the running image are out of reach of a plain memory write									*/
+	if(ADDRESS_VERIFIED != verify_Slot_Destination(hostDesiredAddress, hostNumberOfBytesToWrite))
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Address outside the inactive slot \r\n");
+#endif
+		isAddressVerified = ADDRESS_VERIFAILED;
+	}
+	
+	if(ADDRESS_VERIFIED == isAddressVerified)
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Send to Host Address Verification Success \r\n");
+#endif
+		blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
+		writingStatus = write_Application_on_Flash(hostDesiredAddress, hostNumberOfBytesToWrite, pToData)	;
+	}
+	else
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Send to Host Address Verification Failed \r\n");
+#endif
+		writingStatus = WRITING_FAILURE;				
+		blStatus |= BootLoader_Send_To_Host( &writingStatus, 1 );
+	}
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Stream_Write(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t sessionStatus = STREAM_SESSION_REJECTED;
+	uint8_t streamState = STREAM_STATE_ABORTED;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Stream Write \r\n");
+#endif
+	/*	extract session parameters : base address, total image length and blocks per cumulative ACK	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostTotalLength = *((uint32_t *)(&hostFrame->payload[4]));
+	uint8_t hostWindowSize = hostFrame->payload[8];
+	uint8_t hostFlags = (hostFrame->payloadLength > 9) ? hostFrame->payload[9] : 0;
+	uint32_t resumeOffset = 0;
+	uint8_t sessionReply[STREAM_JOURNAL_REPLY_LEN];
+	
+	/*	a journaled session also reports where the host has to resume	*/
+	streamJournal = (hostFlags & STREAM_FLAG_JOURNAL) ? 1 : 0;
+	
+	/*	send ACK and length of session status	*/
+	blStatus |= BootLoader_Send_ACK( streamJournal ? STREAM_JOURNAL_REPLY_LEN : 1 );
+	
+	/*	session is accepted only if the whole image lands in flash after the bootloader in whole words	*/
+	if( (ADDRESS_VERIFIED == verify_Image_Destination(hostBaseAddress, hostTotalLength))	&&
+			((hostTotalLength % STREAM_RAW_ALIGNMENT) == 0)																		&&
+			(hostWindowSize != 0) && (hostWindowSize <= STREAM_MAX_WINDOW)										&&
+			(streamJournal ? (hostFrame->payloadLength == STREAM_JOURNAL_SESSION_LEN) : (hostFrame->payloadLength <= STREAM_SESSION_LEN)) )
+	{
+		sessionStatus = STREAM_SESSION_OPENED;
+	}
+	
+	/*	the journal decides where the image continues, it only ever resumes on a word boundary	*/
+	if((STREAM_SESSION_OPENED == sessionStatus) && streamJournal)
+	{
+		uint32_t hostSessionId = *((uint32_t *)(&hostFrame->payload[10]));
+		uint32_t hostImageCrc = *((uint32_t *)(&hostFrame->payload[14]));
+		if( (BL_JOURNAL_OK != BL_Journal_Open(hostSessionId, hostBaseAddress, hostTotalLength, hostImageCrc, &resumeOffset))	||
+				((resumeOffset % STREAM_RAW_ALIGNMENT) != 0) )
+		{
+			sessionStatus = STREAM_SESSION_REJECTED;
+			resumeOffset = 0;
+		}
+	}
+	streamWriteAddress = hostBaseAddress + resumeOffset;
+	streamImageEnd = hostBaseAddress + hostTotalLength;
+	streamJournalBase = hostBaseAddress;
+	
+	/*	the sectors under the first window are erased before the host is told to start	*/
+	streamEraseAhead = (STREAM_SESSION_OPENED == sessionStatus) && (hostFlags & STREAM_FLAG_ERASE_AHEAD);
+	if(streamEraseAhead)
+	{
+		/*	a resumed session starts inside a sector it already erased and partly wrote, that one is left alone	*/
+		uint32_t planAddress = streamWriteAddress;
+		uint8_t resumeSector = BL_Flash_Sector_Of(streamWriteAddress);
+		if(resumeOffset && (BL_FLASH_SECTOR_INVALID != resumeSector) && (BL_Flash_Sector_Start(resumeSector) != streamWriteAddress))
+		{
+			planAddress = BL_Flash_Sector_Start(resumeSector) + BL_Flash_Sector_Size(resumeSector);
+		}
+		BL_Erase_Plan(planAddress, (planAddress < streamImageEnd) ? (streamImageEnd - planAddress) : 0);
+		if(BL_ERASE_OK != BL_Erase_Ready(streamWriteAddress, hostWindowSize * STREAM_BLOCK_MAX_DATA))
+		{
+			sessionStatus = STREAM_SESSION_REJECTED;
+		}
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Stream session base 0x%X, length %d, window %d, flags 0x%X, resume at %d, status %d \r\n", hostBaseAddress, hostTotalLength, hostWindowSize, hostFlags, resumeOffset, sessionStatus);
+#endif
+	sessionReply[0] = sessionStatus;
+	memcpy(&sessionReply[1], &resumeOffset, 4);
+	blStatus |= BootLoader_Send_To_Host( sessionReply, streamJournal ? STREAM_JOURNAL_REPLY_LEN : 1 );
+	
+	/*	host starts streaming blocks right after the session status, nothing is left to send for a complete image	*/
+	if(STREAM_SESSION_OPENED == sessionStatus)
+	{
+		if(streamEraseAhead && ((hostWindowSize * BL_RX_Max_Frame_Length()) < BL_RX_DMA_RING_LEN))
+		{
+			(void)BL_Erase_Start_Next();
+		}
+		streamState = (resumeOffset < hostTotalLength) ?
+									stream_Run_Session(hostFrame->SID, hostTotalLength - resumeOffset, hostWindowSize, STREAM_RAW_ALIGNMENT, stream_Sink_Flash) :
+									STREAM_STATE_DONE;
+	}
+	if(streamEraseAhead)
+	{
+		(void)BL_Erase_Finish();
+		streamEraseAhead = 0;
+	}
+	streamJournal = 0;
+	BL_Flash_End();
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+	if((STREAM_SESSION_OPENED == sessionStatus) && (STREAM_STATE_DONE != streamState))
+		LED_Turn_On(LED_ORANGE);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Compressed_Write(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t sessionStatus = STREAM_SESSION_REJECTED;
+	uint8_t streamState = STREAM_STATE_ABORTED;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Compressed Write \r\n");
+#endif
+	/*	extract session parameters : base address, compressed stream length, decompressed image length and blocks per cumulative ACK	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostCompressedLength = *((uint32_t *)(&hostFrame->payload[4]));
+	uint32_t hostImageLength = *((uint32_t *)(&hostFrame->payload[8]));
+	uint8_t hostWindowSize = hostFrame->payload[12];
+	
+	/*	send ACK and length of session status	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	/*	the decompressed image must fit in flash after the bootloader, the compressed stream only has to be non empty	*/
+	if( (ADDRESS_VERIFIED == verify_Image_Destination(hostBaseAddress, hostImageLength))	&&
+			(hostCompressedLength != 0)																													&&
+			(hostWindowSize != 0) && (hostWindowSize <= STREAM_MAX_WINDOW) )
+	{
+		sessionStatus = STREAM_SESSION_OPENED;
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Compressed session base 0x%X, compressed %d, image %d, window %d, status %d \r\n", hostBaseAddress, hostCompressedLength, hostImageLength, hostWindowSize, sessionStatus);
+#endif
+	blStatus |= BootLoader_Send_To_Host( &sessionStatus, 1 );
+	
+	/*	host starts streaming compressed blocks right after the session status, decoded bytes go straight to flash	*/
+	if(STREAM_SESSION_OPENED == sessionStatus)
+	{
+		streamWriteAddress = hostBaseAddress;
+		streamImageEnd = hostBaseAddress + hostImageLength;
+		streamImageLength = hostImageLength;
+		BL_LZ_Begin(&streamLZ, stream_LZ_Output);
+		streamState = stream_Run_Session(hostFrame->SID, hostCompressedLength, hostWindowSize, STREAM_LZ_ALIGNMENT, stream_Sink_Decompress);
+		BL_Flash_End();
+	}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+	if((STREAM_SESSION_OPENED == sessionStatus) && (STREAM_STATE_DONE != streamState))
+		LED_Turn_On(LED_ORANGE);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Image_Hash(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Image Hash \r\n");
+#endif
+	/*	extract region : base address and length	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostLength = *((uint32_t *)(&hostFrame->payload[4]));
+	
+	/*	only flash regions are hashed, the host compares against the CRC of its copy of the installed image :	*/
+	/*	inside flash it is the memory hash, same CRC and the same reply									*/
+	if( (ADD_FLASH_START <= hostBaseAddress) && (hostBaseAddress <= ADD_FLASH_END)	&&
+			(hostLength <= (ADD_FLASH_END - hostBaseAddress + 1)) )
+	{
+		return BootLoader_Memory_Hash(hostFrame);
+	}
+	
+#ifdef SWO_DEBUGGING
+	BL_LOG("Image hash region not in flash, Send to Host NACK \r\n");
+#endif
+	blStatus |= BootLoader_Send_NACK();
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Delta_Write(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t sessionStatus = STREAM_SESSION_REJECTED;
+	uint8_t streamState = STREAM_STATE_ABORTED;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Delta Write \r\n");
+#endif
+	/*	extract session parameters : base address, installed and patched image, patch length and blocks per cumulative ACK	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostOldLength = *((uint32_t *)(&hostFrame->payload[4]));
+	uint32_t hostOldCrc = *((uint32_t *)(&hostFrame->payload[8]));
+	uint32_t hostNewLength = *((uint32_t *)(&hostFrame->payload[12]));
+	uint32_t hostNewCrc = *((uint32_t *)(&hostFrame->payload[16]));
+	uint32_t hostPatchLength = *((uint32_t *)(&hostFrame->payload[20]));
+	uint8_t hostWindowSize = hostFrame->payload[24];
+	
+	/*	the installed image is the one that boots, the patched one goes to the other slot :	*/
+	/*	only with no slot booting (first flashing) is the image at the base patched in place	*/
+	uint8_t bootSlot = verify_Booting_Slot();
+	uint32_t sourceAddress = hostBaseAddress;
+	uint32_t sourceLength = ADD_FLASH_END - hostBaseAddress + 1;
+	if(BL_SLOT_NONE != bootSlot)
+	{
+		sourceAddress = BL_SLOT_ADDRESS(bootSlot);
+		sourceLength = BL_SLOT_LENGTH(bootSlot);
+	}
+	
+	/*	send ACK and length of session status	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	/*	the patch only applies on top of the exact image it was made against	*/
+	if( (ADDRESS_VERIFIED == verify_Image_Destination(hostBaseAddress, hostNewLength))						&&
+			(hostOldLength <= sourceLength)																														&&
+			(hostOldCrc == BL_CRC_Calculate((const uint8_t *)sourceAddress, hostOldLength))						&&
+			(hostPatchLength != 0)																																		&&
+			(hostWindowSize != 0) && (hostWindowSize <= STREAM_MAX_WINDOW)														&&
+			(BL_DELTA_OK == BL_Delta_Begin(hostBaseAddress, sourceAddress, hostOldLength, hostNewLength)) )
+	{
+		sessionStatus = STREAM_SESSION_OPENED;
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Delta session base 0x%X, source 0x%X, old %d, new %d, patch %d, status %d \r\n", hostBaseAddress, sourceAddress, hostOldLength, hostNewLength, hostPatchLength, sessionStatus);
+#endif
+	blStatus |= BootLoader_Send_To_Host( &sessionStatus, 1 );
+	
+	/*	host starts streaming patch blocks right after the session status	*/
+	if(STREAM_SESSION_OPENED == sessionStatus)
+	{
+		streamImageLength = hostNewLength;
+		streamImageCrc = hostNewCrc;
+		streamWriteAddress = hostBaseAddress;
+		streamState = stream_Run_Session(hostFrame->SID, hostPatchLength, hostWindowSize, STREAM_LZ_ALIGNMENT, stream_Sink_Delta);
+#ifdef SWO_DEBUGGING
+		BL_LOG("Delta session rewrote %d sectors \r\n", BL_Delta_Sectors_Written());
+#endif
+	}
+	BL_Flash_End();
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+	if((STREAM_SESSION_OPENED == sessionStatus) && (STREAM_STATE_DONE != streamState))
+		LED_Turn_On(LED_ORANGE);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Slot_Info(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	(void)hostFrame;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Slot Info \r\n");
+#endif
+	uint8_t slotInfo[SLOT_INFO_REPLY_LEN];
+	uint8_t *entry = &slotInfo[1];
+	
+	/*	boot slot first, then the header of each slot and whether its image still matches it	*/
+	slotInfo[0] = BL_Slot_Select_Boot();
+	for(uint8_t slot = 0; slot < BL_SLOT_COUNT; slot++)
+	{
+		BL_SlotRecordTypeDef record;
+		entry[0] = (BL_SLOT_OK == BL_Slot_Get_Record(slot, &record)) ? BL_SLOT_STATE_VALID : BL_SLOT_STATE_EMPTY;
+		entry[1] = BL_Slot_Verify(slot);
+		memcpy(&entry[2], &record.version, 4);
+		memcpy(&entry[6], &record.length, 4);
+		memcpy(&entry[10], &record.imageCrc, 4);
+		entry += SLOT_INFO_ENTRY_LEN;
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Boot slot is %d \r\n", slotInfo[0]);
+#endif
+	/*	send ACK and length of slot info then the info itself	*/
+	blStatus |= BootLoader_Send_ACK( SLOT_INFO_REPLY_LEN );
+	blStatus |= BootLoader_Send_To_Host( slotInfo, SLOT_INFO_REPLY_LEN );
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Set_Active_Slot(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t activateStatus = SLOT_ACTIVATE_FAILED;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Set Active Slot \r\n");
+#endif
+	/*	extract image header : slot, version, length and image CRC	*/
+	uint8_t hostSlot = hostFrame->payload[0];
+	uint32_t hostVersion = *((uint32_t *)(&hostFrame->payload[1]));
+	uint32_t hostLength = *((uint32_t *)(&hostFrame->payload[5]));
+	uint32_t hostImageCrc = *((uint32_t *)(&hostFrame->payload[9]));
+	
+	/*	send ACK and length of activation status	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	/*	a new header commits a freshly written slot, an empty one flips back to what the slot already holds	*/
+	if(0 == hostLength)
+	{
+		activateStatus = (BL_SLOT_OK == BL_Slot_Rollback(hostSlot)) ? SLOT_ACTIVATE_DONE : SLOT_ACTIVATE_FAILED;
+	}
+	else
+	{
+		activateStatus = (BL_SLOT_OK == BL_Slot_Activate(hostSlot, hostVersion, hostLength, hostImageCrc)) ? SLOT_ACTIVATE_DONE : SLOT_ACTIVATE_FAILED;
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Activate slot %d, version 0x%X, length %d : status %d \r\n", hostSlot, hostVersion, hostLength, activateStatus);
+#endif
+	blStatus |= BootLoader_Send_To_Host( &activateStatus, 1 );
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus || (SLOT_ACTIVATE_DONE != activateStatus))
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Memory_Read(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t readStatus = MEM_READ_REJECTED;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Memory Read \r\n");
+#endif
+	/*	extract region : start address and length	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostLength = *((uint32_t *)(&hostFrame->payload[4]));
+	
+	/*	send ACK and length of read status	*/
+	blStatus |= BootLoader_Send_ACK( 1 );
+	
+	if(ADDRESS_VERIFIED == verify_Memory_Region(hostBaseAddress, hostLength))
+	{
+		readStatus = MEM_READ_ACCEPTED;
+	}
+#ifdef SWO_DEBUGGING
+	BL_LOG("Memory read of 0x%X, length %d : status %d \r\n", hostBaseAddress, hostLength, readStatus);
+#endif
+	blStatus |= BootLoader_Send_To_Host( &readStatus, 1 );
+	
+	/*	region goes out in big chunks straight from memory, each one followed by the CRC of everything	*/
+	/*	sent so far, so the host can check as it reads and the last CRC covers the whole region	*/
+	if(MEM_READ_ACCEPTED == readStatus)
+	{
+		uint8_t *pToData = (uint8_t *)hostBaseAddress;
+		uint32_t remainingBytes = hostLength;
 		
-			/*	check validity of Address	*/
-			isAddressVerified = verify_Address(hostDesiredAddress);
-			if(ADDRESS_VERIFIED == isAddressVerified)
-			{
+		BL_CRC_Begin();
+		while(remainingBytes && (BL_OK == blStatus))
+		{
+			uint16_t chunkLength = (remainingBytes > MEM_READ_CHUNK_LEN) ? MEM_READ_CHUNK_LEN : (uint16_t)remainingBytes;
+			BL_CRC_Update(pToData, chunkLength);
+			uint32_t runningCrc = BL_CRC_Running();
+			
+			blStatus |= BootLoader_Send_To_Host( pToData, chunkLength );
+			blStatus |= BootLoader_Send_To_Host( (uint8_t *)&runningCrc, 4 );
+			
+			pToData += chunkLength;
+			remainingBytes -= chunkLength;
+		}
+		(void)BL_CRC_End();
+	}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Memory_Hash(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Memory Hash \r\n");
+#endif
+	/*	extract region : start address and length	*/
+	uint32_t hostBaseAddress = *((uint32_t *)(&hostFrame->payload[0]));
+	uint32_t hostLength = *((uint32_t *)(&hostFrame->payload[4]));
+	
+	/*	same regions as memory read, but only the CRC crosses the wire	*/
+	if(ADDRESS_VERIFIED == verify_Memory_Region(hostBaseAddress, hostLength))
+	{
+		uint32_t regionHash = BL_CRC_Calculate((const uint8_t *)hostBaseAddress, hostLength);
+#ifdef SWO_DEBUGGING
+		BL_LOG("Memory hash of 0x%X, length %d is 0x%X \r\n", hostBaseAddress, hostLength, regionHash);
+#endif
+		/*	send ACK and length of hash then the hash itself	*/
+		blStatus |= BootLoader_Send_ACK( 4 );
+		blStatus |= BootLoader_Send_To_Host( (uint8_t *)&regionHash, 4 );
+	}
+	else
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Memory hash region not readable, Send to Host NACK \r\n");
+#endif
+		blStatus |= BootLoader_Send_NACK();
+	}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Get_Sector_Protection_Status(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t sectorStatus[BL_FLASH_SECTOR_COUNT * SECTOR_STATUS_ENTRY_LEN];
+	uint8_t sectorCount = 0;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Read Sector Status \r\n");
+#endif
+	/*	extract range : first sector and number of sectors, same rules as erase	*/
+	uint8_t hostSector = hostFrame->payload[0];
+	uint8_t hostSectorCount = hostFrame->payload[1];
+	
+	if(verify_Sectors(hostSector, hostSectorCount) && (0 != hostSectorCount))
+	{
+		sectorCount = verify_Accurate_Remaining_Sectors(hostSector, hostSectorCount);
+		
+		for(uint8_t i = 0; i < sectorCount; i++)
+		{
+			uint8_t sector = hostSector + i;
+			uint32_t sectorStart = BL_Flash_Sector_Start(sector);
+			uint32_t sectorCrc = BL_CRC_Calculate((const uint8_t *)sectorStart, BL_Flash_Sector_Size(sector));
+			uint8_t *entry = &sectorStatus[i * SECTOR_STATUS_ENTRY_LEN];
+			
+			/*	nWRP bit cleared means the sector is write protected (SPRMOD = 0)	*/
+			entry[0] =	(BL_Flash_Sector_Is_Blank(sector) ? SECTOR_STATUS_BLANK : 0)																			|
+									((0 == (FLASH->OPTCR & (1U << (FLASH_OPTCR_nWRP_Pos + sector)))) ? SECTOR_STATUS_PROTECTED : 0)	|
+									((OVERWRITE_POSITIVE == verify_Application_Doesnot_Overwrite_Bootloader(sectorStart)) ? SECTOR_STATUS_BOOTLOADER : 0);
+			memcpy(&entry[1], &sectorCrc, 4);
+#ifdef SWO_DEBUGGING
+			BL_LOG("Sector %d : flags 0x%X, CRC 0x%X \r\n", sector, entry[0], sectorCrc);
+#endif
+		}
+		
+		/*	send ACK and length of the status table then the table itself	*/
+		blStatus |= BootLoader_Send_ACK( 1 + (sectorCount * SECTOR_STATUS_ENTRY_LEN) );
+		blStatus |= BootLoader_Send_To_Host( &sectorCount, 1 );
+		blStatus |= BootLoader_Send_To_Host( sectorStatus, sectorCount * SECTOR_STATUS_ENTRY_LEN );
+	}
+	else
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Sector status range invalid, Send to Host NACK \r\n");
+#endif
+		blStatus |= BootLoader_Send_NACK();
+	}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Set_Baud(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t baudStatus = BAUD_REJECTED;
+	uint8_t rateCount = BL_Baud_Count();
+	uint32_t rateTable[BL_BAUD_MAX_RATES];
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Set Baud \r\n");
+#endif
+	/*	extract requested rate, 0 only asks for the table	*/
+	uint32_t hostBaudRate = *((uint32_t *)(&hostFrame->payload[0]));
+	const BL_BaudRateTypeDef *newRate = BL_Baud_Find(hostBaudRate);
+	const BL_BaudRateTypeDef *oldRate = BL_Baud_Current();
+	
+	/*	rates only mean something on the UART, over USB the answer is a rejection with an empty table	*/
+	if(!BL_Transport_Is_Active(BL_TRANSPORT_UART))
+	{
+		newRate = NULL;
+		rateCount = 0;
+	}
+	
+	if((NULL != newRate) && (NULL != oldRate))
+	{
+		baudStatus = BAUD_SWITCHING;
+	}
+	for(uint8_t i = 0; i < rateCount; i++)
+	{
+		rateTable[i] = BL_Baud_Get(i)->baudRate;
+	}
+	
+	/*	status and rate table still go out at the old rate	*/
+	blStatus |= BootLoader_Send_ACK( 2 + (4 * rateCount) );
+	blStatus |= BootLoader_Send_To_Host( &baudStatus, 1 );
+	blStatus |= BootLoader_Send_To_Host( &rateCount, 1 );
+	blStatus |= BootLoader_Send_To_Host( (uint8_t *)rateTable, 4 * rateCount );
+	
+	/*	both ends switch, then the pattern has to make it through in both directions before the rate is kept	*/
+	if((BAUD_SWITCHING == baudStatus) && (BL_OK == blStatus))
+	{
+		if( (BL_BAUD_OK != BL_Baud_Apply(newRate))	||
+				(BAUD_NEGOTIATED != baud_Test_Link()) )
+		{
+			(void)BL_Baud_Apply(oldRate);
+			baudStatus = BAUD_REJECTED;
+		}
+		else
+		{
+			baudStatus = BAUD_NEGOTIATED;
+		}
+	}
 #ifdef SWO_DEBUGGING
-				printf("Send to Host Address Verification Success \r\n");
+	BL_LOG("Host link %u baud requested : status %d, running at %u \r\n", hostBaudRate, baudStatus, BL_Baud_Current()->baudRate);
 #endif
-				blStatus |= BootLoader_Send_To_Host( &isAddressVerified, 1 );
-				
-				/*	verify no overwriting happens between bootloader and application	*/
-				uint8_t overwrite = verify_Application_Doesnot_Overwrite_Bootloader(hostDesiredAddress);
-				
-				if(OVERWRITE_NEGATIVE == overwrite)
-				{
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Set_Protocol(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	uint8_t protocolReply[PROTOCOL_REPLY_LEN];
 #ifdef SWO_DEBUGGING
-					printf("Send to Host Overwrite Negative \r\n");
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Set Protocol \r\n");
 #endif
-					writingStatus = write_Application_on_Flash(hostDesiredAddress, hostNumberOfBytesToWrite, pToData)	;
-				}
-				else
-				{
+	/*	extract requested frame format, anything above v2 is answered with v2	*/
+	uint8_t hostVersion = hostFrame->payload[0];
+	uint8_t acceptedVersion = BL_RX_Get_Format();
+	
+	if(PROTOCOL_VERSION_QUERY != hostVersion)
+	{
+		acceptedVersion = (hostVersion >= BL_RX_FORMAT_V2) ? BL_RX_FORMAT_V2 : BL_RX_FORMAT_V1;
+	}
+	
+	/*	switch before replying : the host only sends the next frame after the reply, so no frame straddles the change	*/
+	BL_RX_Set_Format(acceptedVersion);
+	
+	uint16_t maxLengthField = BL_RX_Max_Frame_Length() - BL_RX_Header_Len();
+	protocolReply[0] = acceptedVersion;
+	protocolReply[1] = (uint8_t)(maxLengthField & 0xFF);
+	protocolReply[2] = (uint8_t)(maxLengthField >> 8);
+	
+	/*	replies keep their v1 layout in both formats	*/
+	blStatus |= BootLoader_Send_ACK( PROTOCOL_REPLY_LEN );
+	blStatus |= BootLoader_Send_To_Host( protocolReply, PROTOCOL_REPLY_LEN );
 #ifdef SWO_DEBUGGING
-					printf("Send to Host Overwrite Positive \r\n");
+	BL_LOG("Frame format v%d requested, v%d in use, length field up to %d \r\n", hostVersion, acceptedVersion, maxLengthField);
 #endif
-					writingStatus = WRITING_FAILURE;				
-					blStatus |= BootLoader_Send_To_Host( &writingStatus, 1 );
-				}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Bench_Read(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	BL_BenchRecordTypeDef benchRecords[BENCH_READ_MAX_RECORDS];
+	uint8_t benchReply[BENCH_READ_HEADER_LEN];
+	uint16_t lost = 0;
+	uint16_t count = 0;
+	
+	/*	no log lines here : the log drains over DMA and would show up in the stamps of the next frames	*/
+	if(hostFrame->payload[0] & BENCH_READ_RESET)
+	{
+		BL_Bench_Reset();
+	}
+	count = BL_Bench_Read(benchRecords, BENCH_READ_MAX_RECORDS, &lost);
+	
+	benchReply[0] = (uint8_t)count;
+	benchReply[1] = (uint8_t)(lost & 0xFF);
+	benchReply[2] = (uint8_t)(lost >> 8);
+	
+	blStatus |= BootLoader_Send_ACK( (uint8_t)(BENCH_READ_HEADER_LEN + count * sizeof(BL_BenchRecordTypeDef)) );
+	blStatus |= BootLoader_Send_To_Host( benchReply, BENCH_READ_HEADER_LEN );
+	if(count)
+	{
+		blStatus |= BootLoader_Send_To_Host( (uint8_t *)benchRecords, count * sizeof(BL_BenchRecordTypeDef) );
+	}
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static BL_StatusTypeDef BootLoader_Journal_Query(const BL_FrameTypeDef *hostFrame)
+{
+	BL_StatusTypeDef blStatus = BL_OK;
+	BL_JournalHeaderTypeDef journalHeader;
+	uint32_t verifiedOffset = 0;
+	uint8_t journalReply[JOURNAL_QUERY_REPLY_LEN];
+	(void)hostFrame;
+#ifdef SWO_DEBUGGING
+	BL_LOG("==========================================================================================\r\n");
+	BL_LOG("Bootloader Journal Query \r\n");
+#endif
+	
+	/*	state | session id | base | length | image CRC | verified offset	*/
+	journalReply[0] = BL_Journal_Query(&journalHeader, &verifiedOffset);
+	memcpy(&journalReply[1], &journalHeader.sessionId, 4);
+	memcpy(&journalReply[5], &journalHeader.baseAddress, 4);
+	memcpy(&journalReply[9], &journalHeader.length, 4);
+	memcpy(&journalReply[13], &journalHeader.imageCrc, 4);
+	memcpy(&journalReply[17], &verifiedOffset, 4);
+#ifdef SWO_DEBUGGING
+	BL_LOG("Journal state %d, session 0x%X, verified %d of %d \r\n", journalReply[0], journalHeader.sessionId, verifiedOffset, journalHeader.length);
+#endif
+	
+	blStatus |= BootLoader_Send_ACK( JOURNAL_QUERY_REPLY_LEN );
+	blStatus |= BootLoader_Send_To_Host( journalReply, JOURNAL_QUERY_REPLY_LEN );
+	
+#ifdef BootLoader_LED_STATUS_Debugging
+	if(blStatus)
+		LED_Turn_On(LED_RED);
+#endif
+	
+	return blStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t verify_Image_Destination(uint32_t baseAddress, uint32_t imageLength)
+{
+	uint8_t destinationStatus = ADDRESS_VERIFAILED;
+	
+	/*	the whole image has to land in one slot, the one the device does not boot	*/
+	if( (imageLength != 0)																																&&
+			(ADDRESS_VERIFIED == verify_Slot_Destination(baseAddress, imageLength)) )
+	{
+		destinationStatus = ADDRESS_VERIFIED;
+	}
+	return destinationStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t verify_Slot_Destination(uint32_t baseAddress, uint32_t length)
+{
+	uint8_t destinationStatus = ADDRESS_VERIFAILED;
+	uint8_t bootSlot = verify_Booting_Slot();
+	
+	/*	an update goes into the inactive slot and ends at its last byte, the old image stays bootable	*/
+	for(uint8_t slot = BL_SLOT_A; slot < BL_SLOT_COUNT; slot++)
+	{
+		uint32_t slotStart = BL_SLOT_ADDRESS(slot);
+		uint32_t slotEnd = slotStart + BL_SLOT_LENGTH(slot);
+		
+		if( (slot != bootSlot)																																&&
+				(baseAddress >= slotStart) && (baseAddress < slotEnd)															&&
+				(length <= (slotEnd - baseAddress)) )
+		{
+			destinationStatus = ADDRESS_VERIFIED;
+		}
+	}
+	return destinationStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t verify_Booting_Slot(void)
+{
+	uint8_t bootSlot = BL_Slot_Select_Header();
+	BL_SlotRecordTypeDef bootRecord;
+	
+	/*	a slot boots by its committed header, an image without one (first flashing) may still be rewritten	*/
+	if((BL_SLOT_NONE != bootSlot) && (BL_SLOT_OK != BL_Slot_Get_Record(bootSlot, &bootRecord)))
+	{
+		bootSlot = BL_SLOT_NONE;
+	}
+	return bootSlot;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t stream_Sink_Flash(uint8_t *data, uint16_t length, uint8_t lastBlock)
+{
+	uint8_t writingStatus = WRITING_FAILURE;
+	(void)lastBlock;
+	
+	if( (streamWriteAddress + length <= streamImageEnd) &&
+			(!streamEraseAhead || (BL_ERASE_OK == BL_Erase_Ready(streamWriteAddress, length))) &&
+			(WRITING_SUCCESS == write_Application_on_Flash(streamWriteAddress, length, data)) )
+	{
+		streamWriteAddress += length;
+		writingStatus = WRITING_SUCCESS;
+	}
+	return writingStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t stream_Sink_Decompress(uint8_t *data, uint16_t length, uint8_t lastBlock)
+{
+	uint8_t writingStatus = WRITING_FAILURE;
+	
+	if(BL_LZ_OK == BL_LZ_Decompress(&streamLZ, data, length))
+	{
+		writingStatus = WRITING_SUCCESS;
+		
+		/*	the stream has to end on a symbol boundary and decode to exactly the announced image	*/
+		if(lastBlock && ((BL_LZ_OK != BL_LZ_End(&streamLZ)) || (BL_LZ_Output_Count(&streamLZ) != streamImageLength)))
+		{
+#ifdef SWO_DEBUGGING
+			BL_LOG("Compressed stream decoded to %d bytes, expected %d \r\n", BL_LZ_Output_Count(&streamLZ), streamImageLength);
+#endif
+			writingStatus = WRITING_FAILURE;
+		}
+	}
+	return writingStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t stream_LZ_Output(const uint8_t *data, uint16_t length)
+{
+	/*	decoded chunks are programmed in place, the decoder stops on the first failure	*/
+	return (WRITING_SUCCESS == stream_Sink_Flash((uint8_t *)data, length, 0)) ? BL_LZ_OK : BL_LZ_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t stream_Sink_Delta(uint8_t *data, uint16_t length, uint8_t lastBlock)
+{
+	uint8_t writingStatus = WRITING_FAILURE;
+	
+	if(BL_DELTA_OK == BL_Delta_Apply(data, length))
+	{
+		writingStatus = WRITING_SUCCESS;
+		
+		/*	the patch has to be complete and rebuild exactly the image the host diffed against	*/
+		if(lastBlock && ((BL_DELTA_OK != BL_Delta_End()) ||
+										 (streamImageCrc != BL_CRC_Calculate((const uint8_t *)streamWriteAddress, streamImageLength))))
+		{
+#ifdef SWO_DEBUGGING
+			BL_LOG("Delta result does not match the new image CRC \r\n");
+#endif
+			writingStatus = WRITING_FAILURE;
+		}
+	}
+	return writingStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t stream_Run_Session(uint8_t streamSID, uint32_t totalLength, uint8_t windowSize, uint8_t blockAlignment, streamSinkFunction blockSink)
+{
+	uint8_t streamState = STREAM_STATE_ACTIVE;
+	uint32_t bytesWritten = 0;
+	uint16_t expectedSequence = 0;
+	uint8_t failedWindows = 0;
+	
+	while(STREAM_STATE_ACTIVE == streamState)
+	{
+		uint8_t blocksReceived = 0;
+		uint8_t windowFailed = 0;
+		uint32_t bytesAnnounced = bytesWritten;
+		
+		/*	blocks of a window arrive back to back : each one is verified and programmed while the receive engine	*/
+		/*	assembles the next, the window ends early on the block that completes the image	*/
+		while(blocksReceived < windowSize && bytesAnnounced < totalLength)
+		{
+			uint8_t *block = BL_RX_Get_Frame(STREAM_BLOCK_TIMEOUT_MS);
+			if(NULL == block)
+			{
+				windowFailed = 1;
+				break;
 			}
-			else
+			blocksReceived++;
+			
+			uint8_t blockHeader = STREAM_BLOCK_HEADER_LEN;
+			uint16_t blockLength = BL_RX_Frame_Length(block);
+			uint16_t blockSequence = (uint16_t)(block[blockHeader - 2] | (block[blockHeader - 1] << 8));
+			uint16_t blockDataLength = (blockLength > blockHeader + 4) ? (blockLength - blockHeader - 4) : 0;
+			bytesAnnounced += blockDataLength;
+			BL_Bench_Open(BL_BENCH_KIND_BLOCK, BL_RX_Frame_Cycles(block), blockLength);
+			
+			/*	after the first bad block the rest of the window is only drained, the host resends it anyway	*/
+			if(windowFailed || (STREAM_STATE_ACTIVE != streamState))
+			{
+				BL_Bench_Close(BL_BENCH_KIND_BLOCK, streamSID, blockSequence, BL_NACK);
+				BL_RX_Release_Frame(block);
+				continue;
+			}
+			
+			if( (0 == blockDataLength)																																		||
+					(CRC_VERIFIED != verify_CRC(block, blockLength, *((uint32_t*)(block + blockLength - 4)))) ||
+					(blockSequence != expectedSequence)																												||
+					((blockDataLength % blockAlignment) != 0)																									||
+					(bytesWritten + blockDataLength > totalLength) )
 			{
 #ifdef SWO_DEBUGGING
-				printf("Send to Host Address Verification Failed \r\n");
+				BL_LOG("Stream block %d rejected, expected %d \r\n", blockSequence, expectedSequence);
 #endif
-				writingStatus = WRITING_FAILURE;				
-				blStatus |= BootLoader_Send_To_Host( &writingStatus, 1 );
+				windowFailed = 1;
 			}
-	}
-	else 
-	{
+			else if(WRITING_FAILURE == blockSink(&block[blockHeader], blockDataLength, (bytesWritten + blockDataLength == totalLength)))
+			{
+				streamState = STREAM_STATE_ABORTED;
+			}
+			else
+			{
+				bytesWritten += blockDataLength;
+				expectedSequence++;
+				failedWindows = 0;
+				
+				if(bytesWritten == totalLength)
+				{
+					streamState = STREAM_STATE_DONE;
+				}
+			}
+			
+			/*	the block stays open, the window reply stamps its TX stage	*/
+			BL_Bench_Close(BL_BENCH_KIND_BLOCK, streamSID, blockSequence,
+										 (uint8_t)((windowFailed || (STREAM_STATE_ABORTED == streamState)) ? BL_NACK : BL_ACK));
+			BL_RX_Release_Frame(block);
+		}
+		
+		/*	give up when the host keeps failing without any progress	*/
+		if(windowFailed && (++failedWindows >= STREAM_MAX_RETRIES))
+		{
+			streamState = STREAM_STATE_ABORTED;
+		}
+		
+		/*	flow control : the reply waits until every sector the next window can reach is erased	*/
+		if( streamEraseAhead && (STREAM_STATE_ACTIVE == streamState)	&&
+				(BL_ERASE_OK != BL_Erase_Ready(streamWriteAddress, windowSize * STREAM_BLOCK_MAX_DATA)) )
+		{
+			streamState = STREAM_STATE_ABORTED;
+		}
+		
+		/*	what is verified and in flash goes into the journal before the host hears about it,	*/
+		/*	an aborted session may still have an erase running, it is not journaled	*/
+		if(streamJournal && (STREAM_STATE_ABORTED != streamState))
+		{
+			(void)BL_Journal_Progress(streamWriteAddress - streamJournalBase);
+		}
+		
+		/*	cumulative reply : host resends everything starting from the next expected sequence	*/
+		uint8_t windowReply[4] = {	(uint8_t)((windowFailed || (STREAM_STATE_ABORTED == streamState)) ? BL_NACK : BL_ACK),
+																(uint8_t)(expectedSequence & 0xFF),
+																(uint8_t)(expectedSequence >> 8),
+																streamState	};
+		BootLoader_Send_To_Host(windowReply, 4);
 #ifdef SWO_DEBUGGING
-		printf("Send to Host NACK \r\n");
+		BL_LOG("Stream window reply 0x%X, next sequence %d, state %d \r\n", windowReply[0], expectedSequence, streamState);
 #endif
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
+		
+		/*	the reply is out : the next erase runs while the host sends the window, DMA and the RX interrupts	*/
+		/*	keep taking it in meanwhile, but nothing is programmed until the erase ends, so the window has to fit the ring	*/
+		if( streamEraseAhead && (STREAM_STATE_ACTIVE == streamState)	&&
+				((windowSize * BL_RX_Max_Frame_Length()) < BL_RX_DMA_RING_LEN) )
+		{
+			(void)BL_Erase_Start_Next();
+		}
 	}
 	
-	return blStatus;
+	return streamState;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -768,54 +1817,35 @@ static uint8_t write_Application_on_Flash(uint32_t host_Start_Address, uint16_t
 	uint8_t writingStatus = WRITING_SUCCESS;
 	HAL_StatusTypeDef halStatus = HAL_OK;
 	
-	/*	unlock flash for erasing sectors	*/
-	halStatus |= HAL_FLASH_Unlock();
+	/*	flash stays unlocked for the whole write session, only the first frame pays for unlocking	*/
+	halStatus |= BL_Flash_Begin();
 #ifdef SWO_DEBUGGING
 	if(0 == halStatus)
-		printf("HAL Status after unlocking flash is OK \r\n");
+		BL_LOG("HAL Status after unlocking flash is OK \r\n");
 	else 
-		printf("HAL Status after unlocking flash is ERROR \r\n");
+		BL_LOG("HAL Status after unlocking flash is ERROR \r\n");
 #endif			
 	
-	/*	write on flash	*/
-	for(uint16_t i = 0; i < data_Number_Bytes; i+=4)
-	{
-		halStatus |= HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, host_Start_Address+i, *( (uint32_t*)(pToStartData+ i) ) );
-		if(halStatus)
-		{
-#ifdef SWO_DEBUGGING
-			printf("Flash Writing failed on WORD number %d\r\n", i);
-#endif	
-			break;
-		}
-	}
-#ifdef SWO_DEBUGGING
-	if(0 == halStatus)
-		printf("HAL Status after writing on flash is OK \r\n");
-	else 
-		printf("HAL Status after writing on flash is ERROR \r\n");
-#endif	
-	
-	/*	lock flash after writing sectors	*/
-	halStatus |= HAL_FLASH_Lock();
+	/*	write on flash at the widest parallelism of the voltage range, units already holding the data are skipped	*/
+	halStatus |= BL_Flash_Program(host_Start_Address, pToStartData, data_Number_Bytes);
 #ifdef SWO_DEBUGGING
 	if(0 == halStatus)
-		printf("HAL Status after locking flash is OK \r\n");
+		BL_LOG("HAL Status after writing on flash is OK \r\n");
 	else 
-		printf("HAL Status after locking flash is ERROR \r\n");
+		BL_LOG("HAL Status after writing on flash is ERROR \r\n");
 #endif	
 	
 	if(halStatus)
 	{
 #ifdef SWO_DEBUGGING
-		printf("Writing Failed Return failure \r\n");
+		BL_LOG("Writing Failed Return failure \r\n");
 #endif	
 		writingStatus = WRITING_FAILURE;
 	}
 	else
 	{
 #ifdef SWO_DEBUGGING
-		printf("Writing Success Return Success \r\n");
+		BL_LOG("Writing Success Return Success \r\n");
 #endif	
 		writingStatus = WRITING_SUCCESS;
 	}
@@ -827,50 +1857,30 @@ static uint8_t write_Application_on_Flash(uint32_t host_Start_Address, uint16_t
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
-static BL_StatusTypeDef BootLoader_Read_Protection_Level(uint8_t *hostBuffer)
+static BL_StatusTypeDef BootLoader_Read_Protection_Level(const BL_FrameTypeDef *hostFrame)
 {
 	BL_StatusTypeDef blStatus = BL_OK;
 	FLASH_OBProgramInitTypeDef Flash_RDB_Cfg;
 	uint8_t RDB_Value = 0x11;
-	
-	/*	calculate frame length from first byte of frame and add one	*/
-	uint8_t frameLength = hostBuffer[0] + 1;
-	
-	/*	extract CRC from Frame : it is the last 4 bytes	*/
-	uint32_t crc_Host = *((uint32_t*)(hostBuffer + frameLength - 4));
+	(void)hostFrame;
 	
 #ifdef SWO_DEBUGGING
-		printf("==========================================================================================\r\n");
-		printf( "Bootloader Get Flash Protection Level Number\r\n");
+		BL_LOG("==========================================================================================\r\n");
+		BL_LOG( "Bootloader Get Flash Protection Level Number\r\n");
 #endif
-	/*	verify CRC	*/
-	if(verify_CRC(hostBuffer, frameLength, crc_Host) == CRC_VERIFIED)
-	{					
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Passed \r\n");
-#endif		
-		/*	send ACK and data, then send read protection data	*/
-		blStatus |= BootLoader_Send_ACK( 1  );
-		
-		/*	read flash Option bytes configuration	*/
-		HAL_FLASHEx_OBGetConfig(&Flash_RDB_Cfg);
-		
-		/*	send flash RDB to host	*/
-		RDB_Value = (uint8_t)Flash_RDB_Cfg.RDPLevel;
+	/*	send ACK and data, then send read protection data	*/
+	blStatus |= BootLoader_Send_ACK( 1  );
+	
+	/*	read flash Option bytes configuration	*/
+	HAL_FLASHEx_OBGetConfig(&Flash_RDB_Cfg);
+	
+	/*	send flash RDB to host	*/
+	RDB_Value = (uint8_t)Flash_RDB_Cfg.RDPLevel;
 #ifdef SWO_DEBUGGING
-		printf( "Option Bytes Protection Level is %d \r\n", RDB_Value);
+	BL_LOG( "Option Bytes Protection Level is %d \r\n", RDB_Value);
 #endif	
-		blStatus |= BootLoader_Send_To_Host( &RDB_Value ,1 );
-		
-	}
-	else 
-	{
-#ifdef SWO_DEBUGGING
-		printf( "CRC Verified Failed \r\n");
-#endif
-		/*	send NACK	*/
-		blStatus |= BootLoader_Send_NACK();
-	}
+	blStatus |= BootLoader_Send_To_Host( &RDB_Value ,1 );
+	
 	
 #ifdef BootLoader_LED_STATUS_Debugging
 if(blStatus)
@@ -11,6 +11,22 @@
 #include "usart.h"
 #include "crc.h"
 #include "led.h"
+#include "bootloader_rx.h"
+#include "bootloader_log.h"
+#include "bootloader_crc.h"
+#include "bootloader_flash.h"
+#include "bootloader_erase.h"
+#include "bootloader_lz.h"
+#include "bootloader_delta.h"
+#include "bootloader_slot.h"
+#include "bootloader_manifest.h"
+#include "bootloader_boot.h"
+#include "bootloader_baud.h"
+#include "bootloader_bench.h"
+#include "bootloader_journal.h"
+#include "bootloader_transport.h"
+#include "bootloader_uart.h"
+#include "bootloader_usb.h"
 
 /* Macro Declarations---------------------------------------------------------*/
 #define ENABLED 1
@@ -29,6 +45,17 @@
 #define CBL_READ_SECTOR_STATUS_CMD	0x19
 #define CBL_OTP_READ_CMD						0x20
 #define CBL_CHANGE_ROP_LEVEL_CMD		0x21
+#define CBL_STREAM_WRITE_CMD				0x22
+#define CBL_COMPRESSED_WRITE_CMD		0x23
+#define CBL_IMAGE_HASH_CMD					0x24
+#define CBL_DELTA_WRITE_CMD					0x25
+#define CBL_SLOT_INFO_CMD						0x26
+#define CBL_SET_ACTIVE_SLOT_CMD			0x27
+#define CBL_MEM_HASH_CMD						0x28
+#define CBL_SET_BAUD_CMD						0x29
+#define CBL_SET_PROTOCOL_CMD				0x2A
+#define CBL_BENCH_READ_CMD					0x2B
+#define CBL_JOURNAL_QUERY_CMD				0x2C
 
 
 #define BL_VENDOR_ID								0x15
@@ -54,6 +81,7 @@
 #define ADD_SRAM16KB_END            0x2001FFFF
 #define ADD_SRAM112KB_START         0x20000000
 #define ADD_SRAM112KB_END           0x2001BFFF
+#define ADD_BLOCK_MASK							0xFF000000
 #define THUMB_INSTRUCTION_ADDITIVE	0x01
 typedef void (*jumpToAddressFunction)(void);
 
@@ -72,6 +100,110 @@ typedef void (*jumpToAddressFunction)(void);
 #define WRITING_SUCCESS							0x01
 #define SECTOR2_START_ADDRESS				0x08008000						
 
+/*	naming conventions for streaming write session	*/
+/*	session frame : len | SID | base address(4) | total length(4) | window(1) | [flags(1) | [session id(4) | image CRC(4)]] | CRC(4)	*/
+/*	block frame   : len(1 or 2) | sequence(2) | data(4*n) | CRC(4)	*/
+/*	window reply  : ACK/NACK | next expected sequence(2) | stream state(1)	*/
+#define STREAM_MAX_WINDOW						32
+#define STREAM_BLOCK_SEQUENCE_LEN		2
+#define STREAM_BLOCK_HEADER_LEN			(BL_RX_Header_Len() + STREAM_BLOCK_SEQUENCE_LEN)
+#define STREAM_BLOCK_MAX_DATA				((BL_RX_Max_Frame_Length() - STREAM_BLOCK_HEADER_LEN - 4) & ~3U)
+#define STREAM_BLOCK_TIMEOUT_MS			2000
+#define STREAM_MAX_RETRIES					5
+#define STREAM_SESSION_REJECTED			0x00
+#define STREAM_SESSION_OPENED				0x01
+#define STREAM_STATE_ACTIVE					0x01
+#define STREAM_STATE_ABORTED				0x02
+#define STREAM_STATE_DONE						0x03
+
+/*	FLAG to let the session erase the sectors it writes, no separate erase command beforehand	*/
+/*	the reply of a window is held while the erase lags behind the data, the next sector is erased while	*/
+/*	the host sends the following window, provided the whole window fits the RX ring	*/
+#define STREAM_FLAG_ERASE_AHEAD			0x01
+
+/*	FLAG to keep the session in the update journal, the frame then carries the session id and image CRC	*/
+/*	session reply : ACK | 5 | status(1) | resume offset(4), the host sends the image from there with sequence 0	*/
+/*	the same id, base, length and CRC after a lost link resume behind the last window that checks out in flash,	*/
+/*	anything else starts over at 0, an offset equal to the length means the image is already complete	*/
+#define STREAM_FLAG_JOURNAL					0x02
+#define STREAM_SESSION_LEN					10
+#define STREAM_JOURNAL_SESSION_LEN	18
+#define STREAM_JOURNAL_REPLY_LEN		5
+
+/*	compressed write session reuses the stream blocks and window replies, blocks carry the LZ stream	*/
+/*	session frame : len | SID | base address(4) | compressed length(4) | image length(4) | window(1) | CRC(4)	*/
+/*	the last window reports DONE only when the stream decodes to exactly image length bytes	*/
+#define STREAM_RAW_ALIGNMENT				4
+#define STREAM_LZ_ALIGNMENT					1
+
+/*	delta write session applies a patch against the installed image, blocks carry the patch stream	*/
+/*	session frame : len | SID | base(4) | old length(4) | old CRC(4) | new length(4) | new CRC(4) | patch length(4) | window(1) | CRC(4)	*/
+/*	the old CRC must match the installed image (see CBL_IMAGE_HASH_CMD) and the new one the patched result	*/
+/*	each SECTOR record erases two sectors, the host should close the window right after it	*/
+
+/*	naming conventions for A/B slot commands	*/
+/*	slot info reply  : boot slot(1) | per slot : state(1) | verified(1) | version(4) | length(4) | CRC(4)	*/
+/*	set active frame : len | SID | slot(1) | version(4) | length(4) | CRC(4) | CRC(4), length 0 rolls back to the slot's header	*/
+#define SLOT_INFO_ENTRY_LEN					14
+#define SLOT_INFO_REPLY_LEN					(1 + (BL_SLOT_COUNT * SLOT_INFO_ENTRY_LEN))
+#define SLOT_ACTIVATE_FAILED				0x00
+#define SLOT_ACTIVATE_DONE					0x01
+
+/*	naming conventions for memory read and hash commands	*/
+/*	read frame  : len | SID | address(4) | length(4) | CRC(4)	*/
+/*	read reply  : ACK | 1 | status(1), then per chunk : data(up to MEM_READ_CHUNK_LEN) | running CRC(4)	*/
+/*	hash frame  : len | SID | address(4) | length(4) | CRC(4)	*/
+/*	hash reply  : ACK | 4 | CRC(4) of the region, or NACK	*/
+#define MEM_READ_CHUNK_LEN					1024
+#define MEM_READ_REJECTED						0x00
+#define MEM_READ_ACCEPTED						0x01
+
+/*	naming conventions for sector status command	*/
+/*	status frame : len | SID | first sector(1) | number of sectors(1) | CRC(4), clipped to the last sector like erase	*/
+/*	status reply : ACK | 1+5n | count(1), then per sector : flags(1) | CRC(4) of the whole sector	*/
+/*	the host compares the CRCs with its image padded with 0xFF and only erases/writes sectors that differ	*/
+#define SECTOR_STATUS_ENTRY_LEN			5
+#define SECTOR_STATUS_BLANK					0x01
+#define SECTOR_STATUS_PROTECTED			0x02
+#define SECTOR_STATUS_BOOTLOADER		0x04
+
+/*	naming conventions for host link rate negotiation	*/
+/*	baud frame    : len | SID | baud(4) | CRC(4), baud 0 only asks for the rate table	*/
+/*	rate reply    : ACK | 2+4n | status(1) | count(1) | rates(4*n), sent at the old rate	*/
+/*	test frame    : len | SID | pattern | CRC(4) from the host at the new rate, echoed as ACK | len | pattern	*/
+/*	confirm frame : len | SID | CRC(4) from the host, answered ACK | 1 | BAUD_NEGOTIATED	*/
+/*	a missing or bad test/confirm frame puts both ends back on the old rate	*/
+#define BAUD_TEST_PATTERN_LEN				16
+#define BAUD_TEST_TIMEOUT_MS				1000
+#define BAUD_REJECTED								0x00
+#define BAUD_SWITCHING							0x01
+#define BAUD_NEGOTIATED							0x02
+
+/*	naming conventions for frame format negotiation	*/
+/*	protocol frame : len | SID | version(1) | CRC(4), always sent in the format currently in use	*/
+/*	protocol reply : ACK | 3 | accepted version(1) | largest length field(2), the next frame uses the accepted format	*/
+/*	version 0 only asks for the current one, a higher version than supported is answered with the highest	*/
+/*	v2 : len(2, little endian) | SID | payload(up to 4097) | CRC(4), the CRC covers both length bytes	*/
+/*	the format lasts until reset, the next negotiation or a host that stalls halfway through a v2 frame	*/
+#define PROTOCOL_REPLY_LEN					3
+#define PROTOCOL_VERSION_QUERY			0x00
+
+/*	naming conventions for benchmark stage stamps (see bootloader_bench.h for the record layout)	*/
+/*	bench frame : len | SID | flags(1) | CRC(4), BENCH_READ_RESET discards every record and the lost count first	*/
+/*	bench reply : ACK | 3+24n | count(1) | lost(2) | records(24*n), the records returned are removed	*/
+/*	the host reads until count is 0, reading does not add a record of its own	*/
+#define BENCH_READ_RESET						0x01
+#define BENCH_READ_MAX_RECORDS			10
+#define BENCH_READ_HEADER_LEN				3
+
+/*	naming conventions for update journal query	*/
+/*	query frame : len | SID | CRC(4)	*/
+/*	query reply : ACK | 21 | state(1) | session id(4) | base(4) | length(4) | image CRC(4) | verified offset(4)	*/
+/*	state is BL_JOURNAL_STATE_NONE, PARTIAL or COMPLETE, the offset is re-checked against flash on every query	*/
+#define JOURNAL_QUERY_REPLY_LEN			21
+
+typedef uint8_t (*streamSinkFunction)(uint8_t *data, uint16_t length, uint8_t lastBlock);
+
 /*	MACRO to enable or disable debugging prints 	*/
 #define BootLoader_Debugging				BootLoader_Debugging
 #define SWO_DEBUGGING								SWO_DEBUGGING
@@ -80,18 +212,49 @@ typedef void (*jumpToAddressFunction)(void);
 
 /* HW modules assigned to the bootloader	*/
 #define BL_HOST_COMM_UART 					&huart2	
+#define BL_HOST_COMM_USB 						&hpcd_USB_OTG_FS
 #define BL_DEBUG_UART 							&huart3		
 #define BL_CRC &hcrc	
 
-/*	MACRO for size of host buffer	*/
-#define HOST_BUFFER_LEN							300
-
 /*	typedef for BootLoader error status	*/
 typedef enum{	
 	BL_OK,
 	BL_ERROR,
 }BL_StatusTypeDef;
 
+/*	host frame : len | SID | payload | CRC(4), len counts every byte after itself and is 1 byte (v1) or 2 bytes (v2)	*/
+#define FRAME_HEADER_LEN						(BL_RX_Header_Len() + 1)
+#define FRAME_CRC_LEN								4
+#define FRAME_MIN_LEN_FIELD					(1 + FRAME_CRC_LEN)
+#define FRAME_MAX_PAYLOAD_LEN				(BL_RX_V2_MAX_LEN_FIELD - 1 - FRAME_CRC_LEN)
+#define FRAME_VERIFIED							1
+#define FRAME_VERIFAILED						0
+
+/*	typed view of a verified host frame, payload points into the receive slot and nothing is copied	*/
+typedef struct{
+	uint8_t *frame;
+	uint8_t SID;
+	uint8_t *payload;
+	uint16_t payloadLength;
+}BL_FrameTypeDef;
+
+typedef BL_StatusTypeDef (*commandHandlerFunction)(const BL_FrameTypeDef *hostFrame);
+
+/*	one dispatch table entry, a NULL handler marks a command that is listed but not implemented	*/
+typedef struct{
+	uint8_t SID;
+	uint16_t minPayloadLength;
+	uint16_t maxPayloadLength;
+	commandHandlerFunction handler;
+}BL_CommandTypeDef;
+
+/*	DWT cycles spent in each handler, ACK and reply transmission included	*/
+typedef struct{
+	uint32_t calls;
+	uint32_t totalCycles;
+	uint32_t maxCycles;
+}BL_CommandProfileTypeDef;
+
 /*	Address for Identication Data Address	*/
 #define DBGMCU_IDCODE			      		((*((volatile uint32_t*)0xE0042000)))   
 /*	ID Code for this Device is 	*/	
@@ -103,6 +266,7 @@ typedef enum{
 			
 
 BL_StatusTypeDef bootloader_Debug_Display(char* str, ...);
+const BL_CommandProfileTypeDef *bootloader_Get_Command_Profile(uint8_t SID);
 BL_StatusTypeDef bootloader_Receive_From_Host(void);
 
 void jump_To_Application(void);
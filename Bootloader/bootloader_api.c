@@ -0,0 +1,223 @@
+#include "bootloader_api.h"
+#include "bootloader_crc.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	widest program unit the supply range allows without VPP, x64 needs the external programming voltage	*/
+#define API_FLASH_MAX_UNIT					((FLASH_VOLTAGE_RANGE_1 == BL_FLASH_VOLTAGE_RANGE) ? 1U :	\
+																		 (FLASH_VOLTAGE_RANGE_2 == BL_FLASH_VOLTAGE_RANGE) ? 2U : 4U)
+
+/* Static Software Interface Declarations ------------------------------------*/
+static HAL_StatusTypeDef api_Flash_Program(uint32_t address, const uint8_t *data, uint32_t length);
+static HAL_StatusTypeDef api_Flash_Erase_Sector(uint8_t sector);
+static uint8_t api_Flash_Writable(uint32_t address, uint32_t length);
+static uint8_t api_Flash_Unlock(void);
+static HAL_StatusTypeDef api_Flash_Wait(void);
+static uint32_t api_Flash_PSize(uint32_t unit);
+static void api_Flash_Flush_Caches(void);
+
+/* Service Table -------------------------------------------------------------*/
+
+/*	linked at BL_API_ADDRESS : ARMCC places a section named .ARM.__at_<address> at that address	*/
+static const BL_ApiTypeDef apiTable __attribute__((section(".ARM.__at_0x08000200"), used)) = {
+	BL_API_MAGIC,
+	BL_API_VERSION,
+	sizeof(BL_ApiTypeDef),
+	0,
+
+	BL_CRC_Calculate,
+	BL_CRC_Software,
+
+	api_Flash_Program,
+	api_Flash_Erase_Sector,
+	BL_Flash_Sector_Of,
+	BL_Flash_Sector_Start,
+	BL_Flash_Sector_Size,
+
+	BL_SHA256_Begin,
+	BL_SHA256_Update,
+	BL_SHA256_End,
+	BL_SHA256_Calculate,
+
+	BL_LZ_Begin,
+	BL_LZ_Decompress,
+	BL_LZ_End,
+	BL_LZ_Output_Count,
+
+	BL_Log_Ring_Init,
+	BL_Log_Ring_Write,
+	BL_Log_Ring_Read,
+};
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+const BL_ApiTypeDef *BL_Api_Table( void )
+{
+	return &apiTable;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static HAL_StatusTypeDef api_Flash_Program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint8_t wasLocked = 0;
+	
+	if(!api_Flash_Writable(address, length))
+	{
+		return HAL_ERROR;
+	}
+	
+	wasLocked = api_Flash_Unlock();
+	halStatus |= api_Flash_Wait();
+	
+	while(length && (HAL_OK == halStatus))
+	{
+		/*	widest unit the supply allows, narrowed for unaligned heads and short tails	*/
+		uint32_t unit = API_FLASH_MAX_UNIT;
+		uint32_t word = 0;
+		while((unit > 1) && ((address & (unit - 1)) || (length < unit)))
+		{
+			unit >>= 1;
+		}
+	
+		/*	the caller's data may sit anywhere, the store to flash has to be aligned	*/
+		memcpy(&word, data, unit);
+		MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE, api_Flash_PSize(unit));
+		SET_BIT(FLASH->CR, FLASH_CR_PG);
+		switch(unit)
+		{
+			case( 4 ):	*(__IO uint32_t *)address = word;						break;
+			case( 2 ):	*(__IO uint16_t *)address = (uint16_t)word;	break;
+			default:		*(__IO uint8_t *)address = (uint8_t)word;		break;
+		}
+		halStatus |= api_Flash_Wait();
+	
+		address += unit;
+		data += unit;
+		length -= unit;
+	}
+	
+	CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+	if(wasLocked)
+	{
+		SET_BIT(FLASH->CR, FLASH_CR_LOCK);
+	}
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef api_Flash_Erase_Sector(uint8_t sector)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint8_t wasLocked = 0;
+	
+	if((sector >= BL_FLASH_SECTOR_COUNT) || !api_Flash_Writable(BL_Flash_Sector_Start(sector), BL_Flash_Sector_Size(sector)))
+	{
+		return HAL_ERROR;
+	}
+	
+	wasLocked = api_Flash_Unlock();
+	halStatus |= api_Flash_Wait();
+	
+	if(HAL_OK == halStatus)
+	{
+		MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE | FLASH_CR_SNB, api_Flash_PSize(API_FLASH_MAX_UNIT) | ((uint32_t)sector << FLASH_CR_SNB_Pos));
+		SET_BIT(FLASH->CR, FLASH_CR_SER);
+		SET_BIT(FLASH->CR, FLASH_CR_STRT);
+		halStatus |= api_Flash_Wait();
+		CLEAR_BIT(FLASH->CR, FLASH_CR_SER | FLASH_CR_SNB);
+		api_Flash_Flush_Caches();
+	}
+	
+	if(wasLocked)
+	{
+		SET_BIT(FLASH->CR, FLASH_CR_LOCK);
+	}
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t api_Flash_Writable(uint32_t address, uint32_t length)
+{
+	return	(address >= BL_API_WRITE_START) && (address <= BL_API_WRITE_END)	&&
+					(length <= (BL_API_WRITE_END - address));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t api_Flash_Unlock(void)
+{
+	/*	an application that unlocked the controller itself keeps it unlocked	*/
+	if(!READ_BIT(FLASH->CR, FLASH_CR_LOCK))
+	{
+		return 0;
+	}
+	
+	WRITE_REG(FLASH->KEYR, FLASH_KEY1);
+	WRITE_REG(FLASH->KEYR, FLASH_KEY2);
+	return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef api_Flash_Wait(void)
+{
+	/*	no HAL tick to time out on, the application's SysTick is its own : the controller always finishes	*/
+	while(FLASH->SR & FLASH_SR_BSY)
+	{
+	}
+	
+	if(FLASH->SR & BL_FLASH_ERROR_FLAGS)
+	{
+		__HAL_FLASH_CLEAR_FLAG(BL_FLASH_ERROR_FLAGS);
+		return HAL_ERROR;
+	}
+	
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP);
+	return HAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint32_t api_Flash_PSize(uint32_t unit)
+{
+	/*	PSIZE 0..2 selects x8, x16, x32, for programming and erasing alike	*/
+	return	(unit == 4) ? FLASH_PSIZE_WORD			:
+					(unit == 2) ? FLASH_PSIZE_HALF_WORD	: FLASH_PSIZE_BYTE;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void api_Flash_Flush_Caches(void)
+{
+	/*	the ART caches may still hold lines of the erased sector, as HAL_FLASHEx_Erase does it	*/
+	if(READ_BIT(FLASH->ACR, FLASH_ACR_ICEN))
+	{
+		__HAL_FLASH_INSTRUCTION_CACHE_DISABLE();
+		__HAL_FLASH_INSTRUCTION_CACHE_RESET();
+		__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	}
+	if(READ_BIT(FLASH->ACR, FLASH_ACR_DCEN))
+	{
+		__HAL_FLASH_DATA_CACHE_DISABLE();
+		__HAL_FLASH_DATA_CACHE_RESET();
+		__HAL_FLASH_DATA_CACHE_ENABLE();
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef  BOOTLOADER_API_H__
+#define	 BOOTLOADER_API_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+#include "bootloader_slot.h"
+#include "bootloader_sha256.h"
+#include "bootloader_lz.h"
+#include "bootloader_log.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	services the bootloader exports to applications : a table of entry points at a fixed flash address, right	*/
+/*	after the vector table, so an application calls the bootloader's CRC, flash, SHA-256, LZ and log code		*/
+/*	instead of linking its own copies																																				*/
+#define BL_API_ADDRESS							0x08000200U
+#define BL_API_MAGIC								0x49504142U
+
+/*	ABI : entries are only ever appended, which bumps the minor version and the size, anything else bumps	*/
+/*	the major version. An application checks magic and major, and the size before using a newer entry		*/
+#define BL_API_VERSION_MAJOR				1U
+#define BL_API_VERSION_MINOR				0U
+#define BL_API_VERSION							((BL_API_VERSION_MAJOR << 16) | BL_API_VERSION_MINOR)
+
+/*	flash the services may erase and write : both slots, nothing of the bootloader, scratch or slot table	*/
+#define BL_API_WRITE_START					BL_SLOT_A_ADDRESS
+#define BL_API_WRITE_END						(BL_SLOT_B_ADDRESS + BL_SLOT_B_LENGTH)
+
+/*	the bootloader's RAM belongs to the application once it runs, so no service keeps state there :		*/
+/*	contexts and rings are the caller's memory, flash is programmed and erased from flash-resident code	*/
+/*	(the CPU stalls while the controller is busy), and the CRC unit clock is the caller's to enable		*/
+typedef struct{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t reserved;
+
+	/*	CRC-32/MPEG-2 as the host and the slot table compute it, crcSoftware continues a CRC byte by byte	*/
+	uint32_t (*crcCalculate)( const uint8_t *data, uint32_t length );
+	uint32_t (*crcSoftware)( uint32_t crc, const uint8_t *data, uint32_t length );
+
+	/*	unlocked and locked again around each call, anything outside BL_API_WRITE_START..END is refused	*/
+	HAL_StatusTypeDef (*flashProgram)( uint32_t address, const uint8_t *data, uint32_t length );
+	HAL_StatusTypeDef (*flashEraseSector)( uint8_t sector );
+	uint8_t (*flashSectorOf)( uint32_t address );
+	uint32_t (*flashSectorStart)( uint8_t sector );
+	uint32_t (*flashSectorSize)( uint8_t sector );
+
+	void (*sha256Begin)( BL_SHA256_ContextTypeDef *context );
+	void (*sha256Update)( BL_SHA256_ContextTypeDef *context, const uint8_t *data, uint32_t length );
+	void (*sha256End)( BL_SHA256_ContextTypeDef *context, uint8_t digest[BL_SHA256_DIGEST_LEN] );
+	void (*sha256Calculate)( const uint8_t *data, uint32_t length, uint8_t digest[BL_SHA256_DIGEST_LEN] );
+
+	/*	the format Host/bl_compress.py produces	*/
+	void (*lzBegin)( BL_LZ_ContextTypeDef *context, lzOutputFunction output );
+	uint8_t (*lzDecompress)( BL_LZ_ContextTypeDef *context, const uint8_t *input, uint32_t length );
+	uint8_t (*lzEnd)( BL_LZ_ContextTypeDef *context );
+	uint32_t (*lzOutputCount)( const BL_LZ_ContextTypeDef *context );
+
+	/*	binary log records on the caller's ring, Host/bl_log.py decodes them against the application's .axf	*/
+	void (*logRingInit)( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t wordCount );
+	void (*logRingWrite)( BL_LogRingTypeDef *ring, const char *format, const uint32_t *args, uint32_t argCount );
+	uint32_t (*logRingRead)( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t maxWords );
+}BL_ApiTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+#define BL_API											((const BL_ApiTypeDef *)BL_API_ADDRESS)
+#define BL_API_MAJOR(version)				((version) >> 16)
+
+/*	a table of the same major version that is long enough to hold the entry	*/
+#define BL_API_HAS(api, entry)			(((api)->magic == BL_API_MAGIC)																					&&	\
+																		 (BL_API_MAJOR((api)->version) == BL_API_VERSION_MAJOR)									&&	\
+																		 ((api)->size >= (offsetof(BL_ApiTypeDef, entry) + sizeof((api)->entry))))
+
+/*	the layout is the ABI : checked wherever this header is compiled for the 32-bit target, the bootloader	*/
+/*	and every application alike, so a reordered or resized entry fails the build instead of a call				*/
+#define BL_API_CHECK(name, check)		typedef char blApiCheck_##name[((sizeof(void *) != 4U) || (check)) ? 1 : -1]
+
+BL_API_CHECK(crcCalculate,			offsetof(BL_ApiTypeDef, crcCalculate) == 16U);
+BL_API_CHECK(flashProgram,			offsetof(BL_ApiTypeDef, flashProgram) == 24U);
+BL_API_CHECK(sha256Begin,				offsetof(BL_ApiTypeDef, sha256Begin) == 44U);
+BL_API_CHECK(lzBegin,						offsetof(BL_ApiTypeDef, lzBegin) == 60U);
+BL_API_CHECK(logRingInit,				offsetof(BL_ApiTypeDef, logRingInit) == 76U);
+BL_API_CHECK(size,							sizeof(BL_ApiTypeDef) == 88U);
+BL_API_CHECK(sha256Context,			sizeof(BL_SHA256_ContextTypeDef) == 112U);
+BL_API_CHECK(lzContext,					sizeof(BL_LZ_ContextTypeDef) == (24U + BL_LZ_WINDOW_LEN + BL_LZ_OUTPUT_CHUNK_LEN));
+BL_API_CHECK(logRing,						sizeof(BL_LogRingTypeDef) == 24U);
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+const BL_ApiTypeDef *BL_Api_Table( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_API_H__*/
@@ -0,0 +1,201 @@
+#include "bootloader_baud.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static UART_HandleTypeDef *baudUart = NULL;
+
+/*	rates that survived the divider check, built once from the real peripheral clock	*/
+static const uint32_t baudCandidates[BL_BAUD_MAX_RATES] = { BL_BAUD_CANDIDATES };
+static BL_BaudRateTypeDef baudRates[BL_BAUD_MAX_RATES];
+static uint8_t baudRateCount = 0;
+
+static const BL_BaudRateTypeDef *baudDefault = NULL;
+static const BL_BaudRateTypeDef *baudCurrent = NULL;
+static uint8_t baudLinkErrors = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t baud_Evaluate(uint32_t pclk, uint32_t baudRate, uint32_t overSampling, BL_BaudRateTypeDef *rate);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Baud_Init( UART_HandleTypeDef *huart )
+{
+	uint32_t pclk;
+	
+	baudUart = huart;
+	baudRateCount = 0;
+	baudLinkErrors = 0;
+	
+	/*	USART1 and USART6 hang on APB2, the others on APB1	*/
+	if((USART1 == huart->Instance) || (USART6 == huart->Instance))
+	{
+		pclk = HAL_RCC_GetPCLK2Freq();
+	}
+	else
+	{
+		pclk = HAL_RCC_GetPCLK1Freq();
+	}
+	
+	/*	16x oversampling tolerates more noise, 8x is only used for rates 16x cannot reach	*/
+	for(uint8_t i = 0; i < BL_BAUD_MAX_RATES; i++)
+	{
+		BL_BaudRateTypeDef *rate = &baudRates[baudRateCount];
+		if( baud_Evaluate(pclk, baudCandidates[i], UART_OVERSAMPLING_16, rate) ||
+				baud_Evaluate(pclk, baudCandidates[i], UART_OVERSAMPLING_8, rate) )
+		{
+			baudRateCount++;
+		}
+	}
+	
+	/*	the rate CubeMX configured is where the host finds us after reset and where errors fall back to	*/
+	baudDefault = BL_Baud_Find(huart->Init.BaudRate);
+	baudCurrent = baudDefault;
+	
+#ifdef SWO_DEBUGGING
+	BL_LOG("Host link rates from PCLK %u Hz :\r\n", pclk);
+	for(uint8_t i = 0; i < baudRateCount; i++)
+	{
+		BL_LOG("  %u baud, %ux oversampling, actual %u (%d ppm)\r\n", baudRates[i].baudRate,
+						(UART_OVERSAMPLING_8 == baudRates[i].overSampling) ? 8U : 16U, baudRates[i].actualRate, baudRates[i].errorPpm);
+	}
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Baud_Count( void )
+{
+	return baudRateCount;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const BL_BaudRateTypeDef *BL_Baud_Get( uint8_t index )
+{
+	return (index < baudRateCount) ? &baudRates[index] : NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const BL_BaudRateTypeDef *BL_Baud_Find( uint32_t baudRate )
+{
+	for(uint8_t i = 0; i < baudRateCount; i++)
+	{
+		if(baudRates[i].baudRate == baudRate)
+		{
+			return &baudRates[i];
+		}
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const BL_BaudRateTypeDef *BL_Baud_Current( void )
+{
+	return baudCurrent;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Baud_Apply( const BL_BaudRateTypeDef *rate )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	
+	if(NULL == rate)
+	{
+		return BL_BAUD_ERROR;
+	}
+	
+	/*	a reply byte still in the shift register would leave garbled at the new rate	*/
+	while(RESET == __HAL_UART_GET_FLAG(baudUart, UART_FLAG_TC));
+	
+	/*	HAL_UART_Init on a ready handle skips the MSP, it only rewrites BRR/CR1 so the DMA link stays	*/
+	HAL_UART_AbortReceive(baudUart);
+	baudUart->Init.BaudRate = rate->baudRate;
+	baudUart->Init.OverSampling = rate->overSampling;
+	halStatus = HAL_UART_Init(baudUart);
+	
+	/*	bytes caught while the line was switching are noise, restart reception on an empty ring	*/
+	BL_RX_Flush();
+	baudLinkErrors = 0;
+	
+	if(HAL_OK != halStatus)
+	{
+		return BL_BAUD_ERROR;
+	}
+	baudCurrent = rate;
+	return BL_BAUD_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Baud_Link_Event( uint8_t frameValid )
+{
+	if(frameValid)
+	{
+		baudLinkErrors = 0;
+		return;
+	}
+	
+	/*	a run of bad frames at a raised rate means the link no longer holds, go back to where the host can always find us	*/
+	if((++baudLinkErrors >= BL_BAUD_MAX_LINK_ERRORS) && (baudCurrent != baudDefault))
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Host link errors at %u baud, falling back \r\n", baudCurrent->baudRate);
+#endif
+		(void)BL_Baud_Apply(baudDefault);
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t baud_Evaluate(uint32_t pclk, uint32_t baudRate, uint32_t overSampling, BL_BaudRateTypeDef *rate)
+{
+	uint32_t brr, divider;
+	int64_t errorPpm;
+	
+	/*	divider in clock periods per bit as the hardware will see it, HAL rounds the fraction into BRR	*/
+	if(UART_OVERSAMPLING_16 == overSampling)
+	{
+		brr = UART_BRR_SAMPLING16(pclk, baudRate);
+		divider = brr;
+		if(divider < 16U)
+		{
+			return BL_BAUD_ERROR;
+		}
+	}
+	else
+	{
+		brr = UART_BRR_SAMPLING8(pclk, baudRate);
+		divider = ((brr >> 4) << 3) + (brr & 0x07U);
+		if(divider < 8U)
+		{
+			return BL_BAUD_ERROR;
+		}
+	}
+	
+	rate->baudRate = baudRate;
+	rate->overSampling = overSampling;
+	rate->actualRate = pclk / divider;
+	errorPpm = (((int64_t)rate->actualRate - (int64_t)baudRate) * 1000000) / (int64_t)baudRate;
+	rate->errorPpm = (int32_t)errorPpm;
+	
+	if((errorPpm > BL_BAUD_MAX_ERROR_PPM) || (errorPpm < -BL_BAUD_MAX_ERROR_PPM))
+	{
+		return BL_BAUD_ERROR;
+	}
+	return BL_BAUD_OK;
+}
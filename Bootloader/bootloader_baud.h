@@ -0,0 +1,50 @@
+#ifndef  BOOTLOADER_BAUD_H__
+#define	 BOOTLOADER_BAUD_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include "usart.h"
+#include "bootloader_rx.h"
+#include "bootloader_log.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	candidate host link rates, only those the UART clock divides within BL_BAUD_MAX_ERROR_PPM are offered	*/
+/*	USART2 on 42 MHz APB1 : 16x oversampling up to 2.625 Mbaud, 8x oversampling up to 5.25 Mbaud	*/
+#define BL_BAUD_CANDIDATES					115200U, 230400U, 460800U, 921600U, 1000000U, 1500000U,	\
+																		2000000U, 2625000U, 3000000U, 4000000U, 5250000U
+#define BL_BAUD_MAX_RATES						11U
+#define BL_BAUD_MAX_ERROR_PPM				10000
+
+/*	consecutive bad frames after which a raised rate drops back to the power-up rate	*/
+#define BL_BAUD_MAX_LINK_ERRORS			8U
+
+/*	naming conventions for baud status	*/
+#define BL_BAUD_OK									0x01
+#define BL_BAUD_ERROR								0x00
+
+/*	one usable rate : requested rate, oversampling that reaches it and the rate the divider really gives	*/
+typedef struct{
+	uint32_t baudRate;
+	uint32_t overSampling;
+	uint32_t actualRate;
+	int32_t errorPpm;
+}BL_BaudRateTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Baud_Init( UART_HandleTypeDef *huart );
+uint8_t BL_Baud_Count( void );
+const BL_BaudRateTypeDef *BL_Baud_Get( uint8_t index );
+const BL_BaudRateTypeDef *BL_Baud_Find( uint32_t baudRate );
+const BL_BaudRateTypeDef *BL_Baud_Current( void );
+uint8_t BL_Baud_Apply( const BL_BaudRateTypeDef *rate );
+void BL_Baud_Link_Event( uint8_t frameValid );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_BAUD_H__*/
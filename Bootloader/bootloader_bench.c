@@ -0,0 +1,127 @@
+#include "bootloader_bench.h"
+
+#ifdef BL_BENCH
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	one open record per kind : a session command stays open while its blocks come and go	*/
+static BL_BenchRecordTypeDef benchOpen[BL_BENCH_KIND_COUNT];
+static uint8_t benchIsOpen[BL_BENCH_KIND_COUNT];
+
+/*	finished records, the oldest are kept and newer ones counted as lost when the host reads too late	*/
+static BL_BenchRecordTypeDef benchRecords[BL_BENCH_RECORDS];
+static uint32_t benchHead = 0;
+static uint32_t benchTail = 0;
+static uint16_t benchLost = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void bench_Commit(uint8_t kind);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Bench_Open( uint8_t kind, uint32_t rxCycles, uint16_t frameLength )
+{
+	/*	a block left open by the previous one (no reply in between) is finished here	*/
+	if(benchIsOpen[kind])
+	{
+		bench_Commit(kind);
+	}
+	
+	memset(&benchOpen[kind], 0, sizeof(benchOpen[kind]));
+	benchOpen[kind].kind = kind;
+	benchOpen[kind].frameLength = frameLength;
+	benchOpen[kind].rxCycles = rxCycles;
+	benchIsOpen[kind] = 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Bench_Stamp( uint8_t stage )
+{
+	uint32_t cycles = DWT->CYCCNT;
+	
+	/*	CRC is per frame : a block's check must not move the stamp of the session command around it	*/
+	if(benchIsOpen[BL_BENCH_KIND_BLOCK])
+	{
+		benchOpen[BL_BENCH_KIND_BLOCK].stageCycles[stage] = cycles;
+		if(BL_BENCH_STAGE_CRC == stage)
+		{
+			return;
+		}
+	}
+	if(benchIsOpen[BL_BENCH_KIND_COMMAND])
+	{
+		benchOpen[BL_BENCH_KIND_COMMAND].stageCycles[stage] = cycles;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Bench_Close( uint8_t kind, uint8_t SID, uint16_t sequence, uint8_t status )
+{
+	if(!benchIsOpen[kind])
+	{
+		return;
+	}
+	
+	benchOpen[kind].SID = SID;
+	benchOpen[kind].sequence = sequence;
+	benchOpen[kind].status = status;
+	
+	/*	blocks stay open for the window reply, the next block or the end of the session commits them	*/
+	if(BL_BENCH_KIND_COMMAND == kind)
+	{
+		if(benchIsOpen[BL_BENCH_KIND_BLOCK])
+		{
+			bench_Commit(BL_BENCH_KIND_BLOCK);
+		}
+		bench_Commit(BL_BENCH_KIND_COMMAND);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint16_t BL_Bench_Read( BL_BenchRecordTypeDef *records, uint16_t maxRecords, uint16_t *lost )
+{
+	uint16_t count = 0;
+	
+	while((count < maxRecords) && (benchTail != benchHead))
+	{
+		records[count++] = benchRecords[benchTail++ & BL_BENCH_RECORDS_MASK];
+	}
+	*lost = benchLost;
+	return count;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Bench_Reset( void )
+{
+	benchTail = benchHead;
+	benchLost = 0;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void bench_Commit(uint8_t kind)
+{
+	if((benchHead - benchTail) < BL_BENCH_RECORDS)
+	{
+		benchRecords[benchHead++ & BL_BENCH_RECORDS_MASK] = benchOpen[kind];
+	}
+	else if(benchLost < 0xFFFFU)
+	{
+		benchLost++;
+	}
+	benchIsOpen[kind] = 0;
+}
+
+#endif /*BL_BENCH*/
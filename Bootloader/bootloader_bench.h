@@ -0,0 +1,66 @@
+#ifndef  BOOTLOADER_BENCH_H__
+#define	 BOOTLOADER_BENCH_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	MACRO to enable or disable the per frame stage stamps, Host/bl_bench.py reads them with CBL_BENCH_READ_CMD	*/
+#define BL_BENCH										BL_BENCH
+
+/*	records wait here until the host reads them, must be a power of two	*/
+#define BL_BENCH_RECORDS						128U
+#define BL_BENCH_RECORDS_MASK				(BL_BENCH_RECORDS - 1U)
+
+/*	stages after the frame is complete in its slot, DWT cycles, 0 when the frame never got there	*/
+/*	CRC   : frame CRC checked																							*/
+/*	FLASH : last program or erase operation finished														*/
+/*	TX    : last reply byte left the UART (blocking transmit returns on TC)			*/
+#define BL_BENCH_STAGE_CRC					0
+#define BL_BENCH_STAGE_FLASH				1
+#define BL_BENCH_STAGE_TX						2
+#define BL_BENCH_STAGE_COUNT				3
+
+/*	a command frame, or one block of a stream/compressed/delta session (the window reply is stamped on the last block)	*/
+#define BL_BENCH_KIND_COMMAND				0x00
+#define BL_BENCH_KIND_BLOCK					0x01
+#define BL_BENCH_KIND_COUNT					2
+
+/*	24 bytes, sent as they are in memory (little endian, no padding)	*/
+typedef struct{
+	uint8_t SID;
+	uint8_t kind;
+	uint8_t status;
+	uint8_t reserved;
+	uint16_t frameLength;
+	uint16_t sequence;
+	uint32_t rxCycles;
+	uint32_t stageCycles[BL_BENCH_STAGE_COUNT];
+}BL_BenchRecordTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+#ifndef BL_BENCH
+#define BL_Bench_Open(kind, rxCycles, frameLength)
+#define BL_Bench_Stamp(stage)
+#define BL_Bench_Close(kind, SID, sequence, status)
+#define BL_Bench_Read(records, maxRecords, lost)		(0)
+#define BL_Bench_Reset()
+#else
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Bench_Open( uint8_t kind, uint32_t rxCycles, uint16_t frameLength );
+void BL_Bench_Stamp( uint8_t stage );
+void BL_Bench_Close( uint8_t kind, uint8_t SID, uint16_t sequence, uint8_t status );
+uint16_t BL_Bench_Read( BL_BenchRecordTypeDef *records, uint16_t maxRecords, uint16_t *lost );
+void BL_Bench_Reset( void );
+
+#endif
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_BENCH_H__*/
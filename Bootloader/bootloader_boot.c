@@ -0,0 +1,284 @@
+#include "bootloader_boot.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	placed at BL_BOOT_INFO_ADDRESS by the scatter file, the UNINIT region is not cleared at startup	*/
+static BL_BootInfoTypeDef bootInfo __attribute__((section(".bss.noinit")));
+
+/*	request left by the application before the reset, latched before the boot info is cleared	*/
+static uint32_t bootRequest = BL_BOOT_REQUEST_NONE;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t boot_Button_Pressed(void);
+#if defined(BL_FAST_BOOT_VERIFY_IMAGE) || defined(BL_SECURE_BOOT)
+static void boot_Clock_Raise(void);
+static void boot_Clock_Restore(uint32_t flashAcr);
+#endif
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Boot_Info_Init( void )
+{
+	uint32_t mainCycles = DWT->CYCCNT;
+	
+	/*	after power up the region holds garbage, a request only counts if the bootloader wrote the magic before	*/
+	bootRequest = (BL_BOOT_INFO_MAGIC == bootInfo.magic) ? bootInfo.bootRequest : BL_BOOT_REQUEST_NONE;
+	
+	memset(&bootInfo, 0, sizeof(bootInfo));
+	bootInfo.magic = BL_BOOT_INFO_MAGIC;
+	bootInfo.resetFlags = RCC->CSR;
+	bootInfo.bootPath = BL_BOOT_PATH_BOOTLOADER;
+	bootInfo.bootSlot = BL_SLOT_NONE;
+	bootInfo.stageCycles[BL_BOOT_STAGE_MAIN] = mainCycles;
+	bootInfo.stageClockHz[BL_BOOT_STAGE_MAIN] = SystemCoreClock;
+	bootInfo.apiTable = (uint32_t)BL_Api_Table();
+	RCC->CSR |= RCC_CSR_RMVF;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Boot_Stamp( uint8_t stage )
+{
+	if(stage < BL_BOOT_STAGE_COUNT)
+	{
+		bootInfo.stageCycles[stage] = DWT->CYCCNT;
+		bootInfo.stageClockHz[stage] = SystemCoreClock;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Boot_Fast_Path( void )
+{
+	uint8_t bootSlot = BL_SLOT_NONE;
+#if defined(BL_FAST_BOOT_VERIFY_IMAGE) || defined(BL_SECURE_BOOT)
+	uint32_t flashAcr = FLASH->ACR;
+#endif
+	
+	/*	only the CRC unit is needed to read the slot table, everything runs on the 16 MHz HSI	*/
+	__HAL_RCC_CRC_CLK_ENABLE();
+	
+	if((BL_BOOT_REQUEST_STAY != bootRequest) && !boot_Button_Pressed())
+	{
+		BL_Slot_Init();
+#if defined(BL_FAST_BOOT_VERIFY_IMAGE) || defined(BL_SECURE_BOOT)
+		/*	secure boot never skips the manifest : one pass of SHA-256 over the image and the signature,	*/
+		/*	on the PLL instead of the HSI, that is the whole cost of the decision								*/
+		boot_Clock_Raise();
+		bootSlot = BL_Slot_Select_Boot();
+#else
+		bootSlot = BL_Slot_Select_Header();
+#endif
+	}
+	
+	__HAL_RCC_CRC_CLK_DISABLE();
+	BL_Boot_Stamp(BL_BOOT_STAGE_DECISION);
+	
+#if defined(BL_FAST_BOOT_VERIFY_IMAGE) || defined(BL_SECURE_BOOT)
+	/*	stamped before : the boot info holds the cycles and the clock the checks ran at	*/
+	boot_Clock_Restore(flashAcr);
+#endif
+	
+	return bootSlot;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Boot_Start_Slot( uint8_t slot, uint8_t bootPath )
+{
+	/*	the slot was selected on a checked vector table, nothing comes back from here	*/
+	(void)BL_Boot_Handoff(BL_SLOT_ADDRESS(slot), BL_SLOT_LENGTH(slot), slot, bootPath);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Boot_Check_Vectors( const uint32_t *vectors, uint32_t imageBase, uint32_t imageLength )
+{
+	uint32_t stackPointer = vectors[0];
+	uint32_t linkBase = imageBase;
+	uint8_t imageKind = BL_BOOT_IMAGE_IN_PLACE;
+	
+	/*	initial MSP inside SRAM or CCM (top of RAM included), 8-byte aligned as the AAPCS wants it	*/
+	if( !(((stackPointer > BL_BOOT_SRAM_START) && (stackPointer <= BL_BOOT_SRAM_END))	||
+				((stackPointer > BL_BOOT_CCM_START) && (stackPointer <= BL_BOOT_CCM_END)))			||
+			(stackPointer & 7U) || (imageLength <= (BL_BOOT_VECTOR_COUNT * 4U)) )
+	{
+		return BL_BOOT_IMAGE_INVALID;
+	}
+	
+	/*	a reset handler below the image length can only be an offset : the image was linked at 0	*/
+	if(vectors[1] < imageLength)
+	{
+		linkBase = 0;
+		imageKind = BL_BOOT_IMAGE_RELOCATABLE;
+	}
+	
+	/*	reset, NMI and HardFault are required, every other core handler is optional : all are thumb code behind the table	*/
+	for(uint32_t i = 1; i < BL_BOOT_CORE_VECTOR_COUNT; i++)
+	{
+		uint32_t handler = vectors[i];
+		
+		/*	reserved entries 7-10 and 13, some toolchains keep a checksum there	*/
+		if(((i >= 7U) && (i <= 10U)) || (13U == i) || ((0 == handler) && (i > 3U)))
+		{
+			continue;
+		}
+		if( !(handler & 1U) || (handler <= linkBase + (BL_BOOT_VECTOR_COUNT * 4U)) || (handler >= linkBase + imageLength) )
+		{
+			return BL_BOOT_IMAGE_INVALID;
+		}
+	}
+	
+	return imageKind;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Boot_Handoff( uint32_t imageBase, uint32_t imageLength, uint8_t slot, uint8_t bootPath )
+{
+	const uint32_t *imageVectors = (const uint32_t *)imageBase;
+	uint32_t *vectorTable = (uint32_t *)imageBase;
+	jumpToApplicationFunction applicationResetHandler;
+	uint8_t imageKind = BL_Boot_Check_Vectors(imageVectors, imageBase, imageLength);
+	
+	if(BL_BOOT_IMAGE_INVALID == imageKind)
+	{
+		return BL_BOOT_IMAGE_INVALID;
+	}
+	
+	/*	no handler of the bootloader may run from here on, PRIMASK is given back right before the jump	*/
+	__disable_irq();
+	
+	/*	SysTick stopped with nothing pending, so the application never enters its handler before it set up its own	*/
+	SysTick->CTRL = 0;
+	SysTick->LOAD = 0;
+	SysTick->VAL = 0;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk | SCB_ICSR_PENDSVCLR_Msk;
+	
+	/*	every interrupt disabled and its pending flag cleared, as out of reset	*/
+	for(uint32_t i = 0; i < (sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0])); i++)
+	{
+		NVIC->ICER[i] = 0xFFFFFFFFU;
+		NVIC->ICPR[i] = 0xFFFFFFFFU;
+	}
+	
+	/*	linked at 0 : the handlers are offsets into the image, the core wants them as addresses	*/
+	if(BL_BOOT_IMAGE_RELOCATABLE == imageKind)
+	{
+		vectorTable = BL_BOOT_VECTORS;
+		vectorTable[0] = imageVectors[0];
+		for(uint32_t i = 1; i < BL_BOOT_VECTOR_COUNT; i++)
+		{
+			vectorTable[i] = imageVectors[i] ? (imageVectors[i] + imageBase) : 0;
+		}
+	}
+	
+	bootInfo.bootPath = bootPath;
+	bootInfo.bootSlot = slot;
+	bootInfo.imageBase = imageBase;
+	bootInfo.vectorTable = (uint32_t)vectorTable;
+	BL_Boot_Stamp(BL_BOOT_STAGE_JUMP);
+	
+	/*	interrupts of the application are taken from its own vector table, it need not set VTOR itself	*/
+	SCB->VTOR = (uint32_t)vectorTable;
+	__DSB();
+	__ISB();
+	
+	/*	privileged thread mode on the main stack without an FP context, as out of reset	*/
+	__set_CONTROL(0);
+	__ISB();
+	
+	/*	reset handler read before the stack moves under the locals	*/
+	applicationResetHandler = (jumpToApplicationFunction)vectorTable[1];
+	
+	/*	using CMSIS function set MSP to the MSP address of applcation	*/
+	__set_MSP(vectorTable[0]);
+	__enable_irq();
+	
+	/*	BYE	*/
+	applicationResetHandler();
+	
+	return imageKind;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t boot_Button_Pressed(void)
+{
+	uint8_t pressed = 0;
+	
+	/*	PA0 resets to a floating input, the board pulls it down : only the port clock is needed	*/
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	__DSB();
+	pressed = (BL_BOOT_BUTTON_PORT->IDR & BL_BOOT_BUTTON_PIN) ? 1 : 0;
+	__HAL_RCC_GPIOA_CLK_DISABLE();
+	
+	return pressed;
+}
+
+#if defined(BL_FAST_BOOT_VERIFY_IMAGE) || defined(BL_SECURE_BOOT)
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void boot_Clock_Raise(void)
+{
+	RCC_OscInitTypeDef oscConfig = {0};
+	RCC_ClkInitTypeDef clockConfig = {0};
+	
+	/*	the HSI is running already, the PLL locks on it within a few hundred cycles	*/
+	__HAL_RCC_PWR_CLK_ENABLE();
+	__HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
+	
+	oscConfig.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+	oscConfig.PLL.PLLState = RCC_PLL_ON;
+	oscConfig.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+	oscConfig.PLL.PLLM = BL_BOOT_VERIFY_PLLM;
+	oscConfig.PLL.PLLN = BL_BOOT_VERIFY_PLLN;
+	oscConfig.PLL.PLLP = BL_BOOT_VERIFY_PLLP;
+	oscConfig.PLL.PLLQ = BL_BOOT_VERIFY_PLLQ;
+	if(HAL_OK != HAL_RCC_OscConfig(&oscConfig))
+	{
+		return;
+	}
+	
+	/*	prefetch and the ART caches keep the wait states off the hash loop, the image is read sequentially	*/
+	__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	__HAL_FLASH_DATA_CACHE_ENABLE();
+	
+	/*	APB1 at most 42 MHz and APB2 84 MHz, as SystemClock_Config sets them	*/
+	clockConfig.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+	clockConfig.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	clockConfig.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	clockConfig.APB1CLKDivider = RCC_HCLK_DIV4;
+	clockConfig.APB2CLKDivider = RCC_HCLK_DIV2;
+	(void)HAL_RCC_ClockConfig(&clockConfig, BL_BOOT_VERIFY_LATENCY);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void boot_Clock_Restore(uint32_t flashAcr)
+{
+	/*	back on the HSI with the PLL off, then wait states and caches as they were : as out of reset	*/
+	(void)HAL_RCC_DeInit();
+	__HAL_FLASH_INSTRUCTION_CACHE_DISABLE();
+	__HAL_FLASH_DATA_CACHE_DISABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_RESET();
+	__HAL_FLASH_DATA_CACHE_RESET();
+	FLASH->ACR = flashAcr;
+	__HAL_RCC_PWR_CLK_DISABLE();
+}
+#endif
@@ -0,0 +1,111 @@
+#ifndef  BOOTLOADER_BOOT_H__
+#define	 BOOTLOADER_BOOT_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_slot.h"
+#include "bootloader_manifest.h"
+#include "bootloader_api.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	MACRO to enable or disable the reset fast path that starts the application before clocks and UARTs	*/
+#define BL_FAST_BOOT								BL_FAST_BOOT
+
+/*	MACRO to hash the whole image on the fast path too, otherwise only the slot header and vectors are checked	*/
+/* #define BL_FAST_BOOT_VERIFY_IMAGE */
+
+/*	image checks on the fast path run on the PLL from the HSI, no HSE start-up to wait for :	*/
+/*	16 MHz / 16 * 336 / 2 = 168 MHz, 5 wait states at 2.7-3.6 V, the application still starts on the HSI	*/
+#define BL_BOOT_VERIFY_PLLM					16U
+#define BL_BOOT_VERIFY_PLLN					336U
+#define BL_BOOT_VERIFY_PLLP					RCC_PLLP_DIV2
+#define BL_BOOT_VERIFY_PLLQ					7U
+#define BL_BOOT_VERIFY_LATENCY			FLASH_LATENCY_5
+
+/*	user button B1 of the discovery board, held during reset it keeps the bootloader running	*/
+#define BL_BOOT_BUTTON_PORT					GPIOA
+#define BL_BOOT_BUTTON_PIN					GPIO_PIN_0
+
+/*	boot info lives in the last 1K of SRAM2 and survives resets, the application reads it there	*/
+/*	and must keep the region out of its own RAM (see RW_NOINIT in MDK-ARM/PractiseBL.sct)	*/
+#define BL_BOOT_INFO_ADDRESS				0x2001FC00U
+#define BL_BOOT_INFO_MAGIC					0xB007B007U
+
+/*	vector table of a position independent image, rebased into the upper half of the same 1K	*/
+/*	VTOR wants the table aligned to the next power of two of its size, 98 words need 512 bytes	*/
+#define BL_BOOT_VECTORS_ADDRESS			0x2001FE00U
+#define BL_BOOT_VECTOR_COUNT				(16U + (uint32_t)FPU_IRQn + 1U)
+#define BL_BOOT_CORE_VECTOR_COUNT		16U
+
+/*	where an initial MSP may point, the top of each RAM included	*/
+#define BL_BOOT_SRAM_START					0x20000000U
+#define BL_BOOT_SRAM_END						0x20020000U
+#define BL_BOOT_CCM_START						0x10000000U
+#define BL_BOOT_CCM_END							0x10010000U
+
+/*	the application writes this to bootRequest before a software reset to get into the bootloader	*/
+#define BL_BOOT_REQUEST_NONE				0x00000000U
+#define BL_BOOT_REQUEST_STAY				0x53544159U
+
+/*	naming conventions for the path taken on the last reset	*/
+#define BL_BOOT_PATH_FAST						0x01
+#define BL_BOOT_PATH_BOOTLOADER			0x02
+#define BL_BOOT_PATH_COMMAND				0x03
+
+/*	naming conventions for what a vector table was linked for	*/
+#define BL_BOOT_IMAGE_INVALID				0x00
+#define BL_BOOT_IMAGE_IN_PLACE			0x01
+#define BL_BOOT_IMAGE_RELOCATABLE		0x02
+
+/*	DWT cycle count stamps, the counter is zeroed in SystemInit right after reset	*/
+#define BL_BOOT_STAGE_MAIN					0
+#define BL_BOOT_STAGE_DECISION			1
+#define BL_BOOT_STAGE_HAL_INIT			2
+#define BL_BOOT_STAGE_CLOCK					3
+#define BL_BOOT_STAGE_PERIPHERALS		4
+#define BL_BOOT_STAGE_READY					5
+#define BL_BOOT_STAGE_JUMP					6
+#define BL_BOOT_STAGE_COUNT					7
+
+typedef void (*jumpToApplicationFunction)(void);
+
+/*	layout shared with the application, stages that did not run on the last reset read 0	*/
+/*	new fields only ever go at the end, an application built against an older layout still finds its own	*/
+typedef struct{
+	uint32_t magic;
+	uint32_t bootRequest;
+	uint32_t resetFlags;
+	uint8_t bootPath;
+	uint8_t bootSlot;
+	uint16_t reserved;
+	uint32_t stageCycles[BL_BOOT_STAGE_COUNT];
+	uint32_t stageClockHz[BL_BOOT_STAGE_COUNT];
+	uint32_t imageBase;
+	uint32_t vectorTable;
+	uint32_t apiTable;
+}BL_BootInfoTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+#define BL_BOOT_INFO								((BL_BootInfoTypeDef *)BL_BOOT_INFO_ADDRESS)
+#define BL_BOOT_VECTORS							((uint32_t *)BL_BOOT_VECTORS_ADDRESS)
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Boot_Info_Init( void );
+void BL_Boot_Stamp( uint8_t stage );
+uint8_t BL_Boot_Fast_Path( void );
+void BL_Boot_Start_Slot( uint8_t slot, uint8_t bootPath );
+
+/*	an image starts with the NVIC, SysTick and PRIMASK as after a reset, VTOR on its own vectors and the boot info filled in	*/
+/*	linked for imageBase it runs in place, linked at 0 its vectors are rebased and it may sit at any slot address	*/
+/*	returns only if the vector table does not hold up																													*/
+uint8_t BL_Boot_Check_Vectors( const uint32_t *vectors, uint32_t imageBase, uint32_t imageLength );
+uint8_t BL_Boot_Handoff( uint32_t imageBase, uint32_t imageLength, uint8_t slot, uint8_t bootPath );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_BOOT_H__*/
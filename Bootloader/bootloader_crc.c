@@ -0,0 +1,273 @@
+#include "bootloader_crc.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	bytes of an unfinished word carried over between BL_CRC_Update calls	*/
+static uint8_t crcPendingBytes[4];
+static uint8_t crcPendingCount = 0;
+
+/*	MSB-first table for the software path : tail bytes and the bit-exact fallback	*/
+static const uint32_t crcTable[256] = {
+	0x00000000U, 0x04C11DB7U, 0x09823B6EU, 0x0D4326D9U, 0x130476DCU, 0x17C56B6BU,
+	0x1A864DB2U, 0x1E475005U, 0x2608EDB8U, 0x22C9F00FU, 0x2F8AD6D6U, 0x2B4BCB61U,
+	0x350C9B64U, 0x31CD86D3U, 0x3C8EA00AU, 0x384FBDBDU, 0x4C11DB70U, 0x48D0C6C7U,
+	0x4593E01EU, 0x4152FDA9U, 0x5F15ADACU, 0x5BD4B01BU, 0x569796C2U, 0x52568B75U,
+	0x6A1936C8U, 0x6ED82B7FU, 0x639B0DA6U, 0x675A1011U, 0x791D4014U, 0x7DDC5DA3U,
+	0x709F7B7AU, 0x745E66CDU, 0x9823B6E0U, 0x9CE2AB57U, 0x91A18D8EU, 0x95609039U,
+	0x8B27C03CU, 0x8FE6DD8BU, 0x82A5FB52U, 0x8664E6E5U, 0xBE2B5B58U, 0xBAEA46EFU,
+	0xB7A96036U, 0xB3687D81U, 0xAD2F2D84U, 0xA9EE3033U, 0xA4AD16EAU, 0xA06C0B5DU,
+	0xD4326D90U, 0xD0F37027U, 0xDDB056FEU, 0xD9714B49U, 0xC7361B4CU, 0xC3F706FBU,
+	0xCEB42022U, 0xCA753D95U, 0xF23A8028U, 0xF6FB9D9FU, 0xFBB8BB46U, 0xFF79A6F1U,
+	0xE13EF6F4U, 0xE5FFEB43U, 0xE8BCCD9AU, 0xEC7DD02DU, 0x34867077U, 0x30476DC0U,
+	0x3D044B19U, 0x39C556AEU, 0x278206ABU, 0x23431B1CU, 0x2E003DC5U, 0x2AC12072U,
+	0x128E9DCFU, 0x164F8078U, 0x1B0CA6A1U, 0x1FCDBB16U, 0x018AEB13U, 0x054BF6A4U,
+	0x0808D07DU, 0x0CC9CDCAU, 0x7897AB07U, 0x7C56B6B0U, 0x71159069U, 0x75D48DDEU,
+	0x6B93DDDBU, 0x6F52C06CU, 0x6211E6B5U, 0x66D0FB02U, 0x5E9F46BFU, 0x5A5E5B08U,
+	0x571D7DD1U, 0x53DC6066U, 0x4D9B3063U, 0x495A2DD4U, 0x44190B0DU, 0x40D816BAU,
+	0xACA5C697U, 0xA864DB20U, 0xA527FDF9U, 0xA1E6E04EU, 0xBFA1B04BU, 0xBB60ADFCU,
+	0xB6238B25U, 0xB2E29692U, 0x8AAD2B2FU, 0x8E6C3698U, 0x832F1041U, 0x87EE0DF6U,
+	0x99A95DF3U, 0x9D684044U, 0x902B669DU, 0x94EA7B2AU, 0xE0B41DE7U, 0xE4750050U,
+	0xE9362689U, 0xEDF73B3EU, 0xF3B06B3BU, 0xF771768CU, 0xFA325055U, 0xFEF34DE2U,
+	0xC6BCF05FU, 0xC27DEDE8U, 0xCF3ECB31U, 0xCBFFD686U, 0xD5B88683U, 0xD1799B34U,
+	0xDC3ABDEDU, 0xD8FBA05AU, 0x690CE0EEU, 0x6DCDFD59U, 0x608EDB80U, 0x644FC637U,
+	0x7A089632U, 0x7EC98B85U, 0x738AAD5CU, 0x774BB0EBU, 0x4F040D56U, 0x4BC510E1U,
+	0x46863638U, 0x42472B8FU, 0x5C007B8AU, 0x58C1663DU, 0x558240E4U, 0x51435D53U,
+	0x251D3B9EU, 0x21DC2629U, 0x2C9F00F0U, 0x285E1D47U, 0x36194D42U, 0x32D850F5U,
+	0x3F9B762CU, 0x3B5A6B9BU, 0x0315D626U, 0x07D4CB91U, 0x0A97ED48U, 0x0E56F0FFU,
+	0x1011A0FAU, 0x14D0BD4DU, 0x19939B94U, 0x1D528623U, 0xF12F560EU, 0xF5EE4BB9U,
+	0xF8AD6D60U, 0xFC6C70D7U, 0xE22B20D2U, 0xE6EA3D65U, 0xEBA91BBCU, 0xEF68060BU,
+	0xD727BBB6U, 0xD3E6A601U, 0xDEA580D8U, 0xDA649D6FU, 0xC423CD6AU, 0xC0E2D0DDU,
+	0xCDA1F604U, 0xC960EBB3U, 0xBD3E8D7EU, 0xB9FF90C9U, 0xB4BCB610U, 0xB07DABA7U,
+	0xAE3AFBA2U, 0xAAFBE615U, 0xA7B8C0CCU, 0xA379DD7BU, 0x9B3660C6U, 0x9FF77D71U,
+	0x92B45BA8U, 0x9675461FU, 0x8832161AU, 0x8CF30BADU, 0x81B02D74U, 0x857130C3U,
+	0x5D8A9099U, 0x594B8D2EU, 0x5408ABF7U, 0x50C9B640U, 0x4E8EE645U, 0x4A4FFBF2U,
+	0x470CDD2BU, 0x43CDC09CU, 0x7B827D21U, 0x7F436096U, 0x7200464FU, 0x76C15BF8U,
+	0x68860BFDU, 0x6C47164AU, 0x61043093U, 0x65C52D24U, 0x119B4BE9U, 0x155A565EU,
+	0x18197087U, 0x1CD86D30U, 0x029F3D35U, 0x065E2082U, 0x0B1D065BU, 0x0FDC1BECU,
+	0x3793A651U, 0x3352BBE6U, 0x3E119D3FU, 0x3AD08088U, 0x2497D08DU, 0x2056CD3AU,
+	0x2D15EBE3U, 0x29D4F654U, 0xC5A92679U, 0xC1683BCEU, 0xCC2B1D17U, 0xC8EA00A0U,
+	0xD6AD50A5U, 0xD26C4D12U, 0xDF2F6BCBU, 0xDBEE767CU, 0xE3A1CBC1U, 0xE760D676U,
+	0xEA23F0AFU, 0xEEE2ED18U, 0xF0A5BD1DU, 0xF464A0AAU, 0xF9278673U, 0xFDE69BC4U,
+	0x89B8FD09U, 0x8D79E0BEU, 0x803AC667U, 0x84FBDBD0U, 0x9ABC8BD5U, 0x9E7D9662U,
+	0x933EB0BBU, 0x97FFAD0CU, 0xAFB010B1U, 0xAB710D06U, 0xA6322BDFU, 0xA2F33668U,
+	0xBCB4666DU, 0xB8757BDAU, 0xB5365D03U, 0xB1F740B4U
+};
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void crc_Feed_Words(const uint8_t *data, uint32_t wordCount);
+#ifdef BL_CRC_BENCHMARK
+static uint32_t crc_Bytes_Per_Kcycle(uint32_t length, uint32_t cycles);
+#endif
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+uint32_t BL_CRC_Calculate( const uint8_t *data, uint32_t length )
+{
+	/*	one shot with no state in RAM, so applications can call it through the service table as well	*/
+	CRC->CR = CRC_CR_RESET;
+	crc_Feed_Words(data, length / 4);
+	return BL_CRC_Software(CRC->DR, data + (length & ~3U), length & 3U);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_CRC_Begin( void )
+{
+	/*	reset data register to 0xFFFFFFFF	*/
+	CRC->CR = CRC_CR_RESET;
+	crcPendingCount = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_CRC_Update( const uint8_t *data, uint32_t length )
+{
+	/*	complete a word left over from the previous call first	*/
+	while(crcPendingCount && length)
+	{
+		crcPendingBytes[crcPendingCount++] = *data++;
+		length--;
+		if(4 == crcPendingCount)
+		{
+			crc_Feed_Words(crcPendingBytes, 1);
+			crcPendingCount = 0;
+		}
+	}
+	
+	/*	whole words go to the CRC unit	*/
+	crc_Feed_Words(data, length / 4);
+	data += length & ~3U;
+	
+	/*	keep the 0..3 remaining bytes until more data or the end of the stream	*/
+	for(uint32_t i = 0; i < (length & 3U); i++)
+	{
+		crcPendingBytes[crcPendingCount++] = data[i];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_CRC_End( void )
+{
+	/*	tail rule : trailing bytes continue the unit's CRC in software, no zero padding	*/
+	uint32_t crc = BL_CRC_Software(CRC->DR, crcPendingBytes, crcPendingCount);
+	crcPendingCount = 0;
+	return crc;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_CRC_Running( void )
+{
+	/*	CRC of everything fed so far, the stream stays open for further updates	*/
+	return BL_CRC_Software(CRC->DR, crcPendingBytes, crcPendingCount);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_CRC_Software( uint32_t crc, const uint8_t *data, uint32_t length )
+{
+	while(length--)
+	{
+		crc = (crc << 8) ^ crcTable[((crc >> 24) ^ *data++) & 0xFFU];
+	}
+	return crc;
+}
+
+#ifdef BL_CRC_BENCHMARK
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_CRC_Calculate_Words_DMA( const uint32_t *words, uint32_t wordCount, uint32_t *crc )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	
+	CRC->CR = CRC_CR_RESET;
+	while(wordCount && (HAL_OK == halStatus))
+	{
+		uint32_t chunk = (wordCount > BL_CRC_DMA_MAX_WORDS) ? BL_CRC_DMA_MAX_WORDS : wordCount;
+		halStatus = HAL_DMA_Start(&hdma_memtomem_dma2_stream0, (uint32_t)words, (uint32_t)&CRC->DR, chunk);
+		if(HAL_OK == halStatus)
+		{
+			halStatus = HAL_DMA_PollForTransfer(&hdma_memtomem_dma2_stream0, HAL_DMA_FULL_TRANSFER, BL_CRC_DMA_TIMEOUT_MS);
+		}
+		words += chunk;
+		wordCount -= chunk;
+	}
+	
+	/*	a failed or timed out stream may still be feeding the unit, stop it and hand out no CRC	*/
+	if(HAL_OK != halStatus)
+	{
+		(void)HAL_DMA_Abort(&hdma_memtomem_dma2_stream0);
+		return halStatus;
+	}
+	*crc = CRC->DR;
+	return HAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_CRC_Benchmark( const uint8_t *region, uint32_t length )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint32_t startCycles, oldCycles, newCycles, softCycles, wordCycles, dmaCycles;
+	uint32_t newCrc, softCrc, wordCrc, dmaCrc = 0;
+	const uint32_t *words = (const uint32_t *)region;
+	uint32_t word = 0;
+	
+	/*	enable the DWT cycle counter	*/
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	/*	old path : every byte widened to a word and pushed through HAL_CRC_Accumulate	*/
+	startCycles = DWT->CYCCNT;
+	for(uint32_t i = 0; i < length; i++)
+	{
+		word = (uint32_t)region[i];
+		HAL_CRC_Accumulate(&hcrc, &word, 1);
+	}
+	oldCycles = DWT->CYCCNT - startCycles;
+	__HAL_CRC_DR_RESET(&hcrc);
+	
+	startCycles = DWT->CYCCNT;
+	newCrc = BL_CRC_Calculate(region, length);
+	newCycles = DWT->CYCCNT - startCycles;
+	
+	startCycles = DWT->CYCCNT;
+	softCrc = BL_CRC_Software(BL_CRC_INITIAL_VALUE, region, length);
+	softCycles = DWT->CYCCNT - startCycles;
+	
+	/*	the DMA feeds words in memory order, the CPU doing the same is what it has to match and beat	*/
+	startCycles = DWT->CYCCNT;
+	CRC->CR = CRC_CR_RESET;
+	for(uint32_t i = 0; i < (length / 4U); i++)
+	{
+		CRC->DR = words[i];
+	}
+	wordCrc = CRC->DR;
+	wordCycles = DWT->CYCCNT - startCycles;
+	
+	startCycles = DWT->CYCCNT;
+	halStatus = BL_CRC_Calculate_Words_DMA(words, length / 4U, &dmaCrc);
+	dmaCycles = DWT->CYCCNT - startCycles;
+	
+	/*	bytes per 1000 cycles to stay in integer printf	*/
+	BL_LOG("CRC benchmark over %d bytes (bytes per 1000 cycles)\r\n", length);
+	BL_LOG("  HAL per byte : %d cycles, %d\r\n", oldCycles,  crc_Bytes_Per_Kcycle(length, oldCycles));
+	BL_LOG("  unit words   : %d cycles, %d\r\n", newCycles,  crc_Bytes_Per_Kcycle(length, newCycles));
+	BL_LOG("  software     : %d cycles, %d\r\n", softCycles, crc_Bytes_Per_Kcycle(length, softCycles));
+	BL_LOG("  CPU words    : %d cycles, %d\r\n", wordCycles, crc_Bytes_Per_Kcycle(length, wordCycles));
+	if(HAL_OK != halStatus)
+	{
+		BL_LOG("  DMA words    : HAL status %d\r\n", halStatus);
+		return halStatus;
+	}
+	BL_LOG("  DMA words    : %d cycles, %d\r\n", dmaCycles,  crc_Bytes_Per_Kcycle(length, dmaCycles));
+	
+	/*	a path that is fast but wrong is no result	*/
+	if((newCrc != softCrc) || (dmaCrc != wordCrc))
+	{
+		BL_LOG("  results differ : unit 0x%X, software 0x%X, CPU words 0x%X, DMA words 0x%X\r\n", newCrc, softCrc, wordCrc, dmaCrc);
+		return HAL_ERROR;
+	}
+	return HAL_OK;
+}
+#endif
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void crc_Feed_Words(const uint8_t *data, uint32_t wordCount)
+{
+	/*	unaligned loads are fine on Cortex-M4 ; REV turns the little-endian load into stream order	*/
+	while(wordCount--)
+	{
+		CRC->DR = __REV(__UNALIGNED_UINT32_READ(data));
+		data += 4;
+	}
+}
+
+#ifdef BL_CRC_BENCHMARK
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint32_t crc_Bytes_Per_Kcycle(uint32_t length, uint32_t cycles)
+{
+	/*	a counter that did not move (host build without CPU time charged) reports no rate rather than faulting	*/
+	return cycles ? (uint32_t)(((uint64_t)length * 1000U) / cycles) : 0U;
+}
+#endif
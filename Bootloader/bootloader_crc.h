@@ -0,0 +1,48 @@
+#ifndef  BOOTLOADER_CRC_H__
+#define	 BOOTLOADER_CRC_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <stdio.h>
+#include "crc.h"
+#include "dma.h"
+#include "bootloader_log.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	CRC-32/MPEG-2 : poly 0x04C11DB7, init 0xFFFFFFFF, no reflection, no final XOR	*/
+/*	the CRC unit takes whole 32-bit words MSB first, so bytes are fed as big-endian words	*/
+/*	and the 1..3 trailing bytes of a stream are finished in software from the unit's result	*/
+#define BL_CRC_INITIAL_VALUE				0xFFFFFFFFU
+#define BL_CRC_POLYNOMIAL						0x04C11DB7U
+
+/*	DMA2 stream feeding whole memory regions to the CRC unit	*/
+#define BL_CRC_DMA_MAX_WORDS				0xFFFFU
+#define BL_CRC_DMA_TIMEOUT_MS				100U
+
+/*	MACRO to enable the old vs new CRC throughput benchmark printed over SWO	*/
+/* #define BL_CRC_BENCHMARK */
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+uint32_t BL_CRC_Calculate( const uint8_t *data, uint32_t length );
+void BL_CRC_Begin( void );
+void BL_CRC_Update( const uint8_t *data, uint32_t length );
+uint32_t BL_CRC_End( void );
+uint32_t BL_CRC_Running( void );
+uint32_t BL_CRC_Software( uint32_t crc, const uint8_t *data, uint32_t length );
+#ifdef BL_CRC_BENCHMARK
+/*	benchmark only : neither the F407 CRC unit nor its DMA reverses bytes, so the words go in memory order and	*/
+/*	*crc is the CRC the CPU gets writing the same words to CRC->DR, BL_CRC_Calculate of their bytes only once	*/
+/*	every word is byte-swapped.  Returns the HAL status of the transfer, *crc is only written on HAL_OK				*/
+HAL_StatusTypeDef BL_CRC_Calculate_Words_DMA( const uint32_t *words, uint32_t wordCount, uint32_t *crc );
+HAL_StatusTypeDef BL_CRC_Benchmark( const uint8_t *region, uint32_t length );
+#endif
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_CRC_H__*/
@@ -0,0 +1,349 @@
+#include "bootloader_delta.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	naming conventions for parser states	*/
+#define DELTA_STATE_OPCODE					0x00
+#define DELTA_STATE_HEADER					0x01
+#define DELTA_STATE_INSERT					0x02
+#define DELTA_STATE_DONE						0x03
+
+#define DELTA_HEADER_MAX_LEN				8U
+
+static uint8_t deltaState = DELTA_STATE_OPCODE;
+static uint8_t deltaStatus = BL_DELTA_OK;
+static uint8_t deltaOpcode = 0;
+static uint8_t deltaHeader[DELTA_HEADER_MAX_LEN];
+static uint8_t deltaHeaderLength = 0;
+static uint8_t deltaHeaderCount = 0;
+static uint32_t deltaInsertRemaining = 0;
+
+static uint32_t deltaBaseAddress = 0;
+static uint32_t deltaSourceAddress = 0;
+static uint32_t deltaOldLength = 0;
+static uint32_t deltaNewEnd = 0;
+
+/*	sector being rebuilt, its old content sits in scratch while it is rewritten	*/
+static uint8_t deltaSector = BL_FLASH_SECTOR_INVALID;
+static uint32_t deltaSectorEnd = 0;
+static uint32_t deltaWriteAddress = 0;
+static uint16_t deltaRewrittenSectors = 0;
+static uint8_t deltaSectorsWritten = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t delta_Header_Length(uint8_t opcode);
+static uint8_t delta_Execute_Header(void);
+static uint8_t delta_Open_Sector(uint8_t sector);
+static uint8_t delta_Copy(uint32_t oldOffset, uint32_t length);
+static uint8_t delta_Write(const uint8_t *data, uint32_t length);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+uint8_t BL_Delta_Begin( uint32_t baseAddress, uint32_t sourceAddress, uint32_t oldLength, uint32_t newLength )
+{
+	uint32_t scratchStart = BL_Flash_Sector_Start(BL_DELTA_SCRATCH_SECTOR);
+	uint32_t newSectorsEnd = 0;
+	
+	deltaState = DELTA_STATE_OPCODE;
+	deltaStatus = BL_DELTA_ERROR;
+	deltaHeaderLength = 0;
+	deltaHeaderCount = 0;
+	deltaInsertRemaining = 0;
+	deltaSector = BL_FLASH_SECTOR_INVALID;
+	deltaSectorEnd = 0;
+	deltaWriteAddress = 0;
+	deltaRewrittenSectors = 0;
+	deltaSectorsWritten = 0;
+	
+	/*	patches work sector by sector, so both images start on a sector and stay below scratch	*/
+	if( (BL_FLASH_SECTOR_INVALID == BL_Flash_Sector_Of(baseAddress))					||
+			(BL_Flash_Sector_Start(BL_Flash_Sector_Of(baseAddress)) != baseAddress)	||
+			(baseAddress >= scratchStart)																						||
+			(newLength > scratchStart - baseAddress)																||
+			(0 == newLength) )
+	{
+		return BL_DELTA_ERROR;
+	}
+	
+	/*	the old image is read in place or from another slot, then none of it may sit in a sector being rewritten	*/
+	newSectorsEnd = BL_Flash_Sector_Start(BL_Flash_Sector_Of(baseAddress + newLength - 1)) +
+									BL_Flash_Sector_Size(BL_Flash_Sector_Of(baseAddress + newLength - 1));
+	if( (BL_FLASH_SECTOR_INVALID == BL_Flash_Sector_Of(sourceAddress))				||
+			(sourceAddress >= scratchStart)																					||
+			(oldLength > scratchStart - sourceAddress)															||
+			((sourceAddress != baseAddress)																					&&
+			 ((sourceAddress + oldLength) > baseAddress) && (sourceAddress < newSectorsEnd)) )
+	{
+		return BL_DELTA_ERROR;
+	}
+	
+	deltaBaseAddress = baseAddress;
+	deltaSourceAddress = sourceAddress;
+	deltaOldLength = oldLength;
+	deltaNewEnd = baseAddress + newLength;
+	
+	if(HAL_OK == BL_Flash_Begin())
+	{
+		deltaStatus = BL_DELTA_OK;
+	}
+	return deltaStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Delta_Apply( const uint8_t *input, uint32_t length )
+{
+	/*	input may be split anywhere, parser state carries over to the next call	*/
+	while(length && (BL_DELTA_OK == deltaStatus))
+	{
+		switch(deltaState)
+		{
+			case( DELTA_STATE_OPCODE ):
+				deltaOpcode = *input++;
+				length--;
+				deltaHeaderLength = delta_Header_Length(deltaOpcode);
+				deltaHeaderCount = 0;
+				if(BL_DELTA_OP_END == deltaOpcode)
+				{
+					deltaState = DELTA_STATE_DONE;
+				}
+				else if(0 == deltaHeaderLength)
+				{
+					deltaStatus = BL_DELTA_ERROR;
+				}
+				else
+				{
+					deltaState = DELTA_STATE_HEADER;
+				}
+				break;
+			
+			case( DELTA_STATE_HEADER ):
+				deltaHeader[deltaHeaderCount++] = *input++;
+				length--;
+				if(deltaHeaderCount == deltaHeaderLength)
+				{
+					deltaStatus = delta_Execute_Header();
+				}
+				break;
+			
+			case( DELTA_STATE_INSERT ):
+			{
+				/*	new bytes are programmed straight out of the receive slot	*/
+				uint32_t chunk = (length < deltaInsertRemaining) ? length : deltaInsertRemaining;
+				deltaStatus = delta_Write(input, chunk);
+				input += chunk;
+				length -= chunk;
+				deltaInsertRemaining -= chunk;
+				if(0 == deltaInsertRemaining)
+				{
+					deltaState = DELTA_STATE_OPCODE;
+				}
+				break;
+			}
+			
+			default:
+				/*	nothing may follow END	*/
+				deltaStatus = BL_DELTA_ERROR;
+				break;
+		}
+	}
+	
+	return deltaStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Delta_End( void )
+{
+	/*	reads after this point must see the programmed flash, not lines cached before the update	*/
+	FLASH_FlushCaches();
+	
+	if((BL_DELTA_OK != deltaStatus) || (DELTA_STATE_DONE != deltaState))
+	{
+		return BL_DELTA_ERROR;
+	}
+	return BL_DELTA_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Delta_Sectors_Written( void )
+{
+	return deltaSectorsWritten;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t delta_Header_Length(uint8_t opcode)
+{
+	switch(opcode)
+	{
+		case( BL_DELTA_OP_SECTOR ):	return 1;
+		case( BL_DELTA_OP_COPY ):		return 8;
+		case( BL_DELTA_OP_INSERT ):	return 2;
+		default:										return 0;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t delta_Execute_Header(void)
+{
+	uint8_t status = BL_DELTA_ERROR;
+	deltaState = DELTA_STATE_OPCODE;
+	
+	switch(deltaOpcode)
+	{
+		case( BL_DELTA_OP_SECTOR ):
+			status = delta_Open_Sector(deltaHeader[0]);
+			break;
+		
+		case( BL_DELTA_OP_COPY ):
+			status = delta_Copy(	(uint32_t)deltaHeader[4] | ((uint32_t)deltaHeader[5] << 8) | ((uint32_t)deltaHeader[6] << 16) | ((uint32_t)deltaHeader[7] << 24),
+														(uint32_t)deltaHeader[0] | ((uint32_t)deltaHeader[1] << 8) | ((uint32_t)deltaHeader[2] << 16) | ((uint32_t)deltaHeader[3] << 24)	);
+			break;
+		
+		case( BL_DELTA_OP_INSERT ):
+			deltaInsertRemaining = (uint32_t)deltaHeader[0] | ((uint32_t)deltaHeader[1] << 8);
+			if(0 != deltaInsertRemaining)
+			{
+				deltaState = DELTA_STATE_INSERT;
+			}
+			status = BL_DELTA_OK;
+			break;
+		
+		default:
+			break;
+	}
+	
+	return status;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t delta_Open_Sector(uint8_t sector)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint32_t sectorStart = BL_Flash_Sector_Start(sector);
+	uint32_t scratchStart = BL_Flash_Sector_Start(BL_DELTA_SCRATCH_SECTOR);
+	uint32_t oldEnd = deltaBaseAddress + deltaOldLength;
+	uint32_t oldBytes = 0;
+	
+	/*	sectors strictly ascending and inside the new image	*/
+	if( (sector >= BL_FLASH_SECTOR_COUNT)																								||
+			((BL_FLASH_SECTOR_INVALID != deltaSector) && (sector <= deltaSector))						||
+			(sectorStart < deltaBaseAddress) || (sectorStart >= deltaNewEnd) )
+	{
+		return BL_DELTA_ERROR;
+	}
+	
+	/*	keep the old content of the sector reachable for copies while it is rewritten, an image read	*/
+	/*	from another slot needs no backup																													*/
+	if((deltaSourceAddress == deltaBaseAddress) && (oldEnd > sectorStart))
+	{
+		oldBytes = oldEnd - sectorStart;
+		if(oldBytes > BL_Flash_Sector_Size(sector))
+		{
+			oldBytes = BL_Flash_Sector_Size(sector);
+		}
+	}
+	if(0 != oldBytes)
+	{
+		halStatus |= BL_Flash_Erase_Sector(BL_DELTA_SCRATCH_SECTOR);
+		halStatus |= BL_Flash_Program(scratchStart, (const uint8_t *)sectorStart, oldBytes);
+	}
+	halStatus |= BL_Flash_Erase_Sector(sector);
+	
+	deltaSector = sector;
+	deltaSectorEnd = sectorStart + BL_Flash_Sector_Size(sector);
+	deltaWriteAddress = sectorStart;
+	deltaRewrittenSectors |= (uint16_t)(1U << sector);
+	deltaSectorsWritten++;
+	
+	return (HAL_OK == halStatus) ? BL_DELTA_OK : BL_DELTA_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t delta_Copy(uint32_t oldOffset, uint32_t length)
+{
+	uint8_t status = BL_DELTA_OK;
+	
+	if((oldOffset > deltaOldLength) || (length > deltaOldLength - oldOffset))
+	{
+		return BL_DELTA_ERROR;
+	}
+	
+	/*	the old image in another slot stays intact for the whole patch	*/
+	if(deltaSourceAddress != deltaBaseAddress)
+	{
+		return delta_Write((const uint8_t *)(deltaSourceAddress + oldOffset), length);
+	}
+	
+	/*	split the copy on source sector boundaries, each piece comes from flash or from scratch	*/
+	while(length && (BL_DELTA_OK == status))
+	{
+		uint32_t sourceAddress = deltaBaseAddress + oldOffset;
+		uint8_t sourceSector = BL_Flash_Sector_Of(sourceAddress);
+		uint32_t sourceOffset = sourceAddress - BL_Flash_Sector_Start(sourceSector);
+		uint32_t chunk = BL_Flash_Sector_Size(sourceSector) - sourceOffset;
+		if(chunk > length)
+		{
+			chunk = length;
+		}
+		
+		if(sourceSector == deltaSector)
+		{
+			status = delta_Write((const uint8_t *)(BL_Flash_Sector_Start(BL_DELTA_SCRATCH_SECTOR) + sourceOffset), chunk);
+		}
+		else if(deltaRewrittenSectors & (1U << sourceSector))
+		{
+			/*	old content of that sector is gone, the host must not reference it	*/
+			status = BL_DELTA_ERROR;
+		}
+		else
+		{
+			status = delta_Write((const uint8_t *)sourceAddress, chunk);
+		}
+		
+		oldOffset += chunk;
+		length -= chunk;
+	}
+	
+	return status;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t delta_Write(const uint8_t *data, uint32_t length)
+{
+	/*	output stays inside the open sector and the new image	*/
+	if( (BL_FLASH_SECTOR_INVALID == deltaSector)	||
+			(length > deltaSectorEnd - deltaWriteAddress)	||
+			(length > deltaNewEnd - deltaWriteAddress) )
+	{
+		return BL_DELTA_ERROR;
+	}
+	
+	if(HAL_OK != BL_Flash_Program(deltaWriteAddress, data, length))
+	{
+		return BL_DELTA_ERROR;
+	}
+	deltaWriteAddress += length;
+	
+	return BL_DELTA_OK;
+}
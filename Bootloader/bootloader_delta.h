@@ -0,0 +1,46 @@
+#ifndef  BOOTLOADER_DELTA_H__
+#define	 BOOTLOADER_DELTA_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	patch stream, little endian, produced by Host/bl_delta.py :	*/
+/*	  SECTOR | sector(1)                 -> back the old sector up to scratch, erase it, write from its start	*/
+/*	  COPY   | length(4) | old offset(4) -> copy bytes of the installed image	*/
+/*	  INSERT | length(2) | data[length]  -> new bytes	*/
+/*	  END                                -> patch complete	*/
+/*	sectors come in ascending order.  Patched in place (source is the base), only changed sectors are	*/
+/*	listed and copies may read the current sector (served from scratch) or any sector not rewritten yet.	*/
+/*	Patched from another slot, every sector of the new image is listed, copies read the source freely	*/
+/*	and nothing is backed up	*/
+#define BL_DELTA_OP_SECTOR					0x01
+#define BL_DELTA_OP_COPY						0x02
+#define BL_DELTA_OP_INSERT					0x03
+#define BL_DELTA_OP_END							0x04
+
+/*	sector 10 is kept free as scratch, images handled by delta updates must end below it	*/
+/*	a slot table compaction stages its records there too (bootloader_slot.h), never during a patch	*/
+#define BL_DELTA_SCRATCH_SECTOR			10U
+
+/*	naming conventions for patch status	*/
+#define BL_DELTA_OK									0x01
+#define BL_DELTA_ERROR							0x00
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+uint8_t BL_Delta_Begin( uint32_t baseAddress, uint32_t sourceAddress, uint32_t oldLength, uint32_t newLength );
+uint8_t BL_Delta_Apply( const uint8_t *input, uint32_t length );
+uint8_t BL_Delta_End( void );
+uint8_t BL_Delta_Sectors_Written( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_DELTA_H__*/
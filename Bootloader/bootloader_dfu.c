@@ -0,0 +1,600 @@
+#include "bootloader_dfu.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	main.c, the same verified slot start the GO command uses	*/
+void jump_To_Application(void);
+
+#define DFU_LAYOUT_MAX_CHARS				96U
+#define DFU_STATUS_LEN							6U
+
+static volatile uint8_t dfuState = BL_DFU_STATE_IDLE;
+static volatile uint8_t dfuStatus = BL_DFU_STATUS_OK;
+static volatile uint8_t dfuLeave = 0;
+
+/*	DfuSe address pointer, data block n lands at dfuAddress + (n - 2) * transfer size	*/
+static uint32_t dfuAddress = BL_DFU_WRITE_START;
+
+/*	download buffers : a block is received straight into a free one, then queued for the thread as a job	*/
+/*	a job of length 0 is a sector erase, jobs run in the order they were queued									*/
+static uint8_t dfuBuffer[BL_DFU_BUFFERS][BL_DFU_TRANSFER_SIZE] __attribute__((aligned(4)));
+static volatile uint8_t dfuBufferState[BL_DFU_BUFFERS];
+static uint32_t dfuJobAddress[BL_DFU_BUFFERS];
+static uint16_t dfuJobLength[BL_DFU_BUFFERS];
+static uint32_t dfuJobMs[BL_DFU_BUFFERS];
+static volatile uint8_t dfuQueue[BL_DFU_BUFFERS];
+static volatile uint8_t dfuQueueHead = 0;
+static volatile uint8_t dfuQueueCount = 0;
+static volatile uint32_t dfuJobStartTick = 0;
+static int8_t dfuFill = -1;
+static uint16_t dfuFillBlock = 0;
+
+/*	a command waits for every queued block : set address before an upload or a leave sees the download complete	*/
+static volatile uint8_t dfuCommandSync = 0;
+
+/*	range written since the last manifestation, the slot it starts at is committed on the next one	*/
+static uint32_t dfuWriteLow = 0;
+static uint32_t dfuWriteHigh = 0;
+
+static uint8_t dfuReply[DFU_STATUS_LEN] __attribute__((aligned(4)));
+static char dfuLayout[DFU_LAYOUT_MAX_CHARS];
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t dfu_Download(uint16_t block, uint16_t length, uint8_t **data, uint16_t *dataLength);
+static uint8_t dfu_Upload(uint16_t block, uint16_t length, uint8_t **data, uint16_t *dataLength);
+static void dfu_Get_Status(void);
+static uint32_t dfu_Poll_Ms(void);
+static uint8_t dfu_Command(uint8_t buffer, uint16_t length);
+static void dfu_Queue(uint8_t buffer, uint32_t address, uint16_t length, uint32_t estimateMs);
+static uint8_t dfu_Buffer_Free(void);
+static void dfu_Error(uint8_t status);
+static uint8_t dfu_Writable(uint32_t address, uint32_t length);
+static void dfu_Manifest(void);
+static char *dfu_Put_Decimal(char *text, uint32_t value, uint8_t digits);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_DFU_Init( void )
+{
+	char *text = dfuLayout;
+	const char *name = "@Internal Flash  /0x";
+	
+	dfuState = BL_DFU_STATE_IDLE;
+	dfuStatus = BL_DFU_STATUS_OK;
+	dfuLeave = 0;
+	dfuQueueHead = 0;
+	dfuQueueCount = 0;
+	dfuFill = -1;
+	dfuWriteLow = 0xFFFFFFFFU;
+	dfuWriteHigh = 0;
+	for(uint8_t i = 0; i < BL_DFU_BUFFERS; i++)
+	{
+		dfuBufferState[i] = BL_DFU_BUFFER_FREE;
+	}
+	
+	/*	DfuSe memory layout from the sector map : runs of equal sectors, 'g' read/erase/write, 'a' read only	*/
+	while(*name)
+	{
+		*text++ = *name++;
+	}
+	for(int8_t shift = 28; shift >= 0; shift -= 4)
+	{
+		uint8_t nibble = (uint8_t)((BL_FLASH_BASE >> shift) & 0x0FU);
+		*text++ = (char)((nibble < 10U) ? (uint32_t)('0' + nibble) : (uint32_t)('A' + nibble - 10U));
+	}
+	*text++ = '/';
+	for(uint8_t sector = 0; sector < BL_FLASH_SECTOR_COUNT; )
+	{
+		uint32_t size = BL_Flash_Sector_Size(sector);
+		uint8_t writable = dfu_Writable(BL_Flash_Sector_Start(sector), size);
+		uint8_t count = 1;
+	
+		while(((sector + count) < BL_FLASH_SECTOR_COUNT) && (size == BL_Flash_Sector_Size(sector + count)) &&
+					(writable == dfu_Writable(BL_Flash_Sector_Start(sector + count), size)))
+		{
+			count++;
+		}
+		if(sector)
+		{
+			*text++ = ',';
+		}
+		text = dfu_Put_Decimal(text, count, 2);
+		*text++ = '*';
+		text = dfu_Put_Decimal(text, size / 1024U, 3);
+		*text++ = 'K';
+		*text++ = writable ? 'g' : 'a';
+		sector += count;
+	}
+	*text = '\0';
+	
+	BL_Transport_Set_Background(BL_DFU_Process);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const char *BL_DFU_Layout( void )
+{
+	return dfuLayout;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_DFU_Process( void )
+{
+	/*	thread context, while the frame layer waits : erase and program here, the interrupt keeps the USB side going	*/
+	while(dfuQueueCount)
+	{
+		uint8_t buffer = dfuQueue[dfuQueueHead];
+		HAL_StatusTypeDef halStatus;
+	
+		__disable_irq();
+		dfuBufferState[buffer] = BL_DFU_BUFFER_BUSY;
+		dfuJobStartTick = HAL_GetTick();
+		__enable_irq();
+	
+		halStatus = BL_Flash_Begin();
+		if(dfuJobLength[buffer])
+		{
+			halStatus |= BL_Flash_Program(dfuJobAddress[buffer], dfuBuffer[buffer], dfuJobLength[buffer]);
+		}
+		else
+		{
+			halStatus |= BL_Flash_Erase_Sector(BL_Flash_Sector_Of(dfuJobAddress[buffer]));
+		}
+		halStatus |= BL_Flash_End();
+	
+		__disable_irq();
+		if(HAL_OK != halStatus)
+		{
+			dfu_Error(dfuJobLength[buffer] ? BL_DFU_STATUS_ERR_PROG : BL_DFU_STATUS_ERR_ERASE);
+		}
+		dfuBufferState[buffer] = BL_DFU_BUFFER_FREE;
+		dfuQueueHead = (dfuQueueHead + 1U) % BL_DFU_BUFFERS;
+		dfuQueueCount--;
+		__enable_irq();
+	}
+	
+	if(dfuLeave)
+	{
+		dfuLeave = 0;
+		dfu_Manifest();
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC uint8_t BL_DFU_Setup( const uint8_t *setup, uint8_t **data, uint16_t *length )
+{
+	/*	GETSTATUS is what the host sends while a sector is erased : this path stays in SRAM1	*/
+	uint16_t value = (uint16_t)(setup[2] | (setup[3] << 8));
+	uint16_t requested = (uint16_t)(setup[6] | (setup[7] << 8));
+	uint8_t reply = BL_DFU_REPLY_STALL;
+	
+	/*	a block whose data stage never completed : the host gave up on it	*/
+	if(dfuFill >= 0)
+	{
+		dfuBufferState[dfuFill] = BL_DFU_BUFFER_FREE;
+		dfuFill = -1;
+	}
+	
+	switch(setup[1])
+	{
+		case BL_DFU_REQ_DNLOAD:
+			reply = dfu_Download(value, requested, data, length);
+			break;
+	
+		case BL_DFU_REQ_UPLOAD:
+			reply = dfu_Upload(value, requested, data, length);
+			break;
+	
+		case BL_DFU_REQ_GETSTATUS:
+			dfu_Get_Status();
+			*data = dfuReply;
+			*length = DFU_STATUS_LEN;
+			reply = BL_DFU_REPLY_IN;
+			break;
+	
+		case BL_DFU_REQ_CLRSTATUS:
+			if(BL_DFU_STATE_ERROR == dfuState)
+			{
+				dfuState = BL_DFU_STATE_IDLE;
+				dfuStatus = BL_DFU_STATUS_OK;
+				reply = BL_DFU_REPLY_STATUS;
+			}
+			break;
+	
+		case BL_DFU_REQ_GETSTATE:
+			dfuReply[0] = dfuState;
+			*data = dfuReply;
+			*length = 1;
+			reply = BL_DFU_REPLY_IN;
+			break;
+	
+		case BL_DFU_REQ_ABORT:
+			/*	blocks already queued are still programmed, the host saw them accepted	*/
+			if((BL_DFU_STATE_MANIFEST != dfuState) && (BL_DFU_STATE_MANIFEST_SYNC != dfuState))
+			{
+				dfuState = BL_DFU_STATE_IDLE;
+				reply = BL_DFU_REPLY_STATUS;
+			}
+			break;
+	
+		default:
+			/*	DETACH : already in DFU mode	*/
+			break;
+	}
+	
+	if(BL_DFU_REPLY_STALL == reply)
+	{
+		dfu_Error(BL_DFU_STATUS_ERR_STALLEDPKT);
+	}
+	return reply;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_DFU_Data_Out( uint16_t length )
+{
+	/*	a download block is in, from the USB interrupt : check it and queue it, errors show at the next GETSTATUS	*/
+	uint8_t buffer = (uint8_t)dfuFill;
+	uint8_t status = BL_DFU_STATUS_OK;
+	
+	if(dfuFill < 0)
+	{
+		return;
+	}
+	dfuFill = -1;
+	dfuState = BL_DFU_STATE_DNLOAD_SYNC;
+	
+	if(0U == dfuFillBlock)
+	{
+		status = dfu_Command(buffer, length);
+	}
+	else if(1U == dfuFillBlock)
+	{
+		status = BL_DFU_STATUS_ERR_STALLEDPKT;
+	}
+	else
+	{
+		uint32_t address = dfuAddress + (uint32_t)(dfuFillBlock - 2U) * BL_DFU_TRANSFER_SIZE;
+	
+		if(!dfu_Writable(address, length))
+		{
+			status = BL_DFU_STATUS_ERR_ADDRESS;
+		}
+		else
+		{
+			dfuWriteLow = (address < dfuWriteLow) ? address : dfuWriteLow;
+			dfuWriteHigh = ((address + length) > dfuWriteHigh) ? (address + length) : dfuWriteHigh;
+			dfu_Queue(buffer, address, length, BL_DFU_PROGRAM_MS);
+		}
+	}
+	
+	if(BL_DFU_STATUS_OK != status)
+	{
+		dfuBufferState[buffer] = BL_DFU_BUFFER_FREE;
+		dfu_Error(status);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void BL_DFU_Request_Done( void )
+{
+	/*	the host has the MANIFEST status : safe to go, the thread commits the download and starts it	*/
+	if(BL_DFU_STATE_MANIFEST == dfuState)
+	{
+		dfuLeave = 1;
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t dfu_Download(uint16_t block, uint16_t length, uint8_t **data, uint16_t *dataLength)
+{
+	int8_t buffer = -1;
+	
+	if((BL_DFU_STATE_IDLE != dfuState) && (BL_DFU_STATE_DNLOAD_IDLE != dfuState))
+	{
+		return BL_DFU_REPLY_STALL;
+	}
+	
+	/*	zero length ends the download : manifestation, which on this device is a slot commit and a start	*/
+	if(0U == length)
+	{
+		if(BL_DFU_STATE_DNLOAD_IDLE != dfuState)
+		{
+			return BL_DFU_REPLY_STALL;
+		}
+		dfuState = BL_DFU_STATE_MANIFEST_SYNC;
+		return BL_DFU_REPLY_STATUS;
+	}
+	
+	for(uint8_t i = 0; (i < BL_DFU_BUFFERS) && (buffer < 0); i++)
+	{
+		if(BL_DFU_BUFFER_FREE == dfuBufferState[i])
+		{
+			buffer = (int8_t)i;
+		}
+	}
+	
+	/*	DNLOAD_IDLE was only reported with a buffer free, a host that did not wait gets a stall	*/
+	if((length > BL_DFU_TRANSFER_SIZE) || (buffer < 0))
+	{
+		return BL_DFU_REPLY_STALL;
+	}
+	
+	dfuBufferState[buffer] = BL_DFU_BUFFER_FILLING;
+	dfuFill = buffer;
+	dfuFillBlock = block;
+	*data = dfuBuffer[buffer];
+	*dataLength = length;
+	return BL_DFU_REPLY_OUT;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t dfu_Upload(uint16_t block, uint16_t length, uint8_t **data, uint16_t *dataLength)
+{
+	uint32_t flashEnd = BL_Flash_Sector_Start(BL_FLASH_SECTOR_COUNT - 1U) + BL_Flash_Sector_Size(BL_FLASH_SECTOR_COUNT - 1U);
+	uint32_t address;
+	
+	if(((BL_DFU_STATE_IDLE != dfuState) && (BL_DFU_STATE_UPLOAD_IDLE != dfuState)) || (0U == length))
+	{
+		return BL_DFU_REPLY_STALL;
+	}
+	
+	/*	block 0 lists the DfuSe commands, flash is read in place from block 2 on	*/
+	if(0U == block)
+	{
+		dfuReply[0] = BL_DFU_CMD_GET_COMMANDS;
+		dfuReply[1] = BL_DFU_CMD_SET_ADDRESS;
+		dfuReply[2] = BL_DFU_CMD_ERASE;
+		*data = dfuReply;
+		*dataLength = 3;
+		dfuState = BL_DFU_STATE_UPLOAD_IDLE;
+		return BL_DFU_REPLY_IN;
+	}
+	
+	address = dfuAddress + (uint32_t)(block - 2U) * length;
+	if((block < 2U) || dfuQueueCount || (address < BL_FLASH_BASE) || (address >= flashEnd))
+	{
+		return BL_DFU_REPLY_STALL;
+	}
+	
+	/*	a short block ends the upload	*/
+	*data = (uint8_t *)address;
+	*dataLength = ((flashEnd - address) < length) ? (uint16_t)(flashEnd - address) : length;
+	dfuState = (*dataLength < length) ? BL_DFU_STATE_IDLE : BL_DFU_STATE_UPLOAD_IDLE;
+	return BL_DFU_REPLY_IN;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void dfu_Get_Status(void)
+{
+	uint32_t pollMs = 0;
+	
+	/*	a block is done for the host as soon as a buffer is free for the next one, a command once the queue is empty	*/
+	if((BL_DFU_STATE_DNLOAD_SYNC == dfuState) || (BL_DFU_STATE_DNBUSY == dfuState))
+	{
+		if(dfuCommandSync ? (0U == dfuQueueCount) : dfu_Buffer_Free())
+		{
+			dfuCommandSync = 0;
+			dfuState = BL_DFU_STATE_DNLOAD_IDLE;
+		}
+		else
+		{
+			dfuState = BL_DFU_STATE_DNBUSY;
+			pollMs = dfu_Poll_Ms();
+		}
+	}
+	else if(BL_DFU_STATE_MANIFEST_SYNC == dfuState)
+	{
+		dfuState = BL_DFU_STATE_MANIFEST;
+		pollMs = dfu_Poll_Ms();
+	}
+	
+	dfuReply[0] = dfuStatus;
+	dfuReply[1] = (uint8_t)pollMs;
+	dfuReply[2] = (uint8_t)(pollMs >> 8);
+	dfuReply[3] = (uint8_t)(pollMs >> 16);
+	dfuReply[4] = dfuState;
+	dfuReply[5] = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static uint32_t dfu_Poll_Ms(void)
+{
+	/*	time left on the running job, plus every job behind it when the host has to wait for all of them	*/
+	uint32_t pollMs = 0;
+	
+	for(uint8_t i = 0; i < dfuQueueCount; i++)
+	{
+		uint8_t buffer = dfuQueue[(dfuQueueHead + i) % BL_DFU_BUFFERS];
+		uint32_t estimateMs = dfuJobMs[buffer];
+	
+		if(BL_DFU_BUFFER_BUSY == dfuBufferState[buffer])
+		{
+			uint32_t elapsed = HAL_GetTick() - dfuJobStartTick;
+			estimateMs = (elapsed < estimateMs) ? (estimateMs - elapsed) : 1U;
+		}
+		pollMs += estimateMs;
+		if(!dfuCommandSync && (BL_DFU_STATE_MANIFEST != dfuState))
+		{
+			break;
+		}
+	}
+	return pollMs;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t dfu_Command(uint8_t buffer, uint16_t length)
+{
+	const uint8_t *command = dfuBuffer[buffer];
+	uint32_t address = (uint32_t)command[1] | ((uint32_t)command[2] << 8) | ((uint32_t)command[3] << 16) | ((uint32_t)command[4] << 24);
+	uint8_t sector;
+	
+	dfuCommandSync = 1;
+	
+	if((BL_DFU_CMD_SET_ADDRESS == command[0]) && (5U == length))
+	{
+		dfuAddress = address;
+		dfuBufferState[buffer] = BL_DFU_BUFFER_FREE;
+		return BL_DFU_STATUS_OK;
+	}
+	
+	/*	page erase of a writable sector only, mass erase (no address) and read unprotect are refused	*/
+	if((BL_DFU_CMD_ERASE == command[0]) && (5U == length))
+	{
+		sector = BL_Flash_Sector_Of(address);
+		if((BL_FLASH_SECTOR_INVALID == sector) || !dfu_Writable(BL_Flash_Sector_Start(sector), BL_Flash_Sector_Size(sector)))
+		{
+			return BL_DFU_STATUS_ERR_TARGET;
+		}
+		dfu_Queue(buffer, BL_Flash_Sector_Start(sector), 0,
+							(BL_Flash_Sector_Size(sector) > 0x10000U) ? BL_DFU_ERASE_128K_MS :
+							((BL_Flash_Sector_Size(sector) > 0x4000U) ? BL_DFU_ERASE_64K_MS : BL_DFU_ERASE_16K_MS));
+		return BL_DFU_STATUS_OK;
+	}
+	
+	return ((BL_DFU_CMD_ERASE == command[0]) || (BL_DFU_CMD_READ_UNPROTECT == command[0])) ? BL_DFU_STATUS_ERR_TARGET : BL_DFU_STATUS_ERR_STALLEDPKT;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void dfu_Queue(uint8_t buffer, uint32_t address, uint16_t length, uint32_t estimateMs)
+{
+	dfuJobAddress[buffer] = address;
+	dfuJobLength[buffer] = length;
+	dfuJobMs[buffer] = estimateMs;
+	dfuBufferState[buffer] = BL_DFU_BUFFER_QUEUED;
+	dfuQueue[(dfuQueueHead + dfuQueueCount) % BL_DFU_BUFFERS] = buffer;
+	dfuQueueCount++;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static uint8_t dfu_Buffer_Free(void)
+{
+	for(uint8_t i = 0; i < BL_DFU_BUFFERS; i++)
+	{
+		if(BL_DFU_BUFFER_FREE == dfuBufferState[i])
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void dfu_Error(uint8_t status)
+{
+	/*	the first error is the one reported, CLRSTATUS goes back to idle	*/
+	if(BL_DFU_STATE_ERROR != dfuState)
+	{
+		dfuStatus = status;
+	}
+	dfuState = BL_DFU_STATE_ERROR;
+	dfuCommandSync = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t dfu_Writable(uint32_t address, uint32_t length)
+{
+	return (address >= BL_DFU_WRITE_START) && (address < BL_DFU_WRITE_END) && (length <= (BL_DFU_WRITE_END - address));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void dfu_Manifest(void)
+{
+	uint8_t slot = BL_SLOT_NONE;
+	uint32_t writeLow = dfuWriteLow;
+	uint32_t writeHigh = dfuWriteHigh;
+	
+	/*	the next download starts its own range, this one is committed from the copy	*/
+	dfuWriteLow = 0xFFFFFFFFU;
+	dfuWriteHigh = 0;
+	
+	/*	a download that starts at a slot is committed as that slot's new image, with the manifest's	*/
+	/*	length and version when it carries one (secure boot requires it), written length otherwise		*/
+	for(uint8_t i = 0; i < BL_SLOT_COUNT; i++)
+	{
+		if((writeLow == BL_SLOT_ADDRESS(i)) && (writeHigh <= (BL_SLOT_ADDRESS(i) + BL_SLOT_LENGTH(i))))
+		{
+			slot = i;
+		}
+	}
+	
+	if(BL_SLOT_NONE != slot)
+	{
+		const BL_ManifestTypeDef *manifest = (const BL_ManifestTypeDef *)BL_MANIFEST_ADDRESS(slot);
+		uint32_t version = 0;
+		uint32_t length = writeHigh - writeLow;
+	
+		if((BL_MANIFEST_MAGIC == manifest->magic) && (manifest->length <= BL_MANIFEST_IMAGE_LIMIT(slot)))
+		{
+			version = manifest->version;
+			length = manifest->length;
+		}
+	
+		if(BL_SLOT_OK != BL_Slot_Activate(slot, version, length, BL_CRC_Calculate((const uint8_t *)BL_SLOT_ADDRESS(slot), length)))
+		{
+			dfu_Error(BL_DFU_STATUS_ERR_FIRMWARE);
+			return;
+		}
+	}
+	
+	/*	DfuSe leave : the verified slot path rather than a jump to whatever address the host named	*/
+	jump_To_Application();
+	
+	/*	only back when no slot holds a bootable image	*/
+	dfu_Error(BL_DFU_STATUS_ERR_FIRMWARE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static char *dfu_Put_Decimal(char *text, uint32_t value, uint8_t digits)
+{
+	for(uint8_t i = digits; i > 0U; i--)
+	{
+		text[i - 1U] = (char)('0' + (value % 10U));
+		value /= 10U;
+	}
+	return text + digits;
+}
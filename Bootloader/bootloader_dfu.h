@@ -0,0 +1,102 @@
+#ifndef  BOOTLOADER_DFU_H__
+#define	 BOOTLOADER_DFU_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+#include "bootloader_crc.h"
+#include "bootloader_slot.h"
+#include "bootloader_manifest.h"
+#include "bootloader_transport.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	DFU 1.1 with the ST DfuSe extensions, interface 2 of the USB device next to the CDC port : dfu-util finds it	*/
+/*	as alt 0 "Internal Flash", e.g.  dfu-util -a 0 -s 0x08008000:leave -D app.bin										*/
+/*	the alt setting string is the sector map, the bootloader, scratch and slot table sectors are read only			*/
+#define BL_DFU_INTERFACE						2U
+#define BL_DFU_STRING_INDEX					4U
+#define BL_DFU_VERSION							0x011AU
+#define BL_DFU_DETACH_TIMEOUT_MS		255U
+
+/*	one download block, two of them : the host sends the next block while the previous one is programmed	*/
+#define BL_DFU_TRANSFER_SIZE				2048U
+#define BL_DFU_BUFFERS							2U
+
+/*	flash the host may erase and write : both slots, nothing of the bootloader or its scratch and table sectors	*/
+#define BL_DFU_WRITE_START					BL_SLOT_A_ADDRESS
+#define BL_DFU_WRITE_END						(BL_SLOT_B_ADDRESS + BL_SLOT_B_LENGTH)
+
+/*	poll timeouts reported while busy, datasheet typical at x32 : 16 us a word, sector erase by size	*/
+#define BL_DFU_PROGRAM_MS						9U
+#define BL_DFU_ERASE_16K_MS					250U
+#define BL_DFU_ERASE_64K_MS					550U
+#define BL_DFU_ERASE_128K_MS				1000U
+
+/*	DFU class requests	*/
+#define BL_DFU_REQ_DETACH						0x00U
+#define BL_DFU_REQ_DNLOAD						0x01U
+#define BL_DFU_REQ_UPLOAD						0x02U
+#define BL_DFU_REQ_GETSTATUS				0x03U
+#define BL_DFU_REQ_CLRSTATUS				0x04U
+#define BL_DFU_REQ_GETSTATE					0x05U
+#define BL_DFU_REQ_ABORT						0x06U
+
+/*	DfuSe commands, sent as a download to block 0	*/
+#define BL_DFU_CMD_GET_COMMANDS			0x00U
+#define BL_DFU_CMD_SET_ADDRESS			0x21U
+#define BL_DFU_CMD_ERASE						0x41U
+#define BL_DFU_CMD_READ_UNPROTECT		0x92U
+
+/*	device states	*/
+#define BL_DFU_STATE_IDLE						2U
+#define BL_DFU_STATE_DNLOAD_SYNC		3U
+#define BL_DFU_STATE_DNBUSY					4U
+#define BL_DFU_STATE_DNLOAD_IDLE		5U
+#define BL_DFU_STATE_MANIFEST_SYNC	6U
+#define BL_DFU_STATE_MANIFEST				7U
+#define BL_DFU_STATE_UPLOAD_IDLE		9U
+#define BL_DFU_STATE_ERROR					10U
+
+/*	status codes	*/
+#define BL_DFU_STATUS_OK						0x00U
+#define BL_DFU_STATUS_ERR_TARGET		0x01U
+#define BL_DFU_STATUS_ERR_WRITE			0x03U
+#define BL_DFU_STATUS_ERR_ERASE			0x04U
+#define BL_DFU_STATUS_ERR_PROG			0x06U
+#define BL_DFU_STATUS_ERR_ADDRESS		0x08U
+#define BL_DFU_STATUS_ERR_NOTDONE		0x09U
+#define BL_DFU_STATUS_ERR_FIRMWARE	0x0AU
+#define BL_DFU_STATUS_ERR_STALLEDPKT	0x0FU
+
+/*	how a request goes on after BL_DFU_Setup	*/
+#define BL_DFU_REPLY_STALL					0x00
+#define BL_DFU_REPLY_STATUS					0x01
+#define BL_DFU_REPLY_IN							0x02
+#define BL_DFU_REPLY_OUT						0x03
+
+/*	naming conventions for download buffer states	*/
+#define BL_DFU_BUFFER_FREE					0x00
+#define BL_DFU_BUFFER_FILLING				0x01
+#define BL_DFU_BUFFER_QUEUED				0x02
+#define BL_DFU_BUFFER_BUSY					0x03
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_DFU_Init( void );
+const char *BL_DFU_Layout( void );
+void BL_DFU_Process( void );
+
+/*	control requests to the DFU interface, from the USB interrupt	*/
+uint8_t BL_DFU_Setup( const uint8_t *setup, uint8_t **data, uint16_t *length );
+void BL_DFU_Data_Out( uint16_t length );
+void BL_DFU_Request_Done( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_DFU_H__*/
@@ -0,0 +1,639 @@
+#include "bootloader_ed25519.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	field elements mod 2^255 - 19 as sixteen 16-bit limbs held in 64-bit words, products fold with 38 = 2 * 19	*/
+typedef int64_t fieldElement[16];
+
+/*	curve constants : d, 2d, base point (X, Y) and sqrt(-1)	*/
+static const fieldElement fe0 = { 0 };
+static const fieldElement fe1 = { 1 };
+static const fieldElement feD = {	0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+																	0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203	};
+static const fieldElement feD2 = {	0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+																	0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406	};
+static const fieldElement feX = {	0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+																	0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169	};
+static const fieldElement feY = {	0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+																	0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666	};
+static const fieldElement feI = {	0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+																	0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83	};
+
+/*	group order L, little-endian	*/
+static const uint8_t groupOrder[32] = {	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+																				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10	};
+
+static const uint64_t sha512K[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t sha512Initial[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+/*	point temporaries are kept off the stack, the bootloader verifies one signature at a time	*/
+static fieldElement pointA[4], pointB[4];
+static fieldElement addTemp[9];
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void fe_Copy(fieldElement r, const fieldElement a);
+static void fe_Carry(fieldElement o);
+static void fe_Select(fieldElement p, fieldElement q, int64_t b);
+static void fe_Pack(uint8_t o[32], const fieldElement n);
+static uint8_t fe_Not_Equal(const fieldElement a, const fieldElement b);
+static uint8_t fe_Parity(const fieldElement a);
+static void fe_Unpack(fieldElement o, const uint8_t n[32]);
+static void fe_Add(fieldElement o, const fieldElement a, const fieldElement b);
+static void fe_Sub(fieldElement o, const fieldElement a, const fieldElement b);
+static void fe_Mul(fieldElement o, const fieldElement a, const fieldElement b);
+static void fe_Square(fieldElement o, const fieldElement a);
+static void fe_Invert(fieldElement o, const fieldElement i);
+static void fe_Pow2523(fieldElement o, const fieldElement i);
+static void point_Add(fieldElement p[4], fieldElement q[4]);
+static void point_Swap(fieldElement p[4], fieldElement q[4], uint8_t b);
+static void point_Pack(uint8_t r[32], fieldElement p[4]);
+static void point_Scalar_Mult(fieldElement p[4], fieldElement q[4], const uint8_t *s);
+static uint8_t point_Unpack_Negative(fieldElement r[4], const uint8_t p[32]);
+static void scalar_Reduce(uint8_t r[64]);
+static uint8_t scalar_Is_Canonical(const uint8_t s[32]);
+static void sha512_Compress(uint64_t state[8], const uint8_t *block);
+static void sha512_Signed_Message(uint8_t digest[64], const uint8_t *r, const uint8_t *publicKey, const uint8_t *message, uint32_t length);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+uint8_t BL_Ed25519_Verify( const uint8_t signature[BL_ED25519_SIGNATURE_LEN], const uint8_t *message, uint32_t length,
+													 const uint8_t publicKey[BL_ED25519_PUBLIC_KEY_LEN] )
+{
+	uint8_t h[64];
+	uint8_t checkR[32];
+	
+	/*	S must be fully reduced, otherwise one signature has several valid encodings	*/
+	if(!scalar_Is_Canonical(&signature[32]))
+	{
+		return BL_ED25519_ERROR;
+	}
+	
+	/*	-A from the public key, a key that is not on the curve fails here	*/
+	if(!point_Unpack_Negative(pointB, publicKey))
+	{
+		return BL_ED25519_ERROR;
+	}
+	
+	/*	h = SHA-512(R || A || M) mod L	*/
+	sha512_Signed_Message(h, signature, publicKey, message, length);
+	scalar_Reduce(h);
+	
+	/*	R' = [h](-A) + [S]B must encode to the R of the signature	*/
+	point_Scalar_Mult(pointA, pointB, h);
+	fe_Copy(pointB[0], feX);
+	fe_Copy(pointB[1], feY);
+	fe_Copy(pointB[2], fe1);
+	fe_Mul(pointB[3], feX, feY);
+	{
+		static fieldElement baseResult[4];
+		point_Scalar_Mult(baseResult, pointB, &signature[32]);
+		point_Add(pointA, baseResult);
+	}
+	point_Pack(checkR, pointA);
+	
+	return (0 == memcmp(checkR, signature, 32)) ? BL_ED25519_OK : BL_ED25519_ERROR;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void fe_Copy(fieldElement r, const fieldElement a)
+{
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		r[i] = a[i];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Carry(fieldElement o)
+{
+	int64_t c;
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[i] += ((int64_t)1 << 16);
+		c = o[i] >> 16;
+		if(i < 15U)
+		{
+			o[i + 1U] += c - 1;
+		}
+		else
+		{
+			o[0] += 38 * (c - 1);
+		}
+		o[i] -= c << 16;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Select(fieldElement p, fieldElement q, int64_t b)
+{
+	int64_t t, c = ~(b - 1);
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		t = c & (p[i] ^ q[i]);
+		p[i] ^= t;
+		q[i] ^= t;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Pack(uint8_t o[32], const fieldElement n)
+{
+	int64_t b;
+	fieldElement m, t;
+	
+	fe_Copy(t, n);
+	fe_Carry(t);
+	fe_Carry(t);
+	fe_Carry(t);
+	
+	/*	subtract p twice if needed so the encoding is canonical	*/
+	for(uint32_t j = 0; j < 2U; j++)
+	{
+		m[0] = t[0] - 0xffed;
+		for(uint32_t i = 1; i < 15U; i++)
+		{
+			m[i] = t[i] - 0xffff - ((m[i - 1U] >> 16) & 1);
+			m[i - 1U] &= 0xffff;
+		}
+		m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+		b = (m[15] >> 16) & 1;
+		m[14] &= 0xffff;
+		fe_Select(t, m, 1 - b);
+	}
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[2U * i] = (uint8_t)(t[i] & 0xff);
+		o[(2U * i) + 1U] = (uint8_t)(t[i] >> 8);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t fe_Not_Equal(const fieldElement a, const fieldElement b)
+{
+	uint8_t c[32], d[32];
+	fe_Pack(c, a);
+	fe_Pack(d, b);
+	return (0 != memcmp(c, d, 32)) ? 1U : 0U;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t fe_Parity(const fieldElement a)
+{
+	uint8_t d[32];
+	fe_Pack(d, a);
+	return d[0] & 1U;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Unpack(fieldElement o, const uint8_t n[32])
+{
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[i] = n[2U * i] + ((int64_t)n[(2U * i) + 1U] << 8);
+	}
+	o[15] &= 0x7fff;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Add(fieldElement o, const fieldElement a, const fieldElement b)
+{
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[i] = a[i] + b[i];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Sub(fieldElement o, const fieldElement a, const fieldElement b)
+{
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[i] = a[i] - b[i];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Mul(fieldElement o, const fieldElement a, const fieldElement b)
+{
+	int64_t t[31];
+	
+	memset(t, 0, sizeof(t));
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		for(uint32_t j = 0; j < 16U; j++)
+		{
+			t[i + j] += a[i] * b[j];
+		}
+	}
+	
+	/*	2^256 = 38 mod p : fold the upper half back in	*/
+	for(uint32_t i = 0; i < 15U; i++)
+	{
+		t[i] += 38 * t[i + 16U];
+	}
+	for(uint32_t i = 0; i < 16U; i++)
+	{
+		o[i] = t[i];
+	}
+	fe_Carry(o);
+	fe_Carry(o);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Square(fieldElement o, const fieldElement a)
+{
+	fe_Mul(o, a, a);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Invert(fieldElement o, const fieldElement i)
+{
+	/*	i^(p - 2)	*/
+	fieldElement c;
+	fe_Copy(c, i);
+	for(int32_t a = 253; a >= 0; a--)
+	{
+		fe_Square(c, c);
+		if((2 != a) && (4 != a))
+		{
+			fe_Mul(c, c, i);
+		}
+	}
+	fe_Copy(o, c);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void fe_Pow2523(fieldElement o, const fieldElement i)
+{
+	/*	i^((p - 5) / 8), the square root candidate	*/
+	fieldElement c;
+	fe_Copy(c, i);
+	for(int32_t a = 250; a >= 0; a--)
+	{
+		fe_Square(c, c);
+		if(1 != a)
+		{
+			fe_Mul(c, c, i);
+		}
+	}
+	fe_Copy(o, c);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void point_Add(fieldElement p[4], fieldElement q[4])
+{
+	/*	extended twisted Edwards coordinates (X : Y : Z : T), p += q	*/
+	fieldElement *a = &addTemp[0], *b = &addTemp[1], *c = &addTemp[2], *d = &addTemp[3], *t = &addTemp[4];
+	fieldElement *e = &addTemp[5], *f = &addTemp[6], *g = &addTemp[7], *h = &addTemp[8];
+	
+	fe_Sub(*a, p[1], p[0]);
+	fe_Sub(*t, q[1], q[0]);
+	fe_Mul(*a, *a, *t);
+	fe_Add(*b, p[0], p[1]);
+	fe_Add(*t, q[0], q[1]);
+	fe_Mul(*b, *b, *t);
+	fe_Mul(*c, p[3], q[3]);
+	fe_Mul(*c, *c, feD2);
+	fe_Mul(*d, p[2], q[2]);
+	fe_Add(*d, *d, *d);
+	fe_Sub(*e, *b, *a);
+	fe_Sub(*f, *d, *c);
+	fe_Add(*g, *d, *c);
+	fe_Add(*h, *b, *a);
+	
+	fe_Mul(p[0], *e, *f);
+	fe_Mul(p[1], *h, *g);
+	fe_Mul(p[2], *g, *f);
+	fe_Mul(p[3], *e, *h);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void point_Swap(fieldElement p[4], fieldElement q[4], uint8_t b)
+{
+	for(uint32_t i = 0; i < 4U; i++)
+	{
+		fe_Select(p[i], q[i], b);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void point_Pack(uint8_t r[32], fieldElement p[4])
+{
+	fieldElement tx, ty, zi;
+	
+	fe_Invert(zi, p[2]);
+	fe_Mul(tx, p[0], zi);
+	fe_Mul(ty, p[1], zi);
+	fe_Pack(r, ty);
+	r[31] ^= (uint8_t)(fe_Parity(tx) << 7);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void point_Scalar_Mult(fieldElement p[4], fieldElement q[4], const uint8_t *s)
+{
+	/*	p = [s]q, q is used as scratch	*/
+	fe_Copy(p[0], fe0);
+	fe_Copy(p[1], fe1);
+	fe_Copy(p[2], fe1);
+	fe_Copy(p[3], fe0);
+	for(int32_t i = 255; i >= 0; i--)
+	{
+		uint8_t b = (s[i / 8] >> (i & 7)) & 1U;
+		point_Swap(p, q, b);
+		point_Add(q, p);
+		point_Add(p, p);
+		point_Swap(p, q, b);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t point_Unpack_Negative(fieldElement r[4], const uint8_t p[32])
+{
+	static fieldElement t, chk, num, den, den2, den4, den6;
+	
+	/*	recover x from y : x^2 = (y^2 - 1) / (d y^2 + 1)	*/
+	fe_Copy(r[2], fe1);
+	fe_Unpack(r[1], p);
+	fe_Square(num, r[1]);
+	fe_Mul(den, num, feD);
+	fe_Sub(num, num, r[2]);
+	fe_Add(den, r[2], den);
+	
+	fe_Square(den2, den);
+	fe_Square(den4, den2);
+	fe_Mul(den6, den4, den2);
+	fe_Mul(t, den6, num);
+	fe_Mul(t, t, den);
+	
+	fe_Pow2523(t, t);
+	fe_Mul(t, t, num);
+	fe_Mul(t, t, den);
+	fe_Mul(t, t, den);
+	fe_Mul(r[0], t, den);
+	
+	fe_Square(chk, r[0]);
+	fe_Mul(chk, chk, den);
+	if(fe_Not_Equal(chk, num))
+	{
+		fe_Mul(r[0], r[0], feI);
+	}
+	
+	fe_Square(chk, r[0]);
+	fe_Mul(chk, chk, den);
+	if(fe_Not_Equal(chk, num))
+	{
+		return 0;
+	}
+	
+	/*	pick the root with the opposite sign bit : this is -A	*/
+	if(fe_Parity(r[0]) == (p[31] >> 7))
+	{
+		fe_Sub(r[0], fe0, r[0]);
+	}
+	fe_Mul(r[3], r[0], r[1]);
+	return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void scalar_Reduce(uint8_t r[64])
+{
+	/*	512-bit little-endian value mod L, result in r[0..31]	*/
+	int64_t carry, x[64];
+	int32_t i, j;
+	
+	for(i = 0; i < 64; i++)
+	{
+		x[i] = (int64_t)r[i];
+	}
+	for(i = 63; i >= 32; i--)
+	{
+		carry = 0;
+		for(j = i - 32; j < i - 12; j++)
+		{
+			x[j] += carry - 16 * x[i] * groupOrder[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+	carry = 0;
+	for(j = 0; j < 32; j++)
+	{
+		x[j] += carry - (x[31] >> 4) * groupOrder[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for(j = 0; j < 32; j++)
+	{
+		x[j] -= carry * groupOrder[j];
+	}
+	for(i = 0; i < 32; i++)
+	{
+		x[i + 1] += x[i] >> 8;
+		r[i] = (uint8_t)(x[i] & 255);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t scalar_Is_Canonical(const uint8_t s[32])
+{
+	for(int32_t i = 31; i >= 0; i--)
+	{
+		if(s[i] != groupOrder[i])
+		{
+			return (s[i] < groupOrder[i]) ? 1U : 0U;
+		}
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+#define SHA512_ROTR(x, n)						(((x) >> (n)) | ((x) << (64U - (n))))
+#define SHA512_LOAD_BE64(p)					(((uint64_t)SHA512_LOAD_BE32(p) << 32) | (uint64_t)SHA512_LOAD_BE32((p) + 4))
+#define SHA512_LOAD_BE32(p)					(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+static void sha512_Compress(uint64_t state[8], const uint8_t *block)
+{
+	uint64_t w[16], v[8], t1, t2;
+	
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		v[i] = state[i];
+	}
+	for(uint32_t i = 0; i < 80U; i++)
+	{
+		if(i < 16U)
+		{
+			w[i] = SHA512_LOAD_BE64(&block[8U * i]);
+		}
+		else
+		{
+			uint64_t s0 = w[(i - 15U) & 15U], s1 = w[(i - 2U) & 15U];
+			w[i & 15U] += (SHA512_ROTR(s1, 19) ^ SHA512_ROTR(s1, 61) ^ (s1 >> 6)) + w[(i - 7U) & 15U] +
+										(SHA512_ROTR(s0, 1) ^ SHA512_ROTR(s0, 8) ^ (s0 >> 7));
+		}
+		t1 = v[7] + (SHA512_ROTR(v[4], 14) ^ SHA512_ROTR(v[4], 18) ^ SHA512_ROTR(v[4], 41)) +
+				 (v[6] ^ (v[4] & (v[5] ^ v[6]))) + sha512K[i] + w[i & 15U];
+		t2 = (SHA512_ROTR(v[0], 28) ^ SHA512_ROTR(v[0], 34) ^ SHA512_ROTR(v[0], 39)) +
+				 ((v[0] & v[1]) | (v[2] & (v[0] | v[1])));
+		v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = v[3] + t1;
+		v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = t1 + t2;
+	}
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		state[i] += v[i];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void sha512_Signed_Message(uint8_t digest[64], const uint8_t *r, const uint8_t *publicKey, const uint8_t *message, uint32_t length)
+{
+	/*	SHA-512 over R || A || M without building the concatenation	*/
+	uint64_t state[8];
+	uint8_t block[128];
+	uint32_t used = 64;
+	uint64_t totalLength = 64U + (uint64_t)length;
+	
+	memcpy(state, sha512Initial, sizeof(state));
+	memcpy(block, r, 32);
+	memcpy(&block[32], publicKey, 32);
+	
+	while(length)
+	{
+		uint32_t fill = 128U - used;
+		if(fill > length)
+		{
+			fill = length;
+		}
+		memcpy(&block[used], message, fill);
+		used += fill;
+		message += fill;
+		length -= fill;
+		if(128U == used)
+		{
+			sha512_Compress(state, block);
+			used = 0;
+		}
+	}
+	
+	/*	padding : 0x80, zeros up to 112 mod 128, then the 128-bit bit length	*/
+	block[used++] = 0x80U;
+	if(used > 112U)
+	{
+		memset(&block[used], 0, 128U - used);
+		sha512_Compress(state, block);
+		used = 0;
+	}
+	memset(&block[used], 0, 128U - used);
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		block[127U - i] = (uint8_t)((totalLength * 8U) >> (8U * i));
+	}
+	block[119] = (uint8_t)(totalLength >> 61);
+	sha512_Compress(state, block);
+	
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		for(uint32_t j = 0; j < 8U; j++)
+		{
+			digest[(8U * i) + j] = (uint8_t)(state[i] >> (56U - (8U * j)));
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef  BOOTLOADER_ED25519_H__
+#define	 BOOTLOADER_ED25519_H__
+
+/* Includes ------------------------------------------------------------------*/
+#ifndef BL_HOST_BUILD
+#include "stm32f4xx.h"
+#endif
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Macro Declarations---------------------------------------------------------*/
+
+#define BL_ED25519_PUBLIC_KEY_LEN		32U
+#define BL_ED25519_SIGNATURE_LEN		64U
+
+/*	naming conventions for signature status	*/
+#define BL_ED25519_OK								0x01
+#define BL_ED25519_ERROR						0x00
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+/*	verification only : no secret is ever on target, so nothing here has to run in constant time	*/
+uint8_t BL_Ed25519_Verify( const uint8_t signature[BL_ED25519_SIGNATURE_LEN], const uint8_t *message, uint32_t length,
+													 const uint8_t publicKey[BL_ED25519_PUBLIC_KEY_LEN] );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_ED25519_H__*/
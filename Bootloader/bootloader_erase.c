@@ -0,0 +1,181 @@
+#include "bootloader_erase.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+#define ERASE_SECTOR_BIT(sector)		((uint16_t)(1U << (sector)))
+
+/*	sectors the session still has to erase and the one the controller is erasing in the background	*/
+static uint16_t erasePending = 0;
+static volatile uint8_t eraseBusySector = BL_FLASH_SECTOR_INVALID;
+static volatile uint8_t eraseFailed = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t erase_Wait(void);
+static uint8_t erase_Overlaps(uint8_t sector, uint32_t address, uint32_t length);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Erase_Plan( uint32_t baseAddress, uint32_t length )
+{
+	uint8_t firstSector = BL_Flash_Sector_Of(baseAddress);
+	uint8_t lastSector = BL_Flash_Sector_Of(baseAddress + length - 1U);
+	
+	(void)erase_Wait();
+	erasePending = 0;
+	eraseFailed = 0;
+	
+	/*	every sector the image touches is erased once, in address order, before its first byte is programmed	*/
+	/*	sectors that are already blank are left alone, an erase cycle there would only cost time and endurance	*/
+	if(length && (BL_FLASH_SECTOR_INVALID != firstSector) && (BL_FLASH_SECTOR_INVALID != lastSector))
+	{
+		for(uint8_t sector = firstSector; sector <= lastSector; sector++)
+		{
+			if(!BL_Flash_Sector_Is_Blank(sector))
+			{
+				erasePending |= ERASE_SECTOR_BIT(sector);
+			}
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Erase_Ready( uint32_t address, uint32_t length )
+{
+	/*	erase lagging behind the data : finish it here, the caller holds the host off until then	*/
+	if(BL_ERASE_OK != erase_Wait())
+	{
+		return BL_ERASE_ERROR;
+	}
+	
+	for(uint8_t sector = 0; (sector < BL_FLASH_SECTOR_COUNT) && erasePending; sector++)
+	{
+		if((erasePending & ERASE_SECTOR_BIT(sector)) && erase_Overlaps(sector, address, length))
+		{
+			if((HAL_OK != BL_Flash_Begin()) || (HAL_OK != BL_Flash_Erase_Sector(sector)))
+			{
+				eraseFailed = 1;
+				return BL_ERASE_ERROR;
+			}
+			erasePending &= (uint16_t)~ERASE_SECTOR_BIT(sector);
+		}
+	}
+	
+	return BL_ERASE_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Erase_Start_Next( void )
+{
+	FLASH_EraseInitTypeDef eraseConfig;
+	uint8_t sector = 0;
+	
+	if(eraseFailed || (BL_FLASH_SECTOR_INVALID != eraseBusySector))
+	{
+		return eraseFailed ? BL_ERASE_ERROR : BL_ERASE_OK;
+	}
+	while((sector < BL_FLASH_SECTOR_COUNT) && !(erasePending & ERASE_SECTOR_BIT(sector)))
+	{
+		sector++;
+	}
+	if(sector >= BL_FLASH_SECTOR_COUNT)
+	{
+		return BL_ERASE_OK;
+	}
+	
+	eraseConfig.TypeErase = FLASH_TYPEERASE_SECTORS;
+	eraseConfig.Banks = FLASH_BANK_1;
+	eraseConfig.Sector = sector;
+	eraseConfig.NbSectors = 1;
+	eraseConfig.VoltageRange = BL_FLASH_VOLTAGE_RANGE;
+	
+	/*	the end of operation interrupt clears eraseBusySector, the session stays unlocked until then	*/
+	if(HAL_OK != BL_Flash_Begin())
+	{
+		return BL_ERASE_ERROR;
+	}
+	erasePending &= (uint16_t)~ERASE_SECTOR_BIT(sector);
+	eraseBusySector = sector;
+	if(HAL_OK != HAL_FLASHEx_Erase_IT(&eraseConfig))
+	{
+		eraseBusySector = BL_FLASH_SECTOR_INVALID;
+		erasePending |= ERASE_SECTOR_BIT(sector);
+		return BL_ERASE_ERROR;
+	}
+	
+	/*	started : HAL_FLASH_EndOfOperationCallback (or the error callback) ends it from the flash interrupt,	*/
+	/*	BL_Erase_Ready waits for that before anything is programmed. The caller stalls on its next flash fetch	*/
+	/*	until then, the RX DMA keeps filling the ring, which is why the window has to fit it					*/
+	return BL_ERASE_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Erase_Finish( void )
+{
+	/*	an aborted session leaves the rest of its sectors as they were	*/
+	uint8_t eraseStatus = erase_Wait();
+	erasePending = 0;
+	return eraseStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+	/*	one sector per request : HAL reports 0xFFFFFFFF once it is done	*/
+	(void)ReturnValue;
+	eraseBusySector = BL_FLASH_SECTOR_INVALID;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+	(void)ReturnValue;
+	eraseFailed = 1;
+	eraseBusySector = BL_FLASH_SECTOR_INVALID;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+BL_RAM_FUNC static uint8_t erase_Wait(void)
+{
+	uint32_t startTick = HAL_GetTick();
+	
+	/*	runs from SRAM1 and SysTick with it, so the timeout is wall time even while the controller is busy	*/
+	while(BL_FLASH_SECTOR_INVALID != eraseBusySector)
+	{
+		if((HAL_GetTick() - startTick) > BL_ERASE_TIMEOUT_MS)
+		{
+			eraseFailed = 1;
+			return BL_ERASE_ERROR;
+		}
+		__WFI();
+	}
+	
+	return eraseFailed ? BL_ERASE_ERROR : BL_ERASE_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t erase_Overlaps(uint8_t sector, uint32_t address, uint32_t length)
+{
+	uint32_t sectorStart = BL_Flash_Sector_Start(sector);
+	uint32_t sectorEnd = sectorStart + BL_Flash_Sector_Size(sector);
+	
+	return length && (address < sectorEnd) && ((address + length) > sectorStart);
+}
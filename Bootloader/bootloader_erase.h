@@ -0,0 +1,34 @@
+#ifndef  BOOTLOADER_ERASE_H__
+#define	 BOOTLOADER_ERASE_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	a 128K sector takes 1-2 s to erase (4 s worst case at x8), anything longer is treated as a failure	*/
+#define BL_ERASE_TIMEOUT_MS					5000U
+
+/*	naming conventions for erase status	*/
+#define BL_ERASE_OK									0x01
+#define BL_ERASE_ERROR							0x00
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+/*	single bank part : any flash fetch stalls while an erase runs, the RX DMA keeps taking in what the host	*/
+/*	sends. BL_Erase_Start_Next only starts the next sector, the end of operation interrupt marks it done,	*/
+/*	erase_Wait (BL_RAM_FUNC) holds programming off until then with the RX interrupts running				*/
+void BL_Erase_Plan( uint32_t baseAddress, uint32_t length );
+uint8_t BL_Erase_Ready( uint32_t address, uint32_t length );
+uint8_t BL_Erase_Start_Next( void );
+uint8_t BL_Erase_Finish( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_ERASE_H__*/
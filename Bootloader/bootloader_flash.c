@@ -0,0 +1,329 @@
+#include "bootloader_flash.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static uint8_t flashSessionOpen = 0;
+
+/*	8-byte aligned so x64 programming can read double words straight out of it	*/
+static uint64_t flashStaging[BL_FLASH_STAGING_LEN / 8];
+
+/*	SRAM1 copy of the vector table, VTOR points here once BL_Flash_Init has run	*/
+static uint32_t flashRamVectors[BL_FLASH_VECTOR_COUNT] __attribute__((aligned(BL_FLASH_VECTOR_ALIGN)));
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint32_t flash_Max_Parallelism(void);
+static HAL_StatusTypeDef flash_Wait_Not_Busy(void);
+static HAL_StatusTypeDef flash_Program_Unit(uint32_t address, const uint8_t *source, uint32_t unit);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Flash_Init( void )
+{
+	/*	the handlers and the HAL paths they run are placed in SRAM1 by the scatter file, only the table	*/
+	/*	still pointed at flash : copy the bootloader's own table from the start of flash and switch to it	*/
+	const uint32_t *flashVectors = (const uint32_t *)BL_FLASH_BASE;
+	
+	for(uint32_t i = 0; i < BL_FLASH_VECTOR_COUNT; i++)
+	{
+		flashRamVectors[i] = flashVectors[i];
+	}
+	SCB->VTOR = (uint32_t)flashRamVectors;
+	__DSB();
+	__ISB();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_Flash_Begin( void )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	
+	if(!flashSessionOpen)
+	{
+		halStatus |= HAL_FLASH_Unlock();
+		halStatus |= flash_Wait_Not_Busy();
+		__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | BL_FLASH_ERROR_FLAGS);
+		flashSessionOpen = (HAL_OK == halStatus);
+	}
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_Flash_Program( uint32_t address, const uint8_t *data, uint32_t length )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint32_t parallelism = flash_Max_Parallelism();
+	
+	if(!flashSessionOpen)
+	{
+		return HAL_ERROR;
+	}
+	
+	while(length && (HAL_OK == halStatus))
+	{
+		uint32_t chunk = (length > BL_FLASH_STAGING_LEN) ? BL_FLASH_STAGING_LEN : length;
+		const uint8_t *staged = (const uint8_t *)flashStaging;
+		uint32_t offset = 0;
+		
+		memcpy(flashStaging, data, chunk);
+		
+		while((offset < chunk) && (HAL_OK == halStatus))
+		{
+			/*	widest unit the voltage range allows, narrowed for unaligned heads and short tails	*/
+			uint32_t unit = parallelism;
+			while((unit > 1) && (((address + offset) & (unit - 1)) || ((chunk - offset) < unit)))
+			{
+				unit >>= 1;
+			}
+			halStatus |= flash_Program_Unit(address + offset, staged + offset, unit);
+			offset += unit;
+		}
+		
+		address += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+	
+	/*	leave PG cleared between frames, the session itself stays unlocked	*/
+	CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+	BL_Bench_Stamp(BL_BENCH_STAGE_FLASH);
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_Flash_End( void )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	
+	if(flashSessionOpen)
+	{
+		halStatus |= flash_Wait_Not_Busy();
+		CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+		halStatus |= HAL_FLASH_Lock();
+		flashSessionOpen = 0;
+	}
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Flash_Is_Open( void )
+{
+	return flashSessionOpen;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC HAL_StatusTypeDef BL_Flash_Erase_Sector( uint8_t sector )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	FLASH_EraseInitTypeDef eraseConfig;
+	uint32_t sectorError = 0;
+	
+	if(!flashSessionOpen || (sector >= BL_FLASH_SECTOR_COUNT))
+	{
+		return HAL_ERROR;
+	}
+	
+	eraseConfig.TypeErase = FLASH_TYPEERASE_SECTORS;
+	eraseConfig.Sector = sector;
+	eraseConfig.NbSectors = 1;
+	eraseConfig.VoltageRange = BL_FLASH_VOLTAGE_RANGE;
+	
+	/*	HAL flushes the ART caches after the erase, so stale lines of the old sector are not read back	*/
+	/*	HAL_FLASHEx_Erase waits for the controller from SRAM1 as well, interrupts are taken meanwhile	*/
+	halStatus |= HAL_FLASHEx_Erase(&eraseConfig, &sectorError);
+	BL_Bench_Stamp(BL_BENCH_STAGE_FLASH);
+	if(0xFFFFFFFFU != sectorError)
+	{
+		halStatus |= HAL_ERROR;
+	}
+	
+	return halStatus;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Flash_Sector_Of( uint32_t address )
+{
+	for(uint8_t sector = 0; sector < BL_FLASH_SECTOR_COUNT; sector++)
+	{
+		if((address >= BL_Flash_Sector_Start(sector)) && (address - BL_Flash_Sector_Start(sector) < BL_Flash_Sector_Size(sector)))
+		{
+			return sector;
+		}
+	}
+	return BL_FLASH_SECTOR_INVALID;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_Flash_Sector_Start( uint8_t sector )
+{
+	if(sector < 4)
+	{
+		return BL_FLASH_BASE + (sector * 0x4000U);
+	}
+	else if(sector == 4)
+	{
+		return BL_FLASH_BASE + 0x10000U;
+	}
+	else
+	{
+		return BL_FLASH_BASE + 0x20000U + ((sector - 5) * 0x20000U);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_Flash_Sector_Size( uint8_t sector )
+{
+	if(sector < 4)
+	{
+		return 0x4000U;
+	}
+	else if(sector == 4)
+	{
+		return 0x10000U;
+	}
+	else if(sector < BL_FLASH_SECTOR_COUNT)
+	{
+		return 0x20000U;
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Flash_Sector_Is_Blank( uint8_t sector )
+{
+	const uint32_t *word = (const uint32_t *)BL_Flash_Sector_Start(sector);
+	const uint32_t *sectorEnd = word + (BL_Flash_Sector_Size(sector) / 4U);
+	
+	if(sector >= BL_FLASH_SECTOR_COUNT)
+	{
+		return 0;
+	}
+	
+	/*	stops at the first programmed word, so only a blank sector is read to the end	*/
+	while((word < sectorEnd) && (0xFFFFFFFFU == *word))
+	{
+		word++;
+	}
+	return (word == sectorEnd);
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint32_t flash_Max_Parallelism(void)
+{
+	switch(BL_FLASH_VOLTAGE_RANGE)
+	{
+		case( FLASH_VOLTAGE_RANGE_1 ):	return 1;
+		case( FLASH_VOLTAGE_RANGE_2 ):	return 2;
+		case( FLASH_VOLTAGE_RANGE_4 ):	return 8;
+		default:												return 4;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static HAL_StatusTypeDef flash_Wait_Not_Busy(void)
+{
+	/*	poll BSY directly instead of going through FLASH_WaitForLastOperation, from RAM like HAL_GetTick	*/
+	uint32_t startTick = HAL_GetTick();
+	
+	while(FLASH->SR & FLASH_SR_BSY)
+	{
+		if((HAL_GetTick() - startTick) > BL_FLASH_TIMEOUT_MS)
+		{
+			return HAL_TIMEOUT;
+		}
+	}
+	
+	if(FLASH->SR & BL_FLASH_ERROR_FLAGS)
+	{
+		__HAL_FLASH_CLEAR_FLAG(BL_FLASH_ERROR_FLAGS);
+		return HAL_ERROR;
+	}
+	
+	return HAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static HAL_StatusTypeDef flash_Program_Unit(uint32_t address, const uint8_t *source, uint32_t unit)
+{
+	uint8_t unitDiffers = 0;
+	
+	/*	skip units that already hold the data, e.g. 0xFF padding on erased flash	*/
+	/*	programming can only clear bits, anything else needs an erase first	*/
+	/*	one byte loop for both checks, a library memcmp would be fetched from flash	*/
+	for(uint32_t i = 0; i < unit; i++)
+	{
+		uint8_t cell = ((const uint8_t *)address)[i];
+		if((cell & source[i]) != source[i])
+		{
+			return HAL_ERROR;
+		}
+		unitDiffers |= (uint8_t)(cell ^ source[i]);
+	}
+	if(!unitDiffers)
+	{
+		return HAL_OK;
+	}
+	
+	/*	PSIZE 0..3 selects x8, x16, x32, x64	*/
+	MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE, ((unit == 8) ? FLASH_PSIZE_DOUBLE_WORD :
+																				 (unit == 4) ? FLASH_PSIZE_WORD				 :
+																				 (unit == 2) ? FLASH_PSIZE_HALF_WORD	 : FLASH_PSIZE_BYTE));
+	SET_BIT(FLASH->CR, FLASH_CR_PG);
+	
+	switch(unit)
+	{
+		case( 8 ):
+			*(__IO uint32_t *)address = *(const uint32_t *)source;
+			/*	both halves of the double word must reach the controller in order	*/
+			__ISB();
+			*(__IO uint32_t *)(address + 4) = *(const uint32_t *)(source + 4);
+			break;
+		case( 4 ):
+			*(__IO uint32_t *)address = *(const uint32_t *)source;
+			break;
+		case( 2 ):
+			*(__IO uint16_t *)address = *(const uint16_t *)source;
+			break;
+		default:
+			*(__IO uint8_t *)address = *source;
+			break;
+	}
+	
+	return flash_Wait_Not_Busy();
+}
@@ -0,0 +1,57 @@
+#ifndef  BOOTLOADER_FLASH_H__
+#define	 BOOTLOADER_FLASH_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_bench.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	supply range of the board, it decides the program parallelism (RM0090 table 6)	*/
+/*	FLASH_VOLTAGE_RANGE_1 : x8, RANGE_2 : x16, RANGE_3 : x32, RANGE_4 (external VPP) : x64	*/
+#define BL_FLASH_VOLTAGE_RANGE			FLASH_VOLTAGE_RANGE_3
+
+/*	data is copied into an aligned staging buffer before programming	*/
+#define BL_FLASH_STAGING_LEN				256U
+
+/*	max time for one program operation before giving up (datasheet max is ~100 us)	*/
+#define BL_FLASH_TIMEOUT_MS					5U
+
+/*	STM32F407 single bank : sectors 0-3 are 16K, sector 4 is 64K, sectors 5-11 are 128K	*/
+#define BL_FLASH_BASE								0x08000000U
+#define BL_FLASH_SECTOR_COUNT				12U
+#define BL_FLASH_SECTOR_INVALID			0xFFU
+
+#define BL_FLASH_ERROR_FLAGS				(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+/*	code that runs while the controller programs or erases : any flash fetch stalls the bus until it is done	*/
+/*	PractiseBL.sct copies the .ramfunc section to SRAM1 at startup, CCM on the F407 holds data only	*/
+/*	noinline keeps a flash-resident caller from pulling a copy back into flash	*/
+#define BL_RAM_FUNC									__attribute__((section(".ramfunc"), noinline))
+
+/*	vector table copied to SRAM1 so interrupts are still taken during an erase : 16 core and 82 F407 vectors,	*/
+/*	VTOR wants the table aligned to the next power of two of its size	*/
+#define BL_FLASH_VECTOR_COUNT				98U
+#define BL_FLASH_VECTOR_ALIGN				512U
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Flash_Init( void );
+HAL_StatusTypeDef BL_Flash_Begin( void );
+HAL_StatusTypeDef BL_Flash_Program( uint32_t address, const uint8_t *data, uint32_t length );
+HAL_StatusTypeDef BL_Flash_End( void );
+uint8_t BL_Flash_Is_Open( void );
+HAL_StatusTypeDef BL_Flash_Erase_Sector( uint8_t sector );
+uint8_t BL_Flash_Sector_Of( uint32_t address );
+uint32_t BL_Flash_Sector_Start( uint8_t sector );
+uint32_t BL_Flash_Sector_Size( uint8_t sector );
+uint8_t BL_Flash_Sector_Is_Blank( uint8_t sector );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_FLASH_H__*/
@@ -0,0 +1,271 @@
+#include "bootloader_journal.h"
+#include "bootloader_slot.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+#define JOURNAL_HEADER_LEN					sizeof(BL_JournalHeaderTypeDef)
+#define JOURNAL_HEADER_CRC_LEN			(JOURNAL_HEADER_LEN - 4U)
+#define JOURNAL_MARK_LEN						sizeof(BL_JournalMarkTypeDef)
+#define JOURNAL_BLANK_WORD					0xFFFFFFFFU
+#define JOURNAL_END									(BL_JOURNAL_ADDRESS + BL_JOURNAL_LENGTH)
+
+/*	latest session, its first mark, the offset of its last mark and the first blank word, rebuilt by BL_Journal_Init	*/
+static BL_JournalHeaderTypeDef journalHeader;
+static uint32_t journalFirstMark = BL_JOURNAL_ADDRESS;
+static uint32_t journalRecorded = 0;
+static uint32_t journalNext = BL_JOURNAL_ADDRESS;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t journal_Header_Is_Valid(const BL_JournalHeaderTypeDef *header);
+static uint32_t journal_Verified_Offset(void);
+static uint8_t journal_Start(uint32_t sessionId, uint32_t baseAddress, uint32_t length, uint32_t imageCrc, uint32_t verifiedOffset);
+static uint8_t journal_Append_Mark(uint32_t fromOffset, uint32_t toOffset);
+static uint8_t journal_Append(const void *entry, uint32_t length);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Journal_Init( void )
+{
+	uint32_t address = BL_JOURNAL_ADDRESS;
+	
+	memset(&journalHeader, 0, sizeof(journalHeader));
+	journalFirstMark = BL_JOURNAL_ADDRESS;
+	journalRecorded = 0;
+	
+	/*	headers and marks are appended in order, the first blank word ends the journal	*/
+	/*	a torn header fails its CRC and leaves no session, a torn mark is caught when the marks are verified	*/
+	while((address + JOURNAL_MARK_LEN <= JOURNAL_END) && (JOURNAL_BLANK_WORD != *((const uint32_t *)address)))
+	{
+		if((BL_JOURNAL_HEADER_MAGIC == *((const uint32_t *)address)) && (address + JOURNAL_HEADER_LEN <= JOURNAL_END))
+		{
+			const BL_JournalHeaderTypeDef *header = (const BL_JournalHeaderTypeDef *)address;
+			if(journal_Header_Is_Valid(header))
+			{
+				journalHeader = *header;
+			}
+			else
+			{
+				journalHeader.magic = 0;
+			}
+			journalRecorded = 0;
+			address += JOURNAL_HEADER_LEN;
+			journalFirstMark = address;
+		}
+		else
+		{
+			const BL_JournalMarkTypeDef *mark = (const BL_JournalMarkTypeDef *)address;
+			if((BL_JOURNAL_HEADER_MAGIC == journalHeader.magic) && (mark->offset > journalRecorded) && (mark->offset <= journalHeader.length))
+			{
+				journalRecorded = mark->offset;
+			}
+			address += JOURNAL_MARK_LEN;
+		}
+	}
+	journalNext = address;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Journal_Open( uint32_t sessionId, uint32_t baseAddress, uint32_t length, uint32_t imageCrc, uint32_t *resumeOffset )
+{
+	uint32_t verifiedOffset = 0;
+	
+	*resumeOffset = 0;
+	
+	/*	same session : resume after the part that still checks out in flash	*/
+	/*	the marks cover the image end to end, so a complete chain needs no second pass over the whole image	*/
+	if( (BL_JOURNAL_HEADER_MAGIC == journalHeader.magic)																			&&
+			(sessionId == journalHeader.sessionId) && (baseAddress == journalHeader.baseAddress)	&&
+			(length == journalHeader.length) && (imageCrc == journalHeader.imageCrc) )
+	{
+		verifiedOffset = journal_Verified_Offset();
+	
+		/*	every mark still holds : carry on appending to the same chain	*/
+		if(verifiedOffset == journalRecorded)
+		{
+			*resumeOffset = verifiedOffset;
+			return BL_JOURNAL_OK;
+		}
+	}
+	
+	/*	new session, or flash no longer holds what the marks claim : a fresh header starts a new chain	*/
+	if(BL_JOURNAL_OK != journal_Start(sessionId, baseAddress, length, imageCrc, verifiedOffset))
+	{
+		return BL_JOURNAL_ERROR;
+	}
+	*resumeOffset = verifiedOffset;
+	return BL_JOURNAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Journal_Progress( uint32_t offset )
+{
+	/*	only forward progress inside the open session is recorded	*/
+	if( (BL_JOURNAL_HEADER_MAGIC != journalHeader.magic)	||
+			(offset <= journalRecorded) || (offset > journalHeader.length) )
+	{
+		return BL_JOURNAL_OK;
+	}
+	
+	return journal_Append_Mark(journalRecorded, offset);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Journal_Query( BL_JournalHeaderTypeDef *header, uint32_t *verifiedOffset )
+{
+	*header = journalHeader;
+	*verifiedOffset = 0;
+	
+	if(BL_JOURNAL_HEADER_MAGIC != journalHeader.magic)
+	{
+		return BL_JOURNAL_STATE_NONE;
+	}
+	
+	*verifiedOffset = journal_Verified_Offset();
+	if(*verifiedOffset == journalHeader.length)
+	{
+		return BL_JOURNAL_STATE_COMPLETE;
+	}
+	return BL_JOURNAL_STATE_PARTIAL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Journal_Restore( const BL_JournalHeaderTypeDef *header, uint32_t recorded )
+{
+	/*	the sector was just erased : write the session back as its header and one mark for all of its progress	*/
+	/*	the caller saved both before the erase (BL_Journal_Query), the RAM copy may be from before a reset		*/
+	BL_Journal_Init();
+	if(!journal_Header_Is_Valid(header) || (recorded > header->length))
+	{
+		return BL_JOURNAL_OK;
+	}
+	if(BL_JOURNAL_OK != journal_Append(header, JOURNAL_HEADER_LEN))
+	{
+		return BL_JOURNAL_ERROR;
+	}
+	journalHeader = *header;
+	journalFirstMark = journalNext;
+	
+	return recorded ? journal_Append_Mark(0, recorded) : BL_JOURNAL_OK;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t journal_Header_Is_Valid(const BL_JournalHeaderTypeDef *header)
+{
+	return	(BL_JOURNAL_HEADER_MAGIC == header->magic)	&&
+					(header->headerCrc == BL_CRC_Calculate((const uint8_t *)header, JOURNAL_HEADER_CRC_LEN));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint32_t journal_Verified_Offset(void)
+{
+	const BL_JournalMarkTypeDef *mark = (const BL_JournalMarkTypeDef *)journalFirstMark;
+	const BL_JournalMarkTypeDef *markEnd = (const BL_JournalMarkTypeDef *)journalNext;
+	uint32_t verifiedOffset = 0;
+	
+	/*	walk the chain from the image start, each segment is checked against flash as it is now	*/
+	/*	so a torn mark, or anything rewritten since by another command, ends the verified part	*/
+	while(mark < markEnd)
+	{
+		if( (mark->offset <= verifiedOffset) || (mark->offset > journalHeader.length)	||
+				(mark->segmentCrc != BL_CRC_Calculate((const uint8_t *)(journalHeader.baseAddress + verifiedOffset), mark->offset - verifiedOffset)) )
+		{
+			break;
+		}
+		verifiedOffset = mark->offset;
+		mark++;
+	}
+	return verifiedOffset;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t journal_Start(uint32_t sessionId, uint32_t baseAddress, uint32_t length, uint32_t imageCrc, uint32_t verifiedOffset)
+{
+	BL_JournalHeaderTypeDef header;
+	
+	memset(&header, 0xFF, sizeof(header));
+	header.magic = BL_JOURNAL_HEADER_MAGIC;
+	header.sessionId = sessionId;
+	header.baseAddress = baseAddress;
+	header.length = length;
+	header.imageCrc = imageCrc;
+	header.headerCrc = BL_CRC_Calculate((const uint8_t *)&header, JOURNAL_HEADER_CRC_LEN);
+	
+	/*	the old session is dropped first, a compaction on the way has nothing of it to write back	*/
+	journalHeader.magic = 0;
+	journalRecorded = 0;
+	if(BL_JOURNAL_OK != journal_Append(&header, JOURNAL_HEADER_LEN))
+	{
+		return BL_JOURNAL_ERROR;
+	}
+	journalHeader = header;
+	journalFirstMark = journalNext;
+	
+	return verifiedOffset ? journal_Append_Mark(0, verifiedOffset) : BL_JOURNAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t journal_Append_Mark(uint32_t fromOffset, uint32_t toOffset)
+{
+	BL_JournalMarkTypeDef mark;
+	
+	mark.offset = toOffset;
+	mark.segmentCrc = BL_CRC_Calculate((const uint8_t *)(journalHeader.baseAddress + fromOffset), toOffset - fromOffset);
+	
+	if(BL_JOURNAL_OK != journal_Append(&mark, JOURNAL_MARK_LEN))
+	{
+		return BL_JOURNAL_ERROR;
+	}
+	journalRecorded = toOffset;
+	return BL_JOURNAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t journal_Append(const void *entry, uint32_t length)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint8_t flashWasOpen = BL_Flash_Is_Open();
+	
+	/*	journal full : the slot table compaction erases the sector and calls BL_Journal_Restore	*/
+	if((journalNext + length > JOURNAL_END) && ((BL_SLOT_OK != BL_Slot_Compact()) || (journalNext + length > JOURNAL_END)))
+	{
+		return BL_JOURNAL_ERROR;
+	}
+	
+	/*	word writes into blank flash, no erase per entry	*/
+	halStatus |= BL_Flash_Begin();
+	halStatus |= BL_Flash_Program(journalNext, (const uint8_t *)entry, length);
+	if(!flashWasOpen)
+	{
+		halStatus |= BL_Flash_End();
+	}
+	FLASH_FlushCaches();
+	
+	journalNext += length;
+	
+	return (HAL_OK == halStatus) ? BL_JOURNAL_OK : BL_JOURNAL_ERROR;
+}
@@ -0,0 +1,60 @@
+#ifndef  BOOTLOADER_JOURNAL_H__
+#define	 BOOTLOADER_JOURNAL_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+#include "bootloader_crc.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	update journal : the last 16K of the slot table sector, below it the slot records	*/
+/*	entries are only ever appended, the sector is erased together with the slot table when either runs full	*/
+#define BL_JOURNAL_ADDRESS					0x080FC000U
+#define BL_JOURNAL_LENGTH						0x00004000U
+#define BL_JOURNAL_HEADER_MAGIC			0x4C4E524AU
+
+/*	naming conventions for journal status	*/
+#define BL_JOURNAL_OK								0x01
+#define BL_JOURNAL_ERROR						0x00
+
+/*	naming conventions for journal states, as reported to the host	*/
+#define BL_JOURNAL_STATE_NONE				0x00
+#define BL_JOURNAL_STATE_PARTIAL		0x01
+#define BL_JOURNAL_STATE_COMPLETE		0x02
+
+/*	opens a session, every mark after it belongs to that session until the next header	*/
+typedef struct{
+	uint32_t magic;
+	uint32_t sessionId;
+	uint32_t baseAddress;
+	uint32_t length;
+	uint32_t imageCrc;
+	uint32_t reserved0;
+	uint32_t reserved1;
+	uint32_t headerCrc;
+}BL_JournalHeaderTypeDef;
+
+/*	progress : the image is written and verified up to offset, segmentCrc covers it from the previous mark	*/
+/*	two word writes per mark, a mark torn by a reset fails its CRC and ends the verified part there	*/
+typedef struct{
+	uint32_t offset;
+	uint32_t segmentCrc;
+}BL_JournalMarkTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Journal_Init( void );
+uint8_t BL_Journal_Open( uint32_t sessionId, uint32_t baseAddress, uint32_t length, uint32_t imageCrc, uint32_t *resumeOffset );
+uint8_t BL_Journal_Progress( uint32_t offset );
+uint8_t BL_Journal_Query( BL_JournalHeaderTypeDef *header, uint32_t *verifiedOffset );
+uint8_t BL_Journal_Restore( const BL_JournalHeaderTypeDef *header, uint32_t recorded );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_JOURNAL_H__*/
@@ -0,0 +1,264 @@
+#include "bootloader_log.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static UART_HandleTypeDef *logUart = NULL;
+
+/*	thread context writes the records, the drain sends them	*/
+static uint32_t logWords[BL_LOG_RING_WORDS];
+static BL_LogRingTypeDef logRing = { logWords, BL_LOG_RING_WORDS - 1U, 0, 0, 0, 0 };
+
+/*	words handed to the DMA, released to the producer when the transfer completes	*/
+static volatile uint8_t logTxBusy = 0;
+static uint32_t logTxWords = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t log_Put_Record(BL_LogRingTypeDef *ring, const char *format, const uint32_t *args, uint32_t argCount);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Log_Init( UART_HandleTypeDef *huart )
+{
+	logUart = huart;
+	BL_Log_Ring_Init(&logRing, logWords, BL_LOG_RING_WORDS);
+	logTxBusy = 0;
+	
+#ifdef BL_LOG_TRANSPORT_SWO
+	/*	records go out raw on their own stimulus port, port 0 keeps serving fputc	*/
+	ITM->TER |= (1UL << BL_LOG_ITM_PORT);
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_Write( const char *format, const uint32_t *args, uint32_t argCount )
+{
+	BL_Log_Ring_Write(&logRing, format, args, argCount);
+	
+	if(!logTxBusy)
+	{
+		BL_Log_Drain();
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_VWrite( const char *format, va_list args )
+{
+	uint32_t argValues[BL_LOG_MAX_ARGS];
+	uint32_t argCount = 0;
+	
+	/*	printf style callers : one 32-bit argument per conversion, "%%" takes none	*/
+	for(const char *p = format; *p && (argCount < BL_LOG_MAX_ARGS); p++)
+	{
+		if('%' == *p)
+		{
+			if('%' == p[1])
+			{
+				p++;
+			}
+			else
+			{
+				argValues[argCount++] = va_arg(args, uint32_t);
+			}
+		}
+	}
+	BL_Log_Write(format, argValues, argCount);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_Drain( void )
+{
+#if defined(BL_LOG_TRANSPORT_UART)
+	uint32_t primask = __get_PRIMASK();
+	
+	/*	the TX complete interrupt also drains, only one of them may start the next transfer	*/
+	__disable_irq();
+	if((NULL != logUart) && !logTxBusy && (logRing.head != logRing.tail))
+	{
+		uint32_t start = logRing.tail & logRing.mask;
+		uint32_t pending = logRing.head - logRing.tail;
+		uint32_t contiguous = BL_LOG_RING_WORDS - start;
+		
+		logTxWords = (pending < contiguous) ? pending : contiguous;
+		if(HAL_OK == HAL_UART_Transmit_DMA(logUart, (uint8_t *)&logWords[start], (uint16_t)(logTxWords * 4U)))
+		{
+			logTxBusy = 1;
+		}
+	}
+	__set_PRIMASK(primask);
+#elif defined(BL_LOG_TRANSPORT_SWO)
+	/*	never wait on the ITM FIFO, whatever does not fit now goes with the next record	*/
+	while( (logRing.head != logRing.tail)								&&
+				 (ITM->TCR & ITM_TCR_ITMENA_Msk)							&&
+				 (ITM->TER & (1UL << BL_LOG_ITM_PORT))				&&
+				 (0U != ITM->PORT[BL_LOG_ITM_PORT].u32) )
+	{
+		ITM->PORT[BL_LOG_ITM_PORT].u32 = logWords[logRing.tail & logRing.mask];
+		logRing.tail++;
+	}
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_Log_Dropped( void )
+{
+	return logRing.droppedTotal;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_Ring_Init( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t wordCount )
+{
+	/*	wordCount must be a power of two	*/
+	ring->words = words;
+	ring->mask = wordCount - 1U;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+	ring->droppedTotal = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_Ring_Write( BL_LogRingTypeDef *ring, const char *format, const uint32_t *args, uint32_t argCount )
+{
+	if(argCount > BL_LOG_MAX_ARGS)
+	{
+		argCount = BL_LOG_MAX_ARGS;
+	}
+	
+	/*	report lost records first so the host sees the gap where it happened	*/
+	if(ring->dropped && log_Put_Record(ring, BL_LOG_DROPPED_FORMAT, &ring->dropped, 1))
+	{
+		ring->dropped = 0;
+	}
+	
+	/*	a full ring never blocks the caller, the record is counted instead	*/
+	if(!log_Put_Record(ring, format, args, argCount))
+	{
+		ring->dropped++;
+		ring->droppedTotal++;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_Log_Ring_Read( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t maxWords )
+{
+	uint32_t count = 0;
+	
+	/*	whole words out in order, the space is handed back to the writer once they are copied	*/
+	while((ring->tail != ring->head) && (count < maxWords))
+	{
+		words[count++] = ring->words[ring->tail & ring->mask];
+		ring->tail++;
+	}
+	
+	return count;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Log_0( const char *format )
+{
+	BL_Log_Write(format, NULL, 0);
+}
+
+void BL_Log_1( const char *format, uint32_t a1 )
+{
+	uint32_t args[1] = { a1 };
+	BL_Log_Write(format, args, 1);
+}
+
+void BL_Log_2( const char *format, uint32_t a1, uint32_t a2 )
+{
+	uint32_t args[2] = { a1, a2 };
+	BL_Log_Write(format, args, 2);
+}
+
+void BL_Log_3( const char *format, uint32_t a1, uint32_t a2, uint32_t a3 )
+{
+	uint32_t args[3] = { a1, a2, a3 };
+	BL_Log_Write(format, args, 3);
+}
+
+void BL_Log_4( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4 )
+{
+	uint32_t args[4] = { a1, a2, a3, a4 };
+	BL_Log_Write(format, args, 4);
+}
+
+void BL_Log_5( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5 )
+{
+	uint32_t args[5] = { a1, a2, a3, a4, a5 };
+	BL_Log_Write(format, args, 5);
+}
+
+void BL_Log_6( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5, uint32_t a6 )
+{
+	uint32_t args[6] = { a1, a2, a3, a4, a5, a6 };
+	BL_Log_Write(format, args, 6);
+}
+
+#if defined(BL_LOG_TRANSPORT_UART)
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if(huart != logUart)
+	{
+		return;
+	}
+	
+	/*	give the sent words back to the producer and chain the next piece of the ring	*/
+	logRing.tail += logTxWords;
+	logTxWords = 0;
+	logTxBusy = 0;
+	BL_Log_Drain();
+}
+#endif
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t log_Put_Record(BL_LogRingTypeDef *ring, const char *format, const uint32_t *args, uint32_t argCount)
+{
+	uint32_t head = ring->head;
+	
+	if(((ring->mask + 1U) - (head - ring->tail)) < (2U + argCount))
+	{
+		return 0;
+	}
+	
+	ring->words[head++ & ring->mask] = BL_LOG_HEADER(argCount, format);
+	ring->words[head++ & ring->mask] = DWT->CYCCNT;
+	for(uint32_t i = 0; i < argCount; i++)
+	{
+		ring->words[head++ & ring->mask] = args[i];
+	}
+	
+	/*	the record must be in RAM before the drain can see the new head	*/
+	__DMB();
+	ring->head = head;
+	return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef  BOOTLOADER_LOG_H__
+#define	 BOOTLOADER_LOG_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <stdarg.h>
+#include "usart.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	deferred formatting : only the format string's flash offset and the raw 32-bit arguments are logged,	*/
+/*	Host/bl_log.py rebuilds the text from the .axf, so a log call costs a few words of RAM writes	*/
+/*	record : header | DWT cycles | arguments, header = sync(8) | argument count(4) | format offset(20)	*/
+#define BL_LOG_SYNC									0xB1U
+#define BL_LOG_FORMAT_BASE					0x08000000U
+#define BL_LOG_FORMAT_MASK					0x000FFFFFU
+#define BL_LOG_MAX_ARGS							6U
+#define BL_LOG_HEADER(count, format)	((BL_LOG_SYNC << 24) | ((uint32_t)(count) << 20) | \
+																		(((uint32_t)(format) - BL_LOG_FORMAT_BASE) & BL_LOG_FORMAT_MASK))
+
+/*	offset 0 is the vector table, never a string : it marks a record counting records lost to a full ring	*/
+#define BL_LOG_DROPPED_FORMAT				((const char *)BL_LOG_FORMAT_BASE)
+
+/*	single producer ring in words, must be a power of two	*/
+#define BL_LOG_RING_WORDS						1024U
+
+/*	drain : USART3 TX DMA in the background, or the ITM stimulus port whenever its FIFO has room	*/
+#define BL_LOG_TRANSPORT_UART
+/* #define BL_LOG_TRANSPORT_SWO */
+#define BL_LOG_ITM_PORT							1U
+
+/*	lock free single producer / single consumer ring : the writer advances head, the drain advances tail	*/
+/*	indexes run free and are masked on access, so head - tail is always the number of pending words		*/
+typedef struct{
+	uint32_t *words;
+	uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t dropped;
+	uint32_t droppedTotal;
+}BL_LogRingTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+/*	BL_LOG("fmt", a, b) picks the writer for the number of arguments, every argument is passed as 32 bits	*/
+#define BL_LOG(...)									BL_LOG_SELECT(__VA_ARGS__, BL_Log_6, BL_Log_5, BL_Log_4, BL_Log_3,	\
+																							BL_Log_2, BL_Log_1, BL_Log_0, 0)(__VA_ARGS__)
+#define BL_LOG_SELECT(format, a1, a2, a3, a4, a5, a6, writer, ...)	writer
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Log_Init( UART_HandleTypeDef *huart );
+void BL_Log_Write( const char *format, const uint32_t *args, uint32_t argCount );
+void BL_Log_VWrite( const char *format, va_list args );
+void BL_Log_Drain( void );
+uint32_t BL_Log_Dropped( void );
+
+/*	the record format on a ring of the caller's, for applications through the service table	*/
+void BL_Log_Ring_Init( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t wordCount );
+void BL_Log_Ring_Write( BL_LogRingTypeDef *ring, const char *format, const uint32_t *args, uint32_t argCount );
+uint32_t BL_Log_Ring_Read( BL_LogRingTypeDef *ring, uint32_t *words, uint32_t maxWords );
+
+void BL_Log_0( const char *format );
+void BL_Log_1( const char *format, uint32_t a1 );
+void BL_Log_2( const char *format, uint32_t a1, uint32_t a2 );
+void BL_Log_3( const char *format, uint32_t a1, uint32_t a2, uint32_t a3 );
+void BL_Log_4( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4 );
+void BL_Log_5( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5 );
+void BL_Log_6( const char *format, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5, uint32_t a6 );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_LOG_H__*/
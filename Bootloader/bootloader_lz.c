@@ -0,0 +1,151 @@
+#include "bootloader_lz.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	naming conventions for decoder states	*/
+#define LZ_STATE_TAG								0x00
+#define LZ_STATE_LITERAL						0x01
+#define LZ_STATE_DISTANCE						0x02
+#define LZ_STATE_COUNT							0x03
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void lz_Emit_Byte(BL_LZ_ContextTypeDef *context, uint8_t value);
+static void lz_Flush_Output(BL_LZ_ContextTypeDef *context);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_LZ_Begin( BL_LZ_ContextTypeDef *context, lzOutputFunction output )
+{
+	/*	the window needs no clearing, a reference before the first output byte is refused	*/
+	context->output = output;
+	context->state = LZ_STATE_TAG;
+	context->status = BL_LZ_OK;
+	context->bitBuffer = 0;
+	context->bitCount = 0;
+	context->distance = 0;
+	context->windowHead = 0;
+	context->outputCount = 0;
+	context->totalOutput = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_LZ_Decompress( BL_LZ_ContextTypeDef *context, const uint8_t *input, uint32_t length )
+{
+	/*	input may be split anywhere, decoder state carries over to the next call	*/
+	while(BL_LZ_OK == context->status)
+	{
+		uint8_t neededBits = (LZ_STATE_TAG == context->state)      ? 1U :
+												 (LZ_STATE_LITERAL == context->state)  ? 8U :
+												 (LZ_STATE_DISTANCE == context->state) ? BL_LZ_WINDOW_BITS : BL_LZ_LOOKAHEAD_BITS;
+		
+		/*	top the bit buffer up a byte at a time, it never holds more than 20 bits	*/
+		if(context->bitCount < neededBits)
+		{
+			if(0 == length)
+			{
+				break;
+			}
+			context->bitBuffer = (context->bitBuffer << 8) | *input++;
+			context->bitCount += 8;
+			length--;
+			continue;
+		}
+		
+		switch(context->state)
+		{
+			case( LZ_STATE_TAG ):
+				context->bitCount--;
+				context->state = ((context->bitBuffer >> context->bitCount) & 1U) ? LZ_STATE_LITERAL : LZ_STATE_DISTANCE;
+				break;
+			
+			case( LZ_STATE_LITERAL ):
+				context->bitCount -= 8;
+				lz_Emit_Byte(context, (uint8_t)(context->bitBuffer >> context->bitCount));
+				context->state = LZ_STATE_TAG;
+				break;
+			
+			case( LZ_STATE_DISTANCE ):
+				context->bitCount -= BL_LZ_WINDOW_BITS;
+				context->distance = (uint16_t)(((context->bitBuffer >> context->bitCount) & (BL_LZ_WINDOW_LEN - 1U)) + 1U);
+				context->state = LZ_STATE_COUNT;
+				/*	a reference before the start of the image is corrupt input	*/
+				if(context->distance > context->totalOutput)
+				{
+					context->status = BL_LZ_ERROR;
+				}
+				break;
+			
+			default:
+			{
+				context->bitCount -= BL_LZ_LOOKAHEAD_BITS;
+				uint16_t count = (uint16_t)(((context->bitBuffer >> context->bitCount) & ((1U << BL_LZ_LOOKAHEAD_BITS) - 1U)) + 1U);
+				while(count--)
+				{
+					lz_Emit_Byte(context, context->window[(uint16_t)(context->windowHead - context->distance) & (BL_LZ_WINDOW_LEN - 1U)]);
+				}
+				context->state = LZ_STATE_TAG;
+				break;
+			}
+		}
+		
+		/*	keep only the unconsumed bits	*/
+		context->bitBuffer &= (1UL << context->bitCount) - 1UL;
+	}
+	
+	return context->status;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_LZ_End( BL_LZ_ContextTypeDef *context )
+{
+	/*	up to 7 zero padding bits may remain, the caller checks the decompressed length	*/
+	if(BL_LZ_OK == context->status)
+	{
+		lz_Flush_Output(context);
+	}
+	
+	return context->status;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_LZ_Output_Count( const BL_LZ_ContextTypeDef *context )
+{
+	return context->totalOutput;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void lz_Emit_Byte(BL_LZ_ContextTypeDef *context, uint8_t value)
+{
+	context->window[context->windowHead] = value;
+	context->windowHead = (context->windowHead + 1U) & (BL_LZ_WINDOW_LEN - 1U);
+	context->totalOutput++;
+	
+	context->chunk[context->outputCount++] = value;
+	if(BL_LZ_OUTPUT_CHUNK_LEN == context->outputCount)
+	{
+		lz_Flush_Output(context);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void lz_Flush_Output(BL_LZ_ContextTypeDef *context)
+{
+	if(context->outputCount && (BL_LZ_OK == context->status))
+	{
+		context->status = context->output(context->chunk, context->outputCount);
+	}
+	context->outputCount = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef  BOOTLOADER_LZ_H__
+#define	 BOOTLOADER_LZ_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	heatshrink-style LZSS bit stream, MSB first :	*/
+/*	  1 | literal(8)                            -> one byte	*/
+/*	  0 | distance-1 (WINDOW_BITS) | count-1 (LOOKAHEAD_BITS) -> copy count bytes from distance back	*/
+/*	Host/bl_compress.py produces exactly this format	*/
+#define BL_LZ_WINDOW_BITS						12
+#define BL_LZ_LOOKAHEAD_BITS				5
+#define BL_LZ_WINDOW_LEN						(1U << BL_LZ_WINDOW_BITS)
+
+/*	decompressed bytes are handed to the output function in chunks of this size	*/
+#define BL_LZ_OUTPUT_CHUNK_LEN			256U
+
+/*	naming conventions for decompression status	*/
+#define BL_LZ_OK										0x01
+#define BL_LZ_ERROR									0x00
+
+/*	output function returns BL_LZ_OK to continue or BL_LZ_ERROR to stop decoding	*/
+typedef uint8_t (*lzOutputFunction)(const uint8_t *data, uint16_t length);
+
+/*	decoder state and history window, the caller's memory : 4.4K, so not on a small stack	*/
+typedef struct{
+	lzOutputFunction output;
+	uint32_t bitBuffer;
+	uint32_t totalOutput;
+	uint16_t distance;
+	uint16_t windowHead;
+	uint16_t outputCount;
+	uint8_t state;
+	uint8_t status;
+	uint8_t bitCount;
+	uint8_t reserved[3];
+	uint8_t window[BL_LZ_WINDOW_LEN];
+	uint8_t chunk[BL_LZ_OUTPUT_CHUNK_LEN];
+}BL_LZ_ContextTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_LZ_Begin( BL_LZ_ContextTypeDef *context, lzOutputFunction output );
+uint8_t BL_LZ_Decompress( BL_LZ_ContextTypeDef *context, const uint8_t *input, uint32_t length );
+uint8_t BL_LZ_End( BL_LZ_ContextTypeDef *context );
+uint32_t BL_LZ_Output_Count( const BL_LZ_ContextTypeDef *context );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_LZ_H__*/
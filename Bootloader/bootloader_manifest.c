@@ -0,0 +1,69 @@
+#include "bootloader_manifest.h"
+#include "bootloader_log.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	the trusted key is provisioned at build time : Host/bl_manifest.py keyheader writes bootloader_manifest_key.h	*/
+/*	from the product key and the build fails without it.  Only host test builds opt into the published		*/
+/*	development key, with -DBL_SECURE_BOOT_DEV_KEY																									*/
+#ifdef BL_SECURE_BOOT_DEV_KEY
+#include "bootloader_manifest_dev_key.h"
+#else
+#include "bootloader_manifest_key.h"
+#endif
+
+#ifndef BL_MANIFEST_PUBLIC_KEY
+#error "no trusted key : generate bootloader_manifest_key.h with Host/bl_manifest.py keyheader"
+#endif
+
+static const uint8_t manifestPublicKey[BL_ED25519_PUBLIC_KEY_LEN] = BL_MANIFEST_PUBLIC_KEY;
+
+/* Static Software Interface Declarations ------------------------------------*/
+
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+uint8_t BL_Manifest_Verify( uint8_t slot, uint32_t length, uint32_t version )
+{
+	const BL_ManifestTypeDef *manifest = NULL;
+	uint8_t digest[BL_SHA256_DIGEST_LEN];
+	
+	if((slot >= BL_SLOT_COUNT) || (0 == length) || (length > BL_MANIFEST_IMAGE_LIMIT(slot)))
+	{
+		return BL_MANIFEST_ERROR;
+	}
+	manifest = (const BL_ManifestTypeDef *)BL_MANIFEST_ADDRESS(slot);
+	
+	/*	cheap checks first : the header has to describe exactly the image the slot table committed	*/
+	if( (BL_MANIFEST_MAGIC != manifest->magic) || (version != manifest->version)	||
+			(length != manifest->length) || (BL_SLOT_ADDRESS(slot) != manifest->loadAddress) )
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Manifest of slot %d does not match its header \r\n", slot);
+#endif
+		return BL_MANIFEST_ERROR;
+	}
+	
+	BL_SHA256_Calculate((const uint8_t *)BL_SLOT_ADDRESS(slot), length, digest);
+	if(0 != memcmp(digest, manifest->digest, BL_SHA256_DIGEST_LEN))
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Image digest of slot %d does not match its manifest \r\n", slot);
+#endif
+		return BL_MANIFEST_ERROR;
+	}
+	
+	/*	the digest is bound to the image, the signature binds the digest, length and address to the key	*/
+	if(BL_ED25519_OK != BL_Ed25519_Verify(manifest->signature, (const uint8_t *)manifest, BL_MANIFEST_SIGNED_LEN, manifestPublicKey))
+	{
+#ifdef SWO_DEBUGGING
+		BL_LOG("Manifest signature of slot %d rejected \r\n", slot);
+#endif
+		return BL_MANIFEST_ERROR;
+	}
+	
+	return BL_MANIFEST_OK;
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
@@ -0,0 +1,48 @@
+#ifndef  BOOTLOADER_MANIFEST_H__
+#define	 BOOTLOADER_MANIFEST_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_slot.h"
+#include "bootloader_sha256.h"
+#include "bootloader_ed25519.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	MACRO to refuse images without a valid signed manifest, at boot and when a slot is activated	*/
+#define BL_SECURE_BOOT							BL_SECURE_BOOT
+
+/*	the manifest fills the last 128 bytes of a slot, written by the host like any other image data	*/
+#define BL_MANIFEST_LEN							128U
+#define BL_MANIFEST_SIGNED_LEN			64U
+#define BL_MANIFEST_MAGIC						0x54464E4DU
+
+/*	naming conventions for manifest status	*/
+#define BL_MANIFEST_OK							0x01
+#define BL_MANIFEST_ERROR						0x00
+
+/*	produced by Host/bl_manifest.py, the signature covers every field before it	*/
+typedef struct{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t length;
+	uint32_t loadAddress;
+	uint8_t digest[BL_SHA256_DIGEST_LEN];
+	uint8_t reserved[16];
+	uint8_t signature[BL_ED25519_SIGNATURE_LEN];
+}BL_ManifestTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+#define BL_MANIFEST_ADDRESS(slot)		(BL_SLOT_ADDRESS(slot) + BL_SLOT_LENGTH(slot) - BL_MANIFEST_LEN)
+#define BL_MANIFEST_IMAGE_LIMIT(slot)	(BL_SLOT_LENGTH(slot) - BL_MANIFEST_LEN)
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+uint8_t BL_Manifest_Verify( uint8_t slot, uint32_t length, uint32_t version );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_MANIFEST_H__*/
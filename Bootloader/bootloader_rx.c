@@ -0,0 +1,359 @@
+#include "bootloader_rx.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static const BL_TransportTypeDef *rxTransport = NULL;
+
+/*	the link writes the ring circularly, rxRingTail follows it as bytes are moved into frame slots	*/
+static uint8_t rxDmaRing[BL_RX_DMA_RING_LEN];
+static volatile uint16_t rxRingHead = 0;
+static uint16_t rxRingTail = 0;
+static volatile uint32_t rxLastEventTick = 0;
+
+/*	frame slots and the FIFO of slots holding complete frames, handlers work on the slot in place	*/
+static uint8_t rxFrameSlots[BL_RX_FRAME_SLOTS][BL_RX_FRAME_LEN] __attribute__((section(".bss.sram2"), aligned(4)));
+static volatile uint8_t rxSlotState[BL_RX_FRAME_SLOTS];
+static uint32_t rxSlotCycles[BL_RX_FRAME_SLOTS];
+static volatile uint8_t rxReadyQueue[BL_RX_FRAME_SLOTS];
+static volatile uint8_t rxReadyHead = 0;
+static volatile uint8_t rxReadyCount = 0;
+static int8_t rxFillSlot = -1;
+static uint16_t rxFillCount = 0;
+static uint16_t rxFillLength = 0;
+static volatile uint8_t rxFormat = BL_RX_FORMAT_V1;
+static uint8_t rxStallCount = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void rx_Assemble_Frames(void);
+static void rx_Drop_Partial_Frame(void);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_RX_Init( const BL_TransportTypeDef *transport )
+{
+	/*	a link that is switched away from stops writing the ring before the next one starts	*/
+	if((NULL != rxTransport) && (transport != rxTransport))
+	{
+		rxTransport->close();
+	}
+	rxTransport = transport;
+	BL_RX_Flush();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t *BL_RX_Get_Frame( uint32_t timeout )
+{
+	uint32_t startTick = HAL_GetTick();
+	uint8_t *frame = NULL;
+	
+	while(NULL == frame)
+	{
+		__disable_irq();
+		if(rxReadyCount)
+		{
+			/*	pop the oldest complete frame, it stays busy until the dispatcher releases it	*/
+			uint8_t slot = rxReadyQueue[rxReadyHead];
+			rxSlotState[slot] = BL_RX_SLOT_BUSY;
+			rxReadyHead = (rxReadyHead + 1) % BL_RX_FRAME_SLOTS;
+			rxReadyCount--;
+			rxStallCount = 0;
+			frame = rxFrameSlots[slot];
+		}
+		else
+		{
+			/*	a steady UART stream raises no idle event and half transfers are a half ring apart (366 ms at	*/
+			/*	115200) : take what the link wrote so far on every wake-up, so frame N+1 is assembled while	*/
+			/*	frame N is still arriving instead of after the idle line at the end of a window				*/
+			uint16_t head = rxTransport->head();
+			
+			if(head != rxRingHead)
+			{
+				rxRingHead = head;
+				rxLastEventTick = HAL_GetTick();
+				rx_Assemble_Frames();
+			}
+			else if((rxFillSlot >= 0) && ((HAL_GetTick() - rxLastEventTick) > BL_RX_INTERFRAME_TIMEOUT_MS))
+			{
+				/*	host stopped in the middle of a frame, resynchronize on the next length field in the same format :	*/
+				/*	a v2 host that lost bytes retries its frame as v2 and keeps the session it negotiated					*/
+				rx_Drop_Partial_Frame();
+				
+				/*	a v1 frame read with a 2 byte length stalls every time : a host that restarted without negotiating	*/
+				/*	gets the v1 format back once its retries stalled BL_RX_MAX_STALLS times with no frame in between		*/
+				if(++rxStallCount >= BL_RX_MAX_STALLS)
+				{
+					rxStallCount = 0;
+					rxFormat = BL_RX_FORMAT_V1;
+				}
+			}
+		}
+		__enable_irq();
+		
+		if((NULL == frame) && !rxReadyCount)
+		{
+			if((HAL_MAX_DELAY != timeout) && ((HAL_GetTick() - startTick) >= timeout))
+			{
+				break;
+			}
+			/*	a link's own work first, then sleep until the next DMA/UART event or SysTick instead of spinning	*/
+			BL_Transport_Background();
+			__WFI();
+		}
+	}
+	
+	return frame;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_RX_Release_Frame( uint8_t *frame )
+{
+	uint8_t slot = (uint8_t)((frame - rxFrameSlots[0]) / BL_RX_FRAME_LEN);
+	
+	__disable_irq();
+	if((slot < BL_RX_FRAME_SLOTS) && (BL_RX_SLOT_BUSY == rxSlotState[slot]))
+	{
+		rxSlotState[slot] = BL_RX_SLOT_FREE;
+		
+		/*	bytes that waited in the ring for a free slot can move now	*/
+		rx_Assemble_Frames();
+	}
+	__enable_irq();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint32_t BL_RX_Frame_Cycles( const uint8_t *frame )
+{
+	/*	DWT cycles when the frame was complete in its slot, for the benchmark stage stamps	*/
+	uint8_t slot = (uint8_t)((frame - rxFrameSlots[0]) / BL_RX_FRAME_LEN);
+	return (slot < BL_RX_FRAME_SLOTS) ? rxSlotCycles[slot] : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_RX_Flush( void )
+{
+	rxTransport->close();
+	
+	__disable_irq();
+	/*	a frame handed to the dispatcher stays valid until it is released	*/
+	for(uint8_t i = 0; i < BL_RX_FRAME_SLOTS; i++)
+	{
+		if(BL_RX_SLOT_BUSY != rxSlotState[i])
+		{
+			rxSlotState[i] = BL_RX_SLOT_FREE;
+		}
+	}
+	rxReadyHead = 0;
+	rxReadyCount = 0;
+	rxFillSlot = -1;
+	rxFillCount = 0;
+	rxFillLength = 0;
+	rxStallCount = 0;
+	rxRingHead = 0;
+	rxRingTail = 0;
+	rxLastEventTick = HAL_GetTick();
+	__enable_irq();
+	
+	rxTransport->open(rxDmaRing, BL_RX_DMA_RING_LEN);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_RX_Set_Format( uint8_t format )
+{
+	/*	called between frames : the reply to the negotiation is not out yet, so the host cannot have sent the next one	*/
+	__disable_irq();
+	rxFormat = (BL_RX_FORMAT_V2 == format) ? BL_RX_FORMAT_V2 : BL_RX_FORMAT_V1;
+	rxStallCount = 0;
+	__enable_irq();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_RX_Get_Format( void )
+{
+	return rxFormat;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_RX_Header_Len( void )
+{
+	return (BL_RX_FORMAT_V2 == rxFormat) ? 2 : 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint16_t BL_RX_Frame_Length( const uint8_t *frame )
+{
+	/*	whole frame : length field itself plus the bytes it counts	*/
+	if(BL_RX_FORMAT_V2 == rxFormat)
+	{
+		return (uint16_t)(2 + (frame[0] | (frame[1] << 8)));
+	}
+	return (uint16_t)(1 + frame[0]);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint16_t BL_RX_Max_Frame_Length( void )
+{
+	return (BL_RX_FORMAT_V2 == rxFormat) ? (2 + BL_RX_V2_MAX_LEN_FIELD) : (1 + BL_RX_V1_MAX_LEN_FIELD);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC uint16_t BL_RX_Ring_Free( void )
+{
+	/*	one byte stays unused so a full ring is not taken for an empty one	*/
+	return (uint16_t)(BL_RX_DMA_RING_LEN - 1U - ((rxRingHead + BL_RX_DMA_RING_LEN - rxRingTail) % BL_RX_DMA_RING_LEN));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void BL_RX_Ring_Event( uint16_t head )
+{
+	/*	called by the active link from its interrupt with the ring's new write position	*/
+	rxRingHead = head;
+	rxLastEventTick = HAL_GetTick();
+	rx_Assemble_Frames();
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+BL_RAM_FUNC static void rx_Assemble_Frames(void)
+{
+	uint16_t startTail = rxRingTail;
+	
+	/*	called from the link interrupt or with interrupts masked, from SRAM1 so it also runs during an erase	*/
+	while(rxRingTail != rxRingHead)
+	{
+		uint8_t *slot;
+		uint16_t frameLength, lengthField, contiguous, chunk;
+		
+		/*	claim a free slot, if both are busy the bytes wait in the ring	*/
+		if(rxFillSlot < 0)
+		{
+			for(uint8_t i = 0; i < BL_RX_FRAME_SLOTS; i++)
+			{
+				if(BL_RX_SLOT_FREE == rxSlotState[i])
+				{
+					rxSlotState[i] = BL_RX_SLOT_FILLING;
+					rxFillSlot = (int8_t)i;
+					rxFillCount = 0;
+					break;
+				}
+			}
+			if(rxFillSlot < 0)
+			{
+				break;
+			}
+		}
+		slot = rxFrameSlots[rxFillSlot];
+		
+		/*	the length field comes first, 1 byte in v1 and 2 in v2, it counts every byte after itself	*/
+		if(0 == rxFillLength)
+		{
+			uint8_t headerLength = (BL_RX_FORMAT_V2 == rxFormat) ? 2 : 1;
+			
+			slot[rxFillCount++] = rxDmaRing[rxRingTail];
+			rxRingTail = (rxRingTail + 1) % BL_RX_DMA_RING_LEN;
+			if(rxFillCount < headerLength)
+			{
+				continue;
+			}
+			
+			lengthField = (1 == headerLength) ? slot[0] : (uint16_t)(slot[0] | (slot[1] << 8));
+			if((0 == lengthField) || (lengthField > BL_RX_V2_MAX_LEN_FIELD))
+			{
+				/*	not a frame start, slide one byte and look again	*/
+				if(headerLength > 1)
+				{
+					slot[0] = slot[1];
+					rxFillCount = 1;
+				}
+				else
+				{
+					rxFillCount = 0;
+				}
+				continue;
+			}
+			rxFillLength = headerLength + lengthField;
+		}
+		
+		/*	copy as much of the frame as is contiguous in the ring	*/
+		frameLength = rxFillLength;
+		if(rxRingTail == rxRingHead)
+		{
+			break;
+		}
+		contiguous = (rxRingHead > rxRingTail) ? (rxRingHead - rxRingTail) : (BL_RX_DMA_RING_LEN - rxRingTail);
+		chunk = frameLength - rxFillCount;
+		if(chunk > contiguous)
+		{
+			chunk = contiguous;
+		}
+		/*	plain copy loop : the library memcpy lives in flash	*/
+		for(uint16_t i = 0; i < chunk; i++)
+		{
+			slot[rxFillCount + i] = rxDmaRing[rxRingTail + i];
+		}
+		rxRingTail = (rxRingTail + chunk) % BL_RX_DMA_RING_LEN;
+		rxFillCount += chunk;
+		
+		/*	frame complete : hand it to the dispatcher queue	*/
+		if(rxFillCount == frameLength)
+		{
+			rxSlotState[rxFillSlot] = BL_RX_SLOT_READY;
+			rxSlotCycles[rxFillSlot] = DWT->CYCCNT;
+			rxReadyQueue[(rxReadyHead + rxReadyCount) % BL_RX_FRAME_SLOTS] = (uint8_t)rxFillSlot;
+			rxReadyCount++;
+			rxFillSlot = -1;
+			rxFillCount = 0;
+			rxFillLength = 0;
+		}
+	}
+	
+	/*	bytes left the ring : a link that holds the host back may take more now	*/
+	if((rxRingTail != startTail) && (NULL != rxTransport->resume))
+	{
+		rxTransport->resume();
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void rx_Drop_Partial_Frame(void)
+{
+	rxSlotState[rxFillSlot] = BL_RX_SLOT_FREE;
+	rxFillSlot = -1;
+	rxFillCount = 0;
+	rxFillLength = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef  BOOTLOADER_RX_H__
+#define	 BOOTLOADER_RX_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+#include "bootloader_transport.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	circular ring the active host link writes into (UART by DMA, USB packet by packet), frames are assembled out of it	*/
+/*	sized for a whole stream window of 32 frames plus one, the UART has no flow control and the ring has to absorb a window	*/
+#define BL_RX_DMA_RING_LEN					8448
+
+/*	frame slots : the command being executed holds one slot, the other two double-buffer the frames behind it	*/
+/*	a slot holds the largest v2 frame, the slots live in SRAM2 next to the other work buffers	*/
+#define BL_RX_FRAME_SLOTS						3
+#define BL_RX_FRAME_LEN							(2 + BL_RX_V2_MAX_LEN_FIELD)
+
+/*	frame formats : v1 has a 1 byte length, v2 a 2 byte little endian length, both count every byte after the length	*/
+/*	the engine starts in v1 so hosts that never negotiate keep working	*/
+#define BL_RX_FORMAT_V1							0x01
+#define BL_RX_FORMAT_V2							0x02
+#define BL_RX_V1_MAX_LEN_FIELD			0xFF
+#define BL_RX_V2_MAX_LEN_FIELD			(2 + 4096 + 4)
+
+/*	a partial frame is dropped when the line stays quiet for this long	*/
+#define BL_RX_INTERFRAME_TIMEOUT_MS	100
+
+/*	consecutive stalled frames after which a v2 link goes back to v1	*/
+#define BL_RX_MAX_STALLS						3
+
+/*	naming conventions for frame slot states	*/
+#define BL_RX_SLOT_FREE							0x00
+#define BL_RX_SLOT_FILLING					0x01
+#define BL_RX_SLOT_READY						0x02
+#define BL_RX_SLOT_BUSY							0x03
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_RX_Init( const BL_TransportTypeDef *transport );
+uint8_t *BL_RX_Get_Frame( uint32_t timeout );
+void BL_RX_Release_Frame( uint8_t *frame );
+uint32_t BL_RX_Frame_Cycles( const uint8_t *frame );
+void BL_RX_Flush( void );
+void BL_RX_Set_Format( uint8_t format );
+uint8_t BL_RX_Get_Format( void );
+uint8_t BL_RX_Header_Len( void );
+uint16_t BL_RX_Frame_Length( const uint8_t *frame );
+uint16_t BL_RX_Max_Frame_Length( void );
+uint16_t BL_RX_Ring_Free( void );
+void BL_RX_Ring_Event( uint16_t head );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_RX_H__*/
@@ -0,0 +1,242 @@
+#include "bootloader_sha256.h"
+#ifdef BL_SHA256_BENCHMARK
+#include "bootloader_log.h"
+#endif
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+#define SHA256_ROTR(x, n)						(((x) >> (n)) | ((x) << (32U - (n))))
+#define SHA256_SIGMA0(x)						(SHA256_ROTR((x), 2) ^ SHA256_ROTR((x), 13) ^ SHA256_ROTR((x), 22))
+#define SHA256_SIGMA1(x)						(SHA256_ROTR((x), 6) ^ SHA256_ROTR((x), 11) ^ SHA256_ROTR((x), 25))
+#define SHA256_GAMMA0(x)						(SHA256_ROTR((x), 7) ^ SHA256_ROTR((x), 18) ^ ((x) >> 3))
+#define SHA256_GAMMA1(x)						(SHA256_ROTR((x), 17) ^ SHA256_ROTR((x), 19) ^ ((x) >> 10))
+#define SHA256_CH(x, y, z)					((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256_MAJ(x, y, z)					(((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256_LOAD_BE32(p)					(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+/*	message schedule lives in a 16 word window, word i is rebuilt in place just before round i uses it	*/
+#define SHA256_SCHEDULE(i)					(w[(i) & 15] += SHA256_GAMMA1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + SHA256_GAMMA0(w[((i) - 15) & 15]))
+
+/*	the eight working variables rotate by renaming instead of being moved every round	*/
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i, wi)																						\
+	do{																																												\
+		uint32_t t1 = (h) + SHA256_SIGMA1(e) + SHA256_CH((e), (f), (g)) + sha256K[(i)] + (wi);	\
+		(d) += t1;																																							\
+		(h) = t1 + SHA256_SIGMA0(a) + SHA256_MAJ((a), (b), (c));																\
+	}while(0)
+
+static const uint32_t sha256K[64] = {
+	0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U,
+	0x923f82a4U, 0xab1c5ed5U, 0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U,
+	0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U, 0xe49b69c1U, 0xefbe4786U,
+	0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+	0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U,
+	0x06ca6351U, 0x14292967U, 0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U,
+	0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U, 0xa2bfe8a1U, 0xa81a664bU,
+	0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+	0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU,
+	0x5b9cca4fU, 0x682e6ff3U, 0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U,
+	0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U
+};
+
+static const uint32_t sha256Initial[8] = { 0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU, 0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U };
+
+#ifdef BL_SHA256_HARDWARE
+static HASH_HandleTypeDef sha256Hash;
+#endif
+
+/* Static Software Interface Declarations ------------------------------------*/
+#ifndef BL_SHA256_HARDWARE
+static void sha256_Compress(uint32_t state[8], const uint8_t *data, uint32_t blockCount);
+#endif
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_SHA256_Begin( BL_SHA256_ContextTypeDef *context )
+{
+	memcpy(context->state, sha256Initial, sizeof(sha256Initial));
+	context->totalLength = 0;
+	context->blockLength = 0;
+	
+#ifdef BL_SHA256_HARDWARE
+	__HAL_RCC_HASH_CLK_ENABLE();
+	sha256Hash.Init.DataType = HASH_DATATYPE_8B;
+	(void)HAL_HASH_DeInit(&sha256Hash);
+	(void)HAL_HASH_Init(&sha256Hash);
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_SHA256_Update( BL_SHA256_ContextTypeDef *context, const uint8_t *data, uint32_t length )
+{
+	context->totalLength += length;
+	
+#ifdef BL_SHA256_HARDWARE
+	/*	the peripheral takes whole words until the last call, an odd tail waits in the context	*/
+	while(context->blockLength && length)
+	{
+		context->block[context->blockLength++] = *data++;
+		length--;
+		if(4U == context->blockLength)
+		{
+			(void)HAL_HASHEx_SHA256_Accmlt(&sha256Hash, context->block, 4U);
+			context->blockLength = 0;
+		}
+	}
+	if(length & ~3U)
+	{
+		(void)HAL_HASHEx_SHA256_Accmlt(&sha256Hash, (uint8_t *)data, length & ~3U);
+		data += length & ~3U;
+	}
+	memcpy(context->block, data, length & 3U);
+	context->blockLength = length & 3U;
+#else
+	/*	top up a partial block first	*/
+	if(context->blockLength)
+	{
+		uint32_t fill = BL_SHA256_BLOCK_LEN - context->blockLength;
+		if(fill > length)
+		{
+			fill = length;
+		}
+		memcpy(&context->block[context->blockLength], data, fill);
+		context->blockLength += fill;
+		data += fill;
+		length -= fill;
+		if(BL_SHA256_BLOCK_LEN != context->blockLength)
+		{
+			return;
+		}
+		sha256_Compress(context->state, context->block, 1);
+		context->blockLength = 0;
+	}
+	
+	/*	whole blocks are hashed straight out of flash without copying	*/
+	if(length >= BL_SHA256_BLOCK_LEN)
+	{
+		sha256_Compress(context->state, data, length / BL_SHA256_BLOCK_LEN);
+		data += length & ~(BL_SHA256_BLOCK_LEN - 1U);
+		length &= (BL_SHA256_BLOCK_LEN - 1U);
+	}
+	
+	memcpy(context->block, data, length);
+	context->blockLength = length;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_SHA256_End( BL_SHA256_ContextTypeDef *context, uint8_t digest[BL_SHA256_DIGEST_LEN] )
+{
+#ifdef BL_SHA256_HARDWARE
+	(void)HAL_HASHEx_SHA256_Accmlt_End(&sha256Hash, context->block, context->blockLength, digest, HAL_MAX_DELAY);
+	context->blockLength = 0;
+#else
+	uint64_t bitLength = context->totalLength * 8U;
+	
+	/*	padding : 0x80, zeros up to 56 mod 64, then the bit length big-endian	*/
+	context->block[context->blockLength++] = 0x80U;
+	if(context->blockLength > (BL_SHA256_BLOCK_LEN - 8U))
+	{
+		memset(&context->block[context->blockLength], 0, BL_SHA256_BLOCK_LEN - context->blockLength);
+		sha256_Compress(context->state, context->block, 1);
+		context->blockLength = 0;
+	}
+	memset(&context->block[context->blockLength], 0, (BL_SHA256_BLOCK_LEN - 8U) - context->blockLength);
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		context->block[BL_SHA256_BLOCK_LEN - 1U - i] = (uint8_t)(bitLength >> (8U * i));
+	}
+	sha256_Compress(context->state, context->block, 1);
+	context->blockLength = 0;
+	
+	for(uint32_t i = 0; i < 8U; i++)
+	{
+		digest[(4U * i) + 0U] = (uint8_t)(context->state[i] >> 24);
+		digest[(4U * i) + 1U] = (uint8_t)(context->state[i] >> 16);
+		digest[(4U * i) + 2U] = (uint8_t)(context->state[i] >> 8);
+		digest[(4U * i) + 3U] = (uint8_t)(context->state[i]);
+	}
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_SHA256_Calculate( const uint8_t *data, uint32_t length, uint8_t digest[BL_SHA256_DIGEST_LEN] )
+{
+	BL_SHA256_ContextTypeDef context;
+	
+	BL_SHA256_Begin(&context);
+	BL_SHA256_Update(&context, data, length);
+	BL_SHA256_End(&context, digest);
+}
+
+#ifdef BL_SHA256_BENCHMARK
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_SHA256_Benchmark( const uint8_t *region, uint32_t length )
+{
+	uint8_t digest[BL_SHA256_DIGEST_LEN];
+	uint32_t startCycles = DWT->CYCCNT;
+	
+	BL_SHA256_Calculate(region, length, digest);
+	uint32_t spentCycles = DWT->CYCCNT - startCycles;
+	
+	/*	bytes per 1000 cycles to stay in integer formats	*/
+	BL_LOG("SHA-256 over %u bytes : %u cycles, %u bytes per 1000 cycles\r\n", length, spentCycles, (uint32_t)(((uint64_t)length * 1000U) / spentCycles));
+}
+#endif
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+#ifndef BL_SHA256_HARDWARE
+static void sha256_Compress(uint32_t state[8], const uint8_t *data, uint32_t blockCount)
+{
+	uint32_t w[16];
+	
+	while(blockCount--)
+	{
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+		
+		/*	rounds 0-15 read the block big-endian byte by byte, flash needs no alignment	*/
+		for(uint32_t i = 0; i < 16U; i += 8U)
+		{
+			w[i + 0U] = SHA256_LOAD_BE32(&data[4U * (i + 0U)]);	SHA256_ROUND(a, b, c, d, e, f, g, h, i + 0U, w[i + 0U]);
+			w[i + 1U] = SHA256_LOAD_BE32(&data[4U * (i + 1U)]);	SHA256_ROUND(h, a, b, c, d, e, f, g, i + 1U, w[i + 1U]);
+			w[i + 2U] = SHA256_LOAD_BE32(&data[4U * (i + 2U)]);	SHA256_ROUND(g, h, a, b, c, d, e, f, i + 2U, w[i + 2U]);
+			w[i + 3U] = SHA256_LOAD_BE32(&data[4U * (i + 3U)]);	SHA256_ROUND(f, g, h, a, b, c, d, e, i + 3U, w[i + 3U]);
+			w[i + 4U] = SHA256_LOAD_BE32(&data[4U * (i + 4U)]);	SHA256_ROUND(e, f, g, h, a, b, c, d, i + 4U, w[i + 4U]);
+			w[i + 5U] = SHA256_LOAD_BE32(&data[4U * (i + 5U)]);	SHA256_ROUND(d, e, f, g, h, a, b, c, i + 5U, w[i + 5U]);
+			w[i + 6U] = SHA256_LOAD_BE32(&data[4U * (i + 6U)]);	SHA256_ROUND(c, d, e, f, g, h, a, b, i + 6U, w[i + 6U]);
+			w[i + 7U] = SHA256_LOAD_BE32(&data[4U * (i + 7U)]);	SHA256_ROUND(b, c, d, e, f, g, h, a, i + 7U, w[i + 7U]);
+		}
+		
+		/*	rounds 16-63 extend the schedule in the window	*/
+		for(uint32_t i = 16U; i < 64U; i += 8U)
+		{
+			SHA256_ROUND(a, b, c, d, e, f, g, h, i + 0U, SHA256_SCHEDULE(i + 0U));
+			SHA256_ROUND(h, a, b, c, d, e, f, g, i + 1U, SHA256_SCHEDULE(i + 1U));
+			SHA256_ROUND(g, h, a, b, c, d, e, f, i + 2U, SHA256_SCHEDULE(i + 2U));
+			SHA256_ROUND(f, g, h, a, b, c, d, e, i + 3U, SHA256_SCHEDULE(i + 3U));
+			SHA256_ROUND(e, f, g, h, a, b, c, d, i + 4U, SHA256_SCHEDULE(i + 4U));
+			SHA256_ROUND(d, e, f, g, h, a, b, c, i + 5U, SHA256_SCHEDULE(i + 5U));
+			SHA256_ROUND(c, d, e, f, g, h, a, b, i + 6U, SHA256_SCHEDULE(i + 6U));
+			SHA256_ROUND(b, c, d, e, f, g, h, a, i + 7U, SHA256_SCHEDULE(i + 7U));
+		}
+		
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		data += BL_SHA256_BLOCK_LEN;
+	}
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef  BOOTLOADER_SHA256_H__
+#define	 BOOTLOADER_SHA256_H__
+
+/* Includes ------------------------------------------------------------------*/
+#ifndef BL_HOST_BUILD
+#include "stm32f4xx.h"
+#endif
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Macro Declarations---------------------------------------------------------*/
+
+#define BL_SHA256_DIGEST_LEN				32U
+#define BL_SHA256_BLOCK_LEN					64U
+
+/*	parts with the HASH processor (F415/F417/F437/F439) stream through HAL_HASHEx_SHA256_Accmlt,	*/
+/*	the F407 has none and uses the unrolled software rounds	*/
+#if defined(HASH) && defined(HAL_HASH_MODULE_ENABLED) && !defined(BL_HOST_BUILD)
+#define BL_SHA256_HARDWARE
+#endif
+
+/*	MACRO to enable the SHA-256 throughput benchmark printed over the debug log	*/
+/* #define BL_SHA256_BENCHMARK */
+
+typedef struct{
+	uint32_t state[8];
+	uint64_t totalLength;
+	uint8_t block[BL_SHA256_BLOCK_LEN];
+	uint32_t blockLength;
+}BL_SHA256_ContextTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_SHA256_Begin( BL_SHA256_ContextTypeDef *context );
+void BL_SHA256_Update( BL_SHA256_ContextTypeDef *context, const uint8_t *data, uint32_t length );
+void BL_SHA256_End( BL_SHA256_ContextTypeDef *context, uint8_t digest[BL_SHA256_DIGEST_LEN] );
+void BL_SHA256_Calculate( const uint8_t *data, uint32_t length, uint8_t digest[BL_SHA256_DIGEST_LEN] );
+#ifdef BL_SHA256_BENCHMARK
+void BL_SHA256_Benchmark( const uint8_t *region, uint32_t length );
+#endif
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_SHA256_H__*/
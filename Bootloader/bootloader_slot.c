@@ -0,0 +1,404 @@
+#include "bootloader_slot.h"
+#include "bootloader_manifest.h"
+#include "bootloader_journal.h"
+#include "bootloader_boot.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+#define SLOT_RECORD_LEN							sizeof(BL_SlotRecordTypeDef)
+#define SLOT_RECORD_CRC_LEN					(SLOT_RECORD_LEN - 4U)
+#define SLOT_BLANK_WORD							0xFFFFFFFFU
+#define SLOT_STAGE_LEN							sizeof(BL_SlotStageTypeDef)
+#define SLOT_STAGE_CRC_LEN					(SLOT_STAGE_LEN - 4U)
+#define SLOT_STAGE									((const BL_SlotStageTypeDef *)BL_SLOT_STAGE_ADDRESS)
+
+/*	with secure boot the tail of each slot holds the manifest, the image has to end before it	*/
+#ifdef BL_SECURE_BOOT
+#define SLOT_IMAGE_LIMIT(slot)			BL_MANIFEST_IMAGE_LIMIT(slot)
+#else
+#define SLOT_IMAGE_LIMIT(slot)			BL_SLOT_LENGTH(slot)
+#endif
+
+/*	latest record of each slot and the first blank record of the table, rebuilt by BL_Slot_Init	*/
+static BL_SlotRecordTypeDef slotLatest[BL_SLOT_COUNT];
+static uint32_t slotNextRecord = BL_SLOT_TABLE_ADDRESS;
+static uint32_t slotNextSequence = 1;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint8_t slot_Record_Is_Valid(const BL_SlotRecordTypeDef *record);
+static uint8_t slot_Append(BL_SlotRecordTypeDef *record);
+static uint8_t slot_Compact(void);
+static uint8_t slot_Compact_Finish(const BL_SlotStageTypeDef *stage);
+static uint8_t slot_Stage_Is_Valid(const BL_SlotStageTypeDef *stage);
+static uint8_t slot_Vector_Table_Looks_Valid(uint8_t slot);
+static uint8_t slot_Header_Is_Bootable(uint8_t slot);
+static uint8_t slot_Legacy_Image_Verifies(void);
+static uint8_t slot_Select(uint8_t verifyImage);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Slot_Init( void )
+{
+	const BL_SlotRecordTypeDef *record = (const BL_SlotRecordTypeDef *)BL_SLOT_TABLE_ADDRESS;
+	const BL_SlotRecordTypeDef *tableEnd = (const BL_SlotRecordTypeDef *)(BL_SLOT_TABLE_ADDRESS + BL_SLOT_TABLE_LENGTH);
+	
+	memset(slotLatest, 0, sizeof(slotLatest));
+	slotNextSequence = 1;
+	
+	/*	a compaction cut short by a reset : the table is whatever the reset left, the stage holds the records	*/
+	/*	until BL_Slot_Recover rewrites the sector, nothing can be appended before that							*/
+	if(slot_Stage_Is_Valid(SLOT_STAGE))
+	{
+		record = SLOT_STAGE->records;
+		tableEnd = record + BL_SLOT_COUNT;
+	}
+	
+	/*	records are appended in order, the first blank one ends the table	*/
+	/*	a torn record from a reset during the write fails its CRC and is skipped	*/
+	while((record < tableEnd) && (SLOT_BLANK_WORD != record->magic))
+	{
+		if(slot_Record_Is_Valid(record))
+		{
+			if(record->sequence >= slotLatest[record->slot].sequence)
+			{
+				slotLatest[record->slot] = *record;
+			}
+			if(record->sequence >= slotNextSequence)
+			{
+				slotNextSequence = record->sequence + 1;
+			}
+		}
+		record++;
+	}
+	slotNextRecord = slot_Stage_Is_Valid(SLOT_STAGE) ? (BL_SLOT_TABLE_ADDRESS + BL_SLOT_TABLE_LENGTH) : (uint32_t)record;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Recover( void )
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint8_t slotStatus = BL_SLOT_OK;
+	
+	/*	a stage is only left behind by a reset during a compaction, it is finished before anything is appended	*/
+	if(slot_Stage_Is_Valid(SLOT_STAGE))
+	{
+		slotStatus = slot_Compact_Finish(SLOT_STAGE);
+		halStatus |= BL_Flash_End();
+	}
+	
+	return ((BL_SLOT_OK == slotStatus) && (HAL_OK == halStatus)) ? BL_SLOT_OK : BL_SLOT_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Select_Boot( void )
+{
+	return slot_Select(1);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Select_Header( void )
+{
+	/*	same choice without hashing the images, for the reset path where every microsecond counts	*/
+	return slot_Select(0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Verify( uint8_t slot )
+{
+	if(!slot_Header_Is_Bootable(slot))
+	{
+		return BL_SLOT_ERROR;
+	}
+	
+#ifdef BL_SECURE_BOOT
+	/*	an interrupted update of the slot leaves its old header behind, the manifest digest catches it :	*/
+	/*	it covers the same bytes as the image CRC, so the image is read once							*/
+	if(BL_MANIFEST_OK != BL_Manifest_Verify(slot, slotLatest[slot].length, slotLatest[slot].version))
+	{
+		return BL_SLOT_ERROR;
+	}
+#else
+	/*	an interrupted update of the slot leaves its old header behind, the image CRC catches it	*/
+	if(slotLatest[slot].imageCrc != BL_CRC_Calculate((const uint8_t *)BL_SLOT_ADDRESS(slot), slotLatest[slot].length))
+	{
+		return BL_SLOT_ERROR;
+	}
+#endif
+	
+	return BL_SLOT_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Get_Record( uint8_t slot, BL_SlotRecordTypeDef *record )
+{
+	if(slot >= BL_SLOT_COUNT)
+	{
+		return BL_SLOT_ERROR;
+	}
+	*record = slotLatest[slot];
+	return (BL_SLOT_STATE_VALID == record->state) ? BL_SLOT_OK : BL_SLOT_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Activate( uint8_t slot, uint32_t version, uint32_t length, uint32_t imageCrc )
+{
+	BL_SlotRecordTypeDef record;
+	
+	/*	the header is only committed for an image that is already complete in the slot	*/
+	if( (slot >= BL_SLOT_COUNT) || (0 == length) || (length > SLOT_IMAGE_LIMIT(slot))	||
+			(imageCrc != BL_CRC_Calculate((const uint8_t *)BL_SLOT_ADDRESS(slot), length))	||
+			!slot_Vector_Table_Looks_Valid(slot) )
+	{
+		return BL_SLOT_ERROR;
+	}
+	
+#ifdef BL_SECURE_BOOT
+	/*	an unsigned image is never committed, so it can never be selected for boot	*/
+	if(BL_MANIFEST_OK != BL_Manifest_Verify(slot, length, version))
+	{
+		return BL_SLOT_ERROR;
+	}
+#endif
+	
+	memset(&record, 0xFF, sizeof(record));
+	record.magic = BL_SLOT_RECORD_MAGIC;
+	record.version = version;
+	record.length = length;
+	record.imageCrc = imageCrc;
+	record.slot = slot;
+	record.state = BL_SLOT_STATE_VALID;
+	
+	return slot_Append(&record);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Rollback( uint8_t slot )
+{
+	/*	rolling back re-commits the header the slot already has, nothing is downloaded again	*/
+	if((slot >= BL_SLOT_COUNT) || (BL_SLOT_OK != BL_Slot_Verify(slot)))
+	{
+		return BL_SLOT_ERROR;
+	}
+	
+	return BL_Slot_Activate(slot, slotLatest[slot].version, slotLatest[slot].length, slotLatest[slot].imageCrc);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+uint8_t BL_Slot_Compact( void )
+{
+	/*	the update journal runs full in the same sector, it is compacted together with the slot records	*/
+	return slot_Compact();
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint8_t slot_Record_Is_Valid(const BL_SlotRecordTypeDef *record)
+{
+	return	(BL_SLOT_RECORD_MAGIC == record->magic)																											&&
+					(record->slot < BL_SLOT_COUNT)																																&&
+					(record->recordCrc == BL_CRC_Calculate((const uint8_t *)record, SLOT_RECORD_CRC_LEN));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Append(BL_SlotRecordTypeDef *record)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint8_t flashWasOpen = BL_Flash_Is_Open();
+	
+	if((slotNextRecord + SLOT_RECORD_LEN > BL_SLOT_TABLE_ADDRESS + BL_SLOT_TABLE_LENGTH) && (BL_SLOT_OK != slot_Compact()))
+	{
+		return BL_SLOT_ERROR;
+	}
+	
+	record->sequence = slotNextSequence;
+	record->recordCrc = BL_CRC_Calculate((const uint8_t *)record, SLOT_RECORD_CRC_LEN);
+	
+	/*	one 32-byte program is the whole switch, a reset before it completes keeps the previous slot	*/
+	halStatus |= BL_Flash_Begin();
+	halStatus |= BL_Flash_Program(slotNextRecord, (const uint8_t *)record, SLOT_RECORD_LEN);
+	if(!flashWasOpen)
+	{
+		halStatus |= BL_Flash_End();
+	}
+	FLASH_FlushCaches();
+	
+	BL_Slot_Init();
+	
+	return ((HAL_OK == halStatus) && (slotLatest[record->slot].sequence == record->sequence)) ? BL_SLOT_OK : BL_SLOT_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Compact(void)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	BL_SlotStageTypeDef stage;
+	
+	/*	table or journal full : keep only the latest record of each slot, sequence numbers are preserved	*/
+	/*	staged in scratch first, until the stage is complete the slot table sector is left as it is		*/
+	memset(&stage, 0xFF, sizeof(stage));
+	stage.magic = BL_SLOT_STAGE_MAGIC;
+	memcpy(stage.records, slotLatest, sizeof(stage.records));
+	(void)BL_Journal_Query(&stage.journalHeader, &stage.journalRecorded);
+	stage.stageCrc = BL_CRC_Calculate((const uint8_t *)&stage, SLOT_STAGE_CRC_LEN);
+	
+	halStatus |= BL_Flash_Begin();
+	halStatus |= BL_Flash_Erase_Sector(BL_SLOT_STAGE_SECTOR);
+	halStatus |= BL_Flash_Program(BL_SLOT_STAGE_ADDRESS, (const uint8_t *)&stage, SLOT_STAGE_LEN);
+	FLASH_FlushCaches();
+	
+	if((HAL_OK != halStatus) || !slot_Stage_Is_Valid(SLOT_STAGE))
+	{
+		return BL_SLOT_ERROR;
+	}
+	
+	return slot_Compact_Finish(SLOT_STAGE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Compact_Finish(const BL_SlotStageTypeDef *stage)
+{
+	HAL_StatusTypeDef halStatus = HAL_OK;
+	uint32_t address = BL_SLOT_TABLE_ADDRESS;
+	const uint32_t stageRetired = 0;
+	
+	halStatus |= BL_Flash_Begin();
+	halStatus |= BL_Flash_Erase_Sector(BL_SLOT_TABLE_SECTOR);
+	for(uint8_t slot = 0; slot < BL_SLOT_COUNT; slot++)
+	{
+		if(BL_SLOT_RECORD_MAGIC == stage->records[slot].magic)
+		{
+			halStatus |= BL_Flash_Program(address, (const uint8_t *)&stage->records[slot], SLOT_RECORD_LEN);
+			address += SLOT_RECORD_LEN;
+		}
+	}
+	FLASH_FlushCaches();
+	
+	/*	the erase took the journal with it, its open session is written back	*/
+	if(BL_JOURNAL_OK != BL_Journal_Restore(&stage->journalHeader, stage->journalRecorded))
+	{
+		halStatus |= HAL_ERROR;
+	}
+	
+	/*	only a complete rewrite retires the stage, a reset before this word repeats the rewrite	*/
+	if(HAL_OK == halStatus)
+	{
+		halStatus |= BL_Flash_Program(BL_SLOT_STAGE_ADDRESS, (const uint8_t *)&stageRetired, sizeof(stageRetired));
+		FLASH_FlushCaches();
+	}
+	
+	BL_Slot_Init();
+	
+	return (HAL_OK == halStatus) ? BL_SLOT_OK : BL_SLOT_ERROR;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Stage_Is_Valid(const BL_SlotStageTypeDef *stage)
+{
+	return	(BL_SLOT_STAGE_MAGIC == stage->magic)	&&
+					(stage->stageCrc == BL_CRC_Calculate((const uint8_t *)stage, SLOT_STAGE_CRC_LEN));
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Select(uint8_t verifyImage)
+{
+	uint8_t bootSlot = BL_SLOT_NONE;
+	
+	/*	newest committed slot that checks out wins, the other one is the fallback	*/
+	for(uint8_t slot = 0; slot < BL_SLOT_COUNT; slot++)
+	{
+		uint8_t slotUsable = verifyImage ? (BL_SLOT_OK == BL_Slot_Verify(slot)) : slot_Header_Is_Bootable(slot);
+		if( slotUsable	&&
+				((BL_SLOT_NONE == bootSlot) || (slotLatest[slot].sequence > slotLatest[bootSlot].sequence)) )
+		{
+			bootSlot = slot;
+		}
+	}
+	
+	/*	no table yet : images flashed before the slot scheme live in slot A without a header, verified as	*/
+	/*	far as a header-less image can be																								*/
+	if((BL_SLOT_NONE == bootSlot) && (0 == slotLatest[BL_SLOT_A].sequence) && (0 == slotLatest[BL_SLOT_B].sequence) &&
+		 slot_Vector_Table_Looks_Valid(BL_SLOT_A) && (!verifyImage || slot_Legacy_Image_Verifies()))
+	{
+		bootSlot = BL_SLOT_A;
+	}
+	
+	return bootSlot;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Legacy_Image_Verifies(void)
+{
+#ifdef BL_SECURE_BOOT
+	/*	no header to take length and version from : the manifest names both and its signature covers them,	*/
+	/*	so an unsigned image in slot A does not boot through the fallback either							*/
+	const BL_ManifestTypeDef *manifest = (const BL_ManifestTypeDef *)BL_MANIFEST_ADDRESS(BL_SLOT_A);
+	return (BL_MANIFEST_OK == BL_Manifest_Verify(BL_SLOT_A, manifest->length, manifest->version));
+#else
+	/*	nothing to check the image against without a header, the vector table is all there is	*/
+	return 1;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Header_Is_Bootable(uint8_t slot)
+{
+	return	(slot < BL_SLOT_COUNT)																																	&&
+					(BL_SLOT_STATE_VALID == slotLatest[slot].state)																					&&
+					(0 != slotLatest[slot].length) && (slotLatest[slot].length <= SLOT_IMAGE_LIMIT(slot))			&&
+					slot_Vector_Table_Looks_Valid(slot);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t slot_Vector_Table_Looks_Valid(uint8_t slot)
+{
+	/*	linked for the slot's own address or position independent, the handoff rebases the latter	*/
+	return (BL_BOOT_IMAGE_INVALID != BL_Boot_Check_Vectors((const uint32_t *)BL_SLOT_ADDRESS(slot), BL_SLOT_ADDRESS(slot), BL_SLOT_LENGTH(slot)));
+}
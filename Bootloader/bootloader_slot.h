@@ -0,0 +1,90 @@
+#ifndef  BOOTLOADER_SLOT_H__
+#define	 BOOTLOADER_SLOT_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "bootloader_flash.h"
+#include "bootloader_crc.h"
+#include "bootloader_journal.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	flash map : bootloader sectors 0-1 | slot A sectors 2-6 | slot B sectors 7-9 | scratch 10 | slot table and update journal 11	*/
+/*	each slot needs an application linked for its own address or at 0 (position independent), the vector table sits at the slot start	*/
+#define BL_SLOT_A										0x00
+#define BL_SLOT_B										0x01
+#define BL_SLOT_COUNT								2U
+#define BL_SLOT_NONE								0xFF
+
+#define BL_SLOT_A_ADDRESS						0x08008000U
+#define BL_SLOT_A_LENGTH						0x00058000U
+#define BL_SLOT_B_ADDRESS						0x08060000U
+#define BL_SLOT_B_LENGTH						0x00060000U
+
+/*	slot table : append-only records, the sector is only erased when it runs full	*/
+/*	the last 16K of the sector hold the update journal (bootloader_journal.h), it is kept over a compaction	*/
+#define BL_SLOT_TABLE_SECTOR				11U
+#define BL_SLOT_TABLE_ADDRESS				0x080E0000U
+#define BL_SLOT_TABLE_LENGTH				0x0001C000U
+#define BL_SLOT_RECORD_MAGIC				0x544F4C53U
+
+/*	a compaction stages what it keeps in the scratch sector before the slot table sector is erased,	*/
+/*	a reset on the way leaves the stage behind and BL_Slot_Recover finishes the compaction from it		*/
+#define BL_SLOT_STAGE_SECTOR				10U
+#define BL_SLOT_STAGE_ADDRESS				0x080C0000U
+#define BL_SLOT_STAGE_MAGIC					0x47415453U
+
+/*	naming conventions for slot states	*/
+#define BL_SLOT_STATE_EMPTY					0x00
+#define BL_SLOT_STATE_VALID					0x01
+
+/*	naming conventions for slot status	*/
+#define BL_SLOT_OK									0x01
+#define BL_SLOT_ERROR								0x00
+
+/*	image header of a slot, one 32-byte record per commit	*/
+typedef struct{
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t version;
+	uint32_t length;
+	uint32_t imageCrc;
+	uint8_t slot;
+	uint8_t state;
+	uint16_t reserved0;
+	uint32_t reserved1;
+	uint32_t recordCrc;
+}BL_SlotRecordTypeDef;
+
+/*	what a compaction keeps : the latest record of each slot and the open session of the update journal	*/
+typedef struct{
+	uint32_t magic;
+	uint32_t journalRecorded;
+	BL_SlotRecordTypeDef records[BL_SLOT_COUNT];
+	BL_JournalHeaderTypeDef journalHeader;
+	uint32_t reserved;
+	uint32_t stageCrc;
+}BL_SlotStageTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+#define BL_SLOT_ADDRESS(slot)				(((slot) == BL_SLOT_B) ? BL_SLOT_B_ADDRESS : BL_SLOT_A_ADDRESS)
+#define BL_SLOT_LENGTH(slot)				(((slot) == BL_SLOT_B) ? BL_SLOT_B_LENGTH : BL_SLOT_A_LENGTH)
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Slot_Init( void );
+uint8_t BL_Slot_Recover( void );
+uint8_t BL_Slot_Select_Boot( void );
+uint8_t BL_Slot_Select_Header( void );
+uint8_t BL_Slot_Verify( uint8_t slot );
+uint8_t BL_Slot_Get_Record( uint8_t slot, BL_SlotRecordTypeDef *record );
+uint8_t BL_Slot_Activate( uint8_t slot, uint32_t version, uint32_t length, uint32_t imageCrc );
+uint8_t BL_Slot_Rollback( uint8_t slot );
+uint8_t BL_Slot_Compact( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_SLOT_H__*/
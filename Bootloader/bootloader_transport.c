@@ -0,0 +1,104 @@
+#include "bootloader_transport.h"
+#include "bootloader_rx.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	the link frames are received from and replies go out on, and the one to fall back to	*/
+static const BL_TransportTypeDef *volatile transportActive = NULL;
+static const BL_TransportTypeDef *transportDefault = NULL;
+static void (*transportBackground)(void) = NULL;
+
+/* Static Software Interface Declarations ------------------------------------*/
+
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_Transport_Init( const BL_TransportTypeDef *defaultTransport )
+{
+	transportDefault = defaultTransport;
+	transportActive = defaultTransport;
+	BL_RX_Init(defaultTransport);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Transport_Select( const BL_TransportTypeDef *transport )
+{
+	/*	NULL goes back to the default link, called by a link when its host comes or goes	*/
+	if(NULL == transport)
+	{
+		transport = transportDefault;
+	}
+	if((NULL == transport) || (transport == transportActive))
+	{
+		return;
+	}
+	
+	/*	whatever the old host had in flight is dropped, the new one starts on an empty ring in v1	*/
+	transportActive = transport;
+	BL_RX_Init(transport);
+	BL_RX_Set_Format(BL_RX_FORMAT_V1);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+const BL_TransportTypeDef *BL_Transport_Active( void )
+{
+	return transportActive;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC uint8_t BL_Transport_Is_Active( uint8_t id )
+{
+	return (NULL != transportActive) && (id == transportActive->id);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_Transport_Send( const uint8_t *data, uint16_t length )
+{
+	const BL_TransportTypeDef *transport = transportActive;
+	return (NULL == transport) ? HAL_ERROR : transport->send(data, length);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+HAL_StatusTypeDef BL_Transport_Flush( void )
+{
+	const BL_TransportTypeDef *transport = transportActive;
+	return (NULL == transport) ? HAL_ERROR : transport->flush();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Transport_Set_Background( void (*task)( void ) )
+{
+	transportBackground = task;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_Transport_Background( void )
+{
+	if(NULL != transportBackground)
+	{
+		transportBackground();
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
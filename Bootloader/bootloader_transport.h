@@ -0,0 +1,54 @@
+#ifndef  BOOTLOADER_TRANSPORT_H__
+#define	 BOOTLOADER_TRANSPORT_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	naming conventions for host links, SPI (0x03) and CAN (0x04) are reserved for later links	*/
+#define BL_TRANSPORT_UART						0x01
+#define BL_TRANSPORT_USB						0x02
+
+/*	how long a send may wait for room on a link that queues its output	*/
+#define BL_TRANSPORT_SEND_TIMEOUT_MS	1000U
+
+/*	a host link under the frame layer : it writes whatever arrives into the receive ring and sends replies	*/
+/*	open    : start writing the ring circularly from offset 0, report progress with BL_RX_Ring_Event		*/
+/*	close   : stop writing the ring, bytes still arriving are dropped or held back by the link				*/
+/*	head    : write position in the ring as the link sees it right now																*/
+/*	resume  : the frame layer freed ring space, a link with flow control may take more (NULL if none)	*/
+/*	send    : queue or send bytes to the host																										*/
+/*	flush   : wait until everything sent has left the device																			*/
+/*	frames are assembled out of the ring by bootloader_rx for every link alike											*/
+typedef struct{
+	uint8_t id;
+	void (*open)( uint8_t *ring, uint16_t ringLength );
+	void (*close)( void );
+	uint16_t (*head)( void );
+	void (*resume)( void );
+	HAL_StatusTypeDef (*send)( const uint8_t *data, uint16_t length );
+	HAL_StatusTypeDef (*flush)( void );
+}BL_TransportTypeDef;
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+void BL_Transport_Init( const BL_TransportTypeDef *defaultTransport );
+void BL_Transport_Select( const BL_TransportTypeDef *transport );
+const BL_TransportTypeDef *BL_Transport_Active( void );
+uint8_t BL_Transport_Is_Active( uint8_t id );
+HAL_StatusTypeDef BL_Transport_Send( const uint8_t *data, uint16_t length );
+HAL_StatusTypeDef BL_Transport_Flush( void );
+
+/*	work a link hands to the thread (DFU erase and program), run by the frame layer while it waits for a frame	*/
+void BL_Transport_Set_Background( void (*task)( void ) );
+void BL_Transport_Background( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_TRANSPORT_H__*/
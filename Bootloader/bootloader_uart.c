@@ -0,0 +1,114 @@
+#include "bootloader_uart.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static UART_HandleTypeDef *uartHost = NULL;
+static uint16_t uartRingLength = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void uart_Open(uint8_t *ring, uint16_t ringLength);
+static void uart_Close(void);
+static uint16_t uart_Head(void);
+static HAL_StatusTypeDef uart_Send(const uint8_t *data, uint16_t length);
+static HAL_StatusTypeDef uart_Flush(void);
+
+const BL_TransportTypeDef BL_UART_Transport = {
+	BL_TRANSPORT_UART,
+	uart_Open,
+	uart_Close,
+	uart_Head,
+	NULL,
+	uart_Send,
+	uart_Flush,
+};
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_UART_Init( UART_HandleTypeDef *huart )
+{
+	uartHost = huart;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	if((huart != uartHost) || !BL_Transport_Is_Active(BL_TRANSPORT_UART))
+	{
+		return;
+	}
+	
+	/*	the write position is read back from the DMA counter rather than taken from Size : after a flash erase	*/
+	/*	has stalled the CPU, half transfer, transfer complete and idle events arrive together and out of order	*/
+	(void)Size;
+	BL_RX_Ring_Event(uart_Head());
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	/*	HAL aborts reception on overrun/framing/noise errors, restart it at the current ring position	*/
+	if((huart == uartHost) && BL_Transport_Is_Active(BL_TRANSPORT_UART))
+	{
+		BL_RX_Flush();
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void uart_Open(uint8_t *ring, uint16_t ringLength)
+{
+	uartRingLength = ringLength;
+	HAL_UARTEx_ReceiveToIdle_DMA(uartHost, ring, ringLength);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void uart_Close(void)
+{
+	HAL_UART_AbortReceive(uartHost);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static uint16_t uart_Head(void)
+{
+	return (uint16_t)((uartRingLength - __HAL_DMA_GET_COUNTER(uartHost->hdmarx)) % uartRingLength);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef uart_Send(const uint8_t *data, uint16_t length)
+{
+	/*	blocking : the bytes are on the wire, but for the last one, when this returns	*/
+	return HAL_UART_Transmit(uartHost, (uint8_t *)data, length, HAL_MAX_DELAY);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef uart_Flush(void)
+{
+	uint32_t startTick = HAL_GetTick();
+	
+	while(RESET == __HAL_UART_GET_FLAG(uartHost, UART_FLAG_TC))
+	{
+		if((HAL_GetTick() - startTick) >= BL_UART_FLUSH_TIMEOUT_MS)
+		{
+			return HAL_TIMEOUT;
+		}
+	}
+	return HAL_OK;
+}
@@ -0,0 +1,29 @@
+#ifndef  BOOTLOADER_UART_H__
+#define	 BOOTLOADER_UART_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include "usart.h"
+#include "bootloader_flash.h"
+#include "bootloader_transport.h"
+#include "bootloader_rx.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	how long a flush waits for the last byte to leave the shift register	*/
+#define BL_UART_FLUSH_TIMEOUT_MS		10U
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+/*	host link over a UART : circular DMA reception with idle line detection, blocking transmit	*/
+extern const BL_TransportTypeDef BL_UART_Transport;
+
+void BL_UART_Init( UART_HandleTypeDef *huart );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_UART_H__*/
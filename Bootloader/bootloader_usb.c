@@ -0,0 +1,870 @@
+#include "bootloader_usb.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+/*	standard requests, descriptor types and the control pipe states this device goes through	*/
+#define USB_REQ_TYPE_MASK						0x60U
+#define USB_REQ_TYPE_STANDARD				0x00U
+#define USB_REQ_TYPE_CLASS					0x20U
+#define USB_REQ_RECIPIENT_MASK			0x1FU
+#define USB_REQ_RECIPIENT_INTERFACE	0x01U
+#define USB_REQ_RECIPIENT_ENDPOINT	0x02U
+#define USB_REQ_GET_STATUS					0x00U
+#define USB_REQ_CLEAR_FEATURE				0x01U
+#define USB_REQ_SET_FEATURE					0x03U
+#define USB_REQ_SET_ADDRESS					0x05U
+#define USB_REQ_GET_DESCRIPTOR			0x06U
+#define USB_REQ_GET_CONFIGURATION		0x08U
+#define USB_REQ_SET_CONFIGURATION		0x09U
+#define USB_REQ_GET_INTERFACE				0x0AU
+#define USB_REQ_SET_INTERFACE				0x0BU
+#define USB_DESC_DEVICE							0x01U
+#define USB_DESC_CONFIGURATION			0x02U
+#define USB_DESC_STRING							0x03U
+#define USB_CTL_IDLE								0x00U
+#define USB_CTL_DATA_IN							0x01U
+#define USB_CTL_DATA_OUT						0x02U
+#define USB_CTL_STATUS_IN						0x03U
+#define USB_CTL_STATUS_OUT					0x04U
+#define USB_CONFIG_DESCRIPTOR_LEN		93U
+#define USB_STRING_MAX_CHARS				96U
+
+static const uint8_t usbDeviceDescriptor[18] = {
+	18, USB_DESC_DEVICE, 0x00, 0x02,																/*	USB 2.0									*/
+	0xEF, 0x02, 0x01, BL_USB_EP0_MPS,															/*	composite with IADs			*/
+	(uint8_t)BL_USB_VID, (uint8_t)(BL_USB_VID >> 8), (uint8_t)BL_USB_PID, (uint8_t)(BL_USB_PID >> 8),
+	(uint8_t)BL_USB_BCD_DEVICE, (uint8_t)(BL_USB_BCD_DEVICE >> 8),
+	1, 2, 3, 1																										/*	strings, 1 configuration	*/
+};
+
+/*	one configuration : the CDC pair grouped by an IAD (communication interface with its notification endpoint,	*/
+/*	data interface with the bulk pair), then the DFU interface, which only uses the control endpoint					*/
+static const uint8_t usbConfigDescriptor[USB_CONFIG_DESCRIPTOR_LEN] = {
+	9, USB_DESC_CONFIGURATION, USB_CONFIG_DESCRIPTOR_LEN, 0x00, 3, 1, 0, 0x80, 50,
+	8, 0x0B, 0, 2, 0x02, 0x02, 0x01, 0,															/*	IAD : interfaces 0-1		*/
+	9, 0x04, 0, 0, 1, 0x02, 0x02, 0x01, 0,													/*	interface 0 : CDC ACM		*/
+	5, 0x24, 0x00, 0x10, 0x01,																			/*	header, CDC 1.10				*/
+	5, 0x24, 0x01, 0x00, 1,																					/*	call management					*/
+	4, 0x24, 0x02, 0x02,																						/*	ACM : line coding/state	*/
+	5, 0x24, 0x06, 0, 1,																						/*	union : 0 controls 1		*/
+	7, 0x05, BL_USB_CMD_IN_EP, 0x03, BL_USB_CMD_MPS, 0x00, 0x10,
+	9, 0x04, 1, 0, 2, 0x0A, 0x00, 0x00, 0,													/*	interface 1 : CDC data	*/
+	7, 0x05, BL_USB_DATA_OUT_EP, 0x02, BL_USB_DATA_MPS, 0x00, 0x00,
+	7, 0x05, BL_USB_DATA_IN_EP, 0x02, BL_USB_DATA_MPS, 0x00, 0x00,
+	9, 0x04, BL_DFU_INTERFACE, 0, 0, 0xFE, 0x01, 0x02, BL_DFU_STRING_INDEX,		/*	interface 2 : DFU mode	*/
+	9, 0x21, 0x03, (uint8_t)BL_DFU_DETACH_TIMEOUT_MS, 0x00,								/*	download, upload				*/
+	(uint8_t)BL_DFU_TRANSFER_SIZE, (uint8_t)(BL_DFU_TRANSFER_SIZE >> 8), (uint8_t)BL_DFU_VERSION, (uint8_t)(BL_DFU_VERSION >> 8)
+};
+
+static const uint8_t usbLangIdDescriptor[4] = { 4, USB_DESC_STRING, 0x09, 0x04 };
+static const char usbManufacturerString[] = "PractiseBL";
+static const char usbProductString[] = "PractiseBL Bootloader";
+
+static PCD_HandleTypeDef *usbPcd = NULL;
+static volatile uint8_t usbConfiguration = 0;
+static volatile uint8_t usbLineState = 0;
+
+/*	115200 8N1 until the host sets its own, only ever reported back	*/
+static uint8_t usbLineCoding[BL_USB_CDC_LINE_CODING_LEN] = { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };
+
+/*	control pipe : the data stage in flight and what is left of it, OUT data lands at usbCtlRxData	*/
+static uint8_t usbCtlState = USB_CTL_IDLE;
+static uint8_t usbCtlRequest = 0;
+static uint8_t usbCtlDfu = 0;
+static const uint8_t *usbCtlData = NULL;
+static uint8_t *usbCtlRxData = NULL;
+static uint16_t usbCtlReceived = 0;
+static uint16_t usbCtlRemaining = 0;
+static uint8_t usbCtlZlp = 0;
+static uint8_t usbCtlBuffer[8] __attribute__((aligned(4)));
+static uint8_t usbStringBuffer[2 + (2 * USB_STRING_MAX_CHARS)] __attribute__((aligned(4)));
+
+/*	receive : one OUT packet at a time, copied into the frame layer's ring while it is open	*/
+static uint8_t usbRxPacket[BL_USB_DATA_MPS] __attribute__((aligned(4)));
+static uint8_t *usbRing = NULL;
+static uint16_t usbRingLength = 0;
+static volatile uint16_t usbRingHead = 0;
+static volatile uint8_t usbRingOpen = 0;
+static volatile uint8_t usbRxArmed = 0;
+
+/*	transmit : replies wait here, usbTxInFlight bytes from usbTxTail are on the IN endpoint	*/
+static uint8_t usbTxRing[BL_USB_TX_RING_LEN] __attribute__((aligned(4)));
+static volatile uint16_t usbTxHead = 0;
+static volatile uint16_t usbTxTail = 0;
+static volatile uint16_t usbTxInFlight = 0;
+static volatile uint8_t usbTxBusy = 0;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void usb_Open(uint8_t *ring, uint16_t ringLength);
+static void usb_Close(void);
+static uint16_t usb_Head(void);
+static void usb_Resume(void);
+static HAL_StatusTypeDef usb_Send(const uint8_t *data, uint16_t length);
+static HAL_StatusTypeDef usb_Flush(void);
+static uint8_t usb_Link_Up(void);
+static void usb_Arm_Receive(void);
+static void usb_Start_Transmit(void);
+static void usb_Reset_Pipes(void);
+static void usb_Standard_Request(const uint8_t *setup);
+static void usb_Class_Request(const uint8_t *setup);
+static void usb_Dfu_Request(const uint8_t *setup);
+static void usb_Get_Descriptor(uint16_t value, uint16_t length);
+static void usb_Set_Configuration(uint8_t configuration);
+static void usb_Line_State_Changed(void);
+static const uint8_t *usb_String_Descriptor(uint8_t index);
+static void usb_Ctl_Send(const uint8_t *data, uint16_t length, uint16_t requested);
+static void usb_Ctl_Send_Next(void);
+static void usb_Ctl_Receive(uint8_t *data, uint16_t length);
+static void usb_Ctl_Status_In(void);
+static void usb_Ctl_Stall(void);
+static void usb_Ctl_In_Stage(void);
+static void usb_Ctl_Out_Stage(void);
+
+const BL_TransportTypeDef BL_USB_Transport = {
+	BL_TRANSPORT_USB,
+	usb_Open,
+	usb_Close,
+	usb_Head,
+	usb_Resume,
+	usb_Send,
+	usb_Flush,
+};
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+void BL_USB_Init( PCD_HandleTypeDef *hpcd )
+{
+	usbPcd = hpcd;
+	
+	/*	FIFO sizes before the core starts, enumeration then runs from the interrupt in the background	*/
+	HAL_PCDEx_SetRxFiFo(hpcd, BL_USB_RX_FIFO_WORDS);
+	HAL_PCDEx_SetTxFiFo(hpcd, 0, BL_USB_TX0_FIFO_WORDS);
+	HAL_PCDEx_SetTxFiFo(hpcd, BL_USB_DATA_IN_EP & 0x7FU, BL_USB_TX1_FIFO_WORDS);
+	HAL_PCDEx_SetTxFiFo(hpcd, BL_USB_CMD_IN_EP & 0x7FU, BL_USB_TX2_FIFO_WORDS);
+	BL_DFU_Init();
+	HAL_PCD_Start(hpcd);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void BL_USB_DeInit( void )
+{
+	/*	the host sees the device go away, the application enumerates its own	*/
+	if(NULL != usbPcd)
+	{
+		HAL_PCD_Stop(usbPcd);
+		HAL_PCD_DeInit(usbPcd);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+	const uint8_t *setup = (const uint8_t *)hpcd->Setup;
+	
+	/*	a new setup packet ends whatever the control pipe was doing	*/
+	/*	class requests run from SRAM1 : DFU status polls keep being answered while a sector is erased	*/
+	usbCtlState = USB_CTL_IDLE;
+	usbCtlDfu = 0;
+	if(USB_REQ_TYPE_STANDARD == (setup[0] & USB_REQ_TYPE_MASK))
+	{
+		usb_Standard_Request(setup);
+	}
+	else if(USB_REQ_TYPE_CLASS == (setup[0] & USB_REQ_TYPE_MASK))
+	{
+		usb_Class_Request(setup);
+	}
+	else
+	{
+		usb_Ctl_Stall();
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	if(0U == epnum)
+	{
+		usb_Ctl_Out_Stage();
+		return;
+	}
+	if((BL_USB_DATA_OUT_EP & 0x7FU) != epnum)
+	{
+		return;
+	}
+	
+	/*	a packet that lands after the ring was closed is dropped, the ring never overflows : usb_Arm_Receive checked for room	*/
+	usbRxArmed = 0;
+	if(usbRingOpen)
+	{
+		uint16_t count = (uint16_t)HAL_PCD_EP_GetRxCount(hpcd, epnum);
+		uint16_t head = usbRingHead;
+	
+		for(uint16_t i = 0; i < count; i++)
+		{
+			usbRing[head] = usbRxPacket[i];
+			head = (uint16_t)((head + 1U) % usbRingLength);
+		}
+		usbRingHead = head;
+		BL_RX_Ring_Event(head);
+	}
+	usb_Arm_Receive();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	uint16_t sent;
+	
+	if(0U == epnum)
+	{
+		usb_Ctl_In_Stage();
+		return;
+	}
+	if((BL_USB_DATA_IN_EP & 0x7FU) != epnum)
+	{
+		return;
+	}
+	
+	sent = usbTxInFlight;
+	usbTxTail = (uint16_t)((usbTxTail + sent) % BL_USB_TX_RING_LEN);
+	usbTxInFlight = 0;
+	usbTxBusy = 0;
+	
+	/*	a transfer that ends on a full packet leaves the host's read open, a zero length packet closes it	*/
+	if(sent && (0U == (sent % BL_USB_DATA_MPS)) && (usbTxHead == usbTxTail))
+	{
+		usbTxBusy = 1;
+		HAL_PCD_EP_Transmit(hpcd, BL_USB_DATA_IN_EP, NULL, 0);
+		return;
+	}
+	usb_Start_Transmit();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+	/*	bus reset : back to the default address and state, only the control endpoint is open	*/
+	HAL_PCD_EP_Open(hpcd, 0x00U, BL_USB_EP0_MPS, EP_TYPE_CTRL);
+	HAL_PCD_EP_Open(hpcd, 0x80U, BL_USB_EP0_MPS, EP_TYPE_CTRL);
+	usbConfiguration = 0;
+	usbLineState = 0;
+	usbCtlState = USB_CTL_IDLE;
+	usb_Reset_Pipes();
+	usb_Line_State_Changed();
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void usb_Open(uint8_t *ring, uint16_t ringLength)
+{
+	/*	called from the USB interrupt when the port is opened, or from the frame layer	*/
+	uint32_t primask = __get_PRIMASK();
+	
+	__disable_irq();
+	usbRing = ring;
+	usbRingLength = ringLength;
+	usbRingHead = 0;
+	usbRingOpen = 1;
+	usb_Arm_Receive();
+	__set_PRIMASK(primask);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Close(void)
+{
+	/*	a receive still armed completes into nothing and is not armed again	*/
+	usbRingOpen = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static uint16_t usb_Head(void)
+{
+	return usbRingHead;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Resume(void)
+{
+	usb_Arm_Receive();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef usb_Send(const uint8_t *data, uint16_t length)
+{
+	uint32_t startTick = HAL_GetTick();
+	
+	while(length)
+	{
+		uint32_t primask = __get_PRIMASK();
+		uint16_t space, chunk;
+	
+		if(!usb_Link_Up())
+		{
+			return HAL_ERROR;
+		}
+	
+		/*	queue what fits, the IN endpoint takes it from the ring in the background	*/
+		__disable_irq();
+		space = (uint16_t)((BL_USB_TX_RING_LEN - 1U) - ((usbTxHead + BL_USB_TX_RING_LEN - usbTxTail) % BL_USB_TX_RING_LEN));
+		chunk = (length < space) ? length : space;
+		for(uint16_t i = 0; i < chunk; i++)
+		{
+			usbTxRing[(usbTxHead + i) % BL_USB_TX_RING_LEN] = data[i];
+		}
+		usbTxHead = (uint16_t)((usbTxHead + chunk) % BL_USB_TX_RING_LEN);
+		usb_Start_Transmit();
+		__set_PRIMASK(primask);
+	
+		data += chunk;
+		length -= chunk;
+		if(chunk)
+		{
+			startTick = HAL_GetTick();
+		}
+		else if((HAL_GetTick() - startTick) >= BL_TRANSPORT_SEND_TIMEOUT_MS)
+		{
+			return HAL_TIMEOUT;
+		}
+	}
+	return HAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static HAL_StatusTypeDef usb_Flush(void)
+{
+	uint32_t startTick = HAL_GetTick();
+	
+	while(usbTxBusy || (usbTxHead != usbTxTail))
+	{
+		if(!usb_Link_Up())
+		{
+			return HAL_ERROR;
+		}
+		if((HAL_GetTick() - startTick) >= BL_TRANSPORT_SEND_TIMEOUT_MS)
+		{
+			return HAL_TIMEOUT;
+		}
+	}
+	return HAL_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static uint8_t usb_Link_Up(void)
+{
+	return usbConfiguration && (usbLineState & BL_USB_CDC_LINE_STATE_DTR);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Arm_Receive(void)
+{
+	/*	called from the USB interrupt or with interrupts masked : the host is NAKed until the ring has room for a packet	*/
+	if(usbRingOpen && usbConfiguration && !usbRxArmed && (BL_RX_Ring_Free() >= BL_USB_DATA_MPS))
+	{
+		usbRxArmed = 1;
+		HAL_PCD_EP_Receive(usbPcd, BL_USB_DATA_OUT_EP, usbRxPacket, BL_USB_DATA_MPS);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Start_Transmit(void)
+{
+	/*	called from the USB interrupt or with interrupts masked : everything contiguous in the ring goes as one transfer	*/
+	if(!usbTxBusy && usbConfiguration && (usbTxHead != usbTxTail))
+	{
+		uint16_t length = (usbTxHead > usbTxTail) ? (uint16_t)(usbTxHead - usbTxTail) : (uint16_t)(BL_USB_TX_RING_LEN - usbTxTail);
+		usbTxBusy = 1;
+		usbTxInFlight = length;
+		HAL_PCD_EP_Transmit(usbPcd, BL_USB_DATA_IN_EP, &usbTxRing[usbTxTail], length);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Reset_Pipes(void)
+{
+	/*	unconfigured : nothing is armed or in flight any more, queued replies are dropped	*/
+	usbRxArmed = 0;
+	usbTxBusy = 0;
+	usbTxInFlight = 0;
+	usbTxHead = 0;
+	usbTxTail = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Standard_Request(const uint8_t *setup)
+{
+	uint16_t value = (uint16_t)(setup[2] | (setup[3] << 8));
+	uint16_t index = (uint16_t)(setup[4] | (setup[5] << 8));
+	uint16_t length = (uint16_t)(setup[6] | (setup[7] << 8));
+	uint8_t toEndpoint = (USB_REQ_RECIPIENT_ENDPOINT == (setup[0] & USB_REQ_RECIPIENT_MASK));
+	
+	switch(setup[1])
+	{
+		case USB_REQ_GET_DESCRIPTOR:
+			usb_Get_Descriptor(value, length);
+			break;
+	
+		case USB_REQ_SET_ADDRESS:
+			/*	the core answers the status stage at the old address, then uses the new one	*/
+			HAL_PCD_SetAddress(usbPcd, (uint8_t)(value & 0x7FU));
+			usb_Ctl_Status_In();
+			break;
+	
+		case USB_REQ_SET_CONFIGURATION:
+			if((value & 0xFFU) > 1U)
+			{
+				usb_Ctl_Stall();
+				break;
+			}
+			usb_Set_Configuration((uint8_t)value);
+			usb_Ctl_Status_In();
+			break;
+	
+		case USB_REQ_GET_CONFIGURATION:
+			usbCtlBuffer[0] = usbConfiguration;
+			usb_Ctl_Send(usbCtlBuffer, 1, length);
+			break;
+	
+		case USB_REQ_GET_STATUS:
+			/*	bus powered, no remote wakeup, no endpoint halted	*/
+			usbCtlBuffer[0] = 0;
+			usbCtlBuffer[1] = 0;
+			usb_Ctl_Send(usbCtlBuffer, 2, length);
+			break;
+	
+		case USB_REQ_CLEAR_FEATURE:
+		case USB_REQ_SET_FEATURE:
+			/*	endpoint halt is the only feature, on a data endpoint	*/
+			if(toEndpoint && (0U == value) && (0U != (index & 0x7FU)))
+			{
+				if(USB_REQ_SET_FEATURE == setup[1])
+				{
+					HAL_PCD_EP_SetStall(usbPcd, (uint8_t)index);
+				}
+				else
+				{
+					HAL_PCD_EP_ClrStall(usbPcd, (uint8_t)index);
+				}
+			}
+			usb_Ctl_Status_In();
+			break;
+	
+		case USB_REQ_GET_INTERFACE:
+			usbCtlBuffer[0] = 0;
+			usb_Ctl_Send(usbCtlBuffer, 1, length);
+			break;
+	
+		case USB_REQ_SET_INTERFACE:
+			usb_Ctl_Status_In();
+			break;
+	
+		default:
+			usb_Ctl_Stall();
+			break;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Class_Request(const uint8_t *setup)
+{
+	uint16_t value = (uint16_t)(setup[2] | (setup[3] << 8));
+	uint16_t index = (uint16_t)(setup[4] | (setup[5] << 8));
+	uint16_t length = (uint16_t)(setup[6] | (setup[7] << 8));
+	
+	if((USB_REQ_RECIPIENT_INTERFACE == (setup[0] & USB_REQ_RECIPIENT_MASK)) && (BL_DFU_INTERFACE == (index & 0xFFU)))
+	{
+		usb_Dfu_Request(setup);
+		return;
+	}
+	
+	switch(setup[1])
+	{
+		case BL_USB_CDC_SET_LINE_CODING:
+			/*	the rate goes nowhere, it is kept for GET_LINE_CODING so terminal programs stay happy	*/
+			if(BL_USB_CDC_LINE_CODING_LEN != length)
+			{
+				usb_Ctl_Stall();
+				break;
+			}
+			usbCtlRequest = setup[1];
+			usb_Ctl_Receive(usbCtlBuffer, BL_USB_CDC_LINE_CODING_LEN);
+			break;
+	
+		case BL_USB_CDC_GET_LINE_CODING:
+			usb_Ctl_Send(usbLineCoding, BL_USB_CDC_LINE_CODING_LEN, length);
+			break;
+	
+		case BL_USB_CDC_SET_LINE_STATE:
+			usbLineState = (uint8_t)value;
+			usb_Ctl_Status_In();
+			usb_Line_State_Changed();
+			break;
+	
+		case BL_USB_CDC_SEND_BREAK:
+			usb_Ctl_Status_In();
+			break;
+	
+		default:
+			usb_Ctl_Stall();
+			break;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Dfu_Request(const uint8_t *setup)
+{
+	/*	the DFU module decides, a download block goes straight into one of its buffers	*/
+	uint8_t *data = NULL;
+	uint16_t dataLength = 0;
+	uint16_t length = (uint16_t)(setup[6] | (setup[7] << 8));
+	
+	usbCtlDfu = 1;
+	switch(BL_DFU_Setup(setup, &data, &dataLength))
+	{
+		case BL_DFU_REPLY_IN:
+			usb_Ctl_Send(data, dataLength, length);
+			break;
+	
+		case BL_DFU_REPLY_OUT:
+			usb_Ctl_Receive(data, dataLength);
+			break;
+	
+		case BL_DFU_REPLY_STATUS:
+			usb_Ctl_Status_In();
+			break;
+	
+		default:
+			usb_Ctl_Stall();
+			break;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Get_Descriptor(uint16_t value, uint16_t length)
+{
+	const uint8_t *descriptor = NULL;
+	
+	switch(value >> 8)
+	{
+		case USB_DESC_DEVICE:
+			descriptor = usbDeviceDescriptor;
+			break;
+	
+		case USB_DESC_CONFIGURATION:
+			usb_Ctl_Send(usbConfigDescriptor, USB_CONFIG_DESCRIPTOR_LEN, length);
+			return;
+	
+		case USB_DESC_STRING:
+			descriptor = usb_String_Descriptor((uint8_t)value);
+			break;
+	
+		default:
+			/*	full speed only : no device qualifier, a high speed host asks for it and moves on	*/
+			break;
+	}
+	
+	if(NULL == descriptor)
+	{
+		usb_Ctl_Stall();
+		return;
+	}
+	usb_Ctl_Send(descriptor, descriptor[0], length);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Set_Configuration(uint8_t configuration)
+{
+	if(configuration == usbConfiguration)
+	{
+		return;
+	}
+	
+	usb_Reset_Pipes();
+	if(configuration)
+	{
+		HAL_PCD_EP_Open(usbPcd, BL_USB_DATA_OUT_EP, BL_USB_DATA_MPS, EP_TYPE_BULK);
+		HAL_PCD_EP_Open(usbPcd, BL_USB_DATA_IN_EP, BL_USB_DATA_MPS, EP_TYPE_BULK);
+		HAL_PCD_EP_Open(usbPcd, BL_USB_CMD_IN_EP, BL_USB_CMD_MPS, EP_TYPE_INTR);
+		usbConfiguration = configuration;
+		usb_Arm_Receive();
+	}
+	else
+	{
+		HAL_PCD_EP_Close(usbPcd, BL_USB_DATA_OUT_EP);
+		HAL_PCD_EP_Close(usbPcd, BL_USB_DATA_IN_EP);
+		HAL_PCD_EP_Close(usbPcd, BL_USB_CMD_IN_EP);
+		usbConfiguration = 0;
+		usbLineState = 0;
+		usb_Line_State_Changed();
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static void usb_Line_State_Changed(void)
+{
+	/*	a host program opening the port raises DTR : USB becomes the host link until the port is closed again	*/
+	if(usb_Link_Up())
+	{
+		BL_Transport_Select(&BL_USB_Transport);
+	}
+	else if(BL_Transport_Is_Active(BL_TRANSPORT_USB))
+	{
+		BL_Transport_Select(NULL);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+static const uint8_t *usb_String_Descriptor(uint8_t index)
+{
+	const char *text = NULL;
+	char serial[25];
+	uint8_t count = 0;
+	
+	switch(index)
+	{
+		case 0:
+			return usbLangIdDescriptor;
+	
+		case 1:
+			text = usbManufacturerString;
+			break;
+	
+		case 2:
+			text = usbProductString;
+			break;
+	
+		case 3:
+			/*	the 96 bit unique ID in hex, so several boards on one host keep apart	*/
+			for(uint8_t i = 0; i < 24U; i++)
+			{
+				uint32_t word = *((const uint32_t *)(UID_BASE + 4U * (i / 8U)));
+				uint8_t nibble = (uint8_t)((word >> (28U - 4U * (i % 8U))) & 0x0FU);
+				serial[i] = (char)((nibble < 10U) ? (uint32_t)('0' + nibble) : (uint32_t)('A' + nibble - 10U));
+			}
+			serial[24] = '\0';
+			text = serial;
+			break;
+	
+		case BL_DFU_STRING_INDEX:
+			text = BL_DFU_Layout();
+			break;
+	
+		default:
+			return NULL;
+	}
+	
+	/*	UTF-16LE, ASCII only	*/
+	while(text[count] && (count < USB_STRING_MAX_CHARS))
+	{
+		usbStringBuffer[2 + 2 * count] = (uint8_t)text[count];
+		usbStringBuffer[3 + 2 * count] = 0;
+		count++;
+	}
+	usbStringBuffer[0] = (uint8_t)(2 + 2 * count);
+	usbStringBuffer[1] = USB_DESC_STRING;
+	return usbStringBuffer;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Send(const uint8_t *data, uint16_t length, uint16_t requested)
+{
+	/*	never more than the host asked for, a short answer that ends on a full packet needs a zero length packet	*/
+	if(length > requested)
+	{
+		length = requested;
+	}
+	usbCtlData = data;
+	usbCtlRemaining = length;
+	usbCtlZlp = (length < requested) && (0U == (length % BL_USB_EP0_MPS));
+	usbCtlState = USB_CTL_DATA_IN;
+	usb_Ctl_Send_Next();
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Send_Next(void)
+{
+	/*	the core sends one EP0 packet per transfer	*/
+	uint16_t chunk = (usbCtlRemaining > BL_USB_EP0_MPS) ? BL_USB_EP0_MPS : usbCtlRemaining;
+	
+	HAL_PCD_EP_Transmit(usbPcd, 0x80U, (uint8_t *)usbCtlData, chunk);
+	usbCtlData += chunk;
+	usbCtlRemaining -= chunk;
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Receive(uint8_t *data, uint16_t length)
+{
+	/*	one packet per transfer here too, usb_Ctl_Out_Stage arms the rest of the data stage	*/
+	usbCtlRxData = data;
+	usbCtlReceived = 0;
+	usbCtlRemaining = length;
+	usbCtlState = USB_CTL_DATA_OUT;
+	HAL_PCD_EP_Receive(usbPcd, 0x00U, data, (length > BL_USB_EP0_MPS) ? BL_USB_EP0_MPS : length);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Status_In(void)
+{
+	usbCtlState = USB_CTL_STATUS_IN;
+	HAL_PCD_EP_Transmit(usbPcd, 0x80U, NULL, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Stall(void)
+{
+	usbCtlState = USB_CTL_IDLE;
+	HAL_PCD_EP_SetStall(usbPcd, 0x80U);
+	HAL_PCD_EP_SetStall(usbPcd, 0x00U);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_In_Stage(void)
+{
+	if(USB_CTL_DATA_IN != usbCtlState)
+	{
+		/*	status stage of a request without data or with OUT data is over	*/
+		usbCtlState = USB_CTL_IDLE;
+		if(usbCtlDfu)
+		{
+			BL_DFU_Request_Done();
+		}
+		return;
+	}
+	
+	if(usbCtlRemaining)
+	{
+		usb_Ctl_Send_Next();
+	}
+	else if(usbCtlZlp)
+	{
+		usbCtlZlp = 0;
+		HAL_PCD_EP_Transmit(usbPcd, 0x80U, NULL, 0);
+	}
+	else
+	{
+		/*	data stage done, the host closes the transfer with a zero length OUT	*/
+		usbCtlState = USB_CTL_STATUS_OUT;
+		HAL_PCD_EP_Receive(usbPcd, 0x00U, NULL, 0);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+BL_RAM_FUNC static void usb_Ctl_Out_Stage(void)
+{
+	uint16_t count;
+	
+	if(USB_CTL_DATA_OUT != usbCtlState)
+	{
+		/*	status stage of an IN request is over	*/
+		usbCtlState = USB_CTL_IDLE;
+		if(usbCtlDfu)
+		{
+			BL_DFU_Request_Done();
+		}
+		return;
+	}
+	
+	/*	a full packet with more to come re-arms for the next one, a short packet ends the stage early	*/
+	count = (uint16_t)HAL_PCD_EP_GetRxCount(usbPcd, 0x00U);
+	count = (count > usbCtlRemaining) ? usbCtlRemaining : count;
+	usbCtlReceived += count;
+	usbCtlRemaining -= count;
+	if(usbCtlRemaining && (BL_USB_EP0_MPS == count))
+	{
+		HAL_PCD_EP_Receive(usbPcd, 0x00U, &usbCtlRxData[usbCtlReceived], (usbCtlRemaining > BL_USB_EP0_MPS) ? BL_USB_EP0_MPS : usbCtlRemaining);
+		return;
+	}
+	
+	if(usbCtlDfu)
+	{
+		BL_DFU_Data_Out(usbCtlReceived);
+	}
+	else if(BL_USB_CDC_SET_LINE_CODING == usbCtlRequest)
+	{
+		memcpy(usbLineCoding, usbCtlBuffer, BL_USB_CDC_LINE_CODING_LEN);
+	}
+	usb_Ctl_Status_In();
+}
@@ -0,0 +1,61 @@
+#ifndef  BOOTLOADER_USB_H__
+#define	 BOOTLOADER_USB_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "usb_otg.h"
+#include "bootloader_flash.h"
+#include "bootloader_transport.h"
+#include "bootloader_rx.h"
+#include "bootloader_dfu.h"
+
+/* Macro Declarations---------------------------------------------------------*/
+
+/*	USB FS CDC-ACM : the host sees a virtual COM port, any baud rate it sets is accepted and ignored	*/
+/*	the device only becomes the host link once a host opens the port (DTR set), the UART stays the link until then	*/
+/*	a DFU interface sits next to it in the same configuration, see bootloader_dfu.h										*/
+#define BL_USB_VID									0x0483U
+#define BL_USB_PID									0x5740U
+#define BL_USB_BCD_DEVICE						0x0200U
+
+/*	endpoints : EP0 control, EP1 bulk data in both directions, EP2 IN notifications (never sent)	*/
+#define BL_USB_EP0_MPS							64U
+#define BL_USB_DATA_MPS							64U
+#define BL_USB_DATA_OUT_EP					0x01U
+#define BL_USB_DATA_IN_EP						0x81U
+#define BL_USB_CMD_IN_EP						0x82U
+#define BL_USB_CMD_MPS							8U
+
+/*	FIFO RAM in 32 bit words, 320 on the OTG FS core : shared receive FIFO, then one transmit FIFO per IN endpoint	*/
+#define BL_USB_RX_FIFO_WORDS				0x80U
+#define BL_USB_TX0_FIFO_WORDS				0x20U
+#define BL_USB_TX1_FIFO_WORDS				0x80U
+#define BL_USB_TX2_FIFO_WORDS				0x10U
+
+/*	replies are queued here and leave in the background, several small sends share one IN transfer	*/
+#define BL_USB_TX_RING_LEN					1024U
+
+/*	CDC class requests	*/
+#define BL_USB_CDC_SET_LINE_CODING	0x20U
+#define BL_USB_CDC_GET_LINE_CODING	0x21U
+#define BL_USB_CDC_SET_LINE_STATE		0x22U
+#define BL_USB_CDC_SEND_BREAK				0x23U
+#define BL_USB_CDC_LINE_CODING_LEN	7U
+#define BL_USB_CDC_LINE_STATE_DTR		0x01U
+
+/* Macro Functions------------------------------------------------------------*/
+
+
+/* Software Interface Decalarations ------------------------------------------*/
+
+/*	host link over USB FS CDC-ACM, flow controlled : an OUT packet is only taken when the receive ring has room for it	*/
+extern const BL_TransportTypeDef BL_USB_Transport;
+
+void BL_USB_Init( PCD_HandleTypeDef *hpcd );
+void BL_USB_DeInit( void );
+
+/* Static Function Declarations ----------------------------------------------*/
+
+#endif /*BOOTLOADER_USB_H__*/
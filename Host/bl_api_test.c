@@ -0,0 +1,249 @@
+/*
+ * Layout test of the service table applications call the bootloader through.
+ *
+ * Built for a 32-bit host, where pointers are as wide as on the target, it
+ * checks the offset of every entry of BL_ApiTypeDef and its size against
+ * the ABI the applications were built for (bootloader_api.h checks some of
+ * them at compile time, this lists them all).  -malign-double gives 64-bit
+ * members the 8-byte alignment of the AAPCS, as in the SHA-256 context.
+ * Given the bl_sim binary, it also reads back the header of the table the
+ * firmware links at BL_API_ADDRESS : magic, version, and a size that
+ * covers every entry at the pointer width of that build.
+ *
+ *   cc -m32 -malign-double -DUSE_HAL_DRIVER -DSTM32F407xx -IHost/sim -IInc -IBootloader \
+ *      -IDrivers/STM32F4xx_HAL_Driver/Inc -IDrivers/CMSIS/Device/ST/STM32F4xx/Include -IDrivers/CMSIS/Include \
+ *      -o bl_api_test Host/bl_api_test.c
+ *   ./bl_api_test [bl_sim]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <elf.h>
+
+#include "bootloader_api.h"
+
+#define API_SECTION_NAME			".ARM.__at_0x08000200"
+#define API_HEADER_LEN				16U
+#define API_ENTRY_COUNT				((sizeof(BL_ApiTypeDef) - API_HEADER_LEN) / sizeof(void *))
+
+#define API_ENTRY(member, offset)	{ #member, offsetof(BL_ApiTypeDef, member), offset }
+
+typedef struct{
+	const char *name;
+	size_t offset;
+	size_t expected;
+}ApiEntry;
+
+static const ApiEntry entries[] = {
+	API_ENTRY(magic,							0),
+	API_ENTRY(version,						4),
+	API_ENTRY(size,								8),
+	API_ENTRY(reserved,						12),
+	API_ENTRY(crcCalculate,				16),
+	API_ENTRY(crcSoftware,				20),
+	API_ENTRY(flashProgram,				24),
+	API_ENTRY(flashEraseSector,		28),
+	API_ENTRY(flashSectorOf,			32),
+	API_ENTRY(flashSectorStart,		36),
+	API_ENTRY(flashSectorSize,		40),
+	API_ENTRY(sha256Begin,				44),
+	API_ENTRY(sha256Update,				48),
+	API_ENTRY(sha256End,					52),
+	API_ENTRY(sha256Calculate,		56),
+	API_ENTRY(lzBegin,						60),
+	API_ENTRY(lzDecompress,				64),
+	API_ENTRY(lzEnd,							68),
+	API_ENTRY(lzOutputCount,			72),
+	API_ENTRY(logRingInit,				76),
+	API_ENTRY(logRingWrite,				80),
+	API_ENTRY(logRingRead,				84),
+};
+
+static int check_layout(void)
+{
+	int failures = 0;
+
+	if(4U != sizeof(void *))
+	{
+		printf("layout needs a 32-bit build (-m32), pointers are %zu bytes here\n", sizeof(void *));
+		return 1;
+	}
+
+	for(size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++)
+	{
+		if(entries[i].offset != entries[i].expected)
+		{
+			printf("%-18s : offset %zu, expected %zu\n", entries[i].name, entries[i].offset, entries[i].expected);
+			failures++;
+		}
+	}
+	if(88U != sizeof(BL_ApiTypeDef))
+	{
+		printf("BL_ApiTypeDef     : %zu bytes, expected 88\n", sizeof(BL_ApiTypeDef));
+		failures++;
+	}
+	if(!failures)
+	{
+		printf("layout OK, %zu entries in %zu bytes\n", API_ENTRY_COUNT, sizeof(BL_ApiTypeDef));
+	}
+	return failures;
+}
+
+static uint8_t *read_file(const char *path, size_t *length)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data;
+	if(NULL == f)
+	{
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*length = (size_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(*length);
+	if((NULL != data) && (1 != fread(data, *length, 1, f)))
+	{
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+typedef struct{
+	const uint8_t *elf;
+	size_t length;
+	uint64_t shoff;
+	uint32_t shentsize;
+	uint32_t shnum;
+	uint32_t shstrndx;
+	uint32_t pointerSize;
+}ElfFile;
+
+static int elf_open(ElfFile *file, const uint8_t *elf, size_t length)
+{
+	file->elf = elf;
+	file->length = length;
+	if((length < sizeof(Elf64_Ehdr)) || (0 != memcmp(elf, ELFMAG, SELFMAG)))
+	{
+		return 0;
+	}
+
+	/*	either class : the 32-bit test reads a 64-bit sim as well	*/
+	if(ELFCLASS64 == elf[EI_CLASS])
+	{
+		const Elf64_Ehdr *header = (const Elf64_Ehdr *)elf;
+		file->shoff = header->e_shoff;
+		file->shentsize = header->e_shentsize;
+		file->shnum = header->e_shnum;
+		file->shstrndx = header->e_shstrndx;
+		file->pointerSize = 8;
+	}
+	else
+	{
+		const Elf32_Ehdr *header = (const Elf32_Ehdr *)elf;
+		file->shoff = header->e_shoff;
+		file->shentsize = header->e_shentsize;
+		file->shnum = header->e_shnum;
+		file->shstrndx = header->e_shstrndx;
+		file->pointerSize = 4;
+	}
+	return (file->shstrndx < file->shnum) && ((file->shoff + (uint64_t)file->shnum * file->shentsize) <= length);
+}
+
+static int elf_section(const ElfFile *file, uint32_t index, uint64_t *offset, uint64_t *size, uint32_t *name)
+{
+	const uint8_t *section = file->elf + file->shoff + (uint64_t)index * file->shentsize;
+
+	if(8U == file->pointerSize)
+	{
+		const Elf64_Shdr *header = (const Elf64_Shdr *)section;
+		*offset = header->sh_offset;
+		*size = header->sh_size;
+		*name = header->sh_name;
+	}
+	else
+	{
+		const Elf32_Shdr *header = (const Elf32_Shdr *)section;
+		*offset = header->sh_offset;
+		*size = header->sh_size;
+		*name = header->sh_name;
+	}
+	return (*offset + *size) <= file->length;
+}
+
+static const uint8_t *elf_find_section(const ElfFile *file, const char *wanted, uint64_t *size)
+{
+	uint64_t names, namesSize, offset;
+	uint32_t name;
+
+	if(!elf_section(file, file->shstrndx, &names, &namesSize, &name))
+	{
+		return NULL;
+	}
+	for(uint32_t i = 0; i < file->shnum; i++)
+	{
+		if(	elf_section(file, i, &offset, size, &name) && (name < namesSize)	&&
+				(0 == strncmp((const char *)file->elf + names + name, wanted, namesSize - name)) )
+		{
+			return file->elf + offset;
+		}
+	}
+	return NULL;
+}
+
+static int check_image(const char *path)
+{
+	size_t length = 0;
+	uint64_t size = 0;
+	uint32_t header[4];
+	uint8_t *elf = read_file(path, &length);
+	ElfFile file;
+	const uint8_t *table = NULL;
+	int failures = 0;
+
+	if((NULL != elf) && elf_open(&file, elf, length))
+	{
+		table = elf_find_section(&file, API_SECTION_NAME, &size);
+	}
+	if((NULL == table) || (size < API_HEADER_LEN))
+	{
+		printf("%s : no %s section\n", path, API_SECTION_NAME);
+		free(elf);
+		return 1;
+	}
+
+	memcpy(header, table, sizeof(header));
+	if(BL_API_MAGIC != header[0])
+	{
+		printf("%s : magic 0x%08X, expected 0x%08X\n", path, header[0], BL_API_MAGIC);
+		failures++;
+	}
+	if(BL_API_VERSION != header[1])
+	{
+		printf("%s : version 0x%08X, expected 0x%08X\n", path, header[1], BL_API_VERSION);
+		failures++;
+	}
+	if((API_HEADER_LEN + API_ENTRY_COUNT * file.pointerSize) != header[2])
+	{
+		printf("%s : size %u, expected %zu\n", path, header[2], API_HEADER_LEN + API_ENTRY_COUNT * file.pointerSize);
+		failures++;
+	}
+	if(!failures)
+	{
+		printf("%s : table header OK, version %u.%u\n", path, BL_API_MAJOR(header[1]), header[1] & 0xFFFFU);
+	}
+	free(elf);
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int failures = check_layout();
+
+	if(2 == argc)
+	{
+		failures += check_image(argv[1]);
+	}
+	return failures ? 1 : 0;
+}
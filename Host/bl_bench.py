@@ -0,0 +1,533 @@
+#!/usr/bin/env python3
+"""Measure throughput and per-stage latency of the bootloader protocol.
+
+Every case is run --repeat times.  The host times each exchange from the
+first byte written to the last reply byte read (CLOCK_MONOTONIC), and the
+target stamps every frame with DWT cycles when it is complete in its RX
+slot, when its CRC is checked, when flash work ends and when the last
+reply byte leaves the UART.  After each sample the stamps are read back
+with CBL_BENCH_READ_CMD and turned into microseconds with --clock:
+
+    crc     rx complete -> CRC checked
+    flash   rx complete -> last program/erase finished (flash commands)
+    tx      rx complete -> reply sent
+    host    host round trip of the whole exchange
+
+A stream write also yields one target record per block, with the window
+reply stamped on the last block of each window.
+
+Cases:
+    ver help cid rdp slots      the simple queries, no payload
+    hash                        CBL_MEM_HASH_CMD over --hash-length of the bootloader
+    status                      CBL_READ_SECTOR_STATUS_CMD over all sectors
+    read                        CBL_MEM_READ_CMD of --read-length bytes
+    erase                       CBL_FLASH_ERASE_CMD of the --scratch sector (needs --write)
+    memwrite                    erase, then CBL_MEM_WRITE_CMD frames of --block bytes (needs --write)
+    stream                      erase, then a stream session (needs --write)
+    stream-ahead                stream session with erase-ahead on a dirty sector (needs --write)
+
+--fast, --block and --window take comma separated lists; the cases run for
+every combination so frame sizes, baud rates and write strategies can be
+compared in one go.  Payloads come from --seed so runs are repeatable.
+The port is driven through termios, no pyserial needed; it also works on
+the pseudo-terminal of Host/bl_sim.
+
+usage: bl_bench.py [options] port
+    --baud RATE         rate the bootloader listens at (115200)
+    --fast RATES        negotiate each rate in turn (CBL_SET_BAUD_CMD)
+    --v2                negotiate v2 frames first (CBL_SET_PROTOCOL_CMD)
+    --cases LIST        comma separated cases (default the read only ones)
+    --write             allow the flash cases, they destroy the --scratch sector
+    --scratch N         sector used by the flash cases (9, the end of slot B :
+                        the device only writes into the slot it does not boot)
+    --length N          bytes written per memwrite/stream sample (16384)
+    --block SIZES       data bytes per write frame (default the largest)
+    --window SIZES      stream blocks per window (8)
+    --hash-length N     bytes hashed per hash sample (32768)
+    --read-length N     bytes read per read sample (4096)
+    --repeat N          samples per case (20)
+    --clock HZ          target core clock (168000000)
+    --seed N            payload seed (1)
+    --label TEXT        copied into every row, tells concatenated runs apart
+    --csv FILE          one row per sample and stage, - for stdout
+    --json FILE         percentiles per case and stage, - for stdout
+"""
+
+import json
+import os
+import random
+import select
+import struct
+import sys
+import termios
+import time
+
+CBL_GET_VER_CMD = 0x10
+CBL_GET_HELP_CMD = 0x11
+CBL_GET_CID_CMD = 0x12
+CBL_GET_RDP_STATUS_CMD = 0x13
+CBL_FLASH_ERASE_CMD = 0x15
+CBL_MEM_WRITE_CMD = 0x16
+CBL_MEM_READ_CMD = 0x18
+CBL_READ_SECTOR_STATUS_CMD = 0x19
+CBL_STREAM_WRITE_CMD = 0x22
+CBL_SLOT_INFO_CMD = 0x26
+CBL_MEM_HASH_CMD = 0x28
+CBL_SET_BAUD_CMD = 0x29
+CBL_SET_PROTOCOL_CMD = 0x2A
+CBL_BENCH_READ_CMD = 0x2B
+BL_ACK = 0xCD
+
+FORMAT_V1 = 0x01
+FORMAT_V2 = 0x02
+V1_MAX_LEN_FIELD = 0xFF
+BAUD_SWITCHING = 0x01
+BAUD_CONFIRMED = 0x02
+BAUD_TEST_PATTERN = bytes([0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+                           0x01, 0x80, 0x7E, 0x81, 0x5A, 0xA5, 0x96, 0x69])
+ERASE_DONE = 0x03
+FLASH_PAYLOAD_WRITE_PASSED = 0x01
+MEM_READ_CHUNK_LEN = 1024
+STREAM_SESSION_OPENED = 0x01
+STREAM_STATE_ACTIVE = 0x01
+STREAM_STATE_DONE = 0x03
+STREAM_FLAG_ERASE_AHEAD = 0x01
+STREAM_MAX_WINDOW = 32
+BENCH_READ_RESET = 0x01
+BENCH_RECORD = struct.Struct("<BBBBHHIIII")
+BENCH_KIND_COMMAND = 0x00
+BENCH_KIND_BLOCK = 0x01
+STAGES = ("crc", "flash", "tx")
+
+FLASH_BASE = 0x08000000
+SECTORS = [(FLASH_BASE + i * 0x4000, 0x4000) for i in range(4)] + \
+          [(FLASH_BASE + 0x10000, 0x10000)] + \
+          [(FLASH_BASE + 0x20000 + i * 0x20000, 0x20000) for i in range(7)]
+
+READ_ONLY_CASES = ("ver", "help", "cid", "rdp", "slots", "hash", "status", "read")
+FLASH_CASES = ("erase", "memwrite", "stream", "stream-ahead")
+REPLY_TIMEOUT = 5.0
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def now_ns():
+    return time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+
+
+def percentile(values, p):
+    """linear interpolation between closest ranks, values sorted"""
+    if len(values) == 1:
+        return values[0]
+    rank = (len(values) - 1) * p / 100.0
+    low = int(rank)
+    high = min(low + 1, len(values) - 1)
+    return values[low] + (values[high] - values[low]) * (rank - low)
+
+
+class Port:
+    def __init__(self, path, baud):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        attrs = termios.tcgetattr(self.fd)
+        attrs[0] = 0                                    # iflag
+        attrs[1] = 0                                    # oflag
+        attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attrs[3] = 0                                    # lflag
+        termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        self.set_baud(baud)
+
+    def set_baud(self, baud):
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is None:
+            raise IOError("%d baud is not a termios rate" % baud)
+        attrs = termios.tcgetattr(self.fd)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, attrs)
+        self.baud = baud
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            view = view[os.write(self.fd, view):]
+
+    def read(self, length, timeout=REPLY_TIMEOUT):
+        data = b""
+        deadline = time.monotonic() + timeout
+        while len(data) < length:
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                raise IOError("timed out, %d of %d reply bytes" % (len(data), length))
+            chunk = os.read(self.fd, length - len(data))
+            if not chunk:
+                raise IOError("port closed")
+            data += chunk
+        return data
+
+    def flush(self):
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+
+
+class Target:
+    def __init__(self, port):
+        self.port = port
+        self.format = FORMAT_V1
+        self.max_length = 1 + V1_MAX_LEN_FIELD
+
+    def frame(self, sid, payload, sequence=None):
+        body = (struct.pack("<H", sequence) if sequence is not None else bytes([sid])) + payload
+        length = len(body) + 4
+        header = struct.pack("<H", length) if self.format == FORMAT_V2 else bytes([length])
+        body = header + body
+        return body + struct.pack("<I", crc32_mpeg2(body))
+
+    def header_len(self):
+        return 2 if self.format == FORMAT_V2 else 1
+
+    def max_block(self):
+        return (self.max_length - self.header_len() - 2 - 4) & ~3
+
+    def max_write(self):
+        return min(self.max_length - self.header_len() - 1 - 5 - 4, 255)
+
+    def ack(self, sid, timeout=REPLY_TIMEOUT):
+        head = self.port.read(2, timeout)
+        if head[0] != BL_ACK:
+            raise IOError("command 0x%02X not acknowledged" % sid)
+        return head[1]
+
+    def command(self, sid, payload=b"", reply=None, timeout=REPLY_TIMEOUT):
+        """reply : fixed reply length whatever the ACK announces, None takes the ACK length"""
+        self.port.write(self.frame(sid, payload))
+        length = self.ack(sid, timeout)
+        return self.port.read(length if reply is None else reply, timeout)
+
+    def negotiate_baud(self, baud):
+        if baud == self.port.baud:
+            return
+        old = self.port.baud
+        if self.command(CBL_SET_BAUD_CMD, struct.pack("<I", baud))[0] != BAUD_SWITCHING:
+            raise IOError("device refused %d baud" % baud)
+        termios.tcdrain(self.port.fd)
+        self.port.set_baud(baud)
+        time.sleep(0.02)
+        try:
+            if self.command(CBL_SET_BAUD_CMD, BAUD_TEST_PATTERN) != BAUD_TEST_PATTERN:
+                raise IOError("test pattern corrupted")
+            if self.command(CBL_SET_BAUD_CMD, b"") != bytes([BAUD_CONFIRMED]):
+                raise IOError("rate not confirmed")
+        except IOError as error:
+            # the device falls back on its own once the confirm window runs out
+            self.port.set_baud(old)
+            time.sleep(1.2)
+            self.port.flush()
+            raise IOError("%d baud failed : %s" % (baud, error))
+
+    def negotiate_v2(self):
+        reply = self.command(CBL_SET_PROTOCOL_CMD, bytes([FORMAT_V2]))
+        if len(reply) != 3 or reply[0] != FORMAT_V2:
+            raise IOError("device stays on v1 frames")
+        self.format = FORMAT_V2
+        self.max_length = 2 + struct.unpack_from("<H", reply, 1)[0]
+
+    def bench_read(self, reset=False):
+        """every record the device holds, oldest first, and how many it had to drop"""
+        records = []
+        lost = 0
+        flags = BENCH_READ_RESET if reset else 0
+        while True:
+            reply = self.command(CBL_BENCH_READ_CMD, bytes([flags]))
+            flags = 0
+            count, dropped = struct.unpack_from("<BH", reply)
+            lost += dropped
+            for i in range(count):
+                records.append(BENCH_RECORD.unpack_from(reply, 3 + i * BENCH_RECORD.size))
+            if count == 0:
+                return records, lost
+
+
+class Bench:
+    def __init__(self, target, options):
+        self.target = target
+        self.options = options
+        self.random = random.Random(options["seed"])
+        self.rows = []
+
+    def params(self, block=None, window=None):
+        return {"label": self.options["label"], "baud": self.target.port.baud,
+                "format": self.target.format, "block": block or "", "window": window or ""}
+
+    def sample(self, case, index, params, nbytes, exchange):
+        start = now_ns()
+        exchange()
+        host_us = (now_ns() - start) / 1000.0
+        records, lost = self.target.bench_read()
+        if lost:
+            sys.stderr.write("%s : the device dropped %d records, lower --length\n" % (case, lost))
+        clock = self.options["clock"] / 1e6
+
+        def row(kind, sid, sequence, metric, value):
+            entry = dict(params)
+            entry.update({"case": case, "sample": index, "kind": kind, "sid": "0x%02X" % sid,
+                          "sequence": sequence, "bytes": nbytes, "metric": metric,
+                          "us": round(value, 3)})
+            self.rows.append(entry)
+
+        sid = records[-1][0] if records else 0
+        row("host", sid, "", "host", host_us)
+        if nbytes:
+            row("host", sid, "", "kib_per_s", nbytes / 1024.0 / (host_us / 1e6))
+        for sid, kind, status, _, length, sequence, rx, *stages in records:
+            kind = "block" if kind == BENCH_KIND_BLOCK else "command"
+            for name, stamp in zip(STAGES, stages):
+                if stamp:
+                    row(kind, sid, sequence, name, ((stamp - rx) & 0xFFFFFFFF) / clock)
+
+    def payload(self, length):
+        return bytes(self.random.getrandbits(8) for _ in range(length))
+
+    def scratch(self):
+        return SECTORS[self.options["scratch"]]
+
+    def erase(self):
+        sector = self.options["scratch"]
+        result = self.target.command(CBL_FLASH_ERASE_CMD, bytes([sector, 1]), reply=1, timeout=10)
+        if result[0] != ERASE_DONE:
+            raise IOError("erase of sector %d failed" % sector)
+
+    def run_query(self, case, sid, payload=b"", reply=None, nbytes=0):
+        for i in range(self.options["repeat"]):
+            self.sample(case, i, self.params(), nbytes,
+                        lambda: self.target.command(sid, payload, reply))
+
+    def run_read(self):
+        address = FLASH_BASE
+        length = self.options["read_length"]
+
+        def exchange():
+            self.target.port.write(self.target.frame(CBL_MEM_READ_CMD, struct.pack("<II", address, length)))
+            self.target.ack(CBL_MEM_READ_CMD)
+            if self.target.port.read(1)[0] != 1:
+                raise IOError("memory read refused")
+            left = length
+            while left:
+                chunk = min(left, MEM_READ_CHUNK_LEN)
+                self.target.port.read(chunk + 4)
+                left -= chunk
+
+        for i in range(self.options["repeat"]):
+            self.sample("read", i, self.params(), length, exchange)
+
+    def run_erase(self):
+        for i in range(self.options["repeat"]):
+            self.sample("erase", i, self.params(), 0, self.erase)
+
+    def run_memwrite(self, block):
+        base, size = self.scratch()
+        length = min(self.options["length"], size)
+        block = min(block, self.target.max_write()) & ~3
+
+        def exchange():
+            offset = 0
+            while offset < length:
+                data = self.payload(min(block, length - offset))
+                result = self.target.command(CBL_MEM_WRITE_CMD,
+                                             struct.pack("<IB", base + offset, len(data)) + data, reply=1)
+                if result[0] != FLASH_PAYLOAD_WRITE_PASSED:
+                    raise IOError("memory write at 0x%08X failed" % (base + offset))
+                offset += len(data)
+
+        for i in range(self.options["repeat"]):
+            self.erase()
+            self.target.bench_read()
+            self.sample("memwrite", i, self.params(block), length, exchange)
+
+    def run_stream(self, case, block, window):
+        base, size = self.scratch()
+        length = min(self.options["length"], size) & ~3
+        block = min(block, self.target.max_block())
+        flags = STREAM_FLAG_ERASE_AHEAD if case == "stream-ahead" else 0
+
+        def exchange():
+            image = self.payload(length)
+            session = self.target.command(CBL_STREAM_WRITE_CMD,
+                                          struct.pack("<IIBB", base, length, window, flags), reply=1,
+                                          timeout=10)
+            if session[0] != STREAM_SESSION_OPENED:
+                raise IOError("stream session rejected")
+            acked = 0
+            retries = 0
+            while True:
+                frames = b""
+                offset = acked * block
+                sent = 0
+                while sent < window and offset < length:
+                    frames += self.target.frame(None, image[offset:offset + block], acked + sent)
+                    offset += block
+                    sent += 1
+                self.target.port.write(frames)
+                ack, following, state = struct.unpack("<BHB", self.target.port.read(4, 10))
+                if state == STREAM_STATE_DONE:
+                    return
+                if state != STREAM_STATE_ACTIVE:
+                    raise IOError("stream aborted by the device")
+                if ack != BL_ACK:
+                    retries += 1
+                    if retries > 5:
+                        raise IOError("too many failed windows")
+                acked = following
+
+        for i in range(self.options["repeat"]):
+            # erase-ahead finds the sector dirty from the sample before, the plain stream needs it blank
+            if not flags:
+                self.erase()
+                self.target.bench_read()
+            self.sample(case, i, self.params(block, window), length, exchange)
+
+    def run(self, cases):
+        self.target.bench_read(reset=True)
+        queries = {"ver": (CBL_GET_VER_CMD, b""), "help": (CBL_GET_HELP_CMD, b""),
+                   "cid": (CBL_GET_CID_CMD, b""), "rdp": (CBL_GET_RDP_STATUS_CMD, b""),
+                   "slots": (CBL_SLOT_INFO_CMD, b""),
+                   "hash": (CBL_MEM_HASH_CMD, struct.pack("<II", FLASH_BASE, self.options["hash_length"])),
+                   "status": (CBL_READ_SECTOR_STATUS_CMD, bytes([0, len(SECTORS)]))}
+        for case in cases:
+            if case in queries:
+                sid, payload = queries[case]
+                nbytes = self.options["hash_length"] if case == "hash" else 0
+                self.run_query(case, sid, payload, nbytes=nbytes)
+            elif case == "read":
+                self.run_read()
+            elif case == "erase":
+                self.run_erase()
+            elif case == "memwrite":
+                for block in self.options["blocks"] or [self.target.max_write()]:
+                    self.run_memwrite(block)
+            else:
+                for block in self.options["blocks"] or [self.target.max_block()]:
+                    for window in self.options["windows"]:
+                        self.run_stream(case, block, window)
+
+
+def summarize(rows):
+    groups = {}
+    for row in rows:
+        key = (row["label"], row["baud"], row["format"], row["case"], row["block"], row["window"],
+               row["kind"], row["metric"])
+        groups.setdefault(key, []).append(row["us"])
+    summary = []
+    for key, values in groups.items():
+        values.sort()
+        entry = dict(zip(("label", "baud", "format", "case", "block", "window", "kind", "metric"), key))
+        entry.update({"count": len(values), "mean": round(sum(values) / len(values), 3),
+                      "p50": round(percentile(values, 50), 3), "p90": round(percentile(values, 90), 3),
+                      "p99": round(percentile(values, 99), 3), "max": values[-1]})
+        summary.append(entry)
+    return summary
+
+
+def open_output(path):
+    return sys.stdout if path == "-" else open(path, "w")
+
+
+def write_csv(path, rows):
+    columns = ("label", "baud", "format", "case", "block", "window", "sample", "kind", "sid",
+               "sequence", "bytes", "metric", "us")
+    out = open_output(path)
+    out.write(",".join(columns) + "\n")
+    for row in rows:
+        out.write(",".join(str(row[column]) for column in columns) + "\n")
+    if out is not sys.stdout:
+        out.close()
+
+
+def print_summary(summary):
+    print("%-12s %7s %2s %5s %3s %-7s %-9s %5s %10s %10s %10s %10s"
+          % ("case", "baud", "v", "block", "win", "kind", "metric", "n", "p50", "p90", "p99", "max"))
+    for entry in summary:
+        print("%-12s %7d %2d %5s %3s %-7s %-9s %5d %10.1f %10.1f %10.1f %10.1f"
+              % (entry["case"], entry["baud"], entry["format"], entry["block"], entry["window"],
+                 entry["kind"], entry["metric"], entry["count"], entry["p50"], entry["p90"],
+                 entry["p99"], entry["max"]))
+
+
+def int_list(text):
+    return [int(value, 0) for value in text.split(",") if value]
+
+
+def main(argv):
+    options = {"baud": 115200, "fast": [], "v2": False, "cases": list(READ_ONLY_CASES),
+               "write": False, "scratch": 9, "length": 16384, "blocks": [], "windows": [8],
+               "hash_length": 32768, "read_length": 4096, "repeat": 20, "clock": 168000000,
+               "seed": 1, "label": "", "csv": None, "json": None}
+    numbers = {"--baud": "baud", "--scratch": "scratch", "--length": "length",
+               "--hash-length": "hash_length", "--read-length": "read_length",
+               "--repeat": "repeat", "--clock": "clock", "--seed": "seed"}
+    lists = {"--fast": "fast", "--block": "blocks", "--window": "windows"}
+    texts = {"--label": "label", "--csv": "csv", "--json": "json"}
+    args = argv[1:]
+    try:
+        while args and args[0].startswith("--"):
+            option = args.pop(0)
+            if option == "--v2":
+                options["v2"] = True
+            elif option == "--write":
+                options["write"] = True
+            elif option == "--cases" and args:
+                options["cases"] = [case for case in args.pop(0).split(",") if case]
+            elif option in numbers and args:
+                options[numbers[option]] = int(args.pop(0), 0)
+            elif option in lists and args:
+                options[lists[option]] = int_list(args.pop(0))
+            elif option in texts and args:
+                options[texts[option]] = args.pop(0)
+            else:
+                raise ValueError(option)
+    except ValueError:
+        args = []
+    unknown = [case for case in options["cases"] if case not in READ_ONLY_CASES + FLASH_CASES]
+    if len(args) != 1 or unknown or options["repeat"] < 1 or \
+            not all(0 < window <= STREAM_MAX_WINDOW for window in options["windows"]) or \
+            not 0 <= options["scratch"] < len(SECTORS):
+        sys.stderr.write(__doc__)
+        return 1
+    if not options["write"] and any(case in FLASH_CASES for case in options["cases"]):
+        sys.stderr.write("the flash cases erase sector %d, pass --write to run them\n" % options["scratch"])
+        return 1
+
+    try:
+        target = Target(Port(args[0], options["baud"]))
+        if options["v2"]:
+            target.negotiate_v2()
+        bench = Bench(target, options)
+        for baud in options["fast"] or [options["baud"]]:
+            target.negotiate_baud(baud)
+            bench.run(options["cases"])
+    except IOError as error:
+        sys.stderr.write("%s : %s\n" % (args[0], error))
+        return 1
+
+    summary = summarize(bench.rows)
+    if options["csv"]:
+        write_csv(options["csv"], bench.rows)
+    if options["json"]:
+        out = open_output(options["json"])
+        json.dump({"clock": options["clock"], "repeat": options["repeat"], "seed": options["seed"],
+                   "label": options["label"], "results": summary}, out, indent=1)
+        out.write("\n")
+        if out is not sys.stdout:
+            out.close()
+    if options["csv"] != "-" and options["json"] != "-":
+        print_summary(summary)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
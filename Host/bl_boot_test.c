@@ -0,0 +1,98 @@
+/*
+ * Host build of BL_Boot_Check_Vectors, the check every slot passes before
+ * it is selected and before the handoff starts it.
+ *
+ * Runs it on vector tables of the kinds a slot can hold : an image linked
+ * for the slot (runs in place), one linked at 0 (rebased at the handoff),
+ * one linked for the other slot or with its MSP outside RAM, and an erased
+ * slot.  Against the sim headers, the rest of bootloader_boot.c is stubbed
+ * and never called.
+ *
+ *   cc -O2 -DUSE_HAL_DRIVER -DSTM32F407xx -IHost/sim -IInc -IBootloader -IDrivers/STM32F4xx_HAL_Driver/Inc \
+ *      -IDrivers/CMSIS/Device/ST/STM32F4xx/Include -IDrivers/CMSIS/Include -o bl_boot_test Host/bl_boot_test.c
+ *   ./bl_boot_test
+ */
+
+#include <stdio.h>
+
+#include "../Bootloader/bootloader_boot.c"
+
+#define TEST_STACK_TOP				BL_BOOT_SRAM_END
+#define TEST_HANDLER_OFFSET		0x400U
+
+typedef struct{
+	const char *name;
+	uint32_t stackPointer;
+	uint32_t linkBase;
+	uint32_t fill;
+	uint32_t slotBase;
+	uint32_t slotLength;
+	uint8_t expected;
+}VectorCase;
+
+static const VectorCase cases[] = {
+	{ "in place, slot A", TEST_STACK_TOP, BL_SLOT_A_ADDRESS, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_IN_PLACE },
+	{ "in place, slot B", BL_BOOT_CCM_END, BL_SLOT_B_ADDRESS, 0, BL_SLOT_B_ADDRESS, BL_SLOT_B_LENGTH, BL_BOOT_IMAGE_IN_PLACE },
+	{ "relocatable, slot A", TEST_STACK_TOP, 0, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_RELOCATABLE },
+	{ "relocatable, slot B", TEST_STACK_TOP, 0, 0, BL_SLOT_B_ADDRESS, BL_SLOT_B_LENGTH, BL_BOOT_IMAGE_RELOCATABLE },
+	{ "slot B image in slot A", TEST_STACK_TOP, BL_SLOT_B_ADDRESS, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_INVALID },
+	{ "slot A image in slot B", TEST_STACK_TOP, BL_SLOT_A_ADDRESS, 0, BL_SLOT_B_ADDRESS, BL_SLOT_B_LENGTH, BL_BOOT_IMAGE_INVALID },
+	{ "MSP in flash", BL_SLOT_A_ADDRESS, BL_SLOT_A_ADDRESS, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_INVALID },
+	{ "MSP past the end of SRAM", TEST_STACK_TOP + 8U, BL_SLOT_A_ADDRESS, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_INVALID },
+	{ "MSP not 8-byte aligned", TEST_STACK_TOP - 4U, BL_SLOT_A_ADDRESS, 0, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_INVALID },
+	{ "erased slot", 0xFFFFFFFFU, 0, 0xFFFFFFFFU, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH, BL_BOOT_IMAGE_INVALID },
+};
+
+/*	the rest of bootloader_boot.c links against these, the check under test calls none of them	*/
+uint32_t SystemCoreClock = 16000000U;
+const BL_ApiTypeDef *BL_Api_Table( void ) { return NULL; }
+void BL_Slot_Init( void ) { }
+uint8_t BL_Slot_Select_Boot( void ) { return BL_SLOT_NONE; }
+HAL_StatusTypeDef HAL_RCC_DeInit( void ) { return HAL_OK; }
+HAL_StatusTypeDef HAL_RCC_OscConfig( RCC_OscInitTypeDef *oscInit ) { (void)oscInit; return HAL_OK; }
+HAL_StatusTypeDef HAL_RCC_ClockConfig( RCC_ClkInitTypeDef *clkInit, uint32_t latency ) { (void)clkInit; (void)latency; return HAL_OK; }
+void __enable_irq(void) { }
+void __disable_irq(void) { }
+void __set_MSP(uint32_t topOfMainStack) { (void)topOfMainStack; }
+
+static void build_vectors(const VectorCase *test, uint32_t *vectors)
+{
+	/*	reset, NMI, the fault handlers, SVC, PendSV and SysTick behind the table, everything else unused	*/
+	for(uint32_t i = 0; i < BL_BOOT_VECTOR_COUNT; i++)
+	{
+		uint8_t used = ((i >= 1U) && (i <= 6U)) || (11U == i) || (12U == i) || (14U == i) || (15U == i);
+		vectors[i] = test->fill ? test->fill : (used ? ((test->linkBase + TEST_HANDLER_OFFSET) | 1U) : 0U);
+	}
+	vectors[0] = test->stackPointer;
+}
+
+int main(void)
+{
+	uint32_t vectors[BL_BOOT_VECTOR_COUNT];
+	int failures = 0;
+
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		uint8_t kind;
+
+		build_vectors(&cases[i], vectors);
+		kind = BL_Boot_Check_Vectors(vectors, cases[i].slotBase, cases[i].slotLength);
+		if(kind != cases[i].expected)
+		{
+			printf("%-26s : kind %u, expected %u\n", cases[i].name, kind, cases[i].expected);
+			failures++;
+		}
+	}
+
+	/*	a handler without the thumb bit, the core would fault on the first exception	*/
+	build_vectors(&cases[0], vectors);
+	vectors[3] &= ~1U;
+	if(BL_BOOT_IMAGE_INVALID != BL_Boot_Check_Vectors(vectors, BL_SLOT_A_ADDRESS, BL_SLOT_A_LENGTH))
+	{
+		printf("%-26s : accepted\n", "ARM state HardFault");
+		failures++;
+	}
+
+	printf("%s\n", failures ? "vector checks FAILED" : "vector checks OK");
+	return failures ? 1 : 0;
+}
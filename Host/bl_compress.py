@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Compress an application image for CBL_COMPRESSED_WRITE_CMD.
+
+Produces the heatshrink-style LZSS bit stream decoded by
+Bootloader/bootloader_lz.c (MSB first):
+
+    1 | literal(8)
+    0 | distance-1 (WINDOW_BITS) | count-1 (LOOKAHEAD_BITS)
+
+The final byte is padded with zero bits.
+
+An Intel HEX input is compressed from its lowest address on, gaps filled
+with erased flash (0xFF); its load address is printed for the session.
+
+usage: bl_compress.py input.bin|input.hex output.lz
+"""
+
+import sys
+
+WINDOW_BITS = 12
+LOOKAHEAD_BITS = 5
+WINDOW_LEN = 1 << WINDOW_BITS
+MAX_MATCH = 1 << LOOKAHEAD_BITS
+# a back-reference costs 1 + 12 + 5 bits, two literals cost 18
+MIN_MATCH = 2
+MAX_CANDIDATES = 256
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.bits = 0
+
+    def write(self, value, count):
+        self.acc = (self.acc << count) | (value & ((1 << count) - 1))
+        self.bits += count
+        while self.bits >= 8:
+            self.bits -= 8
+            self.out.append((self.acc >> self.bits) & 0xFF)
+        self.acc &= (1 << self.bits) - 1
+
+    def finish(self):
+        if self.bits:
+            self.out.append((self.acc << (8 - self.bits)) & 0xFF)
+            self.acc = 0
+            self.bits = 0
+        return bytes(self.out)
+
+
+def read_hex(path):
+    """Intel HEX to (load address, image bytes)"""
+    chunks = {}
+    upper = 0
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            record = bytes.fromhex(line[1:]) if line.startswith(":") else b""
+            if len(record) < 5 or len(record) != record[0] + 5 or sum(record) & 0xFF:
+                raise ValueError("%s:%d: bad record" % (path, number))
+            kind = record[3]
+            data = record[4:-1]
+            if kind == 0x00:
+                chunks[upper + ((record[1] << 8) | record[2])] = data
+            elif kind == 0x01:
+                break
+            elif kind == 0x02:
+                upper = int.from_bytes(data, "big") << 4
+            elif kind == 0x04:
+                upper = int.from_bytes(data, "big") << 16
+            # 0x03 and 0x05 are start addresses, not image content
+    if not chunks:
+        raise ValueError("%s: no data records" % path)
+    base = min(chunks)
+    image = bytearray(b"\xff" * (max(a + len(d) for a, d in chunks.items()) - base))
+    for address, data in chunks.items():
+        image[address - base:address - base + len(data)] = data
+    return base, bytes(image)
+
+
+def read_image(path):
+    """(load address or None, image bytes) of a .hex or .bin file"""
+    if path.lower().endswith(".hex"):
+        return read_hex(path)
+    with open(path, "rb") as f:
+        return None, f.read()
+
+
+def compress(data):
+    writer = BitWriter()
+    chains = {}
+    pos = 0
+    size = len(data)
+
+    while pos < size:
+        best_len = 0
+        best_dist = 0
+        if pos + MIN_MATCH <= size:
+            key = data[pos:pos + MIN_MATCH]
+            limit = min(MAX_MATCH, size - pos)
+            for cand in reversed(chains.get(key, ())):
+                dist = pos - cand
+                if dist > WINDOW_LEN:
+                    break
+                length = MIN_MATCH
+                # overlapping copies are fine, the decoder copies byte by byte
+                while length < limit and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_dist = dist
+                    if length == limit:
+                        break
+
+        step = best_len if best_len >= MIN_MATCH else 1
+        if step == 1:
+            writer.write(1, 1)
+            writer.write(data[pos], 8)
+        else:
+            writer.write(0, 1)
+            writer.write(best_dist - 1, WINDOW_BITS)
+            writer.write(best_len - 1, LOOKAHEAD_BITS)
+
+        for p in range(pos, pos + step):
+            if p + MIN_MATCH <= size:
+                chain = chains.setdefault(data[p:p + MIN_MATCH], [])
+                chain.append(p)
+                if len(chain) > MAX_CANDIDATES:
+                    del chain[0]
+        pos += step
+
+    return writer.finish()
+
+
+def decompress(stream):
+    """Reference decoder, mirrors BL_LZ_Decompress."""
+    out = bytearray()
+    acc = 0
+    bits = 0
+    it = iter(stream)
+
+    def take(count):
+        nonlocal acc, bits
+        while bits < count:
+            acc = (acc << 8) | next(it)
+            bits += 8
+        bits -= count
+        value = (acc >> bits) & ((1 << count) - 1)
+        acc &= (1 << bits) - 1
+        return value
+
+    try:
+        while True:
+            if take(1):
+                out.append(take(8))
+            else:
+                dist = take(WINDOW_BITS) + 1
+                count = take(LOOKAHEAD_BITS) + 1
+                for _ in range(count):
+                    out.append(out[-dist])
+    except StopIteration:
+        pass
+    return bytes(out)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    base, data = read_image(argv[1])
+    packed = compress(data)
+    if decompress(packed)[:len(data)] != data:
+        sys.stderr.write("round trip failed\n")
+        return 1
+    with open(argv[2], "wb") as f:
+        f.write(packed)
+    print("%s: %d -> %d bytes (%.1f%%)" % (argv[1], len(data), len(packed),
+                                           100.0 * len(packed) / max(len(data), 1)))
+    if base is not None:
+        print("load address 0x%08X" % base)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
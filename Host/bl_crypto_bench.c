@@ -0,0 +1,179 @@
+/*
+ * Host build of the bootloader's SHA-256 and Ed25519 code.
+ *
+ * Checks both against known answers (FIPS 180-2 and RFC 8032), then reports
+ * SHA-256 throughput and the time to verify a 1 MB image the way
+ * BL_Manifest_Verify does : hash the image, then check one signature.
+ * With arguments it also checks a manifest made by bl_manifest.py.
+ *
+ *   cc -O2 -DBL_HOST_BUILD -IBootloader -o bl_crypto_bench Host/bl_crypto_bench.c
+ *   ./bl_crypto_bench [image.bin manifest.bin public-key-hex]
+ *
+ * The target runs the same C, its figures come from BL_SHA256_BENCHMARK.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../Bootloader/bootloader_sha256.c"
+#include "../Bootloader/bootloader_ed25519.c"
+
+#define BENCH_IMAGE_LEN			(1024U * 1024U)
+#define BENCH_ROUNDS				20U
+#define MANIFEST_LEN				128U
+#define MANIFEST_SIGNED_LEN	64U
+
+typedef struct{
+	const char *publicKey;
+	const char *message;
+	const char *signature;
+}SignatureVector;
+
+static const SignatureVector vectors[] = {
+	{	"d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+		"e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"	},
+	{	"3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+		"92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"	},
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static size_t from_hex(const char *hex, uint8_t *out, size_t max)
+{
+	size_t n = 0;
+	unsigned int byte;
+	while((n < max) && (1 == sscanf(&hex[2U * n], "%2x", &byte)))
+	{
+		out[n++] = (uint8_t)byte;
+	}
+	return n;
+}
+
+static uint8_t *read_file(const char *path, size_t *length)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data;
+	long size;
+	if(!f)
+	{
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc((size_t)size + 1U);
+	*length = fread(data, 1, (size_t)size, f);
+	fclose(f);
+	return data;
+}
+
+static int known_answers(void)
+{
+	static const uint8_t abc[32] = {
+		0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+		0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad	};
+	uint8_t digest[32], key[32], message[4], signature[64];
+	int failures = 0;
+
+	BL_SHA256_Calculate((const uint8_t *)"abc", 3, digest);
+	if(memcmp(digest, abc, 32))
+	{
+		printf("SHA-256(\"abc\") mismatch\n");
+		failures++;
+	}
+
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+	{
+		size_t length = from_hex(vectors[i].message, message, sizeof(message));
+		from_hex(vectors[i].publicKey, key, 32);
+		from_hex(vectors[i].signature, signature, 64);
+		if(BL_ED25519_OK != BL_Ed25519_Verify(signature, message, (uint32_t)length, key))
+		{
+			printf("RFC 8032 vector %zu rejected\n", i + 1U);
+			failures++;
+		}
+		signature[i] ^= 0x01U;
+		if(BL_ED25519_ERROR != BL_Ed25519_Verify(signature, message, (uint32_t)length, key))
+		{
+			printf("RFC 8032 vector %zu accepted with a flipped bit\n", i + 1U);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static int check_manifest(const char *imagePath, const char *manifestPath, const char *keyHex)
+{
+	size_t imageLength = 0, manifestLength = 0;
+	uint8_t *image = read_file(imagePath, &imageLength);
+	uint8_t *manifest = read_file(manifestPath, &manifestLength);
+	uint8_t key[32], digest[32];
+	uint32_t length;
+
+	if(!image || !manifest || (MANIFEST_LEN != manifestLength) || (32U != from_hex(keyHex, key, 32)))
+	{
+		printf("cannot read image, manifest or key\n");
+		return 1;
+	}
+	memcpy(&length, &manifest[8], 4);
+	BL_SHA256_Calculate(image, (uint32_t)imageLength, digest);
+	if((length != imageLength) || memcmp(digest, &manifest[16], 32))
+	{
+		printf("manifest does not describe the image\n");
+		return 1;
+	}
+	if(BL_ED25519_OK != BL_Ed25519_Verify(&manifest[MANIFEST_SIGNED_LEN], manifest, MANIFEST_SIGNED_LEN, key))
+	{
+		printf("manifest signature rejected\n");
+		return 1;
+	}
+	printf("manifest OK\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *image = malloc(BENCH_IMAGE_LEN);
+	uint8_t digest[32], key[32], signature[64];
+	double start, hashTime, verifyTime;
+
+	if(known_answers())
+	{
+		return 1;
+	}
+	printf("known answers OK\n");
+
+	for(uint32_t i = 0; i < BENCH_IMAGE_LEN; i++)
+	{
+		image[i] = (uint8_t)((i * 2654435761U) >> 24);
+	}
+
+	start = now();
+	for(uint32_t i = 0; i < BENCH_ROUNDS; i++)
+	{
+		BL_SHA256_Calculate(image, BENCH_IMAGE_LEN, digest);
+	}
+	hashTime = (now() - start) / BENCH_ROUNDS;
+
+	from_hex(vectors[1].publicKey, key, 32);
+	from_hex(vectors[1].signature, signature, 64);
+	start = now();
+	for(uint32_t i = 0; i < BENCH_ROUNDS; i++)
+	{
+		(void)BL_Ed25519_Verify(signature, (const uint8_t *)"\x72", 1, key);
+	}
+	verifyTime = (now() - start) / BENCH_ROUNDS;
+
+	printf("SHA-256          : %.1f MB/s\n", (BENCH_IMAGE_LEN / 1048576.0) / hashTime);
+	printf("Ed25519 verify   : %.2f ms\n", verifyTime * 1000.0);
+	printf("1 MB image check : %.2f ms\n", (hashTime + verifyTime) * 1000.0);
+
+	free(image);
+	return (4 == argc) ? check_manifest(argv[1], argv[2], argv[3]) : 0;
+}
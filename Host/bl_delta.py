@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+"""Build a delta patch for CBL_DELTA_WRITE_CMD.
+
+The patch rebuilds new.bin at --base from old.bin, the installed image,
+and is applied by Bootloader/bootloader_delta.c sector by sector:
+
+    SECTOR | sector(1)                    back up, erase and reopen a sector
+    COPY   | length(4) | old offset(4)    bytes of the installed image
+    INSERT | length(2) | data[length]     new bytes
+    END
+
+In place (old.bin at --base, nothing booting yet) only sectors whose
+content changes are listed.  Copies may read the sector being rebuilt (the
+device serves it from the scratch sector) or any sector that has not been
+rewritten yet; everything else is inserted.
+
+Once a slot boots, the device reads old.bin from that slot and writes the
+new image into the other one : give the booting slot with --source.  Every
+sector of the new image is then listed and copies read old.bin freely.
+
+Before writing the patch it is applied to a model of the flash that follows
+the device rules, and the result is compared byte for byte with new.bin.
+
+usage: bl_delta.py [--base 0x08008000] [--source ADDRESS] old.bin new.bin out.patch
+"""
+
+import struct
+import sys
+
+OP_SECTOR = 0x01
+OP_COPY = 0x02
+OP_INSERT = 0x03
+OP_END = 0x04
+
+FLASH_BASE = 0x08000000
+SCRATCH_SECTOR = 10
+SECTORS = [(FLASH_BASE + i * 0x4000, 0x4000) for i in range(4)] + \
+          [(FLASH_BASE + 0x10000, 0x10000)] + \
+          [(FLASH_BASE + 0x20000 + i * 0x20000, 0x20000) for i in range(7)]
+
+KEY_LEN = 8
+MIN_COPY = 12          # a COPY record costs 9 bytes, INSERT overhead is 3
+MAX_INSERT = 0xFFFF
+MAX_CANDIDATES = 32
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def sector_of(address):
+    for index, (start, size) in enumerate(SECTORS):
+        if start <= address < start + size:
+            return index
+    raise ValueError("address 0x%08X outside flash" % address)
+
+
+def image_sectors(base, length):
+    first = sector_of(base)
+    if SECTORS[first][0] != base:
+        raise ValueError("base must be the start of a sector")
+    last = sector_of(base + length - 1)
+    if last >= SCRATCH_SECTOR:
+        raise ValueError("image reaches the scratch sector")
+    return range(first, last + 1)
+
+
+class Patch:
+    def __init__(self):
+        self.out = bytearray()
+        self.pending = bytearray()
+
+    def flush(self):
+        view = bytes(self.pending)
+        for i in range(0, len(view), MAX_INSERT):
+            chunk = view[i:i + MAX_INSERT]
+            self.out += struct.pack("<BH", OP_INSERT, len(chunk)) + chunk
+        self.pending.clear()
+
+    def sector(self, index):
+        self.flush()
+        self.out += struct.pack("<BB", OP_SECTOR, index)
+
+    def copy(self, offset, length):
+        self.flush()
+        self.out += struct.pack("<BII", OP_COPY, length, offset)
+
+    def insert(self, data):
+        self.pending += data
+
+    def end(self):
+        self.flush()
+        self.out.append(OP_END)
+        return bytes(self.out)
+
+
+def build(old, new, base, source=None):
+    index = {}
+    for pos in range(0, len(old) - KEY_LEN + 1):
+        chain = index.setdefault(old[pos:pos + KEY_LEN], [])
+        if len(chain) < MAX_CANDIDATES:
+            chain.append(pos)
+
+    patch = Patch()
+    rewritten = set()
+    sectors = image_sectors(base, len(new))
+    in_place = source is None or source == base
+
+    for sector in sectors:
+        start, size = SECTORS[sector]
+        lo = start - base
+        hi = min(lo + size, len(new))
+        if in_place and len(old) >= hi and new[lo:hi] == old[lo:hi]:
+            continue
+
+        patch.sector(sector)
+        rewritten.add(sector)
+
+        def readable(offset):
+            owner = sector_of(base + offset)
+            return not in_place or owner == sector or owner not in rewritten
+
+        pos = lo
+        while pos < hi:
+            best_len = 0
+            best_off = 0
+            for cand in index.get(new[pos:pos + KEY_LEN], ()):
+                length = 0
+                while (pos + length < hi and cand + length < len(old)
+                       and old[cand + length] == new[pos + length]
+                       and readable(cand + length)):
+                    length += 1
+                if length > best_len:
+                    best_len, best_off = length, cand
+            if best_len >= MIN_COPY:
+                patch.copy(best_off, best_len)
+                pos += best_len
+            else:
+                patch.insert(new[pos:pos + 1])
+                pos += 1
+
+    return patch.end()
+
+
+def apply(old, patch, base, new_length, source=None):
+    """Model of BL_Delta_Apply on a flash image, raises on rule violations.
+
+    From another slot (source given and not base) the destination starts
+    out erased and the old image is read where it is."""
+    in_place = source is None or source == base
+    last = sector_of(base + max(len(old) if in_place else 0, new_length) - 1)
+    flash = bytearray(b"\xff" * (SECTORS[last][0] + SECTORS[last][1] - base))
+    if in_place:
+        flash[:len(old)] = old
+    scratch = b""
+    rewritten = set()
+    current = None
+    write = end = 0
+    new_end = new_length
+    pos = 0
+    erased = []
+
+    def emit(data):
+        nonlocal write
+        if current is None or write + len(data) > min(end, new_end):
+            raise ValueError("write outside the open sector")
+        flash[write:write + len(data)] = data
+        write += len(data)
+
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_SECTOR:
+            sector = patch[pos]
+            pos += 1
+            if current is not None and sector <= current:
+                raise ValueError("sectors out of order")
+            start, size = SECTORS[sector]
+            lo = start - base
+            scratch = bytes(flash[lo:min(lo + size, len(old))])
+            flash[lo:lo + size] = b"\xff" * len(flash[lo:lo + size])
+            current, write, end = sector, lo, lo + size
+            rewritten.add(sector)
+            erased.append(sector)
+        elif op == OP_COPY:
+            length, offset = struct.unpack_from("<II", patch, pos)
+            pos += 8
+            if offset + length > len(old):
+                raise ValueError("copy beyond the old image")
+            if not in_place:
+                emit(old[offset:offset + length])
+                continue
+            for i in range(offset, offset + length):
+                owner = sector_of(base + i)
+                if owner == current:
+                    emit(scratch[i - (SECTORS[owner][0] - base):][:1])
+                elif owner in rewritten:
+                    raise ValueError("copy from a rewritten sector")
+                else:
+                    emit(bytes(flash[i:i + 1]))
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<H", patch, pos)
+            pos += 2
+            emit(bytes(patch[pos:pos + length]))
+            pos += length
+        else:
+            raise ValueError("bad opcode 0x%02X" % op)
+    if pos != len(patch):
+        raise ValueError("data after END")
+    return bytes(flash[:new_length]), erased
+
+
+def main(argv):
+    base = 0x08008000
+    source = None
+    args = argv[1:]
+    while len(args) > 3 and args[0] in ("--base", "--source"):
+        if args[0] == "--base":
+            base = int(args[1], 0)
+        else:
+            source = int(args[1], 0)
+        args = args[2:]
+    if len(args) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(args[0], "rb") as f:
+        old = f.read()
+    with open(args[1], "rb") as f:
+        new = f.read()
+
+    patch = build(old, new, base, source)
+    result, erased = apply(old, patch, base, len(new), source)
+    if result != new:
+        sys.stderr.write("patched image does not match %s\n" % args[1])
+        return 1
+    with open(args[2], "wb") as f:
+        f.write(patch)
+
+    print("old  %d bytes, CRC 0x%08X" % (len(old), crc32_mpeg2(old)))
+    print("new  %d bytes, CRC 0x%08X" % (len(new), crc32_mpeg2(new)))
+    print("patch %d bytes, %d bytes saved (%.1f%%), sectors rewritten: %s"
+          % (len(patch), len(new) - len(patch),
+             100.0 * (len(new) - len(patch)) / max(len(new), 1),
+             " ".join(str(s) for s in erased) or "none"))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Model the update time of CBL_STREAM_WRITE_CMD with and without erase-ahead.
+
+Without STREAM_FLAG_ERASE_AHEAD the host first erases every sector of the
+image with CBL_FLASH_ERASE_CMD and waits, then streams the blocks.  With
+the flag the session erases the sectors itself:
+
+  - the sectors under the first window are erased before the session status,
+  - after each window reply the next sector is erased in the background while
+    the host sends the following window into the RX ring.  The F407 is single
+    bank, so the CPU stalls until the erase ends and programming waits,
+  - before a reply the target finishes any erase the next window would reach,
+    which holds the host off when erasing lags.
+
+Flash timings are the STM32F407 datasheet values at x32 parallelism.  Typical
+values are used by default and --worst uses the maximum ones.  Link timings
+assume 10 bits per byte and a fixed host turnaround per reply.
+
+usage: bl_erase_sim.py [--worst] [--base 0x08008000] [--turnaround-ms 1]
+"""
+
+import sys
+
+FLASH_BASE = 0x08000000
+SECTORS = [(FLASH_BASE + i * 0x4000, 0x4000) for i in range(4)] + \
+          [(FLASH_BASE + 0x10000, 0x10000)] + \
+          [(FLASH_BASE + 0x20000 + i * 0x20000, 0x20000) for i in range(7)]
+
+# (typical, maximum) in seconds
+ERASE_TIME = {0x4000: (0.25, 0.5), 0x10000: (0.55, 1.1), 0x20000: (1.0, 2.0)}
+WORD_PROGRAM = (16e-6, 100e-6)
+
+FRAME_LEN = 256          # length byte + sequence(2) + data + CRC(4)
+BLOCK_DATA = 248
+REPLY_LEN = 6            # ACK, length, 4-byte window reply
+RING_LEN = 8448
+
+
+def sectors_of(base, length):
+    return [i for i, (start, size) in enumerate(SECTORS)
+            if start < base + length and start + size > base]
+
+
+class Link:
+    def __init__(self, baud, turnaround, worst):
+        self.byte = 10.0 / baud
+        self.turnaround = turnaround
+        self.pick = 1 if worst else 0
+
+    def erase(self, sector):
+        return ERASE_TIME[SECTORS[sector][1]][self.pick]
+
+    def program(self, length):
+        return (length // 4) * WORD_PROGRAM[self.pick]
+
+
+def stream(link, base, length, window, erase_ahead):
+    """Seconds from the session frame to the last window reply."""
+    pending = sectors_of(base, length) if erase_ahead else []
+    background = erase_ahead and window * FRAME_LEN < RING_LEN
+    t = 0.0
+    cpu_free = 0.0
+
+    def settle(address, span, now):
+        # BL_Erase_Ready : synchronous erase of whatever the next window reaches
+        for sector in list(pending):
+            start, size = SECTORS[sector]
+            if start < address + span and start + size > address:
+                now += link.erase(sector)
+                pending.remove(sector)
+        return now
+
+    def start_next(now):
+        # BL_Erase_Start_Next returns once the erase is started, the flash interrupt ends it :
+        # the CPU stalls on its next flash fetch and nothing is programmed until then
+        if background and pending:
+            return now + link.erase(pending.pop(0))
+        return now
+
+    t = settle(base, window * BLOCK_DATA, t)
+    t += REPLY_LEN * link.byte
+    cpu_free = start_next(t)
+
+    written = 0
+    while written < length:
+        send = t + link.turnaround
+        count = min(window, -(-(length - written) // BLOCK_DATA))
+        for i in range(count):
+            data = min(BLOCK_DATA, length - written)
+            arrival = send + (i + 1) * FRAME_LEN * link.byte
+            cpu_free = max(cpu_free, arrival) + link.program(data)
+            written += data
+        t = settle(base + written, window * BLOCK_DATA, cpu_free)
+        t += REPLY_LEN * link.byte
+        cpu_free = start_next(t)
+    return t
+
+
+def update(link, base, length, window, erase_ahead):
+    total = 0.0
+    if not erase_ahead:
+        # one CBL_FLASH_ERASE_CMD for the sector range, the host waits for its reply
+        total += link.turnaround + 16 * link.byte
+        total += sum(link.erase(s) for s in sectors_of(base, length))
+    return total + link.turnaround + 20 * link.byte + stream(link, base, length, window, erase_ahead)
+
+
+def main(argv):
+    worst = False
+    base = 0x08008000
+    turnaround = 0.001
+    args = argv[1:]
+    while args:
+        if args[0] == "--worst":
+            worst = True
+            args = args[1:]
+        elif args[0] in ("--base", "--turnaround-ms") and len(args) > 1:
+            if args[0] == "--base":
+                base = int(args[1], 0)
+            else:
+                turnaround = float(args[1]) / 1000.0
+            args = args[2:]
+        else:
+            sys.stderr.write(__doc__)
+            return 1
+
+    print("%s flash timings, image at 0x%08X, %.1f ms host turnaround"
+          % ("worst case" if worst else "typical", base, turnaround * 1000.0))
+    print("%8s %8s %6s %10s %12s %8s" % ("image", "baud", "window", "erase+send", "erase-ahead", "saved"))
+    for length in (64 * 1024, 256 * 1024, 352 * 1024):
+        for baud in (115200, 921600, 2000000):
+            link = Link(baud, turnaround, worst)
+            for window in (8, 32):
+                before = update(link, base, length, window, False)
+                after = update(link, base, length, window, True)
+                print("%7dK %8d %6d %9.2fs %11.2fs %7.1f%%"
+                      % (length // 1024, baud, window, before, after, 100.0 * (before - after) / before))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
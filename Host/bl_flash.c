@@ -0,0 +1,1410 @@
+/*
+ * Production line flashing tool for the bootloader's CBL_* protocol.
+ *
+ * Loads an Intel HEX or raw binary image and flashes it into every serial
+ * port given on the command line at once.  One epoll loop drives all
+ * ports, and each port runs its own state machine :
+ *
+ *   version -> [link rate] -> [v2 frames] -> [sector status] -> stream sessions -> image hash -> [jump]
+ *
+ * The image goes out in CBL_STREAM_WRITE_CMD blocks.  A whole window of
+ * blocks is in flight before the device answers with one cumulative
+ * reply.  A lost or bad block makes the device answer NACK with the next
+ * sequence it expects, and the window is resent from there (go back N).
+ * The sectors under the image are erased by the session itself
+ * (STREAM_FLAG_ERASE_AHEAD).  With --skip-same, CBL_READ_SECTOR_STATUS_CMD
+ * is asked first and only runs of sectors that differ are streamed.
+ * With --resume each session is kept in the device's update journal
+ * (STREAM_FLAG_JOURNAL) : running the same command again after a lost
+ * link continues behind the last window the device still holds.
+ *
+ * --info only reads version, chip id, protection level, command list and
+ * slot table and update journal from each device.
+ *
+ *   cc -O2 -Wall -o bl_flash Host/bl_flash.c
+ *   ./bl_flash [options] image.hex|image.bin port [port ...]
+ *
+ * Host/bl_pty_sim.py serves simulated bootloaders on pseudo-terminals to
+ * test against.
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CBL_GET_VER_CMD							0x10
+#define CBL_GET_HELP_CMD						0x11
+#define CBL_GET_CID_CMD							0x12
+#define CBL_GET_RDP_STATUS_CMD			0x13
+#define CBL_GO_TO_ADDR_CMD					0x14
+#define CBL_READ_SECTOR_STATUS_CMD	0x19
+#define CBL_STREAM_WRITE_CMD				0x22
+#define CBL_IMAGE_HASH_CMD					0x24
+#define CBL_SLOT_INFO_CMD						0x26
+#define CBL_SET_BAUD_CMD						0x29
+#define CBL_SET_PROTOCOL_CMD				0x2A
+#define CBL_JOURNAL_QUERY_CMD				0x2C
+
+#define BL_ACK											0xCD
+#define BL_NACK											0xAB
+
+#define STREAM_SESSION_OPENED				0x01
+#define STREAM_STATE_ACTIVE					0x01
+#define STREAM_STATE_DONE						0x03
+#define STREAM_FLAG_ERASE_AHEAD			0x01
+#define STREAM_FLAG_JOURNAL					0x02
+#define STREAM_JOURNAL_REPLY_LEN		5
+#define STREAM_MAX_WINDOW						32
+#define STREAM_REPLY_LEN						4
+
+#define SECTOR_STATUS_PROTECTED			0x02
+#define SECTOR_STATUS_BOOTLOADER		0x04
+#define SECTOR_STATUS_ENTRY_LEN			5
+
+#define BAUD_SWITCHING							0x01
+#define BAUD_NEGOTIATED							0x02
+#define BAUD_TEST_PATTERN_LEN				16
+
+#define FORMAT_V1										1
+#define FORMAT_V2										2
+#define V1_MAX_LEN_FIELD						0xFF
+#define V2_MAX_LEN_FIELD						(2 + 4096 + 4)
+#define DEVICE_RX_RING_LEN					8448
+
+#define FLASH_BASE									0x08000000U
+#define FLASH_LEN										0x00100000U
+#define SECTOR_COUNT								12
+
+#define REPLY_TIMEOUT_MS						1500.0
+#define WINDOW_TIMEOUT_MS						3000.0
+#define BAUD_SETTLE_MS							20.0
+#define BAUD_FALLBACK_MS						1200.0
+#define MAX_RETRIES									5
+#define MAX_RUNS										SECTOR_COUNT
+#define RX_BUFFER_LEN								512
+#define TX_BUFFER_LEN								(STREAM_MAX_WINDOW * (2 + V2_MAX_LEN_FIELD))
+
+/*	states of the per device machine, each one sends a frame and waits for its reply	*/
+typedef enum{
+	ST_VERSION,
+	ST_BAUD,
+	ST_BAUD_SETTLE,
+	ST_BAUD_TEST,
+	ST_BAUD_CONFIRM,
+	ST_BAUD_FALLBACK,
+	ST_PROTOCOL,
+	ST_SECTOR_STATUS,
+	ST_SESSION,
+	ST_WINDOW,
+	ST_HASH,
+	ST_GO,
+	ST_INFO_CID,
+	ST_INFO_RDP,
+	ST_INFO_HELP,
+	ST_INFO_SLOTS,
+	ST_INFO_JOURNAL,
+	ST_DONE,
+	ST_FAILED,
+}DeviceState;
+
+/*	replies are ACK | len | data or a lone NACK, stream windows answer with a fixed 4 byte record	*/
+typedef enum{
+	REPLY_NONE,
+	REPLY_ACK_DATA,
+	REPLY_RAW,
+}ReplyKind;
+
+typedef struct{
+	uint32_t offset;
+	uint32_t length;
+}ImageRun;
+
+typedef struct{
+	uint32_t base;
+	uint32_t length;
+	uint8_t *data;
+	uint32_t crc;
+}Image;
+
+typedef struct{
+	uint32_t linkBaud;
+	uint32_t fastBaud;
+	uint8_t useV2;
+	uint16_t blockData;
+	uint8_t window;
+	uint8_t skipSame;
+	uint8_t eraseAhead;
+	uint8_t resume;
+	uint8_t verify;
+	uint8_t jump;
+	uint8_t info;
+}Options;
+
+typedef struct{
+	const char *path;
+	int fd;
+	DeviceState state;
+	const char *failure;
+	double deadline;
+	uint8_t retries;
+
+	uint8_t format;
+	uint32_t baud;
+	uint16_t blockData;
+	uint8_t window;
+
+	ReplyKind replyKind;
+	uint16_t replyLength;
+	uint8_t rx[RX_BUFFER_LEN];
+	size_t rxCount;
+	uint8_t *tx;
+	size_t txLength;
+	size_t txSent;
+
+	ImageRun runs[MAX_RUNS];
+	uint8_t runCount;
+	uint8_t runIndex;
+	uint16_t ackedSequence;
+	uint16_t windowBlocks;
+	uint32_t resumeOffset;
+
+	uint8_t version[4];
+	double startTime;
+	double endTime;
+	uint32_t bytesStreamed;
+	uint32_t bytesSkipped;
+	uint32_t framesSent;
+	uint32_t windowRetries;
+	uint32_t timeouts;
+	uint32_t nacks;
+}Device;
+
+static const uint8_t baudTestPattern[BAUD_TEST_PATTERN_LEN] = {	0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+																																0x01, 0x80, 0x7E, 0x81, 0x5A, 0xA5, 0x96, 0x69	};
+
+static uint32_t crcTable[256];
+static Image image;
+static Options options;
+static int epollFd = -1;
+
+/*----------------------------------------------------------------------------*/
+/*	helpers																																		*/
+/*----------------------------------------------------------------------------*/
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec * 1000.0) + ((double)ts.tv_nsec * 1e-6);
+}
+
+static void crc_init(void)
+{
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i << 24;
+		for(int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x80000000U) ? ((crc << 1) ^ 0x04C11DB7U) : (crc << 1);
+		}
+		crcTable[i] = crc;
+	}
+}
+
+/*	CRC-32/MPEG-2, what the device's CRC unit computes over a frame or a region	*/
+static uint32_t crc32_mpeg2(const uint8_t *data, size_t length)
+{
+	uint32_t crc = 0xFFFFFFFFU;
+	while(length--)
+	{
+		crc = (crc << 8) ^ crcTable[(crc >> 24) ^ *data++];
+	}
+	return crc;
+}
+
+static void put32(uint8_t *out, uint32_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+	out[2] = (uint8_t)(value >> 16);
+	out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static uint32_t sector_start(int sector)
+{
+	if(sector < 4)
+	{
+		return FLASH_BASE + ((uint32_t)sector * 0x4000U);
+	}
+	if(4 == sector)
+	{
+		return FLASH_BASE + 0x10000U;
+	}
+	return FLASH_BASE + 0x20000U + ((uint32_t)(sector - 5) * 0x20000U);
+}
+
+static uint32_t sector_size(int sector)
+{
+	return (sector < 4) ? 0x4000U : ((4 == sector) ? 0x10000U : 0x20000U);
+}
+
+static int sector_of(uint32_t address)
+{
+	for(int sector = 0; sector < SECTOR_COUNT; sector++)
+	{
+		if((address >= sector_start(sector)) && (address < sector_start(sector) + sector_size(sector)))
+		{
+			return sector;
+		}
+	}
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*	image loading																															*/
+/*----------------------------------------------------------------------------*/
+
+static uint8_t *read_file(const char *path, size_t *length)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data = NULL;
+	long size;
+
+	if(NULL == f)
+	{
+		return NULL;
+	}
+	if((0 == fseek(f, 0, SEEK_END)) && ((size = ftell(f)) >= 0) && (0 == fseek(f, 0, SEEK_SET)))
+	{
+		data = malloc((size_t)size + 1);
+		if((NULL != data) && (fread(data, 1, (size_t)size, f) != (size_t)size))
+		{
+			free(data);
+			data = NULL;
+		}
+		*length = (size_t)size;
+	}
+	fclose(f);
+	return data;
+}
+
+static int hex_byte(const char *text)
+{
+	int hi, lo;
+	if(!isxdigit((unsigned char)text[0]) || !isxdigit((unsigned char)text[1]))
+	{
+		return -1;
+	}
+	hi = isdigit((unsigned char)text[0]) ? text[0] - '0' : (tolower((unsigned char)text[0]) - 'a' + 10);
+	lo = isdigit((unsigned char)text[1]) ? text[1] - '0' : (tolower((unsigned char)text[1]) - 'a' + 10);
+	return (hi << 4) | lo;
+}
+
+/*	Intel HEX : data, EOF, extended segment and extended linear address records, gaps are filled with 0xFF	*/
+static int load_hex(const char *text, size_t length)
+{
+	uint8_t *flash = malloc(FLASH_LEN);
+	uint32_t upper = 0, low = 0xFFFFFFFFU, high = 0;
+	const char *line = text, *end = text + length;
+	int lineNumber = 0;
+
+	if(NULL == flash)
+	{
+		return -1;
+	}
+	memset(flash, 0xFF, FLASH_LEN);
+
+	while(line < end)
+	{
+		const char *next = memchr(line, '\n', (size_t)(end - line));
+		uint8_t record[5 + 255];
+		int count, sum = 0;
+
+		next = (NULL == next) ? end : next + 1;
+		lineNumber++;
+		while((line < next) && (':' != *line))
+		{
+			line++;
+		}
+		if(line == next)
+		{
+			line = next;
+			continue;
+		}
+		line++;
+
+		count = hex_byte(line);
+		if((count < 0) || (line + 2 * (count + 5) > next))
+		{
+			fprintf(stderr, "hex line %d : truncated record\n", lineNumber);
+			free(flash);
+			return -1;
+		}
+		for(int i = 0; i < count + 5; i++)
+		{
+			int byte = hex_byte(&line[2 * i]);
+			if(byte < 0)
+			{
+				fprintf(stderr, "hex line %d : bad digit\n", lineNumber);
+				free(flash);
+				return -1;
+			}
+			record[i] = (uint8_t)byte;
+			sum += byte;
+		}
+		if(0 != (sum & 0xFF))
+		{
+			fprintf(stderr, "hex line %d : checksum mismatch\n", lineNumber);
+			free(flash);
+			return -1;
+		}
+
+		switch(record[3])
+		{
+			case 0x00:
+			{
+				uint32_t address = upper + (((uint32_t)record[1] << 8) | record[2]);
+				if((address < FLASH_BASE) || (address + (uint32_t)count > FLASH_BASE + FLASH_LEN))
+				{
+					fprintf(stderr, "hex line %d : data at 0x%08X outside flash\n", lineNumber, address);
+					free(flash);
+					return -1;
+				}
+				memcpy(&flash[address - FLASH_BASE], &record[4], (size_t)count);
+				if(count && (address < low))
+				{
+					low = address;
+				}
+				if(address + (uint32_t)count > high)
+				{
+					high = address + (uint32_t)count;
+				}
+				break;
+			}
+			case 0x01:
+				next = end;
+				break;
+			case 0x02:
+				upper = (((uint32_t)record[4] << 8) | record[5]) << 4;
+				break;
+			case 0x04:
+				upper = (((uint32_t)record[4] << 8) | record[5]) << 16;
+				break;
+			default:
+				/*	start address records do not matter to the bootloader	*/
+				break;
+		}
+		line = next;
+	}
+
+	if(high <= low)
+	{
+		fprintf(stderr, "hex file holds no data\n");
+		free(flash);
+		return -1;
+	}
+	image.base = low;
+	image.length = high - low;
+	image.data = malloc(image.length + 4);
+	memcpy(image.data, &flash[low - FLASH_BASE], image.length);
+	free(flash);
+	return 0;
+}
+
+static int load_image(const char *path, uint32_t base)
+{
+	size_t length = 0;
+	uint8_t *data = read_file(path, &length);
+	const char *dot = strrchr(path, '.');
+
+	if(NULL == data)
+	{
+		fprintf(stderr, "%s : %s\n", path, strerror(errno));
+		return -1;
+	}
+	if((NULL != dot) && ((0 == strcasecmp(dot, ".hex")) || (0 == strcasecmp(dot, ".ihex"))))
+	{
+		int status = load_hex((const char *)data, length);
+		free(data);
+		if(status)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		if((0 == length) || (base < FLASH_BASE) || ((uint64_t)base + length > (uint64_t)FLASH_BASE + FLASH_LEN))
+		{
+			fprintf(stderr, "%s : %zu bytes do not fit flash at 0x%08X\n", path, length, base);
+			free(data);
+			return -1;
+		}
+		image.base = base;
+		image.length = (uint32_t)length;
+		image.data = realloc(data, length + 4);
+	}
+
+	/*	stream sessions program whole words, the tail is padded the way erased flash reads	*/
+	while(image.length % 4)
+	{
+		image.data[image.length++] = 0xFF;
+	}
+	image.crc = crc32_mpeg2(image.data, image.length);
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*	serial ports																															*/
+/*----------------------------------------------------------------------------*/
+
+static speed_t baud_constant(uint32_t baud)
+{
+	switch(baud)
+	{
+		case 9600:			return B9600;
+		case 19200:			return B19200;
+		case 38400:			return B38400;
+		case 57600:			return B57600;
+		case 115200:		return B115200;
+		case 230400:		return B230400;
+		case 460800:		return B460800;
+		case 500000:		return B500000;
+		case 576000:		return B576000;
+		case 921600:		return B921600;
+		case 1000000:		return B1000000;
+		case 1152000:		return B1152000;
+		case 1500000:		return B1500000;
+		case 2000000:		return B2000000;
+		case 2500000:		return B2500000;
+		case 3000000:		return B3000000;
+		default:				return 0;
+	}
+}
+
+static int port_set_baud(int fd, uint32_t baud)
+{
+	struct termios tio;
+	speed_t speed = baud_constant(baud);
+
+	if((0 == speed) || (0 != tcgetattr(fd, &tio)))
+	{
+		return -1;
+	}
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	return tcsetattr(fd, TCSADRAIN, &tio);
+}
+
+static int port_open(const char *path, uint32_t baud)
+{
+	struct termios tio;
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+	if(fd < 0)
+	{
+		return -1;
+	}
+	if(0 != tcgetattr(fd, &tio))
+	{
+		close(fd);
+		return -1;
+	}
+	/*	raw 8N1, no flow control : the bootloader talks plain UART	*/
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	if((0 != tcsetattr(fd, TCSANOW, &tio)) || (0 != port_set_baud(fd, baud)))
+	{
+		close(fd);
+		return -1;
+	}
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+static void port_watch_output(Device *dev, int enable)
+{
+	struct epoll_event event;
+	event.events = EPOLLIN | (enable ? EPOLLOUT : 0);
+	event.data.ptr = dev;
+	epoll_ctl(epollFd, EPOLL_CTL_MOD, dev->fd, &event);
+}
+
+/*----------------------------------------------------------------------------*/
+/*	frames																																		*/
+/*----------------------------------------------------------------------------*/
+
+/*	len | SID | payload | CRC(4), len is 1 byte in v1 and 2 bytes little endian in v2	*/
+static size_t frame_build(const Device *dev, uint8_t *out, uint8_t sid, const uint8_t *payload, uint16_t payloadLength)
+{
+	uint16_t lengthField = (uint16_t)(1 + payloadLength + 4);
+	size_t header = (FORMAT_V2 == dev->format) ? 2 : 1;
+
+	out[0] = (uint8_t)lengthField;
+	if(2 == header)
+	{
+		out[1] = (uint8_t)(lengthField >> 8);
+	}
+	out[header] = sid;
+	memcpy(&out[header + 1], payload, payloadLength);
+	put32(&out[header + 1 + payloadLength], crc32_mpeg2(out, header + 1 + payloadLength));
+	return header + 1 + payloadLength + 4;
+}
+
+/*	stream block : len | sequence(2) | data | CRC(4)	*/
+static size_t block_build(const Device *dev, uint8_t *out, uint16_t sequence, const uint8_t *data, uint16_t dataLength)
+{
+	uint16_t lengthField = (uint16_t)(2 + dataLength + 4);
+	size_t header = (FORMAT_V2 == dev->format) ? 2 : 1;
+
+	out[0] = (uint8_t)lengthField;
+	if(2 == header)
+	{
+		out[1] = (uint8_t)(lengthField >> 8);
+	}
+	out[header] = (uint8_t)sequence;
+	out[header + 1] = (uint8_t)(sequence >> 8);
+	memcpy(&out[header + 2], data, dataLength);
+	put32(&out[header + 2 + dataLength], crc32_mpeg2(out, header + 2 + dataLength));
+	return header + 2 + dataLength + 4;
+}
+
+static uint16_t max_frame_length(uint8_t format)
+{
+	return (FORMAT_V2 == format) ? (2 + V2_MAX_LEN_FIELD) : (1 + V1_MAX_LEN_FIELD);
+}
+
+/*----------------------------------------------------------------------------*/
+/*	device state machine																											*/
+/*----------------------------------------------------------------------------*/
+
+static void device_fail(Device *dev, const char *reason)
+{
+	dev->state = ST_FAILED;
+	dev->failure = reason;
+	dev->replyKind = REPLY_NONE;
+	dev->endTime = now_ms();
+}
+
+static void device_send(Device *dev, size_t length, ReplyKind kind, uint16_t replyLength, double timeout)
+{
+	dev->txLength = length;
+	dev->txSent = 0;
+	dev->rxCount = 0;
+	dev->replyKind = kind;
+	dev->replyLength = replyLength;
+	dev->deadline = now_ms() + timeout;
+	dev->framesSent++;
+	port_watch_output(dev, 1);
+}
+
+static void device_command(Device *dev, uint8_t sid, const uint8_t *payload, uint16_t payloadLength)
+{
+	device_send(dev, frame_build(dev, dev->tx, sid, payload, payloadLength), REPLY_ACK_DATA, 0, REPLY_TIMEOUT_MS);
+}
+
+static void device_wait(Device *dev, DeviceState state, double delay)
+{
+	dev->state = state;
+	dev->replyKind = REPLY_NONE;
+	dev->txLength = dev->txSent = 0;
+	dev->deadline = now_ms() + delay;
+}
+
+static void send_version(Device *dev)
+{
+	dev->state = ST_VERSION;
+	device_command(dev, CBL_GET_VER_CMD, NULL, 0);
+}
+
+static void send_baud(Device *dev)
+{
+	uint8_t payload[4];
+	put32(payload, options.fastBaud);
+	dev->state = ST_BAUD;
+	device_command(dev, CBL_SET_BAUD_CMD, payload, 4);
+}
+
+static void send_protocol(Device *dev)
+{
+	uint8_t version = FORMAT_V2;
+	dev->state = ST_PROTOCOL;
+	device_command(dev, CBL_SET_PROTOCOL_CMD, &version, 1);
+}
+
+static void send_sector_status(Device *dev)
+{
+	int first = sector_of(image.base);
+	int last = sector_of(image.base + image.length - 1);
+	uint8_t payload[2] = {	(uint8_t)first, (uint8_t)(last - first + 1)	};
+	dev->state = ST_SECTOR_STATUS;
+	device_command(dev, CBL_READ_SECTOR_STATUS_CMD, payload, 2);
+}
+
+static void send_session(Device *dev)
+{
+	const ImageRun *run = &dev->runs[dev->runIndex];
+	uint8_t payload[18];
+
+	put32(&payload[0], image.base + run->offset);
+	put32(&payload[4], run->length);
+	payload[8] = dev->window;
+	payload[9] = options.eraseAhead ? STREAM_FLAG_ERASE_AHEAD : 0;
+	if(options.resume)
+	{
+		/*	the id follows from what is written, so the same command finds its journal entry again	*/
+		put32(&payload[14], crc32_mpeg2(&image.data[run->offset], run->length));
+		put32(&payload[10], crc32_mpeg2(payload, 8) ^ get32(&payload[14]));
+		payload[9] |= STREAM_FLAG_JOURNAL;
+	}
+	dev->ackedSequence = 0;
+	dev->resumeOffset = 0;
+	dev->state = ST_SESSION;
+	device_command(dev, CBL_STREAM_WRITE_CMD, payload, options.resume ? 18 : 10);
+}
+
+/*	the whole window goes out back to back, the device answers once after the last block	*/
+static void send_window(Device *dev)
+{
+	const ImageRun *run = &dev->runs[dev->runIndex];
+	uint32_t offset = dev->resumeOffset + (uint32_t)dev->ackedSequence * dev->blockData;
+	size_t length = 0;
+	uint16_t blocks = 0;
+
+	while((blocks < dev->window) && (offset < run->length))
+	{
+		uint16_t chunk = (run->length - offset > dev->blockData) ? dev->blockData : (uint16_t)(run->length - offset);
+		length += block_build(dev, &dev->tx[length], (uint16_t)(dev->ackedSequence + blocks), &image.data[run->offset + offset], chunk);
+		offset += chunk;
+		blocks++;
+	}
+	dev->windowBlocks = blocks;
+	dev->state = ST_WINDOW;
+	/*	timeout covers the window on the wire plus a sector erase the device may do before answering	*/
+	device_send(dev, length, REPLY_RAW, STREAM_REPLY_LEN, WINDOW_TIMEOUT_MS + ((double)length * 10000.0 / dev->baud));
+	dev->framesSent += blocks - 1U;
+}
+
+static void send_hash(Device *dev)
+{
+	uint8_t payload[8];
+	put32(&payload[0], image.base);
+	put32(&payload[4], image.length);
+	dev->state = ST_HASH;
+	device_command(dev, CBL_IMAGE_HASH_CMD, payload, 8);
+}
+
+static void send_go(Device *dev)
+{
+	uint8_t payload[4];
+	put32(payload, image.base);
+	dev->state = ST_GO;
+	device_command(dev, CBL_GO_TO_ADDR_CMD, payload, 4);
+}
+
+static void start_writing(Device *dev)
+{
+	/*	the sector table only lines up with an image that starts on a sector	*/
+	if(options.skipSame && (sector_start(sector_of(image.base)) == image.base))
+	{
+		send_sector_status(dev);
+	}
+	else
+	{
+		dev->runs[0].offset = 0;
+		dev->runs[0].length = image.length;
+		dev->runCount = 1;
+		dev->runIndex = 0;
+		send_session(dev);
+	}
+}
+
+static void next_after_link(Device *dev)
+{
+	if(options.info)
+	{
+		dev->state = ST_INFO_CID;
+		device_command(dev, CBL_GET_CID_CMD, NULL, 0);
+	}
+	else if(options.useV2 && (FORMAT_V1 == dev->format))
+	{
+		send_protocol(dev);
+	}
+	else
+	{
+		start_writing(dev);
+	}
+}
+
+static void finish_writing(Device *dev)
+{
+	if(options.verify)
+	{
+		send_hash(dev);
+	}
+	else if(options.jump)
+	{
+		send_go(dev);
+	}
+	else
+	{
+		dev->state = ST_DONE;
+		dev->endTime = now_ms();
+	}
+}
+
+static void next_run(Device *dev)
+{
+	if(++dev->runIndex < dev->runCount)
+	{
+		send_session(dev);
+	}
+	else
+	{
+		finish_writing(dev);
+	}
+}
+
+static void apply_format(Device *dev, uint8_t format)
+{
+	uint16_t maxData = (uint16_t)((max_frame_length(format) - ((FORMAT_V2 == format) ? 2 : 1) - 2 - 4) & ~3U);
+	uint16_t maxWindow = (uint16_t)((DEVICE_RX_RING_LEN - 1) / max_frame_length(format));
+
+	dev->format = format;
+	dev->blockData = (options.blockData && (options.blockData < maxData)) ? (uint16_t)(options.blockData & ~3U) : maxData;
+	/*	the device only overlaps erase with reception when a whole window fits its RX ring	*/
+	dev->window = options.window ? options.window : (uint8_t)((maxWindow > STREAM_MAX_WINDOW) ? STREAM_MAX_WINDOW : maxWindow);
+}
+
+/*	plan the sessions from the sector table : sectors that already hold the image are left alone	*/
+static int plan_runs(Device *dev, const uint8_t *table, uint8_t count)
+{
+	int first = sector_of(image.base);
+	uint8_t *expected = NULL;
+
+	dev->runCount = 0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		int sector = first + i;
+		uint32_t start = sector_start(sector) - image.base;
+		uint32_t size = sector_size(sector);
+		uint32_t inImage = (start + size > image.length) ? (image.length - start) : size;
+		const uint8_t *entry = &table[i * SECTOR_STATUS_ENTRY_LEN];
+
+		if(entry[0] & (SECTOR_STATUS_PROTECTED | SECTOR_STATUS_BOOTLOADER))
+		{
+			free(expected);
+			return -1;
+		}
+		expected = realloc(expected, size);
+		memset(expected, 0xFF, size);
+		memcpy(expected, &image.data[start], inImage);
+		if(crc32_mpeg2(expected, size) == get32(&entry[1]))
+		{
+			dev->bytesSkipped += inImage;
+			continue;
+		}
+
+		if(dev->runCount && (dev->runs[dev->runCount - 1].offset + dev->runs[dev->runCount - 1].length == start))
+		{
+			dev->runs[dev->runCount - 1].length += inImage;
+		}
+		else
+		{
+			dev->runs[dev->runCount].offset = start;
+			dev->runs[dev->runCount].length = inImage;
+			dev->runCount++;
+		}
+	}
+	free(expected);
+	return 0;
+}
+
+static void on_reply(Device *dev, int acked, const uint8_t *data, uint16_t length)
+{
+	switch(dev->state)
+	{
+		case ST_VERSION:
+			if(!acked || (length < 4))
+			{
+				device_fail(dev, "no version reply");
+				return;
+			}
+			memcpy(dev->version, data, 4);
+			if(options.fastBaud && (options.fastBaud != dev->baud))
+			{
+				send_baud(dev);
+			}
+			else
+			{
+				next_after_link(dev);
+			}
+			break;
+
+		case ST_BAUD:
+			/*	status | count | rates, the device is switching once the reply is out	*/
+			if(acked && (length >= 2) && (BAUD_SWITCHING == data[0]) && (0 == port_set_baud(dev->fd, options.fastBaud)))
+			{
+				device_wait(dev, ST_BAUD_SETTLE, BAUD_SETTLE_MS);
+			}
+			else
+			{
+				next_after_link(dev);
+			}
+			break;
+
+		case ST_BAUD_TEST:
+			if(acked && (BAUD_TEST_PATTERN_LEN == length) && (0 == memcmp(data, baudTestPattern, BAUD_TEST_PATTERN_LEN)))
+			{
+				dev->state = ST_BAUD_CONFIRM;
+				device_command(dev, CBL_SET_BAUD_CMD, NULL, 0);
+			}
+			else
+			{
+				(void)port_set_baud(dev->fd, dev->baud);
+				device_wait(dev, ST_BAUD_FALLBACK, BAUD_FALLBACK_MS);
+			}
+			break;
+
+		case ST_BAUD_CONFIRM:
+			if(acked && (1 == length) && (BAUD_NEGOTIATED == data[0]))
+			{
+				dev->baud = options.fastBaud;
+				next_after_link(dev);
+			}
+			else
+			{
+				(void)port_set_baud(dev->fd, dev->baud);
+				device_wait(dev, ST_BAUD_FALLBACK, BAUD_FALLBACK_MS);
+			}
+			break;
+
+		case ST_PROTOCOL:
+			/*	accepted version | largest length field, an older bootloader NACKs the unknown SID and stays on v1	*/
+			apply_format(dev, (acked && (3 == length) && (FORMAT_V2 == data[0])) ? FORMAT_V2 : FORMAT_V1);
+			start_writing(dev);
+			break;
+
+		case ST_SECTOR_STATUS:
+			if(!acked || (length < 1) || (length != 1 + (data[0] * SECTOR_STATUS_ENTRY_LEN)))
+			{
+				device_fail(dev, "bad sector status reply");
+			}
+			else if(0 != plan_runs(dev, &data[1], data[0]))
+			{
+				device_fail(dev, "image covers a protected or bootloader sector");
+			}
+			else
+			{
+				dev->runIndex = 0;
+				if(dev->runCount)
+				{
+					send_session(dev);
+				}
+				else
+				{
+					/*	nothing differs : the image hash still confirms it	*/
+					finish_writing(dev);
+				}
+			}
+			break;
+
+		case ST_SESSION:
+			if(!acked || (length != (options.resume ? STREAM_JOURNAL_REPLY_LEN : 1)) || (STREAM_SESSION_OPENED != data[0]))
+			{
+				device_fail(dev, "stream session rejected");
+			}
+			else if(options.resume && ((get32(&data[1]) > dev->runs[dev->runIndex].length) || (get32(&data[1]) & 3U)))
+			{
+				device_fail(dev, "bad resume offset");
+			}
+			else
+			{
+				/*	the device already holds the run up to the resume offset	*/
+				dev->resumeOffset = options.resume ? get32(&data[1]) : 0;
+				dev->bytesSkipped += dev->resumeOffset;
+				dev->retries = 0;
+				if(dev->resumeOffset == dev->runs[dev->runIndex].length)
+				{
+					next_run(dev);
+				}
+				else
+				{
+					send_window(dev);
+				}
+			}
+			break;
+
+		case ST_WINDOW:
+		{
+			uint16_t next = (uint16_t)(data[1] | (data[2] << 8));
+			uint8_t streamState = data[3];
+
+			if(next > dev->ackedSequence)
+			{
+				uint32_t progress = (uint32_t)(next - dev->ackedSequence) * dev->blockData;
+				uint32_t remaining = dev->runs[dev->runIndex].length - dev->resumeOffset - ((uint32_t)dev->ackedSequence * dev->blockData);
+				dev->bytesStreamed += (progress > remaining) ? remaining : progress;
+				dev->ackedSequence = next;
+				dev->retries = 0;
+			}
+			if(BL_ACK != data[0])
+			{
+				dev->nacks++;
+			}
+			if(STREAM_STATE_DONE == streamState)
+			{
+				next_run(dev);
+			}
+			else if(STREAM_STATE_ACTIVE != streamState)
+			{
+				device_fail(dev, "stream aborted by the device");
+			}
+			else if((BL_ACK != data[0]) && (++dev->retries > MAX_RETRIES))
+			{
+				device_fail(dev, "too many failed windows");
+			}
+			else
+			{
+				if(BL_ACK != data[0])
+				{
+					dev->windowRetries++;
+				}
+				send_window(dev);
+			}
+			break;
+		}
+
+		case ST_HASH:
+			if(!acked || (4 != length))
+			{
+				device_fail(dev, "image hash refused");
+			}
+			else if(get32(data) != image.crc)
+			{
+				device_fail(dev, "image hash mismatch");
+			}
+			else if(options.jump)
+			{
+				send_go(dev);
+			}
+			else
+			{
+				dev->state = ST_DONE;
+				dev->endTime = now_ms();
+			}
+			break;
+
+		case ST_GO:
+			if(!acked || (1 != length) || (1 != data[0]))
+			{
+				device_fail(dev, "jump refused");
+			}
+			else
+			{
+				dev->state = ST_DONE;
+				dev->endTime = now_ms();
+			}
+			break;
+
+		case ST_INFO_CID:
+			if(acked && (2 == length))
+			{
+				printf("%s : chip id 0x%03X\n", dev->path, (unsigned)(data[0] | (data[1] << 8)) & 0xFFFU);
+			}
+			dev->state = ST_INFO_RDP;
+			device_command(dev, CBL_GET_RDP_STATUS_CMD, NULL, 0);
+			break;
+
+		case ST_INFO_RDP:
+			if(acked && (1 == length))
+			{
+				printf("%s : read protection 0x%02X\n", dev->path, data[0]);
+			}
+			dev->state = ST_INFO_HELP;
+			device_command(dev, CBL_GET_HELP_CMD, NULL, 0);
+			break;
+
+		case ST_INFO_HELP:
+			if(acked)
+			{
+				printf("%s : commands", dev->path);
+				for(uint16_t i = 0; i < length; i++)
+				{
+					printf(" %02X", data[i]);
+				}
+				printf("\n");
+			}
+			dev->state = ST_INFO_SLOTS;
+			device_command(dev, CBL_SLOT_INFO_CMD, NULL, 0);
+			break;
+
+		case ST_INFO_SLOTS:
+			/*	boot slot | per slot : state | verified | version(4) | length(4) | CRC(4)	*/
+			if(acked && (length >= 1))
+			{
+				printf("%s : boot slot %u\n", dev->path, data[0]);
+				for(uint16_t i = 1; i + 14 <= length; i += 14)
+				{
+					printf("%s :   slot %u state %u verified %u version %u length %u CRC 0x%08X\n", dev->path,
+								 (i - 1) / 14, data[i], data[i + 1], get32(&data[i + 2]), get32(&data[i + 6]), get32(&data[i + 10]));
+				}
+			}
+			dev->state = ST_INFO_JOURNAL;
+			device_command(dev, CBL_JOURNAL_QUERY_CMD, NULL, 0);
+			break;
+
+		case ST_INFO_JOURNAL:
+			/*	state | session id(4) | base(4) | length(4) | image CRC(4) | verified(4), older bootloaders NACK it	*/
+			if(acked && (21 == length) && data[0])
+			{
+				printf("%s : journal %s, session 0x%08X at 0x%08X, %u of %u bytes, CRC 0x%08X\n", dev->path,
+							 (2 == data[0]) ? "complete" : "partial", get32(&data[1]), get32(&data[5]), get32(&data[17]), get32(&data[9]), get32(&data[13]));
+			}
+			dev->state = ST_DONE;
+			dev->endTime = now_ms();
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void on_timeout(Device *dev)
+{
+	switch(dev->state)
+	{
+		case ST_BAUD_SETTLE:
+			dev->state = ST_BAUD_TEST;
+			device_command(dev, CBL_SET_BAUD_CMD, baudTestPattern, BAUD_TEST_PATTERN_LEN);
+			break;
+
+		case ST_BAUD_TEST:
+		case ST_BAUD_CONFIRM:
+			/*	the device gives the new rate up on its own after a second, wait for it	*/
+			(void)port_set_baud(dev->fd, dev->baud);
+			device_wait(dev, ST_BAUD_FALLBACK, BAUD_FALLBACK_MS);
+			break;
+
+		case ST_BAUD_FALLBACK:
+			tcflush(dev->fd, TCIOFLUSH);
+			next_after_link(dev);
+			break;
+
+		case ST_WINDOW:
+			/*	reply lost : resend from the last acknowledged block, the device NACKs stale sequences and resyncs	*/
+			dev->timeouts++;
+			if(++dev->retries > MAX_RETRIES)
+			{
+				device_fail(dev, "stream window timed out");
+			}
+			else
+			{
+				tcflush(dev->fd, TCIFLUSH);
+				dev->windowRetries++;
+				send_window(dev);
+			}
+			break;
+
+		default:
+			dev->timeouts++;
+			if(++dev->retries > MAX_RETRIES)
+			{
+				device_fail(dev, "device does not answer");
+			}
+			else
+			{
+				/*	resend the same command frame, still in the buffer	*/
+				tcflush(dev->fd, TCIFLUSH);
+				device_send(dev, dev->txLength, dev->replyKind, dev->replyLength, REPLY_TIMEOUT_MS);
+			}
+			break;
+	}
+}
+
+/*	returns 1 once the expected reply is complete, garbage in front of an ACK/NACK is skipped	*/
+static int reply_parse(Device *dev)
+{
+	while(dev->rxCount)
+	{
+		if(REPLY_RAW == dev->replyKind)
+		{
+			if((BL_ACK != dev->rx[0]) && (BL_NACK != dev->rx[0]))
+			{
+				memmove(dev->rx, &dev->rx[1], --dev->rxCount);
+				continue;
+			}
+			if(dev->rxCount < dev->replyLength)
+			{
+				return 0;
+			}
+			dev->replyKind = REPLY_NONE;
+			dev->retries = 0;
+			on_reply(dev, BL_ACK == dev->rx[0], dev->rx, dev->replyLength);
+			return 1;
+		}
+		if(REPLY_ACK_DATA == dev->replyKind)
+		{
+			uint16_t dataLength;
+
+			if(BL_NACK == dev->rx[0])
+			{
+				dev->replyKind = REPLY_NONE;
+				dev->nacks++;
+				on_reply(dev, 0, NULL, 0);
+				return 1;
+			}
+			if(BL_ACK != dev->rx[0])
+			{
+				memmove(dev->rx, &dev->rx[1], --dev->rxCount);
+				continue;
+			}
+			if(dev->rxCount < 2)
+			{
+				return 0;
+			}
+			dataLength = dev->rx[1];
+			if(dev->rxCount < 2U + dataLength)
+			{
+				return 0;
+			}
+			dev->replyKind = REPLY_NONE;
+			dev->retries = 0;
+			on_reply(dev, 1, &dev->rx[2], dataLength);
+			return 1;
+		}
+		/*	nothing expected : stray bytes are dropped	*/
+		dev->rxCount = 0;
+	}
+	return 0;
+}
+
+static void device_io(Device *dev, uint32_t events)
+{
+	if(events & EPOLLOUT)
+	{
+		while(dev->txSent < dev->txLength)
+		{
+			ssize_t n = write(dev->fd, &dev->tx[dev->txSent], dev->txLength - dev->txSent);
+			if(n <= 0)
+			{
+				break;
+			}
+			dev->txSent += (size_t)n;
+		}
+		if(dev->txSent >= dev->txLength)
+		{
+			port_watch_output(dev, 0);
+		}
+	}
+	if(events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	{
+		for(;;)
+		{
+			ssize_t n = read(dev->fd, &dev->rx[dev->rxCount], sizeof(dev->rx) - dev->rxCount);
+			if(n <= 0)
+			{
+				if((0 == n) || ((EAGAIN != errno) && (EINTR != errno)))
+				{
+					if(events & (EPOLLHUP | EPOLLERR))
+					{
+						device_fail(dev, "port closed");
+					}
+				}
+				break;
+			}
+			dev->rxCount += (size_t)n;
+			if(reply_parse(dev) || (dev->rxCount == sizeof(dev->rx)))
+			{
+				if(dev->rxCount == sizeof(dev->rx))
+				{
+					dev->rxCount = 0;
+				}
+				break;
+			}
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*	main																																			*/
+/*----------------------------------------------------------------------------*/
+
+static const char usage[] =
+	"usage: bl_flash [options] image.hex|image.bin port [port ...]\n"
+	"       bl_flash --info port [port ...]\n"
+	"  --base ADDR      load address of a .bin image (default 0x08008000)\n"
+	"  --baud RATE      rate the bootloader listens at (default 115200)\n"
+	"  --fast RATE      negotiate this rate with CBL_SET_BAUD_CMD first\n"
+	"  --v2             negotiate 16 bit length frames with CBL_SET_PROTOCOL_CMD\n"
+	"  --block N        data bytes per stream block (default the largest)\n"
+	"  --window N       blocks in flight per reply (default what fits the device ring)\n"
+	"  --skip-same      read the sector table and only write sectors that differ\n"
+	"  --no-erase       sectors are already erased, do not erase ahead\n"
+	"  --resume         journal the sessions on the device, rerun to continue an interrupted one\n"
+	"  --no-verify      skip the image hash after writing\n"
+	"  --go             jump to the image when done\n";
+
+int main(int argc, char **argv)
+{
+	uint32_t base = 0x08008000U;
+	const char *imagePath = NULL;
+	Device *devices;
+	int deviceCount, argi = 1, active;
+
+	options.linkBaud = 115200;
+	options.eraseAhead = 1;
+	options.verify = 1;
+
+	for(; (argi < argc) && (0 == strncmp(argv[argi], "--", 2)); argi++)
+	{
+		const char *option = argv[argi];
+		const char *value = (argi + 1 < argc) ? argv[argi + 1] : NULL;
+
+		if(0 == strcmp(option, "--v2"))							{ options.useV2 = 1; }
+		else if(0 == strcmp(option, "--skip-same"))	{ options.skipSame = 1; }
+		else if(0 == strcmp(option, "--no-erase"))	{ options.eraseAhead = 0; }
+		else if(0 == strcmp(option, "--resume"))		{ options.resume = 1; }
+		else if(0 == strcmp(option, "--no-verify"))	{ options.verify = 0; }
+		else if(0 == strcmp(option, "--go"))				{ options.jump = 1; }
+		else if(0 == strcmp(option, "--info"))			{ options.info = 1; }
+		else if(NULL == value)											{ fputs(usage, stderr); return 2; }
+		else if(0 == strcmp(option, "--base"))			{ base = (uint32_t)strtoul(value, NULL, 0); argi++; }
+		else if(0 == strcmp(option, "--baud"))			{ options.linkBaud = (uint32_t)strtoul(value, NULL, 0); argi++; }
+		else if(0 == strcmp(option, "--fast"))			{ options.fastBaud = (uint32_t)strtoul(value, NULL, 0); argi++; }
+		else if(0 == strcmp(option, "--block"))			{ options.blockData = (uint16_t)strtoul(value, NULL, 0); argi++; }
+		else if(0 == strcmp(option, "--window"))		{ options.window = (uint8_t)strtoul(value, NULL, 0); argi++; }
+		else																				{ fputs(usage, stderr); return 2; }
+	}
+	if(!options.info)
+	{
+		imagePath = (argi < argc) ? argv[argi++] : NULL;
+	}
+	if((argi >= argc) || (!options.info && (NULL == imagePath)) || (options.window > STREAM_MAX_WINDOW) ||
+		 (options.fastBaud && !baud_constant(options.fastBaud)) || !baud_constant(options.linkBaud))
+	{
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	crc_init();
+	if(!options.info)
+	{
+		if(0 != load_image(imagePath, base))
+		{
+			return 1;
+		}
+		printf("image 0x%08X, %u bytes, CRC 0x%08X\n", image.base, image.length, image.crc);
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	deviceCount = argc - argi;
+	devices = calloc((size_t)deviceCount, sizeof(Device));
+	if((epollFd < 0) || (NULL == devices))
+	{
+		perror("bl_flash");
+		return 1;
+	}
+
+	for(int i = 0; i < deviceCount; i++)
+	{
+		Device *dev = &devices[i];
+		struct epoll_event event;
+
+		dev->path = argv[argi + i];
+		dev->baud = options.linkBaud;
+		dev->startTime = now_ms();
+		dev->tx = malloc(TX_BUFFER_LEN);
+		apply_format(dev, FORMAT_V1);
+		dev->fd = port_open(dev->path, options.linkBaud);
+		if(dev->fd < 0)
+		{
+			device_fail(dev, strerror(errno));
+			continue;
+		}
+		event.events = EPOLLIN;
+		event.data.ptr = dev;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, dev->fd, &event);
+		send_version(dev);
+	}
+
+	/*	one loop for every port : IO as it comes, timeouts from the nearest deadline	*/
+	do
+	{
+		struct epoll_event events[16];
+		double nearest = -1.0, t = now_ms();
+		int count, timeout;
+
+		active = 0;
+		for(int i = 0; i < deviceCount; i++)
+		{
+			Device *dev = &devices[i];
+			if((ST_DONE == dev->state) || (ST_FAILED == dev->state))
+			{
+				continue;
+			}
+			active++;
+			if(dev->deadline <= t)
+			{
+				on_timeout(dev);
+			}
+			if((nearest < 0.0) || (dev->deadline < nearest))
+			{
+				nearest = dev->deadline;
+			}
+		}
+		if(0 == active)
+		{
+			break;
+		}
+
+		timeout = (nearest <= t) ? 0 : (int)(nearest - t + 1.0);
+		count = epoll_wait(epollFd, events, 16, timeout);
+		for(int i = 0; i < count; i++)
+		{
+			Device *dev = events[i].data.ptr;
+			if((ST_DONE != dev->state) && (ST_FAILED != dev->state))
+			{
+				device_io(dev, events[i].events);
+			}
+		}
+	}while(active);
+
+	/*	per device report : payload rate counts what reached flash over the whole run, link setup included	*/
+	int failures = 0;
+	printf("%-20s %-6s %8s %6s %9s %9s %9s %7s %7s %6s  %s\n",
+				 "port", "result", "baud", "format", "written", "skipped", "B/s", "frames", "retries", "nacks", "");
+	for(int i = 0; i < deviceCount; i++)
+	{
+		Device *dev = &devices[i];
+		double seconds = (dev->endTime - dev->startTime) / 1000.0;
+
+		failures += (ST_FAILED == dev->state);
+		printf("%-20s %-6s %8u %6s %9u %9u %9.0f %7u %7u %6u  %s\n", dev->path,
+					 (ST_DONE == dev->state) ? "ok" : "FAILED", dev->baud, (FORMAT_V2 == dev->format) ? "v2" : "v1",
+					 dev->bytesStreamed, dev->bytesSkipped, (seconds > 0.0) ? dev->bytesStreamed / seconds : 0.0,
+					 dev->framesSent, dev->windowRetries + dev->timeouts, dev->nacks,
+					 (ST_FAILED == dev->state) ? dev->failure : "");
+		if(dev->fd >= 0)
+		{
+			close(dev->fd);
+		}
+	}
+	return failures ? 1 : 0;
+}
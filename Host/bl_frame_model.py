@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Throughput model and simulated benchmark for v1 and v2 host frames.
+
+v1 frames carry a 1 byte length, so a frame holds at most 255 bytes after
+the length.  CBL_SET_PROTOCOL_CMD switches the device to v2, whose 2 byte
+length allows frames of up to 4 KB of data.  This tool estimates the
+payload rate that reaches flash for each frame size.  It covers both ways
+of writing:
+
+  write   CBL_MEM_WRITE_CMD, stop and wait
+          len | SID | address(4) | count(1) | data | CRC(4)
+          then ACK | len | address status | write status
+  stream  CBL_STREAM_WRITE_CMD blocks, one 4 byte reply per window
+          len | sequence(2) | data | CRC(4)
+          the device programs a block while it receives the next one
+
+Each frame costs its bytes on the wire (10 bit times each at 8N1), the
+flash programming time and, once per reply, the host turnaround.  The
+turnaround is the latency of the USB serial adapter plus the scheduling
+of the host tool.
+
+The model column is the closed form for an error free link.  The sim
+column comes from a Monte Carlo run over a whole image.  Each frame is
+lost with probability 1 - (1 - ber) ** bits.  A lost write frame is sent
+again after a reply timeout.  A lost stream block fails its window, and
+the window is resent from that block (go back N).
+
+usage: bl_frame_model.py [--baud 115200,460800,2000000] [--latency-ms 2]
+                         [--ber 1e-6] [--image-kb 256] [--seed 1]
+"""
+
+import random
+import sys
+
+BITS_PER_BYTE = 10               # start + 8 data + stop
+WORD_PROGRAM_S = 16e-6           # F407 word program time, x32 parallelism at 2.7-3.6 V
+REPLY_TIMEOUT_S = 0.1            # host waits this long before resending a lost write frame
+
+WRITE_OVERHEAD = {1: 1 + 1 + 5 + 4, 2: 2 + 1 + 5 + 4}
+WRITE_REPLY = 4
+STREAM_OVERHEAD = {1: 1 + 2 + 4, 2: 2 + 2 + 4}
+STREAM_REPLY = 4
+STREAM_MAX_WINDOW = 32
+RX_RING = 8448                   # BL_RX_DMA_RING_LEN, one window has to fit it for erase-ahead
+MAX_DATA = {1: 248, 2: 4096}     # largest word aligned block data per frame
+
+
+def wire(nbytes, baud):
+    return nbytes * BITS_PER_BYTE / baud
+
+
+def program(nbytes):
+    return ((nbytes + 3) // 4) * WORD_PROGRAM_S
+
+
+def window_for(size, version):
+    return max(1, min(STREAM_MAX_WINDOW, (RX_RING - 1) // (size + STREAM_OVERHEAD[version])))
+
+
+def loss(nbytes, ber):
+    return 1.0 - (1.0 - ber) ** (nbytes * BITS_PER_BYTE)
+
+
+def model_write(size, version, baud, latency):
+    frame = wire(size + WRITE_OVERHEAD[version], baud)
+    return size / (frame + program(size) + wire(WRITE_REPLY, baud) + latency)
+
+
+def model_stream(size, version, baud, latency):
+    window = window_for(size, version)
+    rx = wire(size + STREAM_OVERHEAD[version], baud)
+    prog = program(size)
+    # blocks pipeline through the frame slots, the slower of link and flash sets the pace
+    span = window * max(rx, prog) + min(rx, prog) + wire(STREAM_REPLY, baud) + latency
+    return window * size / span
+
+
+def sim_write(size, version, baud, latency, ber, image, rng):
+    frame_bytes = size + WRITE_OVERHEAD[version]
+    p = loss(frame_bytes, ber)
+    elapsed = 0.0
+    done = 0
+    while done < image:
+        chunk = min(size, image - done)
+        frame = wire(chunk + WRITE_OVERHEAD[version], baud)
+        if rng.random() < p:
+            elapsed += frame + REPLY_TIMEOUT_S
+            continue
+        elapsed += frame + program(chunk) + wire(WRITE_REPLY, baud) + latency
+        done += chunk
+    return image / elapsed
+
+
+def sim_stream(size, version, baud, latency, ber, image, rng):
+    window = window_for(size, version)
+    p = loss(size + STREAM_OVERHEAD[version], ber)
+    elapsed = 0.0
+    done = 0
+    while done < image:
+        blocks = []
+        announced = done
+        while len(blocks) < window and announced < image:
+            chunk = min(size, image - announced)
+            blocks.append(chunk)
+            announced += chunk
+        rx = [wire(b + STREAM_OVERHEAD[version], baud) for b in blocks]
+        # the whole window is on the wire even when an early block is lost
+        flash_free = 0.0
+        arrival = 0.0
+        for index, chunk in enumerate(blocks):
+            arrival += rx[index]
+            if rng.random() < p:
+                flash_free = max(flash_free, sum(rx))
+                break
+            flash_free = max(flash_free, arrival) + program(chunk)
+            done += chunk
+        elapsed += flash_free + wire(STREAM_REPLY, baud) + latency
+    return image / elapsed
+
+
+def sizes(version):
+    return [s for s in (32, 64, 128, 248, 512, 1024, 2048, 4096) if s <= MAX_DATA[version]]
+
+
+def main(argv):
+    bauds = [115200, 460800, 2000000]
+    latency = 0.002
+    ber = 1e-6
+    image = 256 * 1024
+    seed = 1
+    args = argv[1:]
+    while len(args) >= 2 and args[0].startswith("--"):
+        option, value = args[0], args[1]
+        if option == "--baud":
+            bauds = [int(v, 0) for v in value.split(",")]
+        elif option == "--latency-ms":
+            latency = float(value) / 1000.0
+        elif option == "--ber":
+            ber = float(value)
+        elif option == "--image-kb":
+            image = int(value) * 1024
+        elif option == "--seed":
+            seed = int(value)
+        else:
+            break
+        args = args[2:]
+    if args:
+        sys.stderr.write(__doc__)
+        return 1
+
+    print("image %d KB, turnaround %.1f ms, bit error rate %g, word program %.0f us"
+          % (image // 1024, latency * 1000.0, ber, WORD_PROGRAM_S * 1e6))
+    for baud in bauds:
+        ceiling = baud / BITS_PER_BYTE
+        print()
+        print("%d baud, link ceiling %.0f B/s" % (baud, ceiling))
+        print("  fmt  data  win |  write model    sim   |  stream model    sim")
+        for version in (1, 2):
+            for size in sizes(version):
+                rng = random.Random(seed)
+                row = (model_write(size, version, baud, latency),
+                       sim_write(size, version, baud, latency, ber, image, rng),
+                       model_stream(size, version, baud, latency),
+                       sim_stream(size, version, baud, latency, ber, image, rng))
+                print("  v%d  %5d  %3d | %8.0f %8.0f   | %8.0f %8.0f"
+                      % ((version, size, window_for(size, version)) + row))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Decode the binary debug log written by Bootloader/bootloader_log.c.
+
+The target never formats text.  Each BL_LOG() call stores a record of
+32-bit little-endian words in a ring that USART3 DMA (or ITM port 1)
+sends in the background:
+
+    header | DWT cycles | argument[count]
+    header = 0xB1 << 24 | count << 20 | format offset from 0x08000000
+
+The format strings stay in flash, so this tool looks them up in the
+.axf the bootloader was built from and formats them here.  A record with
+format offset 0 counts records lost because the ring was full.
+
+usage: bl_log.py [--clock 168000000] firmware.axf capture.bin
+       bl_log.py [--clock 168000000] [--baud 115200] firmware.axf /dev/ttyUSB0
+"""
+
+import re
+import struct
+import sys
+
+SYNC = 0xB1
+FORMAT_BASE = 0x08000000
+FORMAT_MASK = 0x000FFFFF
+MAX_ARGS = 6
+PT_LOAD = 1
+
+SPEC = re.compile(r"%([-+ 0#]*)(\d*|\*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class Image:
+    """Loadable segments of an ELF32 little-endian file, addressed like the target."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+            raise ValueError("%s is not a little-endian ELF32 file" % path)
+        phoff, = struct.unpack_from("<I", data, 0x1C)
+        phentsize, phnum = struct.unpack_from("<HH", data, 0x2A)
+        self.segments = []
+        for i in range(phnum):
+            (p_type, p_offset, p_vaddr, p_paddr,
+             p_filesz, _, _, _) = struct.unpack_from("<8I", data, phoff + i * phentsize)
+            if p_type == PT_LOAD and p_filesz:
+                # read-only data executes in place, so the load address is the one the target logs
+                self.segments.append((p_paddr, data[p_offset:p_offset + p_filesz]))
+
+    def string(self, address):
+        for start, blob in self.segments:
+            if start <= address < start + len(blob):
+                end = blob.find(b"\0", address - start)
+                end = len(blob) if end < 0 else end
+                return blob[address - start:end].decode("latin-1")
+        return None
+
+
+def signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def render(image, fmt, args):
+    args = list(args)
+
+    def convert(match):
+        flags, width, precision, _, kind = match.groups()
+        if kind == "%":
+            return "%"
+        if width == "*":
+            width = str(signed(args.pop(0))) if args else ""
+        if not args:
+            return match.group(0)
+        value = args.pop(0)
+        spec = "%" + flags + width + ("." + precision if precision else "")
+        if kind in "di":
+            return (spec + "d") % signed(value)
+        if kind == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if kind == "s":
+            text = image.string(value)
+            return (spec + "s") % (text if text is not None else "<0x%08X>" % value)
+        if kind == "p":
+            return "0x%08X" % value
+        return (spec + kind) % value
+
+    return SPEC.sub(convert, fmt)
+
+
+def records(stream):
+    """Yield (count, offset, cycles, args), resynchronising on the header byte after garbage."""
+    buffer = bytearray()
+    for chunk in stream:
+        buffer += chunk
+        while len(buffer) >= 8:
+            header, = struct.unpack_from("<I", buffer, 0)
+            count = (header >> 20) & 0xF
+            if (header >> 24) != SYNC or count > MAX_ARGS:
+                del buffer[0]
+                continue
+            size = 8 + 4 * count
+            if len(buffer) < size:
+                break
+            words = struct.unpack_from("<%dI" % (2 + count), buffer, 0)
+            del buffer[:size]
+            yield count, header & FORMAT_MASK, words[1], words[2:]
+
+
+def file_chunks(path):
+    with open(path, "rb") as f:
+        while True:
+            chunk = f.read(4096)
+            if not chunk:
+                return
+            yield chunk
+
+
+def serial_chunks(port, baud):
+    import serial  # pyserial, only needed for live capture
+    with serial.Serial(port, baud, timeout=0.1) as link:
+        while True:
+            yield link.read(4096)
+
+
+def main(argv):
+    clock = 168000000
+    baud = 115200
+    args = argv[1:]
+    while len(args) > 2 and args[0] in ("--clock", "--baud"):
+        value = int(args[1], 0)
+        if args[0] == "--clock":
+            clock = value
+        else:
+            baud = value
+        args = args[2:]
+    if len(args) != 2:
+        sys.stderr.write(__doc__)
+        return 1
+
+    image = Image(args[0])
+    source = args[1]
+    if source.startswith("/dev/") or source.upper().startswith("COM"):
+        stream = serial_chunks(source, baud)
+    else:
+        stream = file_chunks(source)
+
+    # DWT->CYCCNT wraps every 25 s at 168 MHz, time is accumulated from the deltas
+    elapsed = 0
+    last = None
+    for count, offset, cycles, values in records(stream):
+        if last is not None:
+            elapsed += (cycles - last) & 0xFFFFFFFF
+        last = cycles
+        if offset == 0:
+            text = "<%u log records dropped>" % (values[0] if values else 0)
+        else:
+            fmt = image.string(FORMAT_BASE + offset)
+            if fmt is None:
+                text = "<unknown format 0x%08X> %s" % (
+                    FORMAT_BASE + offset, " ".join("0x%X" % v for v in values))
+            else:
+                text = render(image, fmt, values)
+        for line in text.strip("\r\n").splitlines() or [""]:
+            sys.stdout.write("[%12.6f ms] %s\n" % (elapsed * 1000.0 / clock, line.rstrip("\r")))
+        sys.stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
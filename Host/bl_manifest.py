@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""Sign an application image for BL_SECURE_BOOT.
+
+Bootloader/bootloader_manifest.c expects a 128-byte manifest in the last
+128 bytes of the slot the image is installed in:
+
+    magic(4) | version(4) | length(4) | load address(4) | SHA-256(32)
+    reserved(16, 0xFF) | Ed25519 signature(64) over the first 64 bytes
+
+The image itself must end before the manifest.  Write the manifest with
+CBL_MEM_WRITE_CMD (or append it to a slot-sized binary) after the image.
+
+usage: bl_manifest.py genkey key.hex
+       bl_manifest.py pubkey key.hex            public key as a C initialiser
+       bl_manifest.py keyheader key.hex bootloader_manifest_key.h
+       bl_manifest.py sign [--slot a|b] [--version N] key.hex image.bin out.bin
+       bl_manifest.py verify [--slot a|b] key.hex image.bin manifest.bin
+
+key.hex holds the 32-byte Ed25519 seed as hex.  The bootloader trusts the
+public key in Bootloader/bootloader_manifest_key.h, which keyheader writes
+from the product key before the build; the build fails without it and the
+file is not part of the sources.  Host/bl_dev_ed25519.key is a development
+key published with the sources : only host test builds trust it, with
+-DBL_SECURE_BOOT_DEV_KEY (Host/sim/bootloader_manifest_dev_key.h).
+"""
+
+import hashlib
+import os
+import struct
+import sys
+
+MANIFEST_MAGIC = 0x54464E4D      # "MNFT"
+MANIFEST_LEN = 128
+SIGNED_LEN = 64
+SLOTS = {"a": (0x08008000, 0x58000), "b": (0x08060000, 0x60000)}
+
+# Ed25519, RFC 8032 section 5.1
+P = 2 ** 255 - 19
+L = 2 ** 252 + 27742317777372353535851937790883648493
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+G_Y = 4 * pow(5, P - 2, P) % P
+
+
+def recover_x(y, sign):
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P) % P
+    if x2 == 0:
+        return None if sign else 0
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P:
+        x = x * SQRT_M1 % P
+    if (x * x - x2) % P:
+        return None
+    if x & 1 != sign:
+        x = P - x
+    return x
+
+
+G = (recover_x(G_Y, 0), G_Y, 1, recover_x(G_Y, 0) * G_Y % P)
+
+
+def point_add(p, q):
+    a = (p[1] - p[0]) * (q[1] - q[0]) % P
+    b = (p[1] + p[0]) * (q[1] + q[0]) % P
+    c = 2 * p[3] * q[3] * D % P
+    d = 2 * p[2] * q[2] % P
+    e, f, g, h = b - a, d - c, d + c, b + a
+    return (e * f % P, g * h % P, f * g % P, e * h % P)
+
+
+def point_mul(s, p):
+    q = (0, 1, 1, 0)
+    while s:
+        if s & 1:
+            q = point_add(q, p)
+        p = point_add(p, p)
+        s >>= 1
+    return q
+
+
+def point_compress(p):
+    zinv = pow(p[2], P - 2, P)
+    x, y = p[0] * zinv % P, p[1] * zinv % P
+    return int.to_bytes(y | ((x & 1) << 255), 32, "little")
+
+
+def point_decompress(s):
+    y = int.from_bytes(s, "little")
+    sign = y >> 255
+    y &= (1 << 255) - 1
+    x = None if y >= P else recover_x(y, sign)
+    if x is None:
+        return None
+    return (x, y, 1, x * y % P)
+
+
+def sha512_int(data):
+    return int.from_bytes(hashlib.sha512(data).digest(), "little")
+
+
+def expand(seed):
+    h = hashlib.sha512(seed).digest()
+    a = int.from_bytes(h[:32], "little")
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, h[32:]
+
+
+def public_key(seed):
+    a, _ = expand(seed)
+    return point_compress(point_mul(a, G))
+
+
+def sign(seed, message):
+    a, prefix = expand(seed)
+    pub = point_compress(point_mul(a, G))
+    r = sha512_int(prefix + message) % L
+    big_r = point_compress(point_mul(r, G))
+    s = (r + sha512_int(big_r + pub + message) * a) % L
+    return big_r + int.to_bytes(s, 32, "little")
+
+
+def verify(pub, message, signature):
+    a = point_decompress(pub)
+    r = point_decompress(signature[:32])
+    s = int.from_bytes(signature[32:], "little")
+    if a is None or r is None or s >= L:
+        return False
+    h = sha512_int(signature[:32] + pub + message) % L
+    lhs = point_mul(s, G)
+    rhs = point_add(r, point_mul(h, a))
+    return point_compress(lhs) == point_compress(rhs)
+
+
+def read_key(path):
+    with open(path) as f:
+        seed = bytes.fromhex("".join(line for line in f if not line.startswith("#")).strip())
+    if len(seed) != 32:
+        raise ValueError("%s must hold a 32-byte seed" % path)
+    return seed
+
+
+def build(seed, image, slot, version):
+    base, length = SLOTS[slot]
+    if len(image) > length - MANIFEST_LEN:
+        raise ValueError("image is %d bytes, slot %s holds %d plus the manifest"
+                         % (len(image), slot.upper(), length - MANIFEST_LEN))
+    body = struct.pack("<IIII", MANIFEST_MAGIC, version, len(image), base)
+    body += hashlib.sha256(image).digest() + b"\xff" * 16
+    return body + sign(seed, body)
+
+
+def check(pub, image, manifest, slot):
+    base, _ = SLOTS[slot]
+    if len(manifest) != MANIFEST_LEN:
+        return "manifest is not %d bytes" % MANIFEST_LEN
+    magic, version, length, load = struct.unpack_from("<IIII", manifest)
+    if magic != MANIFEST_MAGIC or load != base or length != len(image):
+        return "header does not match the image"
+    if manifest[16:48] != hashlib.sha256(image).digest():
+        return "digest mismatch"
+    if not verify(pub, manifest[:SIGNED_LEN], manifest[SIGNED_LEN:]):
+        return "bad signature"
+    return None
+
+
+def key_initialiser(pub, separator):
+    rows = [", ".join("0x%02X" % b for b in pub[i:i + 8]) for i in range(0, 32, 8)]
+    return "{\t" + ("," + separator).join(rows) + "\t}"
+
+
+def key_header(pub):
+    """bootloader_manifest_key.h : the key the bootloader trusts, generated, never committed"""
+    return ("/* generated by Host/bl_manifest.py keyheader, do not commit */\n\n"
+            "#ifndef BOOTLOADER_MANIFEST_KEY_H__\n"
+            "#define BOOTLOADER_MANIFEST_KEY_H__\n\n"
+            "#define BL_MANIFEST_PUBLIC_KEY\t" + key_initialiser(pub, "\t\\\n" + "\t" * 17) + "\n\n"
+            "#endif /*BOOTLOADER_MANIFEST_KEY_H__*/\n")
+
+
+def main(argv):
+    args = argv[1:]
+    slot = "a"
+    version = 1
+    command = args.pop(0) if args else ""
+    while len(args) > 1 and args[0] in ("--slot", "--version"):
+        if args[0] == "--slot":
+            slot = args[1].lower()
+        else:
+            version = int(args[1], 0)
+        args = args[2:]
+
+    if command == "genkey" and len(args) == 1:
+        with open(args[0], "w") as f:
+            f.write(os.urandom(32).hex() + "\n")
+        return 0
+    if command == "pubkey" and len(args) == 1:
+        print(key_initialiser(public_key(read_key(args[0])), "\n\t"))
+        return 0
+    if command == "keyheader" and len(args) == 2:
+        with open(args[1], "w") as f:
+            f.write(key_header(public_key(read_key(args[0]))))
+        return 0
+    if command in ("sign", "verify") and len(args) == 3 and slot in SLOTS:
+        seed = read_key(args[0])
+        with open(args[1], "rb") as f:
+            image = f.read()
+        if command == "sign":
+            manifest = build(seed, image, slot, version)
+            with open(args[2], "wb") as f:
+                f.write(manifest)
+            print("image %d bytes, SHA-256 %s" % (len(image), manifest[16:48].hex()))
+            print("manifest for slot %s at 0x%08X"
+                  % (slot.upper(), SLOTS[slot][0] + SLOTS[slot][1] - MANIFEST_LEN))
+            return 0
+        with open(args[2], "rb") as f:
+            manifest = f.read()
+        error = check(public_key(seed), image, manifest, slot)
+        print(error or "manifest OK")
+        return 1 if error else 0
+
+    sys.stderr.write(__doc__)
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,464 @@
+#!/usr/bin/env python3
+"""Simulated bootloaders on pseudo-terminals, for testing host tools without boards.
+
+Each simulated device owns one pty and a model of the F407 flash.  It
+answers the CBL_* protocol the way Bootloader/bootloader.c does:
+
+    frames           v1 and v2 lengths, CRC-32/MPEG-2, 100 ms interframe
+                     timeout, and a fall back to v1 when v2 frames stall
+                     three times in a row
+    replies          ACK | len | data, or NACK
+    stream sessions  cumulative window replies, go back N, erase ahead
+    link rate        the SET_BAUD rate table, test pattern and confirm
+                     (the pty ignores the rate itself)
+
+Supported commands : version, help, chip id, RDP, go, erase, memory
+write, memory read, sector status, stream write, image hash, slot info,
+memory hash, set baud and set protocol.
+
+The slave device names are printed one per line once the devices are
+ready, then the simulator runs until interrupted.
+
+    --count N       number of devices (default 1)
+    --drop P        corrupt each incoming frame with probability P
+    --baud RATE     pace reception as if the bytes came over a UART at RATE
+    --flash FILE    initial flash content for every device (1 MB, at 0x08000000)
+    --seed S        random seed for --drop
+
+usage: bl_pty_sim.py [--count 4] [--drop 0.01] [--baud 115200] [--flash f.bin]
+"""
+
+import os
+import random
+import select
+import struct
+import sys
+import threading
+import time
+import tty
+
+BL_ACK = 0xCD
+BL_NACK = 0xAB
+
+FLASH_BASE = 0x08000000
+FLASH_LEN = 0x100000
+APP_BASE = 0x08008000
+SRAM_BASE, SRAM_END = 0x20000000, 0x20020000
+SECTORS = [(FLASH_BASE + i * 0x4000, 0x4000) for i in range(4)] + \
+          [(FLASH_BASE + 0x10000, 0x10000)] + \
+          [(FLASH_BASE + 0x20000 + i * 0x20000, 0x20000) for i in range(7)]
+SLOTS = [(0x08008000, 0x58000), (0x08060000, 0x60000)]
+SCRATCH_SECTOR = 10
+
+RATES = [115200, 230400, 460800, 921600, 1000000, 2000000]
+PATTERN = bytes([0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+                 0x01, 0x80, 0x7E, 0x81, 0x5A, 0xA5, 0x96, 0x69])
+
+V2_MAX_LEN_FIELD = 2 + 4096 + 4
+INTERFRAME_S = 0.1
+MAX_STALLS = 3
+STREAM_TIMEOUT_S = 2.0
+STREAM_MAX_WINDOW = 32
+STREAM_MAX_RETRIES = 5
+
+
+CRC_TABLE = []
+for _i in range(256):
+    _c = _i << 24
+    for _ in range(8):
+        _c = ((_c << 1) ^ 0x04C11DB7) if _c & 0x80000000 else _c << 1
+        _c &= 0xFFFFFFFF
+    CRC_TABLE.append(_c)
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[(crc >> 24) ^ byte]
+    return crc
+
+
+def sector_of(address):
+    for index, (start, size) in enumerate(SECTORS):
+        if start <= address < start + size:
+            return index
+    return None
+
+
+class Device:
+    def __init__(self, flash, drop, baud, rng):
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        self.name = os.ttyname(self.slave)
+        self.flash = bytearray(flash)
+        self.drop = drop
+        self.baud = baud
+        self.rng = rng
+        self.format = 1
+        self.stalls = 0
+        self.pending = bytearray()
+        self.last_byte = time.monotonic()
+
+    # ------------------------------------------------------------ link
+
+    def send(self, data):
+        view = memoryview(bytes(data))
+        while view:
+            try:
+                written = os.write(self.master, view)
+                view = view[written:]
+            except BlockingIOError:
+                select.select([], [self.master], [], 0.1)
+
+    def ack(self, data):
+        self.send(bytes([BL_ACK, len(data) & 0xFF]) + bytes(data))
+
+    def nack(self):
+        self.send(bytes([BL_NACK]))
+
+    def fill(self, timeout):
+        ready, _, _ = select.select([self.master], [], [], timeout)
+        if not ready:
+            return False
+        try:
+            chunk = os.read(self.master, 65536)
+        except OSError:
+            raise SystemExit
+        if self.baud:
+            time.sleep(len(chunk) * 10.0 / self.baud)
+        self.pending += chunk
+        self.last_byte = time.monotonic()
+        return True
+
+    def header_len(self):
+        return 2 if self.format == 2 else 1
+
+    def frame_length(self, frame):
+        if self.format == 2:
+            return 2 + (frame[0] | (frame[1] << 8))
+        return 1 + frame[0]
+
+    def get_frame(self, timeout=None):
+        """Next frame as bytes, None on timeout, same resync rules as bootloader_rx.c."""
+        start = time.monotonic()
+        while True:
+            header = self.header_len()
+            while len(self.pending) >= header:
+                field = self.pending[0] if header == 1 else self.pending[0] | (self.pending[1] << 8)
+                if field == 0 or field > V2_MAX_LEN_FIELD:
+                    del self.pending[0]
+                    continue
+                total = header + field
+                if len(self.pending) < total:
+                    break
+                frame = bytes(self.pending[:total])
+                del self.pending[:total]
+                if self.drop and self.rng.random() < self.drop:
+                    index = self.rng.randrange(len(frame))
+                    frame = frame[:index] + bytes([frame[index] ^ 0x10]) + frame[index + 1:]
+                self.stalls = 0
+                return frame
+            if self.pending and time.monotonic() - self.last_byte > INTERFRAME_S:
+                # a stalled partial frame is dropped and the format kept, only repeated stalls mean
+                # the host went back to v1
+                self.pending.clear()
+                self.stalls += 1
+                if self.stalls >= MAX_STALLS:
+                    self.stalls = 0
+                    self.format = 1
+                continue
+            wait = INTERFRAME_S if self.pending else 0.5
+            if timeout is not None:
+                left = timeout - (time.monotonic() - start)
+                if left <= 0:
+                    return None
+                wait = min(wait, left)
+            self.fill(wait)
+
+    def decode(self, frame):
+        header = self.header_len()
+        length = self.frame_length(frame)
+        if length - header < 5 or length != len(frame):
+            return None
+        if struct.unpack_from("<I", frame, length - 4)[0] != crc32_mpeg2(frame[:length - 4]):
+            return None
+        return frame[header], frame[header + 1:length - 4]
+
+    # ------------------------------------------------------------ flash
+
+    def readable(self, address, length):
+        if FLASH_BASE <= address and address + length <= FLASH_BASE + FLASH_LEN:
+            return True
+        return SRAM_BASE <= address and address + length <= SRAM_END
+
+    def writable(self, address, length):
+        # inside one slot, as verify_Slot_Destination : the model commits no headers, so no slot boots
+        return any(base <= address < base + size and length <= base + size - address for base, size in SLOTS)
+
+    def read(self, address, length):
+        if FLASH_BASE <= address < FLASH_BASE + FLASH_LEN:
+            return bytes(self.flash[address - FLASH_BASE:address - FLASH_BASE + length])
+        return bytes(length)
+
+    def program(self, address, data):
+        offset = address - FLASH_BASE
+        for i, byte in enumerate(data):
+            # flash only clears bits, programming over non-erased data is an error
+            if self.flash[offset + i] & byte != byte:
+                return False
+            self.flash[offset + i] = byte
+        return True
+
+    def erase(self, sector):
+        start, size = SECTORS[sector]
+        self.flash[start - FLASH_BASE:start - FLASH_BASE + size] = b"\xff" * size
+
+    def sector_blank(self, sector):
+        start, size = SECTORS[sector]
+        return self.flash[start - FLASH_BASE:start - FLASH_BASE + size].count(0xFF) == size
+
+    # ------------------------------------------------------------ commands
+
+    def run(self):
+        handlers = {
+            0x10: self.cmd_version, 0x11: self.cmd_help, 0x12: self.cmd_cid,
+            0x13: self.cmd_rdp, 0x14: self.cmd_go, 0x15: self.cmd_erase,
+            0x16: self.cmd_mem_write, 0x18: self.cmd_mem_read,
+            0x19: self.cmd_sector_status, 0x22: self.cmd_stream,
+            0x24: self.cmd_image_hash, 0x26: self.cmd_slot_info,
+            0x28: self.cmd_mem_hash, 0x29: self.cmd_set_baud,
+            0x2A: self.cmd_set_protocol,
+        }
+        while True:
+            frame = self.get_frame()
+            decoded = self.decode(frame)
+            if decoded is None or decoded[0] not in handlers:
+                self.nack()
+                continue
+            sid, payload = decoded
+            handlers[sid](payload)
+
+    def cmd_version(self, payload):
+        self.ack([0x15, 0x07, 0x06, 0x02])
+
+    def cmd_help(self, payload):
+        self.ack([0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x20,
+                  0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A])
+
+    def cmd_cid(self, payload):
+        self.ack(struct.pack("<H", 0x413))
+
+    def cmd_rdp(self, payload):
+        self.ack([0xAA])
+
+    def cmd_go(self, payload):
+        if len(payload) != 4:
+            return self.nack()
+        address, = struct.unpack("<I", payload)
+        self.ack([1 if self.readable(address, 4) else 0])
+
+    def cmd_erase(self, payload):
+        if len(payload) != 2:
+            return self.nack()
+        first, count = payload
+        # same reply length quirk as the firmware : ACK announces 12 bytes, one status byte follows
+        self.send(bytes([BL_ACK, 12]))
+        if first >= len(SECTORS) or count == 0:
+            return self.send(bytes([0x02]))
+        # sectors 2..9 only : bootloader, scratch, slot table and mass erase are refused as a whole
+        # (the firmware refuses the boot slot too, the model commits no headers so no slot boots)
+        count = min(count, len(SECTORS) - first)
+        if SECTORS[first][0] < APP_BASE or first + count > SCRATCH_SECTOR:
+            return self.send(bytes([0x02]))
+        for sector in range(first, first + count):
+            self.erase(sector)
+        self.send(bytes([0x03]))
+
+    def cmd_mem_write(self, payload):
+        if len(payload) < 5:
+            return self.nack()
+        address, count = struct.unpack_from("<IB", payload)
+        data = payload[5:]
+        length = len(data) if self.format == 2 else count
+        self.send(bytes([BL_ACK, 1]))
+        if length > len(data) or (length & 0xFF) != count or not self.writable(address, length):
+            return self.send(bytes([0]))
+        self.send(bytes([1]))
+        self.program(address, data[:length])
+
+    def cmd_mem_read(self, payload):
+        if len(payload) != 8:
+            return self.nack()
+        address, length = struct.unpack("<II", payload)
+        ok = self.readable(address, length) and length > 0
+        self.ack([1 if ok else 0])
+        if not ok:
+            return
+        data = self.read(address, length)
+        for offset in range(0, length, 1024):
+            chunk = data[offset:offset + 1024]
+            self.send(chunk + struct.pack("<I", crc32_mpeg2(data[:offset + len(chunk)])))
+
+    def cmd_sector_status(self, payload):
+        if len(payload) != 2:
+            return self.nack()
+        first, count = payload
+        if first >= len(SECTORS) or count == 0:
+            return self.nack()
+        count = min(count, len(SECTORS) - first)
+        out = bytearray([count])
+        for sector in range(first, first + count):
+            start, size = SECTORS[sector]
+            flags = (0x01 if self.sector_blank(sector) else 0) | (0x04 if start < APP_BASE else 0)
+            out += bytes([flags]) + struct.pack("<I", crc32_mpeg2(self.flash[start - FLASH_BASE:start - FLASH_BASE + size]))
+        self.ack(out)
+
+    def cmd_image_hash(self, payload):
+        if len(payload) != 8:
+            return self.nack()
+        address, length = struct.unpack("<II", payload)
+        if not (FLASH_BASE <= address and address + length <= FLASH_BASE + FLASH_LEN):
+            return self.nack()
+        self.cmd_mem_hash(payload)
+
+    def cmd_mem_hash(self, payload):
+        if len(payload) != 8:
+            return self.nack()
+        address, length = struct.unpack("<II", payload)
+        if not length or not self.readable(address, length):
+            return self.nack()
+        self.ack(struct.pack("<I", crc32_mpeg2(self.read(address, length))))
+
+    def cmd_slot_info(self, payload):
+        # no boot slot (BL_SLOT_NONE), both slots empty and unverified
+        out = bytearray([0xFF])
+        for _ in range(2):
+            out += bytes([0, 0]) + struct.pack("<III", 0, 0, 0)
+        self.ack(out)
+
+    def cmd_set_baud(self, payload):
+        if len(payload) != 4:
+            return self.nack()
+        rate, = struct.unpack("<I", payload)
+        status = 1 if rate in RATES else 0
+        self.ack(bytes([status, len(RATES)]) + b"".join(struct.pack("<I", r) for r in RATES))
+        if not status:
+            return
+        frame = self.get_frame(1.0)
+        decoded = self.decode(frame) if frame else None
+        if decoded != (0x29, PATTERN):
+            return
+        self.ack(PATTERN)
+        frame = self.get_frame(1.0)
+        decoded = self.decode(frame) if frame else None
+        if decoded == (0x29, b""):
+            self.ack([2])
+
+    def cmd_set_protocol(self, payload):
+        if len(payload) != 1:
+            return self.nack()
+        version = payload[0]
+        if version:
+            self.format = 2 if version >= 2 else 1
+            self.stalls = 0
+        limit = (2 + V2_MAX_LEN_FIELD if self.format == 2 else 256) - self.header_len()
+        self.ack(bytes([self.format]) + struct.pack("<H", limit))
+
+    def cmd_stream(self, payload):
+        if len(payload) not in (9, 10):
+            return self.nack()
+        base, total, window = struct.unpack_from("<IIB", payload)
+        flags = payload[9] if len(payload) > 9 else 0
+        opened = (self.writable(base, total) and total and total % 4 == 0
+                  and 0 < window <= STREAM_MAX_WINDOW)
+        self.ack([1 if opened else 0])
+        if not opened:
+            return
+        if flags & 0x01:
+            for sector in range(sector_of(base), sector_of(base + total - 1) + 1):
+                if not self.sector_blank(sector):
+                    self.erase(sector)
+
+        written = 0
+        expected = 0
+        failed_windows = 0
+        state = 1
+        header = self.header_len()
+        while state == 1:
+            received = 0
+            window_failed = False
+            announced = written
+            while received < window and announced < total:
+                block = self.get_frame(STREAM_TIMEOUT_S)
+                if block is None:
+                    window_failed = True
+                    break
+                received += 1
+                length = self.frame_length(block)
+                sequence = block[header] | (block[header + 1] << 8)
+                data = block[header + 2:length - 4]
+                announced += len(data)
+                if window_failed or state != 1:
+                    continue
+                if (not data or len(block) != length
+                        or struct.unpack_from("<I", block, length - 4)[0] != crc32_mpeg2(block[:length - 4])
+                        or sequence != expected or len(data) % 4 or written + len(data) > total):
+                    window_failed = True
+                elif not self.program(base + written, data):
+                    state = 2
+                else:
+                    written += len(data)
+                    expected += 1
+                    failed_windows = 0
+                    if written == total:
+                        state = 3
+            if window_failed:
+                failed_windows += 1
+                if failed_windows >= STREAM_MAX_RETRIES:
+                    state = 2
+            reply = BL_NACK if window_failed or state == 2 else BL_ACK
+            self.send(struct.pack("<BHB", reply, expected, state))
+
+
+def main(argv):
+    count = 1
+    drop = 0.0
+    baud = 0
+    flash = b"\xff" * FLASH_LEN
+    seed = 1
+    args = argv[1:]
+    while len(args) >= 2 and args[0].startswith("--"):
+        option, value = args[0], args[1]
+        if option == "--count":
+            count = int(value)
+        elif option == "--drop":
+            drop = float(value)
+        elif option == "--baud":
+            baud = int(value)
+        elif option == "--seed":
+            seed = int(value)
+        elif option == "--flash":
+            with open(value, "rb") as f:
+                content = f.read()
+            flash = (content + b"\xff" * FLASH_LEN)[:FLASH_LEN]
+        else:
+            break
+        args = args[2:]
+    if args:
+        sys.stderr.write(__doc__)
+        return 1
+
+    devices = [Device(flash, drop, baud, random.Random(seed + i)) for i in range(count)]
+    for device in devices:
+        threading.Thread(target=device.run, daemon=True).start()
+        print(device.name)
+    sys.stdout.flush()
+    try:
+        while True:
+            time.sleep(3600)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
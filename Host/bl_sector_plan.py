@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Work out which sectors an update really has to erase and write.
+
+Asks the bootloader for CBL_READ_SECTOR_STATUS_CMD over the sectors the
+image covers.  The reply holds per sector a flag byte and the CRC of the
+whole sector.  Each sector is then one of:
+
+    same   the device already holds the image there (image bytes, 0xFF after)
+    write  the sector is blank, program it without erasing
+    erase  the content differs, erase then program
+
+With --erase the erase-class sectors are erased with CBL_FLASH_ERASE_CMD,
+one command per run of adjacent sectors, so a following CBL_MEM_WRITE_CMD
+or stream write only programs.  Writing a sector marked "same" can be
+skipped altogether.
+
+usage: bl_sector_plan.py [--base 0x08008000] [--baud 115200] [--erase] image.bin port
+"""
+
+import struct
+import sys
+
+CBL_FLASH_ERASE_CMD = 0x15
+CBL_READ_SECTOR_STATUS_CMD = 0x19
+BL_ACK = 0xCD
+
+SECTOR_STATUS_BLANK = 0x01
+SECTOR_STATUS_PROTECTED = 0x02
+SECTOR_STATUS_BOOTLOADER = 0x04
+ERASE_DONE = 0x03
+
+FLASH_BASE = 0x08000000
+SECTORS = [(FLASH_BASE + i * 0x4000, 0x4000) for i in range(4)] + \
+          [(FLASH_BASE + 0x10000, 0x10000)] + \
+          [(FLASH_BASE + 0x20000 + i * 0x20000, 0x20000) for i in range(7)]
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def frame(sid, payload):
+    body = bytes([1 + len(payload) + 4, sid]) + payload
+    return body + struct.pack("<I", crc32_mpeg2(body))
+
+
+def sector_range(base, length):
+    covered = [i for i, (start, size) in enumerate(SECTORS)
+               if start < base + length and start + size > base]
+    if not covered or SECTORS[covered[0]][0] != base:
+        raise ValueError("image must start on a sector boundary inside flash")
+    return covered
+
+
+def expected_content(image, base, sector):
+    start, size = SECTORS[sector]
+    chunk = image[start - base:start - base + size]
+    return chunk + b"\xff" * (size - len(chunk))
+
+
+def plan(image, base, status):
+    """status : {sector: (flags, crc)} -> [(sector, action)]"""
+    actions = []
+    for sector in sector_range(base, len(image)):
+        flags, crc = status[sector]
+        if flags & (SECTOR_STATUS_PROTECTED | SECTOR_STATUS_BOOTLOADER):
+            actions.append((sector, "locked"))
+        elif crc == crc32_mpeg2(expected_content(image, base, sector)):
+            actions.append((sector, "same"))
+        elif flags & SECTOR_STATUS_BLANK:
+            actions.append((sector, "write"))
+        else:
+            actions.append((sector, "erase"))
+    return actions
+
+
+def erase_runs(actions):
+    runs = []
+    for sector, action in actions:
+        if action != "erase":
+            continue
+        if runs and runs[-1][0] + runs[-1][1] == sector:
+            runs[-1][1] += 1
+        else:
+            runs.append([sector, 1])
+    return runs
+
+
+class Target:
+    def __init__(self, port, baud):
+        import serial  # pyserial
+        self.link = serial.Serial(port, baud, timeout=5)
+
+    def command(self, sid, payload, erase=False):
+        self.link.write(frame(sid, payload))
+        head = self.link.read(2)
+        if len(head) != 2 or head[0] != BL_ACK:
+            raise IOError("command 0x%02X not acknowledged" % sid)
+        if erase:
+            # a 128K sector takes up to 2 s, wait for the reply as long as needed
+            self.link.timeout = 5 + 2 * payload[1]
+        # the erase reply is one result byte whatever length its ACK announces
+        expected = 1 if erase else head[1]
+        reply = self.link.read(expected)
+        self.link.timeout = 5
+        if len(reply) != expected:
+            raise IOError("short reply to command 0x%02X" % sid)
+        return reply
+
+    def sector_status(self, first, count):
+        reply = self.command(CBL_READ_SECTOR_STATUS_CMD, bytes([first, count]))
+        status = {}
+        for i in range(reply[0]):
+            flags, crc = struct.unpack_from("<BI", reply, 1 + 5 * i)
+            status[first + i] = (flags, crc)
+        return status
+
+
+def main(argv):
+    base = 0x08008000
+    baud = 115200
+    erase = False
+    args = argv[1:]
+    while args and args[0].startswith("--"):
+        if args[0] == "--erase":
+            erase = True
+            args = args[1:]
+        elif args[0] in ("--base", "--baud") and len(args) > 1:
+            if args[0] == "--base":
+                base = int(args[1], 0)
+            else:
+                baud = int(args[1], 0)
+            args = args[2:]
+        else:
+            break
+    if len(args) != 2:
+        sys.stderr.write(__doc__)
+        return 1
+
+    with open(args[0], "rb") as f:
+        image = f.read()
+    sectors = sector_range(base, len(image))
+    target = Target(args[1], baud)
+    actions = plan(image, base, target.sector_status(sectors[0], len(sectors)))
+
+    for sector, action in actions:
+        print("sector %2d  0x%08X  %s" % (sector, SECTORS[sector][0], action))
+    if any(action == "locked" for _, action in actions):
+        sys.stderr.write("image overlaps protected or bootloader sectors\n")
+        return 1
+
+    runs = erase_runs(actions)
+    print("%d of %d sectors need an erase, %d can be skipped entirely"
+          % (sum(n for _, n in runs), len(actions), sum(a == "same" for _, a in actions)))
+    if erase:
+        for first, count in runs:
+            result = target.command(CBL_FLASH_ERASE_CMD, bytes([first, count]), erase=True)
+            print("erase sectors %d-%d : %s" % (first, first + count - 1,
+                                                "done" if result[0] == ERASE_DONE else "FAILED"))
+            if result[0] != ERASE_DONE:
+                return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,1342 @@
+/*
+ * Host build of the bootloader : the unmodified firmware sources run on
+ * x86-64 Linux against a simulated STM32F407, for deterministic
+ * benchmarks, fuzzing and CI without a board.
+ *
+ * Bootloader/bootloader*.c, Led/led.c and the CubeMX init code in Src/ are compiled
+ * as they are.  Src/main.c keeps its main(), renamed on the command line,
+ * and Host/sim/bl_sim_hal.c stands in for the HAL.  The real CMSIS device
+ * headers are used ; Host/sim/cmsis_compiler.h only replaces the ARM
+ * intrinsics.  The machine here provides :
+ *
+ *   memory map    flash, CCM, SRAM, peripherals and the core registers at
+ *                 their F407 addresses (build with -no-pie : the firmware
+ *                 casts pointers to 32 bits, so the program, its data and
+ *                 the firmware stack all live below 4 GB)
+ *   flash         a 1 MB image file mapped read only.  The firmware's own
+ *                 stores into it fault, are single-stepped and then
+ *                 checked against FLASH->CR the way the controller would :
+ *                 PG and unlock required, bits only cleared, 16 us each.
+ *                 Program and erase time is a CPU stall when issued from
+ *                 flash ; from a BL_RAM_FUNC the clock runs on and the
+ *                 interrupts are taken while the flash is busy
+ *   CRC unit      CRC, RCC and FLASH registers share a trapped page, so a
+ *                 word written to CRC->DR is folded into the CRC-32/MPEG-2
+ *                 state, CR.RESET reloads it and SR flags clear on write 1
+ *   clock         virtual : flash program and erase times, UART bytes at
+ *                 the configured baud rate and DMA beats advance it, and
+ *                 WFI waits for the next event (or for real time when the
+ *                 host is quiet).  HAL_GetTick and DWT->CYCCNT follow it.
+ *                 --cpu-scale adds the host CPU time the firmware spends
+ *   host link     a pseudo-terminal.  Bytes from the host are paced at the
+ *                 link rate into the firmware's DMA ring, with half, full
+ *                 and idle events, and keep arriving while an erase stalls
+ *                 the CPU.  With --input the bytes come from a file and
+ *                 the run ends once the firmware is idle (fuzzing, CI).
+ *                 With --transport usb the same bytes are 64 byte bulk
+ *                 OUT packets instead, NAKed until the firmware arms the
+ *                 endpoint, after a scripted host has enumerated the CDC
+ *                 device and opened the port.  --dfu runs a scripted
+ *                 DfuSe download over the same core instead (dfu-util
+ *                 -s ADDRESS:leave -D FILE), verified by upload
+ *   debug log     USART3 records are decoded here, the format strings are
+ *                 in this binary rather than in an .axf
+ *
+ * A jump into flash (CBL_GO_TO_ADDR_CMD, a started slot) ends the run with
+ * the entry point, stack pointer and VTOR on stderr.  Any other fault ends it
+ * with exit status 2, so a fuzzer sees it as a crash.
+ *
+ *   cc -O1 -g -no-pie -std=gnu99 -DUSE_HAL_DRIVER -DSTM32F407xx -Dmain=firmware_main -Dfputc=firmware_fputc \
+ *      -DBL_SECURE_BOOT_DEV_KEY \
+ *      -IHost/sim -IInc -IBootloader -ILed -IDrivers/STM32F4xx_HAL_Driver/Inc \
+ *      -IDrivers/CMSIS/Device/ST/STM32F4xx/Include -IDrivers/CMSIS/Include \
+ *      -Wl,-T,Host/sim/bl_sim.ld -o bl_sim \
+ *      Host/bl_sim.c Host/sim/bl_sim_hal.c Host/sim/bl_sim_dfu.c Bootloader/bootloader*.c Led/led.c \
+ *      Src/main.c Src/usart.c Src/usb_otg.c Src/dma.c Src/crc.c Src/gpio.c Src/system_stm32f4xx.c Src/stm32f4xx_hal_msp.c
+ *   ./bl_sim [options]
+ *
+ * -DBL_SECURE_BOOT_DEV_KEY makes the firmware trust Host/bl_dev_ed25519.key,
+ * which Host/bl_sim_test.py signs with; leave it out and provide
+ * Bootloader/bootloader_manifest_key.h to run with a product key.
+ *
+ * Then point any host tool at the printed port, e.g. Host/bl_flash.
+ * Host/bl_sim_test.py starts its own runs and checks them against flash.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "bl_sim.h"
+#include "bootloader_flash.h"
+#include "bootloader_log.h"
+#include "bootloader_slot.h"
+
+/*	after the device header : termios.h defines CR1, CR2 and friends as macros	*/
+#include <termios.h>
+
+#undef main
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "bl_sim traps flash and CRC accesses with x86-64 Linux single-stepping"
+#endif
+
+#define PAGE_LEN										4096U
+#define EFLAGS_TF										0x100
+#define PF_WRITE										0x02
+#define PF_FETCH										0x10
+
+#define LINK_FIFO_LEN								65536U
+#define LOG_BUFFER_LEN							8192U
+#define FIRMWARE_STACK_LEN					(1U << 20)
+#define NO_EVENT										UINT64_MAX
+#define INPUT_IDLE_NS								1000000000ULL		/* --input : quiet this long after the last byte ends the run */
+
+#define DBGMCU_IDCODE_F407					0x10076413U
+#define FLASH_OPTCR_RESET						0x0FFFAAEDU
+
+#define EXIT_FAULT									2
+
+/*	Src/main.c, built with its main() renamed	*/
+int firmware_main(void);
+void SystemInit(void);
+
+/*	program bounds from the linker, for the log format lookup	*/
+extern char __executable_start[];
+extern char edata[];
+
+typedef enum
+{
+	TRAP_NONE,
+	TRAP_FLASH,
+	TRAP_REGISTER
+} TrapKind;
+
+static const char usage[] =
+	"usage: bl_sim [options]\n"
+	"  --flash FILE        1 MB flash image, created erased if missing (bl_sim_flash.bin)\n"
+	"  --link PATH         also make PATH a symlink to the host link pseudo-terminal\n"
+	"  --input FILE        read the host link from FILE instead, stop once the firmware is idle\n"
+	"  --output FILE       with --input, write what the firmware sends to FILE\n"
+	"  --log FILE          decoded debug log, - for stderr\n"
+	"  --transport T       host link on the pty : uart (USART2, the default) or usb (OTG FS CDC)\n"
+	"  --dfu FILE[@ADDR]   download FILE over USB DFU to ADDR (0x08008000), verify it and leave\n"
+	"  --button            hold the user button (PA0) so a reset stays in the bootloader\n"
+	"  --erase-scale F     multiply the datasheet erase times by F (1.0)\n"
+	"  --cpu-scale F       also charge F times the host CPU time the firmware uses (0)\n"
+	"  --realtime          sleep the modelled delays too, so the host sees them\n";
+
+static struct
+{
+	const char *flashPath;
+	const char *linkPath;
+	const char *inputPath;
+	const char *outputPath;
+	const char *logPath;
+	const char *dfuPath;
+	int usb;
+	int button;
+	int realtime;
+	double eraseScale;
+	double cpuScale;
+} options;
+
+/*	virtual clock, DWT->CYCCNT runs at SystemCoreClock from the last rebase	*/
+static uint64_t nowNs = 0;
+static uint64_t cycleBase = 0;
+static uint64_t cycleBaseNs = 0;
+static uint32_t cycleHz = 0;
+static uint32_t cyclePublished = 0;
+static uint64_t sleepDebtNs = 0;
+static uint64_t cpuLastNs = 0;
+
+/*	interrupt lines : pending mask with a due time per line	*/
+static uint32_t primask = 0;
+static uint32_t irqPending = 0;
+static uint64_t irqDue[SIM_IRQ_LINES];
+static uint64_t irqFirstDue[SIM_IRQ_LINES];
+static int inInterrupt = 0;
+
+/*	memory	*/
+static uint8_t *flashAlias = NULL;
+static uint8_t *periphAlias = NULL;
+static uint8_t firmwareStack[FIRMWARE_STACK_LEN] __attribute__((aligned(16)));
+static ucontext_t hostContext, firmwareContext;
+
+/*	access being single-stepped	*/
+static struct
+{
+	TrapKind kind;
+	uintptr_t address;
+	uintptr_t page;
+	uint32_t pages;
+	int write;
+	uint8_t before[16];
+	uint32_t crcDr;
+	uint32_t flashSr;
+} trap;
+
+/*	host link : bytes read from the pty wait here with the time their stop bit ends	*/
+static int linkFd = -1;
+static int linkSlaveFd = -1;
+static int outputFd = -1;
+static int inputDone = 0;
+static uint8_t linkFifo[LINK_FIFO_LEN];
+static uint64_t linkDue[LINK_FIFO_LEN];
+static uint32_t linkHead = 0, linkTail = 0;
+static uint64_t wireFreeNs = 0;
+static uint64_t idleDueNs = NO_EVENT;
+static UART_HandleTypeDef *linkUart = NULL;
+static uint8_t *linkRing = NULL;
+static uint16_t linkRingLen = 0;
+static int linkActive = 0;
+
+/*	debug log	*/
+static FILE *logFile = NULL;
+static uint8_t logBuffer[LOG_BUFFER_LEN];
+static size_t logFill = 0;
+static uint32_t logLastCycles = 0;
+static int logStarted = 0;
+static double logElapsedMs = 0.0;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static struct
+{
+	uint64_t linkIn;
+	uint64_t linkOut;
+	uint64_t linkLost;
+	uint64_t programs;
+	uint64_t programErrors;
+	uint64_t erasedBytes;
+	uint64_t logRecords;
+	uint64_t stallNs;
+	uint64_t ramBusyNs;
+	uint64_t irqLatencyNs;
+} stats;
+
+/*	firmware functions placed in SRAM1 (BL_RAM_FUNC), bounds from Host/sim/bl_sim.ld	*/
+extern char __ramfunc_start[], __ramfunc_end[];
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void clock_add(uint64_t ns);
+static void clock_publish(void);
+static void cpu_charge(void);
+static void link_read(void);
+static void link_deliver(uint64_t until);
+static uint64_t link_next_due(void);
+static uint64_t link_usb_packet(uint32_t *count);
+static void irq_service(void);
+static uint64_t irq_next_due(void);
+static void report(const char *reason);
+static void finish(const char *reason, int status) __attribute__((noreturn));
+
+/* Clock ---------------------------------------------------------------------*/
+
+uint64_t sim_now_ns(void)
+{
+	return nowNs;
+}
+
+void sim_advance_ns(uint64_t ns)
+{
+	clock_add(ns);
+	if(options.realtime && (sleepDebtNs >= 1000000ULL))
+	{
+		struct timespec pause = { (time_t)(sleepDebtNs / 1000000000ULL), (long)(sleepDebtNs % 1000000000ULL) };
+		nanosleep(&pause, NULL);
+		sleepDebtNs = 0;
+	}
+
+	/*	the DMA keeps moving host bytes while the CPU is busy or stalled	*/
+	link_read();
+	link_deliver(nowNs);
+}
+
+void sim_advance_cycles(uint64_t cycles)
+{
+	uint32_t hz = SystemCoreClock ? SystemCoreClock : HSI_VALUE;
+	sim_advance_ns((cycles * 1000000000ULL) / hz);
+}
+
+uint32_t sim_tick_ms(void)
+{
+	return (uint32_t)(nowNs / 1000000ULL);
+}
+
+/* Interrupts ----------------------------------------------------------------*/
+
+uint32_t sim_primask(void)
+{
+	return primask;
+}
+
+void sim_set_primask(uint32_t mask)
+{
+	primask = mask;
+	if(!primask)
+	{
+		/*	interrupts that became pending while masked are taken right here	*/
+		irq_service();
+	}
+}
+
+void sim_raise(uint32_t irq)
+{
+	sim_raise_at(irq, nowNs);
+}
+
+void sim_raise_at(uint32_t irq, uint64_t dueNs)
+{
+	uint32_t line = __builtin_ctz(irq);
+
+	/*	the wait of a line is measured from the earliest time it was due	*/
+	if(!(irqPending & irq) || (dueNs < irqFirstDue[line]))
+	{
+		irqFirstDue[line] = dueNs;
+	}
+	irqPending |= irq;
+	irqDue[line] = dueNs;
+}
+
+void sim_poll(void)
+{
+	cpu_charge();
+	link_read();
+	link_deliver(nowNs);
+	if(stopRequested)
+	{
+		finish("stopped", 0);
+	}
+	irq_service();
+}
+
+void sim_wait(void)
+{
+	uint64_t nextTick = ((nowNs / 1000000ULL) + 1ULL) * 1000000ULL;
+	uint64_t next;
+
+	sim_poll();
+	/*	WFI returns on a pending interrupt even with PRIMASK set	*/
+	if(NO_EVENT != irq_next_due() && (irq_next_due() <= nowNs))
+	{
+		return;
+	}
+
+	/*	sleep up to the next known event, SysTick wakes the core every millisecond at the latest	*/
+	next = irq_next_due();
+	if(link_next_due() < next)
+	{
+		next = link_next_due();
+	}
+	if(idleDueNs < next)
+	{
+		next = idleDueNs;
+	}
+
+	if(options.inputPath)
+	{
+		static uint64_t quietSinceNs = 0;
+		if((linkHead != linkTail) || (NO_EVENT != idleDueNs) || (NO_EVENT != irq_next_due()) || !inputDone)
+		{
+			quietSinceNs = nowNs;
+		}
+		else if((nowNs - quietSinceNs) >= INPUT_IDLE_NS)
+		{
+			finish("input consumed", 0);
+		}
+	}
+
+	if(next < nextTick)
+	{
+		sim_advance_ns(next - nowNs);
+	}
+	else if(options.inputPath)
+	{
+		sim_advance_ns(nextTick - nowNs);
+	}
+	else
+	{
+		/*	nothing scheduled : the host is thinking, let real time pass until it writes or a tick is due	*/
+		struct pollfd waitFd = { linkFd, POLLIN, 0 };
+		struct timespec before, after;
+		uint64_t elapsed;
+
+		clock_gettime(CLOCK_MONOTONIC, &before);
+		(void)poll(&waitFd, 1, 1);
+		clock_gettime(CLOCK_MONOTONIC, &after);
+		elapsed = (uint64_t)(after.tv_sec - before.tv_sec) * 1000000000ULL + (uint64_t)after.tv_nsec - (uint64_t)before.tv_nsec;
+		sim_advance_ns(((nowNs + elapsed) < nextTick) ? elapsed : (nextTick - nowNs));
+	}
+	sim_poll();
+}
+
+/* Memory --------------------------------------------------------------------*/
+
+volatile void *sim_periph_alias(const volatile void *reg)
+{
+	return periphAlias + ((uintptr_t)reg - SIM_PERIPH_BASE);
+}
+
+uint8_t *sim_flash_alias(uint32_t address)
+{
+	return flashAlias + (address - SIM_FLASH_BASE);
+}
+
+uint32_t sim_crc_word(uint32_t crc, uint32_t word)
+{
+	/*	the F4 unit : polynomial 0x04C11DB7, MSB first, a whole word per write	*/
+	crc ^= word;
+	for(int bit = 0; bit < 32; bit++)
+	{
+		crc = (crc & 0x80000000U) ? ((crc << 1) ^ 0x04C11DB7U) : (crc << 1);
+	}
+	return crc;
+}
+
+void sim_count_erase(uint32_t bytes)
+{
+	stats.erasedBytes += bytes;
+}
+
+int sim_code_in_ram(const void *pc)
+{
+	return ((const char *)pc >= __ramfunc_start) && ((const char *)pc < __ramfunc_end);
+}
+
+void sim_flash_busy(uint64_t ns, int fromRam)
+{
+	/*	also called from the trap handler : only plain arithmetic and stores here	*/
+	if(fromRam)
+	{
+		stats.ramBusyNs += ns;
+	}
+	else
+	{
+		stats.stallNs += ns;
+	}
+}
+
+uint64_t sim_erase_ns(uint32_t sectorBytes, uint32_t voltageRange)
+{
+	/*	typical sector erase times per parallelism : x8, x16, x32, x64 (the last uses x32 numbers)	*/
+	static const uint32_t erase16Ms[4] = { 400, 300, 250, 250 };
+	static const uint32_t erase64Ms[4] = { 1200, 700, 550, 550 };
+	static const uint32_t erase128Ms[4] = { 2000, 1100, 1000, 1000 };
+	uint32_t range = (voltageRange < 4U) ? voltageRange : 2U;
+	uint32_t ms = (sectorBytes <= 0x4000U) ? erase16Ms[range] : (sectorBytes <= 0x10000U) ? erase64Ms[range] : erase128Ms[range];
+
+	return (uint64_t)((double)ms * 1000000.0 * options.eraseScale);
+}
+
+/* Host link -----------------------------------------------------------------*/
+
+void sim_link_send(const uint8_t *data, size_t length)
+{
+	int fd = options.inputPath ? outputFd : linkFd;
+
+	stats.linkOut += length;
+	while((fd >= 0) && length)
+	{
+		ssize_t written = write(fd, data, length);
+		if(written < 0)
+		{
+			if(EAGAIN == errno)
+			{
+				struct pollfd waitFd = { fd, POLLOUT, 0 };
+				(void)poll(&waitFd, 1, 100);
+				continue;
+			}
+			if(EINTR == errno)
+			{
+				continue;
+			}
+			break;
+		}
+		data += written;
+		length -= (size_t)written;
+	}
+}
+
+void sim_link_rx_start(UART_HandleTypeDef *huart, uint8_t *ring, uint16_t length)
+{
+	linkUart = huart;
+	linkRing = ring;
+	linkRingLen = length;
+	linkActive = 1;
+}
+
+void sim_link_rx_stop(void)
+{
+	linkActive = 0;
+	irqPending &= ~SIM_IRQ_HOST_RX;
+}
+
+UART_HandleTypeDef *sim_link_uart(void)
+{
+	return linkUart;
+}
+
+int sim_link_is_usb(void)
+{
+	return options.usb;
+}
+
+/* Debug log -----------------------------------------------------------------*/
+
+static const char *log_string(uint32_t address)
+{
+	/*	the firmware's strings are this program's data, or on its stack, all below 4 GB with -no-pie	*/
+	if(((address >= (uintptr_t)__executable_start) && (address < (uintptr_t)edata)) ||
+		 ((address >= (uintptr_t)firmwareStack) && (address < (uintptr_t)(firmwareStack + sizeof(firmwareStack)))))
+	{
+		return (const char *)(uintptr_t)address;
+	}
+	return NULL;
+}
+
+static const char *log_format(uint32_t offset)
+{
+	/*	records keep 20 bits of (format - 0x08000000), put them back in the 1 MB window holding the program	*/
+	uintptr_t start = (uintptr_t)__executable_start;
+	uintptr_t address = (start & ~(uintptr_t)BL_LOG_FORMAT_MASK) | offset;
+
+	if(address < start)
+	{
+		address += BL_LOG_FORMAT_MASK + 1U;
+	}
+	return log_string((uint32_t)address);
+}
+
+static void log_render(const char *format, const uint32_t *args, uint32_t count)
+{
+	char text[512];
+	size_t used = 0;
+	uint32_t next = 0;
+
+	text[0] = 0;
+	while(*format && (used < sizeof(text) - 64))
+	{
+		char spec[16];
+		size_t specLen = 0;
+		const char *p = format;
+
+		if('%' != *p)
+		{
+			text[used++] = *format++;
+			continue;
+		}
+
+		/*	%[flags][width][.precision][length]conversion, every argument travelled as 32 bits	*/
+		spec[specLen++] = *p++;
+		while(*p && strchr("-+ 0#", *p) && (specLen < 8))								{ spec[specLen++] = *p++; }
+		while(*p && (*p >= '0') && (*p <= '9') && (specLen < 11))				{ spec[specLen++] = *p++; }
+		if('.' == *p)
+		{
+			spec[specLen++] = *p++;
+			while(*p && (*p >= '0') && (*p <= '9') && (specLen < 14))			{ spec[specLen++] = *p++; }
+		}
+		while(*p && strchr("hljzt", *p))																{ p++; }
+		if(!*p)
+		{
+			break;
+		}
+		spec[specLen++] = *p;
+		spec[specLen] = 0;
+		format = p + 1;
+
+		if('%' == *p)
+		{
+			text[used++] = '%';
+			continue;
+		}
+		if(next >= count)
+		{
+			used += (size_t)snprintf(text + used, sizeof(text) - used, "%s", spec);
+			continue;
+		}
+		switch(*p)
+		{
+			case( 'd' ):
+			case( 'i' ):
+				used += (size_t)snprintf(text + used, sizeof(text) - used, spec, (int)args[next++]);
+				break;
+			case( 'c' ):
+				used += (size_t)snprintf(text + used, sizeof(text) - used, spec, (int)(args[next++] & 0xFFU));
+				break;
+			case( 's' ):
+			{
+				const char *string = log_string(args[next]);
+				used += string ? (size_t)snprintf(text + used, sizeof(text) - used, spec, string)
+											 : (size_t)snprintf(text + used, sizeof(text) - used, "<0x%08X>", args[next]);
+				next++;
+				break;
+			}
+			case( 'p' ):
+				used += (size_t)snprintf(text + used, sizeof(text) - used, "0x%08X", args[next++]);
+				break;
+			default:
+				used += (size_t)snprintf(text + used, sizeof(text) - used, spec, (unsigned)args[next++]);
+				break;
+		}
+		if(used >= sizeof(text))
+		{
+			used = sizeof(text) - 1;
+		}
+	}
+	text[used] = 0;
+
+	/*	one line per record, the way Host/bl_log.py prints them	*/
+	for(char *line = strtok(text, "\r\n"); NULL != line; line = strtok(NULL, "\r\n"))
+	{
+		fprintf(logFile, "[%12.6f ms] %s\n", logElapsedMs, line);
+	}
+	fflush(logFile);
+}
+
+void sim_log_send(const uint8_t *data, size_t length)
+{
+	size_t offset = 0;
+
+	if(NULL == logFile)
+	{
+		return;
+	}
+
+	while(length)
+	{
+		size_t chunk = (length < (LOG_BUFFER_LEN - logFill)) ? length : (LOG_BUFFER_LEN - logFill);
+		memcpy(logBuffer + logFill, data, chunk);
+		logFill += chunk;
+		data += chunk;
+		length -= chunk;
+
+		/*	header | DWT cycles | arguments, resynchronising on the sync byte like the host decoder	*/
+		offset = 0;
+		while((logFill - offset) >= 8U)
+		{
+			uint32_t words[2 + BL_LOG_MAX_ARGS];
+			uint32_t header, count;
+
+			memcpy(&header, logBuffer + offset, 4);
+			count = (header >> 20) & 0xFU;
+			if(((header >> 24) != BL_LOG_SYNC) || (count > BL_LOG_MAX_ARGS))
+			{
+				offset++;
+				continue;
+			}
+			if((logFill - offset) < (8U + 4U * count))
+			{
+				break;
+			}
+			memcpy(words, logBuffer + offset, 8U + 4U * count);
+			offset += 8U + 4U * count;
+
+			if(logStarted)
+			{
+				logElapsedMs += (double)(uint32_t)(words[1] - logLastCycles) * 1000.0 / (double)(SystemCoreClock ? SystemCoreClock : HSI_VALUE);
+			}
+			logStarted = 1;
+			logLastCycles = words[1];
+			stats.logRecords++;
+
+			if(0U == (header & BL_LOG_FORMAT_MASK))
+			{
+				fprintf(logFile, "[%12.6f ms] <%u log records dropped>\n", logElapsedMs, count ? words[2] : 0U);
+			}
+			else
+			{
+				const char *format = log_format(header & BL_LOG_FORMAT_MASK);
+				if(NULL != format)
+				{
+					log_render(format, &words[2], count);
+				}
+				else
+				{
+					fprintf(logFile, "[%12.6f ms] <unknown format 0x%05X>\n", logElapsedMs, header & BL_LOG_FORMAT_MASK);
+				}
+			}
+		}
+		memmove(logBuffer, logBuffer + offset, logFill - offset);
+		logFill -= offset;
+	}
+}
+
+/* Traps ---------------------------------------------------------------------*/
+
+static void trap_protect(uintptr_t page, uint32_t pages, int prot)
+{
+	(void)mprotect((void *)page, (size_t)pages * PAGE_LEN, prot);
+}
+
+static void on_segv(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = (ucontext_t *)context;
+	greg_t *regs = uc->uc_mcontext.gregs;
+	uintptr_t address = (uintptr_t)info->si_addr;
+	char message[96];
+
+	(void)sig;
+
+	/*	an instruction fetch from flash : the firmware has jumped to an application	*/
+	if((regs[REG_ERR] & PF_FETCH) || ((uintptr_t)regs[REG_RIP] == address))
+	{
+		if((address >= SIM_FLASH_BASE) && (address < (SIM_FLASH_BASE + SIM_FLASH_LEN)))
+		{
+			snprintf(message, sizeof(message), "jump to 0x%08X, MSP 0x%08X, VTOR 0x%08X", (uint32_t)address, __get_MSP(), SCB->VTOR);
+			finish(message, 0);
+		}
+		snprintf(message, sizeof(message), "fault : jump to 0x%lX", (unsigned long)address);
+		finish(message, EXIT_FAULT);
+	}
+
+	if((regs[REG_ERR] & PF_WRITE) && (address >= SIM_FLASH_BASE) && (address < (SIM_FLASH_BASE + SIM_FLASH_LEN)))
+	{
+		/*	a program operation : let the store through, then judge it in on_trap()	*/
+		trap.kind = TRAP_FLASH;
+		trap.address = address & ~(uintptr_t)7U;
+		trap.page = address & ~(uintptr_t)(PAGE_LEN - 1U);
+		trap.pages = ((trap.address + sizeof(trap.before) - 1U) / PAGE_LEN) - (trap.page / PAGE_LEN) + 1U;
+		if((trap.address + sizeof(trap.before)) > (SIM_FLASH_BASE + SIM_FLASH_LEN))
+		{
+			trap.address = SIM_FLASH_BASE + SIM_FLASH_LEN - sizeof(trap.before);
+			trap.pages = 1;
+		}
+		memcpy(trap.before, sim_flash_alias((uint32_t)trap.address), sizeof(trap.before));
+		trap_protect(trap.page, trap.pages, PROT_READ | PROT_WRITE);
+	}
+	else if((address & ~(uintptr_t)(PAGE_LEN - 1U)) == SIM_TRAP_PAGE)
+	{
+		trap.kind = TRAP_REGISTER;
+		trap.address = address;
+		trap.page = SIM_TRAP_PAGE;
+		trap.pages = 1;
+		trap.write = (regs[REG_ERR] & PF_WRITE) ? 1 : 0;
+		trap.crcDr = SIM_REG(CRC->DR);
+		trap.flashSr = SIM_REG(FLASH->SR);
+		trap_protect(trap.page, trap.pages, PROT_READ | PROT_WRITE);
+	}
+	else
+	{
+		snprintf(message, sizeof(message), "fault : %s 0x%lX at 0x%lX", (regs[REG_ERR] & PF_WRITE) ? "write" : "read",
+						 (unsigned long)address, (unsigned long)regs[REG_RIP]);
+		finish(message, EXIT_FAULT);
+	}
+
+	/*	execute the access alone, on_trap() runs right after it	*/
+	regs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void on_trap(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = (ucontext_t *)context;
+	greg_t *regs = uc->uc_mcontext.gregs;
+
+	(void)sig;
+	(void)info;
+	regs[REG_EFL] &= ~(greg_t)EFLAGS_TF;
+
+	if(TRAP_FLASH == trap.kind)
+	{
+		uint8_t *cell = sim_flash_alias((uint32_t)trap.address);
+		uint32_t cr = SIM_REG(FLASH->CR);
+		uint32_t sector = BL_FLASH_SECTOR_INVALID;
+		uint32_t errors = 0;
+
+		trap_protect(trap.page, trap.pages, PROT_READ);
+		for(uint32_t i = 0; i < 12U; i++)
+		{
+			uint32_t start = (i < 4U) ? (SIM_FLASH_BASE + i * 0x4000U) : (i == 4U) ? (SIM_FLASH_BASE + 0x10000U) : (SIM_FLASH_BASE + 0x20000U + (i - 5U) * 0x20000U);
+			uint32_t size = (i < 4U) ? 0x4000U : (i == 4U) ? 0x10000U : 0x20000U;
+			if((trap.address >= start) && (trap.address < (start + size)))
+			{
+				sector = i;
+			}
+		}
+
+		/*	the controller only programs with PG set on an unlocked CR, outside write protected sectors	*/
+		if((cr & FLASH_CR_LOCK) || !(cr & FLASH_CR_PG))
+		{
+			errors = FLASH_SR_PGSERR;
+		}
+		else if(!(SIM_REG(FLASH->OPTCR) & (1UL << (FLASH_OPTCR_nWRP_Pos + sector))))
+		{
+			errors = FLASH_SR_WRPERR;
+		}
+
+		for(uint32_t i = 0; i < sizeof(trap.before); i++)
+		{
+			/*	programming can only clear bits	*/
+			cell[i] = errors ? trap.before[i] : (uint8_t)(trap.before[i] & cell[i]);
+		}
+		if(errors)
+		{
+			SIM_REG(FLASH->SR) |= errors;
+			stats.programErrors++;
+		}
+		else
+		{
+			/*	x64 programs a double word in two stores, each half costs half the time	*/
+			/*	the store came from flash : the next fetch stalls until the write is over	*/
+			uint64_t ns = (FLASH_PSIZE_DOUBLE_WORD == (cr & FLASH_CR_PSIZE)) ? (SIM_PROGRAM_NS / 2U) : SIM_PROGRAM_NS;
+			stats.programs++;
+			sim_flash_busy(ns, sim_code_in_ram((const void *)regs[REG_RIP]));
+			clock_add(ns);
+		}
+	}
+	else if(TRAP_REGISTER == trap.kind)
+	{
+		trap_protect(trap.page, trap.pages, PROT_NONE);
+		if(trap.write)
+		{
+			uintptr_t reg = trap.address & ~(uintptr_t)3U;
+			if(reg == (uintptr_t)&CRC->DR)
+			{
+				SIM_REG(CRC->DR) = sim_crc_word(trap.crcDr, SIM_REG(CRC->DR));
+			}
+			else if((reg == (uintptr_t)&CRC->CR) && (SIM_REG(CRC->CR) & CRC_CR_RESET))
+			{
+				SIM_REG(CRC->DR) = 0xFFFFFFFFU;
+				SIM_REG(CRC->CR) &= ~CRC_CR_RESET;
+			}
+			else if(reg == (uintptr_t)&FLASH->SR)
+			{
+				/*	status flags clear on writing 1	*/
+				SIM_REG(FLASH->SR) = trap.flashSr & ~SIM_REG(FLASH->SR);
+			}
+			else if((reg == (uintptr_t)&RCC->CSR) && (SIM_REG(RCC->CSR) & RCC_CSR_RMVF))
+			{
+				SIM_REG(RCC->CSR) &= 0x00FFFFFFU & ~RCC_CSR_RMVF;
+			}
+		}
+	}
+	trap.kind = TRAP_NONE;
+}
+
+static void on_stop(int sig)
+{
+	(void)sig;
+	stopRequested = 1;
+}
+
+/* Setup ---------------------------------------------------------------------*/
+
+static void *map_fixed(uint32_t base, uint32_t length, int prot, int flags, int fd)
+{
+	void *region = mmap((void *)(uintptr_t)base, length, prot, flags | MAP_FIXED_NOREPLACE, fd, 0);
+
+	if((MAP_FAILED == region) || ((uintptr_t)region != base))
+	{
+		fprintf(stderr, "bl_sim: cannot map 0x%08X : %s\n", base, strerror(errno));
+		exit(1);
+	}
+	return region;
+}
+
+static void memory_init(void)
+{
+	struct stat status;
+	int flashFd, periphFd;
+
+	/*	flash image : read only where the firmware sees it, writable through the alias	*/
+	flashFd = open(options.flashPath, O_RDWR | O_CREAT, 0644);
+	if((flashFd < 0) || (0 != fstat(flashFd, &status)))
+	{
+		perror(options.flashPath);
+		exit(1);
+	}
+	if(0 == status.st_size)
+	{
+		uint8_t erased[PAGE_LEN];
+		memset(erased, 0xFF, sizeof(erased));
+		for(uint32_t i = 0; i < SIM_FLASH_LEN; i += PAGE_LEN)
+		{
+			if(PAGE_LEN != write(flashFd, erased, PAGE_LEN))
+			{
+				perror(options.flashPath);
+				exit(1);
+			}
+		}
+	}
+	else if(SIM_FLASH_LEN != status.st_size)
+	{
+		fprintf(stderr, "bl_sim: %s must be exactly 1 MB\n", options.flashPath);
+		exit(1);
+	}
+	(void)map_fixed(SIM_FLASH_BASE, SIM_FLASH_LEN, PROT_READ, MAP_SHARED, flashFd);
+	flashAlias = mmap(NULL, SIM_FLASH_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, flashFd, 0);
+
+	/*	peripherals : the same memory twice, so the trap page can be closed to the firmware only	*/
+	periphFd = memfd_create("bl_sim_periph", 0);
+	if((periphFd < 0) || (0 != ftruncate(periphFd, SIM_PERIPH_LEN)))
+	{
+		perror("bl_sim");
+		exit(1);
+	}
+	(void)map_fixed(SIM_PERIPH_BASE, SIM_PERIPH_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, periphFd);
+	periphAlias = mmap(NULL, SIM_PERIPH_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, periphFd, 0);
+	if((MAP_FAILED == flashAlias) || (MAP_FAILED == periphAlias))
+	{
+		perror("bl_sim");
+		exit(1);
+	}
+
+	(void)map_fixed(SIM_CCM_BASE, SIM_CCM_LEN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+	(void)map_fixed(SIM_SYSTEM_BASE, SIM_SYSTEM_LEN, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+	(void)map_fixed(SIM_SRAM_BASE, SIM_SRAM_LEN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+	(void)map_fixed(SIM_AHB2_BASE, SIM_AHB2_LEN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+	(void)map_fixed(SIM_PPB_BASE, SIM_PPB_LEN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+
+	/*	reset values the firmware reads back	*/
+	SIM_REG(FLASH->CR) = FLASH_CR_LOCK;
+	SIM_REG(FLASH->OPTCR) = FLASH_OPTCR_RESET;
+	SIM_REG(CRC->DR) = 0xFFFFFFFFU;
+	SIM_REG(RCC->CR) = RCC_CR_HSION | RCC_CR_HSIRDY;
+	SIM_REG(RCC->PLLCFGR) = 0x24003010U;
+	SIM_REG(RCC->CSR) = RCC_CSR_PORRSTF | RCC_CSR_PINRSTF;
+	DBGMCU->IDCODE = DBGMCU_IDCODE_F407;
+	if(options.button)
+	{
+		GPIOA->IDR |= GPIO_PIN_0;
+	}
+
+	if(0 != mprotect((void *)(uintptr_t)SIM_TRAP_PAGE, PAGE_LEN, PROT_NONE))
+	{
+		perror("bl_sim");
+		exit(1);
+	}
+}
+
+static void signals_init(void)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	action.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &action, NULL);
+	sigaction(SIGBUS, &action, NULL);
+	action.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &action, NULL);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+}
+
+static void link_init(void)
+{
+	if(options.inputPath)
+	{
+		linkFd = open(options.inputPath, O_RDONLY);
+		if(linkFd < 0)
+		{
+			perror(options.inputPath);
+			exit(1);
+		}
+		if(options.outputPath)
+		{
+			outputFd = open(options.outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if(outputFd < 0)
+			{
+				perror(options.outputPath);
+				exit(1);
+			}
+		}
+	}
+	else
+	{
+		struct termios tio;
+		const char *slaveName;
+
+		/*	keep the slave open ourselves : the host may come and go without the master seeing a hangup	*/
+		linkFd = posix_openpt(O_RDWR | O_NOCTTY);
+		if((linkFd < 0) || (0 != grantpt(linkFd)) || (0 != unlockpt(linkFd)) || (NULL == (slaveName = ptsname(linkFd))))
+		{
+			perror("bl_sim");
+			exit(1);
+		}
+		linkSlaveFd = open(slaveName, O_RDWR | O_NOCTTY);
+		if((linkSlaveFd < 0) || (0 != tcgetattr(linkSlaveFd, &tio)))
+		{
+			perror(slaveName);
+			exit(1);
+		}
+		cfmakeraw(&tio);
+		tcsetattr(linkSlaveFd, TCSANOW, &tio);
+		fcntl(linkFd, F_SETFL, fcntl(linkFd, F_GETFL) | O_NONBLOCK);
+
+		if(options.linkPath)
+		{
+			(void)unlink(options.linkPath);
+			if(0 != symlink(slaveName, options.linkPath))
+			{
+				perror(options.linkPath);
+				exit(1);
+			}
+		}
+		printf("bl_sim: host link on %s\n", options.linkPath ? options.linkPath : slaveName);
+		fflush(stdout);
+	}
+}
+
+static void firmware_entry(void)
+{
+	/*	what the reset handler does before main()	*/
+	SystemInit();
+	(void)firmware_main();
+	finish("firmware returned from main", EXIT_FAULT);
+}
+
+int main(int argc, char **argv)
+{
+	options.flashPath = "bl_sim_flash.bin";
+	options.eraseScale = 1.0;
+
+	for(int argi = 1; argi < argc; argi++)
+	{
+		const char *option = argv[argi];
+		const char *value = (argi + 1 < argc) ? argv[argi + 1] : NULL;
+
+		if(0 == strcmp(option, "--button"))							{ options.button = 1; }
+		else if(0 == strcmp(option, "--realtime"))			{ options.realtime = 1; }
+		else if(NULL == value)													{ fputs(usage, stderr); return 2; }
+		else if(0 == strcmp(option, "--flash"))					{ options.flashPath = value; argi++; }
+		else if(0 == strcmp(option, "--link"))					{ options.linkPath = value; argi++; }
+		else if(0 == strcmp(option, "--input"))					{ options.inputPath = value; argi++; }
+		else if(0 == strcmp(option, "--output"))				{ options.outputPath = value; argi++; }
+		else if(0 == strcmp(option, "--log"))						{ options.logPath = value; argi++; }
+		else if(0 == strcmp(option, "--transport"))			{ options.usb = (0 == strcmp(value, "usb")); argi++; }
+		else if(0 == strcmp(option, "--dfu"))						{ options.dfuPath = value; argi++; }
+		else if(0 == strcmp(option, "--erase-scale"))		{ options.eraseScale = strtod(value, NULL); argi++; }
+		else if(0 == strcmp(option, "--cpu-scale"))			{ options.cpuScale = strtod(value, NULL); argi++; }
+		else																						{ fputs(usage, stderr); return 2; }
+	}
+
+	if(options.dfuPath)
+	{
+		/*	FILE@ADDRESS, the address after the last @	*/
+		char *path = strdup(options.dfuPath);
+		char *at = strrchr(path, '@');
+		uint32_t address = BL_SLOT_A_ADDRESS;
+
+		if(NULL != at)
+		{
+			*at = '\0';
+			address = (uint32_t)strtoul(at + 1, NULL, 0);
+		}
+		if(0 != sim_dfu_load(path, address))
+		{
+			perror(path);
+			return 1;
+		}
+		options.usb = 1;
+	}
+
+	if(options.logPath)
+	{
+		logFile = (0 == strcmp(options.logPath, "-")) ? stderr : fopen(options.logPath, "w");
+		if(NULL == logFile)
+		{
+			perror(options.logPath);
+			return 1;
+		}
+		if(((uintptr_t)edata - (uintptr_t)__executable_start) > (BL_LOG_FORMAT_MASK + 1U))
+		{
+			fprintf(stderr, "bl_sim: program larger than 1 MB, log formats may be misread\n");
+		}
+	}
+
+	memory_init();
+	signals_init();
+	link_init();
+	cpu_charge();
+
+	/*	the firmware runs on a stack below 4 GB, its pointers fit the 32 bit casts it makes	*/
+	getcontext(&firmwareContext);
+	firmwareContext.uc_stack.ss_sp = firmwareStack;
+	firmwareContext.uc_stack.ss_size = sizeof(firmwareStack);
+	firmwareContext.uc_link = NULL;
+	makecontext(&firmwareContext, firmware_entry, 0);
+	swapcontext(&hostContext, &firmwareContext);
+	return 0;
+}
+
+void sim_finish(const char *reason, int status)
+{
+	finish(reason, status);
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void clock_add(uint64_t ns)
+{
+	/*	also called from the trap handler : only plain arithmetic and stores here	*/
+	nowNs += ns;
+	if(options.realtime)
+	{
+		sleepDebtNs += ns;
+	}
+	clock_publish();
+}
+
+static void clock_publish(void)
+{
+	uint32_t hz = SystemCoreClock ? SystemCoreClock : HSI_VALUE;
+	uint64_t cycles;
+
+	/*	the firmware may have zeroed the counter or changed the core clock, carry on from there	*/
+	if(DWT->CYCCNT != cyclePublished)
+	{
+		cycleBase = DWT->CYCCNT;
+		cycleBaseNs = nowNs;
+	}
+	if(hz != cycleHz)
+	{
+		cycleBase += ((nowNs - cycleBaseNs) * cycleHz) / 1000000000ULL;
+		cycleBaseNs = nowNs;
+		cycleHz = hz;
+	}
+	cycles = cycleBase + ((nowNs - cycleBaseNs) * hz) / 1000000000ULL;
+	cyclePublished = (uint32_t)cycles;
+	DWT->CYCCNT = cyclePublished;
+}
+
+static void cpu_charge(void)
+{
+	struct timespec cpu;
+	uint64_t cpuNs;
+
+	if(options.cpuScale <= 0.0)
+	{
+		return;
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+	cpuNs = (uint64_t)cpu.tv_sec * 1000000000ULL + (uint64_t)cpu.tv_nsec;
+	if(cpuLastNs)
+	{
+		clock_add((uint64_t)((double)(cpuNs - cpuLastNs) * options.cpuScale));
+	}
+	cpuLastNs = cpuNs;
+}
+
+static void link_read(void)
+{
+	uint64_t byteNs = options.usb ? (SIM_USB_PACKET_NS / 64U) : linkUart ? sim_hal_byte_ns(linkUart) : 86806U;
+
+	while(((linkHead - linkTail) < LINK_FIFO_LEN) && !inputDone)
+	{
+		uint8_t chunk[4096];
+		size_t room = LINK_FIFO_LEN - (linkHead - linkTail);
+		ssize_t got;
+
+		/*	--input : the file is a host that never waits, keep about a ring's worth of bytes queued	*/
+		if(options.inputPath && ((linkHead - linkTail) >= 16384U))
+		{
+			break;
+		}
+		got = read(linkFd, chunk, (room < sizeof(chunk)) ? room : sizeof(chunk));
+		if(got <= 0)
+		{
+			if(options.inputPath && (0 == got))
+			{
+				inputDone = 1;
+			}
+			break;
+		}
+
+		/*	each byte takes its wire time, back to back from the moment it was seen	*/
+		for(ssize_t i = 0; i < got; i++)
+		{
+			wireFreeNs = ((wireFreeNs > nowNs) ? wireFreeNs : nowNs) + byteNs;
+			linkFifo[linkHead % LINK_FIFO_LEN] = chunk[i];
+			linkDue[linkHead % LINK_FIFO_LEN] = wireFreeNs;
+			linkHead++;
+		}
+	}
+}
+
+static void link_deliver(uint64_t until)
+{
+	uint64_t byteNs = linkUart ? sim_hal_byte_ns(linkUart) : 86806U;
+
+	/*	USB : one packet per armed OUT transfer, the rest waits in the FIFO the way a NAKed host waits	*/
+	while(options.usb && (link_next_due() <= until))
+	{
+		uint8_t packet[64];
+		uint32_t count;
+		uint64_t due = link_usb_packet(&count);
+
+		for(uint32_t i = 0; i < count; i++)
+		{
+			packet[i] = linkFifo[(linkTail + i) % LINK_FIFO_LEN];
+		}
+		linkTail += count;
+		stats.linkIn += count;
+		sim_hal_usb_out(packet, count, due);
+	}
+	if(options.usb)
+	{
+		return;
+	}
+
+	while((linkHead != linkTail) && (linkDue[linkTail % LINK_FIFO_LEN] <= until))
+	{
+		uint64_t due = linkDue[linkTail % LINK_FIFO_LEN];
+		uint8_t byte = linkFifo[linkTail % LINK_FIFO_LEN];
+		linkTail++;
+
+		if(linkActive && (NULL != linkUart) && (NULL != linkUart->hdmarx))
+		{
+			/*	circular DMA : NDTR counts down to 0 and reloads, half and full transfer raise the event	*/
+			volatile uint32_t *ndtr = &linkUart->hdmarx->Instance->NDTR;
+			uint16_t position = (uint16_t)(linkRingLen - *ndtr);
+			linkRing[position] = byte;
+			*ndtr = (*ndtr > 1U) ? (*ndtr - 1U) : linkRingLen;
+			position = (uint16_t)((position + 1U) % linkRingLen);
+			if((position == (linkRingLen / 2U)) || (0U == position))
+			{
+				sim_raise_at(SIM_IRQ_HOST_RX, due);
+			}
+			stats.linkIn++;
+		}
+		else
+		{
+			stats.linkLost++;
+		}
+		/*	the idle line flag sets one character time after the last stop bit	*/
+		idleDueNs = due + byteNs;
+	}
+
+	if((NO_EVENT != idleDueNs) && (idleDueNs <= until) &&
+		 ((linkHead == linkTail) || (linkDue[linkTail % LINK_FIFO_LEN] > idleDueNs)))
+	{
+		if(linkActive)
+		{
+			sim_raise_at(SIM_IRQ_HOST_RX, idleDueNs);
+		}
+		idleDueNs = NO_EVENT;
+	}
+}
+
+static uint64_t link_next_due(void)
+{
+	uint32_t count;
+
+	if(linkHead == linkTail)
+	{
+		return NO_EVENT;
+	}
+	return options.usb ? link_usb_packet(&count) : linkDue[linkTail % LINK_FIFO_LEN];
+}
+
+static uint64_t link_usb_packet(uint32_t *count)
+{
+	uint64_t armedNs, due;
+
+	/*	the host sends up to 64 queued bytes as one packet once its last byte is there, a NAKed packet	*/
+	/*	is retried a packet time after the endpoint is armed ; the directions are not arbitrated	*/
+	*count = ((linkHead - linkTail) < 64U) ? (linkHead - linkTail) : 64U;
+	if((0U == *count) || !sim_hal_usb_out_ready(&armedNs))
+	{
+		return NO_EVENT;
+	}
+	due = linkDue[(linkTail + *count - 1U) % LINK_FIFO_LEN];
+	return (due > (armedNs + SIM_USB_PACKET_NS)) ? due : (armedNs + SIM_USB_PACKET_NS);
+}
+
+static uint64_t irq_next_due(void)
+{
+	uint64_t next = NO_EVENT;
+
+	for(uint32_t line = 0; line < SIM_IRQ_LINES; line++)
+	{
+		if((irqPending & (1U << line)) && (irqDue[line] < next))
+		{
+			next = irqDue[line];
+		}
+	}
+	return next;
+}
+
+static void irq_service(void)
+{
+	if(primask || inInterrupt)
+	{
+		return;
+	}
+
+	/*	one handler at a time, lowest line first, a handler may raise another line	*/
+	inInterrupt = 1;
+	for(;;)
+	{
+		uint32_t line = 0;
+		while((line < SIM_IRQ_LINES) && !((irqPending & (1U << line)) && (irqDue[line] <= nowNs)))
+		{
+			line++;
+		}
+		if(line >= SIM_IRQ_LINES)
+		{
+			break;
+		}
+		if((nowNs - irqFirstDue[line]) > stats.irqLatencyNs)
+		{
+			stats.irqLatencyNs = nowNs - irqFirstDue[line];
+		}
+		irqPending &= ~(1U << line);
+		sim_hal_irq(1U << line);
+	}
+	inInterrupt = 0;
+}
+
+static void report(const char *reason)
+{
+	fprintf(stderr, "bl_sim: %s after %.6f s simulated\n", reason, (double)nowNs / 1e9);
+	fprintf(stderr, "bl_sim: link %llu bytes in, %llu out, %llu lost while reception was stopped\n",
+					(unsigned long long)stats.linkIn, (unsigned long long)stats.linkOut, (unsigned long long)stats.linkLost);
+	fprintf(stderr, "bl_sim: flash %llu program operations, %llu refused, %llu KB erased, %llu log records\n",
+					(unsigned long long)stats.programs, (unsigned long long)stats.programErrors,
+					(unsigned long long)(stats.erasedBytes / 1024U), (unsigned long long)stats.logRecords);
+	fprintf(stderr, "bl_sim: flash busy %.3f s with the CPU stalled, %.3f s running from RAM, longest interrupt wait %.3f ms\n",
+					(double)stats.stallNs / 1e9, (double)stats.ramBusyNs / 1e9, (double)stats.irqLatencyNs / 1e6);
+}
+
+static void finish(const char *reason, int status)
+{
+	report(reason);
+
+	/*	a real port stays up when the application starts : hold the master until the host lets go of	*/
+	/*	the slave (or 2 s), so it reads the last reply instead of a hangup	*/
+	if(linkSlaveFd >= 0)
+	{
+		struct pollfd hangup = { linkFd, 0, 0 };
+		close(linkSlaveFd);
+		for(int wait = 0; wait < 200; wait++)
+		{
+			if((1 == poll(&hangup, 1, 0)) && (hangup.revents & POLLHUP))
+			{
+				break;
+			}
+			usleep(10000);
+		}
+	}
+	if(logFile)
+	{
+		fflush(logFile);
+	}
+	if(options.linkPath && !options.inputPath)
+	{
+		(void)unlink(options.linkPath);
+	}
+	_exit(status);
+}
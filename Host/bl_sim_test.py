@@ -0,0 +1,730 @@
+#!/usr/bin/env python3
+"""Regression tests of the bootloader running in Host/bl_sim.
+
+Every case starts a fresh bl_sim on an erased (or a prepared) flash image
+in a temporary directory, talks to it over its pseudo-terminal with the framing of
+Host/bl_bench.py, checks the replies and then reads the flash image the
+simulator leaves behind.  The simulator stands in for HAL_UART_* and
+HAL_FLASH_* (see Host/sim/bl_sim_hal.c), so the cases run the unmodified
+command handlers, receive engine and flash code of the firmware.
+
+Cases:
+    stream              CBL_STREAM_WRITE_CMD of an image into slot A : one
+                        cumulative reply per window, the image in flash
+    stream-retry        a corrupted block fails its window, the reply names
+                        the block to resend from and the image still ends
+                        up intact (go back N)
+    stream-ahead        the same with STREAM_FLAG_ERASE_AHEAD over written
+                        sectors : each is erased in the background, ended by
+                        the flash interrupt, before its first block lands
+    stream-reject       sessions with a bad window or length are refused
+    delta               CBL_DELTA_WRITE_CMD of a Host/bl_delta.py patch between
+                        two real builds (the bootloader sources compiled with
+                        $CC, with and without the benchmark options) : the
+                        flash ends up byte for byte the new build, a patch
+                        announced against the wrong old CRC is refused.
+                        Prints the bytes saved against a full write
+    delta-slots         the same builds once the old one boots from slot A :
+                        the patch reads slot A and writes slot B, slot A is
+                        left as it was and slot B activates, a patch in place
+                        over the boot slot is refused
+    compressed          CBL_COMPRESSED_WRITE_CMD of Host/bl_compress.py streams
+                        of a real .hex (the ARM build in MDK-ARM) and a real
+                        .bin (a host build of the bootloader sources) : both
+                        decode into flash byte for byte, a corrupted stream
+                        ends the session with a NACK
+    erase-bounds        CBL_FLASH_ERASE_CMD refuses sectors 0, 1, 10 and 11 and
+                        a mass erase, and erases inside the slots, but not
+                        inside slot A once a signed image there is active
+    legacy-boot         with no slot table an image in slot A only boots
+                        once its signed manifest checks out
+    fast-boot           a reset with a signed image committed starts it on the
+                        fast path (manifest checked on the PLL), a corrupted
+                        image keeps the device in the bootloader
+    compact-resume      a slot table compaction cut short by a reset : the
+                        staged records and journal session in scratch are
+                        written back on the next start and the stage retired
+    dfu-commit          a DfuSe download of a signed image into slot A (the
+                        scripted dfu-util of --dfu) : the slot record committed
+                        on leave carries the manifest's version and length and
+                        the CRC of the image, and the image starts
+    hash                CBL_IMAGE_HASH_CMD is CBL_MEM_HASH_CMD limited to flash
+    slot-bounds         stream sessions and CBL_MEM_WRITE_CMD only reach the
+                        slot the device does not boot : not past the end of
+                        a slot, not the bootloader, scratch or slot table,
+                        and not slot A once a signed image there is active
+    bench-status        the benchmark record of a command carries the ACK or
+                        NACK that was sent, a known SID with a bad length
+                        included
+    rx-stall            a v2 frame cut short is dropped and v2 frames still
+                        work after it, three stalls in a row bring v1 back
+    rx-rates            the same stream at every link rate the device offers
+                        (CBL_SET_BAUD_CMD) : no byte lost, every window ACKed
+                        first time, and consecutive blocks of a window
+                        complete one wire time apart (or one programming time
+                        when that is longer), so reception overlaps CRC
+                        checks and programming.  Prints the share of each
+                        window the link was busy
+
+Manifests are signed with Host/bl_dev_ed25519.key : bl_sim has to be built
+with -DBL_SECURE_BOOT_DEV_KEY (see Host/bl_sim.c).
+
+usage: bl_sim_test.py [--sim PATH] [--keep DIR] [case ...]
+    --sim PATH          bl_sim binary (./bl_sim)
+    --keep DIR          keep flash images and simulator output in DIR
+"""
+
+import os
+import random
+import shutil
+import signal
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import bl_compress
+import bl_delta
+import bl_manifest
+from bl_bench import (Port, Target, BL_ACK, BENCH_KIND_BLOCK, BENCH_KIND_COMMAND, CBL_FLASH_ERASE_CMD,
+                      CBL_GET_VER_CMD, CBL_MEM_HASH_CMD, CBL_MEM_WRITE_CMD, CBL_SET_BAUD_CMD, CBL_SLOT_INFO_CMD,
+                      CBL_STREAM_WRITE_CMD, FLASH_PAYLOAD_WRITE_PASSED, FORMAT_V1, STREAM_FLAG_ERASE_AHEAD,
+                      STREAM_SESSION_OPENED, STREAM_STATE_ACTIVE, STREAM_STATE_DONE, crc32_mpeg2)
+
+BL_NACK = 0xAB
+FLASH_BASE = 0x08000000
+FLASH_LEN = 1024 * 1024
+SLOT_A_ADDRESS = 0x08008000
+SLOT_A_LENGTH = 0x58000
+SLOT_B_ADDRESS = 0x08060000
+SLOT_B_LENGTH = 0x60000
+SCRATCH_ADDRESS = 0x080C0000
+SLOT_TABLE_ADDRESS = 0x080E0000
+SLOT_TABLE_LENGTH = 0x1C000
+SLOT_RECORD_LEN = 32
+SLOT_RECORD_MAGIC = 0x544F4C53
+SLOT_STAGE_MAGIC = 0x47415453
+JOURNAL_ADDRESS = 0x080FC000
+JOURNAL_HEADER_MAGIC = 0x4C4E524A
+JOURNAL_STATE_PARTIAL = 0x01
+CBL_JOURNAL_QUERY_CMD = 0x2C
+CBL_IMAGE_HASH_CMD = 0x24
+CBL_SET_ACTIVE_SLOT_CMD = 0x27
+SLOT_ACTIVATE_DONE = 0x01
+SLOT_NONE = 0xFF
+ERASE_DONE = 0x03
+ERASE_REFUSED = 0x02
+DEV_KEY = os.path.join(os.path.dirname(os.path.abspath(__file__)), "bl_dev_ed25519.key")
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CBL_COMPRESSED_WRITE_CMD = 0x23
+CBL_DELTA_WRITE_CMD = 0x25
+STREAM_STATE_ABORTED = 0x02
+HEX_IMAGE = os.path.join(REPO, "MDK-ARM", "PractiseBL", "PractiseBL.hex")
+STREAM_SESSION_REJECTED = 0x00
+LINK_BAUD = 115200
+CORE_CLOCK = 168000000
+BITS_PER_BYTE = 10
+REPLY_TIMEOUT = 20.0
+INTERFRAME_S = 0.1
+RX_MAX_STALLS = 3
+
+
+class TestFailure(Exception):
+    pass
+
+
+def check(condition, message):
+    if not condition:
+        raise TestFailure(message)
+
+
+class Sim:
+    """one bl_sim process on its own flash image, stopped with stop()"""
+
+    def __init__(self, binary, directory, name, args=(), flash=None, link=True):
+        self.flash_path = os.path.join(directory, name + ".bin")
+        self.log_path = os.path.join(directory, name + ".txt")
+        if os.path.exists(self.flash_path):
+            os.remove(self.flash_path)
+        if flash is not None:
+            with open(self.flash_path, "wb") as image:
+                image.write(flash)
+        self.log = open(self.log_path, "w")
+        self.process = subprocess.Popen([binary, "--flash", self.flash_path] + list(args),
+                                        stdout=subprocess.PIPE, stderr=self.log, text=True)
+        line = self.process.stdout.readline()
+        if "host link on" not in line:
+            self.process.kill()
+            raise TestFailure("bl_sim did not start, see %s" % self.log_path)
+        # a run that starts an image ends on its own and takes the pseudo-terminal with it, no link then
+        self.target = Target(Port(line.split()[-1], LINK_BAUD)) if link else None
+        self.report = ""
+
+    def stop(self):
+        """ends the run, returns the flash image the firmware left behind"""
+        if self.target is not None:
+            os.close(self.target.port.fd)
+        self.process.send_signal(signal.SIGTERM)
+        self.process.wait(timeout=30)
+        self.log.close()
+        with open(self.log_path) as log:
+            self.report = log.read()
+        with open(self.flash_path, "rb") as flash:
+            return flash.read()
+
+
+def flash_range(image, address, length):
+    return image[address - FLASH_BASE:address - FLASH_BASE + length]
+
+
+def stream_session(target, base, length, window, flags=b""):
+    payload = struct.pack("<IIB", base, length, window) + flags
+    return target.command(CBL_STREAM_WRITE_CMD, payload, reply=1, timeout=REPLY_TIMEOUT)[0]
+
+
+def stream_image(target, image, window, corrupt=None):
+    """sends image block by block, corrupt is the sequence of a block sent once with a bad CRC"""
+    block = target.max_block()
+    blocks = [image[i:i + block] for i in range(0, len(image), block)]
+    acked = 0
+    replies = []
+    while True:
+        frames = b""
+        for sequence in range(acked, min(acked + window, len(blocks))):
+            frame = target.frame(None, blocks[sequence], sequence)
+            if sequence == corrupt:
+                frame = frame[:-1] + bytes([frame[-1] ^ 0xFF])
+                corrupt = None
+            frames += frame
+        target.port.write(frames)
+        reply = struct.unpack("<BHB", target.port.read(4, REPLY_TIMEOUT))
+        replies.append(reply)
+        ack, following, state = reply
+        if state != STREAM_STATE_ACTIVE:
+            return replies
+        check(len(replies) <= 2 * len(blocks), "stream makes no progress : %r" % (replies,))
+        acked = following
+
+
+def mem_write(target, address, data):
+    reply = target.command(CBL_MEM_WRITE_CMD, struct.pack("<IB", address, len(data)) + data, reply=1,
+                           timeout=REPLY_TIMEOUT)
+    return reply[0] == FLASH_PAYLOAD_WRITE_PASSED
+
+
+def slot_image(base, length, seed):
+    """an image linked for base : stack in SRAM, reset, NMI and fault handlers inside the image"""
+    handler = (base + 0x400) | 1
+    vectors = [0x20020000] + [handler if i in (1, 2, 3, 4, 5, 6, 11, 12, 14, 15) else 0 for i in range(1, 98)]
+    head = struct.pack("<98I", *vectors)
+    return head + random.Random(seed).randbytes(length - len(head))
+
+
+def write_image(target, base, image):
+    check(stream_session(target, base, len(image), 8) == STREAM_SESSION_OPENED, "session refused")
+    check(stream_image(target, image, 8)[-1][2] == STREAM_STATE_DONE, "image not written")
+
+
+def write_manifest(target, slot, base, length, image, version=1):
+    manifest = bl_manifest.build(bl_manifest.read_key(DEV_KEY), image, slot, version)
+    end = base + length - len(manifest)
+    for offset in range(0, len(manifest), 64):
+        check(mem_write(target, end + offset, manifest[offset:offset + 64]), "manifest write refused")
+
+
+def boot_slot(target):
+    return target.command(CBL_SLOT_INFO_CMD, timeout=REPLY_TIMEOUT)[0]
+
+
+def install_signed(target, slot, base, length, image, version=1):
+    """streams image into the slot, writes its manifest and commits the slot header"""
+    write_image(target, base, image)
+    write_manifest(target, slot, base, length, image, version)
+    header = struct.pack("<BIII", 0 if slot == "a" else 1, version, len(image), crc32_mpeg2(image))
+    check(target.command(CBL_SET_ACTIVE_SLOT_CMD, header, reply=1, timeout=REPLY_TIMEOUT)[0] == SLOT_ACTIVATE_DONE,
+          "slot %s not activated" % slot.upper())
+
+
+def case_stream(env):
+    sim = env.start("stream")
+    image = random.Random(1).randbytes(20000)
+    window = 8
+    check(stream_session(sim.target, SLOT_A_ADDRESS, len(image), window) == STREAM_SESSION_OPENED,
+          "session refused")
+    replies = stream_image(sim.target, image, window)
+    blocks = -(-len(image) // sim.target.max_block())
+    expected = [(BL_ACK, min((i + 1) * window, blocks), STREAM_STATE_ACTIVE)
+                for i in range(-(-blocks // window))]
+    expected[-1] = (BL_ACK, blocks, STREAM_STATE_DONE)
+    check(replies == expected, "window replies %r, expected %r" % (replies, expected))
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_A_ADDRESS, len(image)) == image, "image in flash differs")
+
+
+def case_stream_retry(env):
+    sim = env.start("stream-retry")
+    image = random.Random(2).randbytes(12000)
+    window = 8
+    check(stream_session(sim.target, SLOT_A_ADDRESS, len(image), window) == STREAM_SESSION_OPENED,
+          "session refused")
+    replies = stream_image(sim.target, image, window, corrupt=11)
+    check(replies[1][0] != BL_ACK and replies[1][1] == 11 and replies[1][2] == STREAM_STATE_ACTIVE,
+          "failed window answered %r" % (replies[1],))
+    check(replies[-1][0] == BL_ACK and replies[-1][2] == STREAM_STATE_DONE, "stream ended %r" % (replies[-1],))
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_A_ADDRESS, len(image)) == image, "image in flash differs")
+
+
+def case_stream_ahead(env):
+    sim = env.start("stream-ahead")
+    image = random.Random(10).randbytes(40 * 1024)
+    # sectors 2, 3 and 4 written before : none of them may be programmed before its erase ended
+    for address in (SLOT_A_ADDRESS, SLOT_A_ADDRESS + 0x4000, SLOT_A_ADDRESS + 0x8000):
+        check(mem_write(sim.target, address + 0x100, bytes(8)), "memory write at 0x%08X refused" % address)
+    check(stream_session(sim.target, SLOT_A_ADDRESS, len(image), 8, bytes([STREAM_FLAG_ERASE_AHEAD])) ==
+          STREAM_SESSION_OPENED, "session refused")
+    replies = stream_image(sim.target, image, 8)
+    flash = sim.stop()
+    check(all(reply[0] == BL_ACK for reply in replies), "a window was refused")
+    check(replies[-1][2] == STREAM_STATE_DONE, "session not done")
+    check(flash_range(flash, SLOT_A_ADDRESS, len(image)) == image, "image in flash differs")
+    check(" 0 refused" in sim.report, "a program operation hit unerased flash")
+
+
+def case_stream_reject(env):
+    sim = env.start("stream-reject")
+    for base, length, window in ((SLOT_A_ADDRESS, 4096, 0), (SLOT_A_ADDRESS, 4096, 33),
+                                 (SLOT_A_ADDRESS, 4098, 8), (FLASH_BASE, 4096, 8)):
+        status = stream_session(sim.target, base, length, window)
+        check(status == STREAM_SESSION_REJECTED,
+              "session at 0x%08X, %d bytes, window %d answered %d" % (base, length, window, status))
+    sim.stop()
+
+
+def firmware_image(env, name, defines=()):
+    """the bootloader sources built for the host (code only, not linked) behind a vector table linked at 0"""
+    obj = os.path.join(env.directory, name + ".o")
+    text = os.path.join(env.directory, name + ".text")
+    sources = sorted(os.path.join("Bootloader", f) for f in os.listdir(os.path.join(REPO, "Bootloader"))
+                     if f.startswith("bootloader") and f.endswith(".c"))
+    subprocess.run([os.environ.get("CC", "cc"), "-O2", "-w", "-r", "-nostdlib",
+                    "-DUSE_HAL_DRIVER", "-DSTM32F407xx", "-DBL_SECURE_BOOT_DEV_KEY",
+                    "-IHost/sim", "-IInc", "-IBootloader", "-ILed", "-IDrivers/STM32F4xx_HAL_Driver/Inc",
+                    "-IDrivers/CMSIS/Device/ST/STM32F4xx/Include", "-IDrivers/CMSIS/Include", "-o", obj]
+                   + ["-D" + define for define in defines] + sources, cwd=REPO, check=True)
+    subprocess.run([os.environ.get("OBJCOPY", "objcopy"), "-O", "binary", "-j", ".text", obj, text], check=True)
+    with open(text, "rb") as code:
+        image = slot_image(0, 392, 0) + code.read()
+    return image + b"\xff" * (-len(image) % 4)
+
+
+def delta_session(target, base, old, new, patch, old_crc=None, window=8):
+    """opens the session, old is the image that boots (or the one at base when none does)"""
+    payload = struct.pack("<6IB", base, len(old), crc32_mpeg2(old) if old_crc is None else old_crc,
+                          len(new), crc32_mpeg2(new), len(patch), window)
+    return target.command(CBL_DELTA_WRITE_CMD, payload, reply=1, timeout=REPLY_TIMEOUT)[0]
+
+
+def case_delta(env):
+    old = firmware_image(env, "delta-old")
+    new = firmware_image(env, "delta-new", ("BL_SHA256_BENCHMARK", "BL_CRC_BENCHMARK"))
+    check(old != new, "both builds are the same")
+    patch = bl_delta.build(old, new, SLOT_A_ADDRESS)
+    result, erased = bl_delta.apply(old, patch, SLOT_A_ADDRESS, len(new))
+    check(result == new, "bl_delta.py model does not rebuild the new build")
+
+    sim = env.start("delta")
+    write_image(sim.target, SLOT_A_ADDRESS, old)
+    status = delta_session(sim.target, SLOT_A_ADDRESS, old, new, patch, crc32_mpeg2(old) ^ 1)
+    check(status == STREAM_SESSION_REJECTED, "patch against the wrong old CRC answered %d" % status)
+    check(delta_session(sim.target, SLOT_A_ADDRESS, old, new, patch) == STREAM_SESSION_OPENED, "delta session refused")
+    replies = stream_image(sim.target, patch, 8)
+    check(replies[-1][0] == BL_ACK and replies[-1][2] == STREAM_STATE_DONE, "delta session ended %r" % (replies[-1],))
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_A_ADDRESS, len(new)) == new, "patched image in flash differs from the new build")
+    print("     %d byte build : patch %d bytes, %d bytes saved against a full write (%.1f %%), sectors %s"
+          % (len(new), len(patch), len(new) - len(patch), 100.0 * (len(new) - len(patch)) / len(new),
+             " ".join(str(sector) for sector in erased)))
+
+
+def case_delta_slots(env):
+    old = firmware_image(env, "delta-slots-old")
+    new = firmware_image(env, "delta-slots-new", ("BL_SHA256_BENCHMARK", "BL_CRC_BENCHMARK"))
+    patch = bl_delta.build(old, new, SLOT_B_ADDRESS, SLOT_A_ADDRESS)
+    result, erased = bl_delta.apply(old, patch, SLOT_B_ADDRESS, len(new), SLOT_A_ADDRESS)
+    check(result == new, "bl_delta.py model does not rebuild the new build")
+
+    sim = env.start("delta-slots")
+    install_signed(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, old)
+    # stale content in slot B, the patch must not depend on it
+    write_image(sim.target, SLOT_B_ADDRESS, random.Random(11).randbytes(8192))
+    in_place = bl_delta.build(old, new, SLOT_A_ADDRESS)
+    check(delta_session(sim.target, SLOT_A_ADDRESS, old, new, in_place) == STREAM_SESSION_REJECTED,
+          "patch in place over the boot slot opened")
+    status = delta_session(sim.target, SLOT_B_ADDRESS, old, new, patch, crc32_mpeg2(old) ^ 1)
+    check(status == STREAM_SESSION_REJECTED, "patch against the wrong old CRC answered %d" % status)
+    check(delta_session(sim.target, SLOT_B_ADDRESS, old, new, patch) == STREAM_SESSION_OPENED, "delta session refused")
+    replies = stream_image(sim.target, patch, 8)
+    check(replies[-1][0] == BL_ACK and replies[-1][2] == STREAM_STATE_DONE, "delta session ended %r" % (replies[-1],))
+
+    write_manifest(sim.target, "b", SLOT_B_ADDRESS, SLOT_B_LENGTH, new, 2)
+    header = struct.pack("<BIII", 1, 2, len(new), crc32_mpeg2(new))
+    check(sim.target.command(CBL_SET_ACTIVE_SLOT_CMD, header, reply=1, timeout=REPLY_TIMEOUT)[0] == SLOT_ACTIVATE_DONE,
+          "slot B not activated")
+    check(boot_slot(sim.target) == 1, "slot B does not boot")
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_B_ADDRESS, len(new)) == new, "patched image in slot B differs from the new build")
+    check(flash_range(flash, SLOT_A_ADDRESS, len(old)) == old, "slot A changed under the patch")
+    print("     slot A to slot B : patch %d bytes, %d bytes saved against a full write, sectors %s"
+          % (len(patch), len(new) - len(patch), " ".join(str(sector) for sector in erased)))
+
+
+def compressed_session(target, base, packed, length, window=8):
+    payload = struct.pack("<IIIB", base, len(packed), length, window)
+    return target.command(CBL_COMPRESSED_WRITE_CMD, payload, reply=1, timeout=REPLY_TIMEOUT)[0]
+
+
+def case_compressed(env):
+    hex_base, hex_image = bl_compress.read_image(HEX_IMAGE)
+    check(hex_base == FLASH_BASE, "%s loads at 0x%08X" % (HEX_IMAGE, hex_base))
+    path = os.path.join(env.directory, "compressed.bin")
+    with open(path, "wb") as image:
+        image.write(firmware_image(env, "compressed"))
+    _, bin_image = bl_compress.read_image(path)
+
+    # the .hex is the bootloader itself, its bytes go to slot A like any other image
+    sim = env.start("compressed")
+    sizes = []
+    for base, image in ((SLOT_A_ADDRESS, hex_image), (SLOT_B_ADDRESS, bin_image)):
+        packed = bl_compress.compress(image)
+        check(compressed_session(sim.target, base, packed, len(image)) == STREAM_SESSION_OPENED,
+              "compressed session at 0x%08X refused" % base)
+        replies = stream_image(sim.target, packed, 8)
+        check(replies[-1][0] == BL_ACK and replies[-1][2] == STREAM_STATE_DONE,
+              "compressed session at 0x%08X ended %r" % (base, replies[-1]))
+        sizes.append((len(image), len(packed)))
+
+    # one byte flipped in the stream of the .hex, which does not change between runs : it decodes to
+    # 12686 bytes instead of the announced 12680
+    packed = bytearray(bl_compress.compress(hex_image))
+    packed[len(packed) // 2] ^= 0x5A
+    check(compressed_session(sim.target, SLOT_B_ADDRESS + 0x40000, packed, len(hex_image)) == STREAM_SESSION_OPENED,
+          "corrupted session refused")
+    replies = stream_image(sim.target, bytes(packed), 8)
+    check(replies[-1][0] == BL_NACK and replies[-1][2] == STREAM_STATE_ABORTED,
+          "corrupted stream ended %r" % (replies[-1],))
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_A_ADDRESS, len(hex_image)) == hex_image, ".hex image in flash differs")
+    check(flash_range(flash, SLOT_B_ADDRESS, len(bin_image)) == bin_image, ".bin image in flash differs")
+    for name, (length, packed_length) in zip((".hex", ".bin"), sizes):
+        print("     %s : %d bytes sent for a %d byte image (%.1f %%)"
+              % (name, packed_length, length, 100.0 * packed_length / length))
+
+
+def erase(target, first, count):
+    return target.command(CBL_FLASH_ERASE_CMD, bytes([first, count]), reply=1, timeout=REPLY_TIMEOUT)[0]
+
+
+def case_erase_bounds(env):
+    sim = env.start("erase-bounds")
+    for first, count in ((0, 1), (1, 1), (0, 12), (11, 1), (10, 1), (10, 2), (9, 2), (1, 3), (2, 0)):
+        status = erase(sim.target, first, count)
+        check(status == ERASE_REFUSED, "erase of %d sectors from %d answered 0x%02X" % (count, first, status))
+    check(mem_write(sim.target, SLOT_B_ADDRESS + 0x40000, bytes(8)), "memory write into slot B refused")
+    check(erase(sim.target, 9, 1) == ERASE_DONE, "erase of sector 9 refused")
+    check(erase(sim.target, 2, 1) == ERASE_DONE, "erase of sector 2 refused with no slot booting")
+
+    # slot A boots from here on : its sectors are refused as writes are, slot B is still erased
+    install_signed(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, slot_image(SLOT_A_ADDRESS, 4096, 12))
+    for first, count in ((2, 1), (6, 2), (4, 6)):
+        status = erase(sim.target, first, count)
+        check(status == ERASE_REFUSED, "erase of %d sectors from %d in the boot slot answered 0x%02X"
+              % (count, first, status))
+    check(mem_write(sim.target, SLOT_B_ADDRESS, bytes(8)), "memory write into slot B refused")
+    check(erase(sim.target, 7, 1) == ERASE_DONE, "erase of sector 7 refused")
+    check(boot_slot(sim.target) == 0, "slot A lost")
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_B_ADDRESS + 0x40000, 8) == b"\xff" * 8, "sector 9 not erased")
+    check(flash_range(flash, SLOT_B_ADDRESS, 8) == b"\xff" * 8, "sector 7 not erased")
+
+
+def case_legacy_boot(env):
+    sim = env.start("legacy-boot")
+    image = slot_image(SLOT_A_ADDRESS, 4096, 6)
+    write_image(sim.target, SLOT_A_ADDRESS, image)
+    check(boot_slot(sim.target) == SLOT_NONE, "unsigned image in slot A boots")
+    write_manifest(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, image)
+    check(boot_slot(sim.target) == 0, "signed image in slot A does not boot")
+    sim.stop()
+
+
+def flash_patch(image, address, data):
+    offset = address - FLASH_BASE
+    return image[:offset] + data + image[offset + len(data):]
+
+
+def case_fast_boot(env):
+    image = slot_image(SLOT_A_ADDRESS, 4096, 9)
+    sim = env.start("fast-boot-install")
+    install_signed(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, image)
+    flash = sim.stop()
+
+    sim = env.start("fast-boot", flash=flash, link=False)
+    sim.process.wait(timeout=30)
+    sim.stop()
+    check("jump to 0x%08X" % ((SLOT_A_ADDRESS + 0x400) | 1) in sim.report, "signed image not started : %s" % sim.report.strip())
+
+    # one byte of the image changed after the commit : the manifest digest no longer matches
+    flash = flash_patch(flash, SLOT_A_ADDRESS + 2048, bytes([flash_range(flash, SLOT_A_ADDRESS + 2048, 1)[0] ^ 0xFF]))
+    sim = env.start("fast-boot-corrupt", flash=flash)
+    check(boot_slot(sim.target) == SLOT_NONE, "corrupted image still selected")
+    sim.stop()
+
+
+def case_compact_resume(env):
+    sim = env.start("compact-resume-install")
+    install_signed(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, slot_image(SLOT_A_ADDRESS, 4096, 7))
+    flash = sim.stop()
+    record = flash_range(flash, SLOT_TABLE_ADDRESS, SLOT_RECORD_LEN)
+
+    # half of a journaled session into slot B, then the reset right after the slot table sector was erased
+    data = random.Random(8).randbytes(4096)
+    header = struct.pack("<7I", JOURNAL_HEADER_MAGIC, 0x1234, SLOT_B_ADDRESS, 8192, 0x55AA55AA, 0xFFFFFFFF, 0xFFFFFFFF)
+    header += struct.pack("<I", crc32_mpeg2(header))
+    stage = struct.pack("<II", SLOT_STAGE_MAGIC, len(data)) + record + bytes(SLOT_RECORD_LEN) + header
+    stage += struct.pack("<I", 0xFFFFFFFF)
+    stage += struct.pack("<I", crc32_mpeg2(stage))
+    flash = flash_patch(flash, SLOT_B_ADDRESS, data)
+    flash = flash_patch(flash, SCRATCH_ADDRESS, stage)
+    flash = flash_patch(flash, SLOT_TABLE_ADDRESS, b"\xff" * (SLOT_TABLE_LENGTH + 0x4000))
+
+    sim = env.start("compact-resume", ["--button"], flash)
+    check(boot_slot(sim.target) == 0, "slot A lost with the compaction")
+    reply = sim.target.command(CBL_JOURNAL_QUERY_CMD, timeout=REPLY_TIMEOUT)
+    state, session, base, length, _, verified = struct.unpack("<BIIIII", reply)
+    check((state, session, base, length, verified) == (JOURNAL_STATE_PARTIAL, 0x1234, SLOT_B_ADDRESS, 8192, len(data)),
+          "journal session not restored : %s" % reply.hex())
+    flash = sim.stop()
+    check(flash_range(flash, SLOT_TABLE_ADDRESS, SLOT_RECORD_LEN) == record, "slot A record not written back")
+    check(flash_range(flash, JOURNAL_ADDRESS, len(header)) == header, "journal header not written back")
+    check(flash_range(flash, SCRATCH_ADDRESS, 4) == bytes(4), "stage not retired")
+
+
+def case_dfu_commit(env):
+    image = slot_image(SLOT_A_ADDRESS, 4096, 10)
+    manifest = bl_manifest.build(bl_manifest.read_key(DEV_KEY), image, "a", 3)
+    path = os.path.join(env.directory, "dfu-commit-image.bin")
+    with open(path, "wb") as download:
+        download.write(image + b"\xff" * (SLOT_A_LENGTH - len(image) - len(manifest)) + manifest)
+
+    sim = env.start("dfu-commit", ["--dfu", "%s@0x%08X" % (path, SLOT_A_ADDRESS)], link=False)
+    sim.process.wait(timeout=60)
+    flash = sim.stop()
+    check("jump to 0x%08X" % ((SLOT_A_ADDRESS + 0x400) | 1) in sim.report, "image not started : %s" % sim.report.strip())
+    record = flash_range(flash, SLOT_TABLE_ADDRESS, SLOT_RECORD_LEN)
+    magic, _, version, length, image_crc, slot, _ = struct.unpack_from("<5IBB", record)
+    check((magic, version, length, image_crc, slot) == (SLOT_RECORD_MAGIC, 3, len(image), crc32_mpeg2(image), 0),
+          "slot record %s" % record.hex())
+
+
+def case_hash(env):
+    sim = env.start("hash")
+    image = random.Random(5).randbytes(4096)
+    check(stream_session(sim.target, SLOT_A_ADDRESS, len(image), 8) == STREAM_SESSION_OPENED, "session refused")
+    stream_image(sim.target, image, 8)
+    region = struct.pack("<II", SLOT_A_ADDRESS, len(image))
+    for sid in (CBL_IMAGE_HASH_CMD, CBL_MEM_HASH_CMD):
+        reply = sim.target.command(sid, region)
+        check(reply == struct.pack("<I", crc32_mpeg2(image)), "command 0x%02X answered %s" % (sid, reply.hex()))
+    sram = struct.pack("<II", 0x20000000, 256)
+    check(len(sim.target.command(CBL_MEM_HASH_CMD, sram)) == 4, "SRAM memory hash refused")
+    try:
+        sim.target.command(CBL_IMAGE_HASH_CMD, sram)
+        check(False, "SRAM image hash answered")
+    except IOError:
+        pass
+    sim.stop()
+
+
+def case_slot_bounds(env):
+    sim = env.start("slot-bounds")
+    for base, length in ((SLOT_A_ADDRESS, SLOT_A_LENGTH + 4), (SLOT_B_ADDRESS + SLOT_B_LENGTH - 4096, 8192),
+                         (SCRATCH_ADDRESS, 4096), (SLOT_TABLE_ADDRESS, 4096)):
+        status = stream_session(sim.target, base, length, 8)
+        check(status == STREAM_SESSION_REJECTED, "session at 0x%08X, %d bytes answered %d" % (base, length, status))
+    for address, length in ((FLASH_BASE + 0x4000, 4), (SCRATCH_ADDRESS, 4), (SLOT_TABLE_ADDRESS, 4),
+                            (SLOT_B_ADDRESS + SLOT_B_LENGTH - 4, 8)):
+        check(not mem_write(sim.target, address, bytes(length)), "memory write at 0x%08X accepted" % address)
+    check(mem_write(sim.target, SLOT_B_ADDRESS, bytes(8)), "memory write into slot B refused")
+
+    # slot A boots from here on : updates go to slot B only
+    install_signed(sim.target, "a", SLOT_A_ADDRESS, SLOT_A_LENGTH, slot_image(SLOT_A_ADDRESS, 4096, 4))
+    check(not mem_write(sim.target, SLOT_A_ADDRESS + 0x2000, bytes(4)), "memory write into the boot slot accepted")
+    check(stream_session(sim.target, SLOT_A_ADDRESS + 0x4000, 4096, 8) == STREAM_SESSION_REJECTED,
+          "session into the boot slot opened")
+    check(stream_session(sim.target, SLOT_B_ADDRESS + 0x4000, 4096, 8) == STREAM_SESSION_OPENED,
+          "session into slot B refused")
+    sim.stop()
+
+
+def case_bench_status(env):
+    sim = env.start("bench-status")
+    sim.target.bench_read(reset=True)
+    sim.target.command(CBL_GET_VER_CMD)
+    sim.target.port.write(sim.target.frame(CBL_GET_VER_CMD, b"\x00"))
+    check(sim.target.port.read(1, REPLY_TIMEOUT)[0] == BL_NACK, "bad length not refused")
+    records, _ = sim.target.bench_read()
+    sim.stop()
+    statuses = [r[2] for r in records if (r[1] == BENCH_KIND_COMMAND) and (r[0] == CBL_GET_VER_CMD)]
+    check(statuses == [BL_ACK, BL_NACK], "recorded statuses %s" % statuses)
+
+
+def stall(target):
+    """half a frame, then a quiet line past the interframe timeout"""
+    frame = target.frame(CBL_GET_VER_CMD, b"")
+    target.port.write(frame[:len(frame) // 2])
+    time.sleep(INTERFRAME_S * 3)
+
+
+def case_rx_stall(env):
+    sim = env.start("rx-stall")
+    sim.target.negotiate_v2()
+    version = sim.target.command(CBL_GET_VER_CMD)
+    for count in range(1, RX_MAX_STALLS):
+        stall(sim.target)
+        check(sim.target.command(CBL_GET_VER_CMD) == version, "v2 frame refused after %d stall(s)" % count)
+
+    # stalls in a row are what a host that restarted on v1 frames looks like : the device goes back to v1
+    for _ in range(RX_MAX_STALLS):
+        stall(sim.target)
+    sim.target.format = FORMAT_V1
+    check(sim.target.command(CBL_GET_VER_CMD) == version, "v1 frame refused after %d stalls" % RX_MAX_STALLS)
+    sim.stop()
+
+
+def case_rx_rates(env):
+    probe = env.start("rx-rates")
+    reply = probe.target.command(CBL_SET_BAUD_CMD, struct.pack("<I", 0))
+    rates = [struct.unpack_from("<I", reply, 2 + 4 * i)[0] for i in range(reply[1])]
+    probe.stop()
+    check(rates, "the device offers no link rates")
+
+    image = random.Random(3).randbytes(8192)
+    window = 8
+    for rate in rates:
+        sim = env.start("rx-%d" % rate)
+        try:
+            sim.target.negotiate_baud(rate)
+        except IOError as error:
+            sim.stop()
+            if "termios" in str(error):
+                continue
+            raise
+        sim.target.bench_read(reset=True)
+        check(stream_session(sim.target, SLOT_A_ADDRESS, len(image), window) == STREAM_SESSION_OPENED,
+              "session refused at %d baud" % rate)
+        replies = stream_image(sim.target, image, window)
+        check(all(ack == BL_ACK for ack, _, _ in replies), "%d baud : a window failed %r" % (rate, replies))
+        records, lost = sim.target.bench_read()
+        flash = sim.stop()
+        check("0 lost" in sim.report, "%d baud : the receive ring lost bytes" % rate)
+        check(flash_range(flash, SLOT_A_ADDRESS, len(image)) == image, "%d baud : image in flash differs" % rate)
+        check(not lost, "%d baud : bench records lost" % rate)
+
+        # blocks of one window : each completes one wire time after the one before it, or once the
+        # one before it is programmed when that takes longer, never the two added up
+        blocks = [r for r in records if r[1] == BENCH_KIND_BLOCK]
+        wire = 0.0
+        span = 0.0
+        for previous, block in zip(blocks, blocks[1:]):
+            if block[5] % window == 0:
+                continue
+            gap = ((block[6] - previous[6]) & 0xFFFFFFFF) / CORE_CLOCK
+            frame = block[4] * BITS_PER_BYTE / rate
+            busy = ((previous[8] - previous[6]) & 0xFFFFFFFF) / CORE_CLOCK if previous[8] else 0.0
+            check(gap < max(frame, busy) * 1.1,
+                  "%d baud : block %d completed %.0f us after the one before, %.0f us on the wire, %.0f us programming"
+                  % (rate, block[5], gap * 1e6, frame * 1e6, busy * 1e6))
+            wire += frame
+            span += gap
+        print("     %8d baud : link busy %.1f %% of each window" % (rate, 100.0 * wire / span))
+
+
+CASES = {
+    "stream": case_stream,
+    "stream-retry": case_stream_retry,
+    "stream-ahead": case_stream_ahead,
+    "stream-reject": case_stream_reject,
+    "delta": case_delta,
+    "delta-slots": case_delta_slots,
+    "compressed": case_compressed,
+    "erase-bounds": case_erase_bounds,
+    "legacy-boot": case_legacy_boot,
+    "fast-boot": case_fast_boot,
+    "compact-resume": case_compact_resume,
+    "dfu-commit": case_dfu_commit,
+    "hash": case_hash,
+    "slot-bounds": case_slot_bounds,
+    "bench-status": case_bench_status,
+    "rx-stall": case_rx_stall,
+    "rx-rates": case_rx_rates,
+}
+
+
+class Env:
+    def __init__(self, binary, directory):
+        self.binary = binary
+        self.directory = directory
+        self.sims = []
+
+    def start(self, name, args=(), flash=None, link=True):
+        sim = Sim(self.binary, self.directory, name, args, flash, link)
+        self.sims.append(sim)
+        return sim
+
+    def cleanup(self):
+        for sim in self.sims:
+            if sim.process.poll() is None:
+                sim.process.kill()
+                sim.process.wait()
+        self.sims = []
+
+
+def main(argv):
+    binary = "./bl_sim"
+    keep = None
+    names = []
+    args = iter(argv[1:])
+    for arg in args:
+        if arg == "--sim":
+            binary = next(args)
+        elif arg == "--keep":
+            keep = next(args)
+        elif arg in CASES:
+            names.append(arg)
+        else:
+            sys.stderr.write(__doc__)
+            return 2
+
+    directory = keep or tempfile.mkdtemp(prefix="bl_sim_test.")
+    os.makedirs(directory, exist_ok=True)
+    failed = 0
+    env = Env(binary, directory)
+    for name in names or list(CASES):
+        try:
+            CASES[name](env)
+            print("PASS %s" % name)
+        except (TestFailure, IOError, subprocess.TimeoutExpired) as error:
+            print("FAIL %s : %s" % (name, error))
+            failed += 1
+        finally:
+            env.cleanup()
+    if keep is None:
+        shutil.rmtree(directory)
+    print("%d of %d cases failed" % (failed, len(names or CASES)))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,105 @@
+/*
+ * Machine interface of the bl_sim host build.
+ *
+ * Host/bl_sim.c is the machine : the STM32F407 memory map, the virtual
+ * clock, the host link on a pseudo-terminal and the interrupt lines.
+ * Host/sim/bl_sim_hal.c is the fake HAL the unmodified firmware links
+ * against, built on the calls below.  Host/sim/bl_sim_dfu.c is the DfuSe
+ * host the fake USB core takes its requests from with --dfu.
+ */
+
+#ifndef BL_SIM_H__
+#define BL_SIM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+/* memory map, every region sits at its STM32F407 address */
+#define SIM_FLASH_BASE							0x08000000U
+#define SIM_FLASH_LEN								0x00100000U
+#define SIM_CCM_BASE								0x10000000U
+#define SIM_CCM_LEN									0x00010000U
+#define SIM_SYSTEM_BASE							0x1FFF0000U
+#define SIM_SYSTEM_LEN							0x00010000U
+#define SIM_SRAM_BASE								0x20000000U
+#define SIM_SRAM_LEN								0x0001F000U		/* the last page holds .bss.noinit, placed by the linker */
+#define SIM_PERIPH_BASE							0x40000000U
+#define SIM_PERIPH_LEN							0x00080000U
+#define SIM_AHB2_BASE								0x50000000U
+#define SIM_AHB2_LEN								0x00061000U
+#define SIM_PPB_BASE								0xE0000000U
+#define SIM_PPB_LEN									0x00100000U
+
+/* CRC, RCC and FLASH registers share this page, it is trapped so their side effects can be modelled */
+#define SIM_TRAP_PAGE								0x40023000U
+
+/* timing from the STM32F407 datasheet, typical values */
+#define SIM_PROGRAM_NS							16000U				/* one program operation, x8 to x32 */
+#define SIM_DMA_WORD_CYCLES					4U						/* memory to CRC unit, read and write on the AHB */
+#define SIM_TICK_CALL_NS						100U					/* a HAL_GetTick call, keeps spin loops on the tick moving */
+#define SIM_USB_PACKET_NS						52600U				/* 64 byte bulk packet, about 19 fit a 1 ms full speed frame */
+#define SIM_USB_STAGE_NS						1000000U			/* one control transfer stage per frame */
+#define SIM_USB_ATTACH_NS						100000000U		/* attach debounce before the host resets the device */
+
+/* interrupt lines the fake HAL raises, served in this order */
+#define SIM_IRQ_HOST_RX							0x01U
+#define SIM_IRQ_FLASH								0x02U
+#define SIM_IRQ_LOG_TX							0x04U
+#define SIM_IRQ_USB									0x08U
+#define SIM_IRQ_LINES								4U
+
+/* register accesses from the fake HAL go through this alias, the firmware's view of the trap page faults */
+#define SIM_REG(reg)								(*(__typeof__(reg) *)sim_periph_alias((const volatile void *)&(reg)))
+
+/* clock */
+uint64_t sim_now_ns(void);
+void sim_advance_ns(uint64_t ns);
+void sim_advance_cycles(uint64_t cycles);
+uint32_t sim_tick_ms(void);
+
+/* interrupts */
+uint32_t sim_primask(void);
+void sim_set_primask(uint32_t primask);
+void sim_raise(uint32_t irq);
+void sim_raise_at(uint32_t irq, uint64_t dueNs);
+void sim_poll(void);
+void sim_wait(void);
+
+/* memory */
+volatile void *sim_periph_alias(const volatile void *reg);
+uint8_t *sim_flash_alias(uint32_t address);
+uint32_t sim_crc_word(uint32_t crc, uint32_t word);
+void sim_count_erase(uint32_t bytes);
+int sim_code_in_ram(const void *pc);
+void sim_flash_busy(uint64_t ns, int fromRam);
+
+/* host link */
+void sim_link_send(const uint8_t *data, size_t length);
+void sim_link_rx_start(UART_HandleTypeDef *huart, uint8_t *ring, uint16_t length);
+void sim_link_rx_stop(void);
+UART_HandleTypeDef *sim_link_uart(void);
+int sim_link_is_usb(void);
+
+/* debug log */
+void sim_log_send(const uint8_t *data, size_t length);
+
+/* end of the run, the same report as a jump or a fault */
+void sim_finish(const char *reason, int status) __attribute__((noreturn));
+
+/* timing knobs set on the command line */
+uint64_t sim_erase_ns(uint32_t sectorBytes, uint32_t voltageRange);
+
+/* fake HAL side : interrupt handlers, the wire time of one character and the USB data OUT endpoint */
+void sim_hal_irq(uint32_t irq);
+uint64_t sim_hal_byte_ns(const UART_HandleTypeDef *huart);
+int sim_hal_usb_out_ready(uint64_t *armedNs);
+void sim_hal_usb_out(const uint8_t *data, uint32_t length, uint64_t dueNs);
+
+/* DfuSe host : control requests once the device is enumerated, and their outcome */
+int sim_dfu_load(const char *path, uint32_t address);
+int sim_dfu_active(void);
+int sim_dfu_request(uint8_t setup[8], const uint8_t **data, uint64_t *delayNs);
+void sim_dfu_reply(const uint8_t *reply, uint32_t length, int stalled);
+
+#endif /*BL_SIM_H__*/
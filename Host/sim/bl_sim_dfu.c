@@ -0,0 +1,376 @@
+/*
+ * Scripted DfuSe host for the bl_sim host build (--dfu FILE[@ADDRESS]).
+ *
+ * Once the fake USB core in Host/sim/bl_sim_hal.c has enumerated the
+ * device, its control requests come from here and do what
+ *
+ *   dfu-util -a 0 -s ADDRESS:leave -D FILE
+ *
+ * does against the DFU interface : read the alt setting's memory layout,
+ * erase every sector the image touches, download the image in
+ * wTransferSize blocks polling GETSTATUS and waiting the poll timeouts the
+ * device reports, then read it back with UPLOAD and compare before
+ * leaving.  The firmware committing the slot and starting it ends the run
+ * with the usual jump report ; a DFU error, a stall or a mismatch ends it
+ * with exit status 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bl_sim.h"
+#include "bootloader_dfu.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+#define DFU_MAX_SECTORS							32U
+#define DFU_LEAVE_WAIT_NS						2000000000ULL		/* the device should be gone by then */
+
+typedef enum
+{
+	DFU_PHASE_LAYOUT,
+	DFU_PHASE_ERASE,
+	DFU_PHASE_ADDRESS,
+	DFU_PHASE_DOWNLOAD,
+	DFU_PHASE_VERIFY_ADDRESS,
+	DFU_PHASE_VERIFY_ABORT,
+	DFU_PHASE_UPLOAD,
+	DFU_PHASE_UPLOAD_ABORT,
+	DFU_PHASE_LEAVE_ADDRESS,
+	DFU_PHASE_LEAVE,
+	DFU_PHASE_LEAVE_STATUS,
+	DFU_PHASE_LEAVE_CHECK,
+	DFU_PHASE_DONE
+} DfuPhase;
+
+static const char *dfuPhaseName[] = {
+	"layout", "erase", "set address", "download", "set address", "abort",
+	"upload", "abort", "set address", "leave", "leave", "leave", "done"
+};
+
+static struct
+{
+	int active;
+	uint8_t *image;
+	uint32_t length;
+	uint32_t address;
+	DfuPhase phase;
+	uint32_t index;
+	int polling;
+	uint32_t pollMs;
+	uint32_t polls;
+	uint8_t command[5];
+	uint32_t sectorStart[DFU_MAX_SECTORS];
+	uint32_t sectorSize[DFU_MAX_SECTORS];
+	uint32_t sectors;
+	uint64_t phaseNs;
+} dfu;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static void dfu_setup(uint8_t setup[8], uint8_t type, uint8_t request, uint16_t value, uint16_t length);
+static const uint8_t *dfu_command(uint8_t command, uint32_t address);
+static uint32_t dfu_blocks(void);
+static void dfu_layout(const uint8_t *descriptor, uint32_t length);
+static void dfu_advance(void);
+static void dfu_fail(const char *what, const uint8_t *status);
+
+/* Software Interface Definitions ---------------------------------------------*/
+
+int sim_dfu_load(const char *path, uint32_t address)
+{
+	FILE *file = fopen(path, "rb");
+	long length;
+
+	if((NULL == file) || (0 != fseek(file, 0, SEEK_END)) || ((length = ftell(file)) <= 0) || (0 != fseek(file, 0, SEEK_SET)))
+	{
+		if(file)
+		{
+			fclose(file);
+		}
+		return -1;
+	}
+	dfu.image = malloc((size_t)length);
+	if((NULL == dfu.image) || (1 != fread(dfu.image, (size_t)length, 1, file)))
+	{
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	dfu.length = (uint32_t)length;
+	dfu.address = address;
+	dfu.phase = DFU_PHASE_LAYOUT;
+	dfu.active = 1;
+	return 0;
+}
+
+int sim_dfu_active(void)
+{
+	return dfu.active;
+}
+
+int sim_dfu_request(uint8_t setup[8], const uint8_t **data, uint64_t *delayNs)
+{
+	uint32_t offset = dfu.index * BL_DFU_TRANSFER_SIZE;
+
+	*data = NULL;
+	*delayNs = 0;
+	if(!dfu.active || (DFU_PHASE_DONE == dfu.phase))
+	{
+		return 0;
+	}
+
+	/*	after a download : GETSTATUS until the device is idle again, waiting the poll timeout it asked for	*/
+	if(dfu.polling)
+	{
+		*delayNs = (uint64_t)dfu.pollMs * 1000000ULL;
+		dfu_setup(setup, 0xA1, BL_DFU_REQ_GETSTATUS, 0, 6);
+		return 1;
+	}
+
+	switch(dfu.phase)
+	{
+		case( DFU_PHASE_LAYOUT ):
+			/*	the alt setting's string, English (US)	*/
+			dfu_setup(setup, 0x80, 0x06, 0x0300U | BL_DFU_STRING_INDEX, 0xFF);
+			setup[4] = 0x09;
+			setup[5] = 0x04;
+			break;
+		case( DFU_PHASE_ERASE ):
+			*data = dfu_command(BL_DFU_CMD_ERASE, dfu.sectorStart[dfu.index]);
+			dfu_setup(setup, 0x21, BL_DFU_REQ_DNLOAD, 0, 5);
+			break;
+		case( DFU_PHASE_ADDRESS ):
+		case( DFU_PHASE_VERIFY_ADDRESS ):
+		case( DFU_PHASE_LEAVE_ADDRESS ):
+			*data = dfu_command(BL_DFU_CMD_SET_ADDRESS, dfu.address);
+			dfu_setup(setup, 0x21, BL_DFU_REQ_DNLOAD, 0, 5);
+			break;
+		case( DFU_PHASE_DOWNLOAD ):
+			*data = &dfu.image[offset];
+			dfu_setup(setup, 0x21, BL_DFU_REQ_DNLOAD, (uint16_t)(2U + dfu.index),
+								(uint16_t)(((dfu.length - offset) < BL_DFU_TRANSFER_SIZE) ? (dfu.length - offset) : BL_DFU_TRANSFER_SIZE));
+			break;
+		case( DFU_PHASE_VERIFY_ABORT ):
+		case( DFU_PHASE_UPLOAD_ABORT ):
+			dfu_setup(setup, 0x21, BL_DFU_REQ_ABORT, 0, 0);
+			break;
+		case( DFU_PHASE_UPLOAD ):
+			dfu_setup(setup, 0xA1, BL_DFU_REQ_UPLOAD, (uint16_t)(2U + dfu.index), BL_DFU_TRANSFER_SIZE);
+			break;
+		case( DFU_PHASE_LEAVE ):
+			/*	zero length download : manifestation, the device commits and starts the image	*/
+			dfu_setup(setup, 0x21, BL_DFU_REQ_DNLOAD, 0, 0);
+			break;
+		case( DFU_PHASE_LEAVE_STATUS ):
+			dfu_setup(setup, 0xA1, BL_DFU_REQ_GETSTATUS, 0, 6);
+			break;
+		case( DFU_PHASE_LEAVE_CHECK ):
+			*delayNs = DFU_LEAVE_WAIT_NS;
+			dfu_setup(setup, 0xA1, BL_DFU_REQ_GETSTATUS, 0, 6);
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+void sim_dfu_reply(const uint8_t *reply, uint32_t length, int stalled)
+{
+	uint32_t offset = dfu.index * BL_DFU_TRANSFER_SIZE;
+
+	if(stalled)
+	{
+		dfu_fail("stalled", NULL);
+	}
+
+	if(dfu.polling)
+	{
+		if((length < 6U) || (BL_DFU_STATUS_OK != reply[0]) || (BL_DFU_STATE_ERROR == reply[4]))
+		{
+			dfu_fail("failed", reply);
+		}
+		dfu.polls++;
+		dfu.pollMs = (uint32_t)(reply[1] | (reply[2] << 8) | (reply[3] << 16));
+		if(BL_DFU_STATE_DNLOAD_IDLE == reply[4])
+		{
+			dfu.polling = 0;
+			dfu_advance();
+		}
+		return;
+	}
+
+	switch(dfu.phase)
+	{
+		case( DFU_PHASE_LAYOUT ):
+			dfu_layout(reply, length);
+			dfu_advance();
+			break;
+		case( DFU_PHASE_ERASE ):
+		case( DFU_PHASE_ADDRESS ):
+		case( DFU_PHASE_DOWNLOAD ):
+		case( DFU_PHASE_VERIFY_ADDRESS ):
+		case( DFU_PHASE_LEAVE_ADDRESS ):
+			dfu.polling = 1;
+			dfu.pollMs = 0;
+			break;
+		case( DFU_PHASE_UPLOAD ):
+		{
+			uint32_t expected = ((dfu.length - offset) < BL_DFU_TRANSFER_SIZE) ? (dfu.length - offset) : BL_DFU_TRANSFER_SIZE;
+			if((length < expected) || (0 != memcmp(reply, &dfu.image[offset], expected)))
+			{
+				fprintf(stderr, "bl_sim: DFU upload of 0x%08X differs from the image\n", dfu.address + offset);
+				sim_finish("DFU verify failed", 1);
+			}
+			dfu_advance();
+			break;
+		}
+		case( DFU_PHASE_LEAVE_STATUS ):
+			if((length < 6U) || (BL_DFU_STATE_MANIFEST != reply[4]))
+			{
+				dfu_fail("did not start manifestation", reply);
+			}
+			dfu_advance();
+			break;
+		case( DFU_PHASE_LEAVE_CHECK ):
+			dfu_fail("still answers after leave", reply);
+			break;
+		default:
+			dfu_advance();
+			break;
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static void dfu_setup(uint8_t setup[8], uint8_t type, uint8_t request, uint16_t value, uint16_t length)
+{
+	setup[0] = type;
+	setup[1] = request;
+	setup[2] = (uint8_t)value;
+	setup[3] = (uint8_t)(value >> 8);
+	setup[4] = BL_DFU_INTERFACE;
+	setup[5] = 0;
+	setup[6] = (uint8_t)length;
+	setup[7] = (uint8_t)(length >> 8);
+}
+
+static const uint8_t *dfu_command(uint8_t command, uint32_t address)
+{
+	dfu.command[0] = command;
+	dfu.command[1] = (uint8_t)address;
+	dfu.command[2] = (uint8_t)(address >> 8);
+	dfu.command[3] = (uint8_t)(address >> 16);
+	dfu.command[4] = (uint8_t)(address >> 24);
+	return dfu.command;
+}
+
+static uint32_t dfu_blocks(void)
+{
+	return (dfu.length + BL_DFU_TRANSFER_SIZE - 1U) / BL_DFU_TRANSFER_SIZE;
+}
+
+static void dfu_layout(const uint8_t *descriptor, uint32_t length)
+{
+	/*	"@Internal Flash  /0x08000000/02*016Ka,02*016Kg,..." : keep the sectors the image touches, all erasable	*/
+	char text[128];
+	const char *cursor;
+	uint32_t count = 0, base, end = dfu.address + dfu.length;
+
+	for(uint32_t i = 2; (i + 1U < length) && (count + 1U < sizeof(text)); i += 2)
+	{
+		text[count++] = (char)descriptor[i];
+	}
+	text[count] = '\0';
+	fprintf(stderr, "bl_sim: DFU alt 0 \"%s\"\n", text);
+
+	cursor = strchr(text, '/');
+	if((NULL == cursor) || (1 != sscanf(cursor, "/0x%x/", &base)) || (NULL == (cursor = strchr(cursor + 1, '/'))))
+	{
+		sim_finish("DFU memory layout not understood", 1);
+	}
+	for(cursor++; *cursor; )
+	{
+		unsigned int sectors, size;
+		char unit, type;
+		int used = 0;
+
+		if(4 != sscanf(cursor, "%u*%u%c%c%n", &sectors, &size, &unit, &type, &used))
+		{
+			sim_finish("DFU memory layout not understood", 1);
+		}
+		size *= ('K' == unit) ? 1024U : (('M' == unit) ? 1048576U : 1U);
+		for(uint32_t i = 0; i < sectors; i++, base += size)
+		{
+			if((base >= end) || ((base + size) <= dfu.address))
+			{
+				continue;
+			}
+			/*	bit 1 of the type letter : erasable, bit 2 : writable	*/
+			if((6 != ((type - 'a' + 1) & 6)) || (dfu.sectors >= DFU_MAX_SECTORS))
+			{
+				fprintf(stderr, "bl_sim: DFU sector at 0x%08X is not writable\n", base);
+				sim_finish("DFU image outside the writable sectors", 1);
+			}
+			dfu.sectorStart[dfu.sectors] = base;
+			dfu.sectorSize[dfu.sectors] = size;
+			dfu.sectors++;
+		}
+		cursor += used;
+		cursor += (',' == *cursor) ? 1 : 0;
+	}
+	if((0U == dfu.sectors) || (dfu.sectorStart[0] > dfu.address) ||
+		 ((dfu.sectorStart[dfu.sectors - 1U] + dfu.sectorSize[dfu.sectors - 1U]) < end))
+	{
+		sim_finish("DFU image outside the flash", 1);
+	}
+}
+
+static void dfu_advance(void)
+{
+	double seconds = (double)(sim_now_ns() - dfu.phaseNs) / 1e9;
+
+	/*	next sector or block of the same phase, otherwise the next phase	*/
+	dfu.index++;
+	if(((DFU_PHASE_ERASE == dfu.phase) && (dfu.index < dfu.sectors)) ||
+		 (((DFU_PHASE_DOWNLOAD == dfu.phase) || (DFU_PHASE_UPLOAD == dfu.phase)) && (dfu.index < dfu_blocks())))
+	{
+		return;
+	}
+
+	switch(dfu.phase)
+	{
+		case( DFU_PHASE_ERASE ):
+			fprintf(stderr, "bl_sim: DFU erased %u sectors in %.3f s\n", dfu.sectors, seconds);
+			break;
+		case( DFU_PHASE_DOWNLOAD ):
+			fprintf(stderr, "bl_sim: DFU downloaded %u bytes to 0x%08X in %.3f s (%.1f KB/s, %u status polls)\n",
+							dfu.length, dfu.address, seconds, (double)dfu.length / 1024.0 / seconds, dfu.polls);
+			break;
+		case( DFU_PHASE_UPLOAD ):
+			fprintf(stderr, "bl_sim: DFU upload matches the image, %.3f s\n", seconds);
+			break;
+		default:
+			break;
+	}
+	if((DFU_PHASE_LAYOUT == dfu.phase) || (DFU_PHASE_ERASE == dfu.phase) || (DFU_PHASE_DOWNLOAD == dfu.phase) ||
+		 (DFU_PHASE_UPLOAD == dfu.phase))
+	{
+		dfu.phaseNs = sim_now_ns();
+		dfu.polls = 0;
+	}
+	dfu.phase++;
+	dfu.index = 0;
+}
+
+static void dfu_fail(const char *what, const uint8_t *status)
+{
+	char reason[96];
+
+	if(NULL != status)
+	{
+		fprintf(stderr, "bl_sim: DFU status %u, state %u\n", status[0], status[4]);
+	}
+	snprintf(reason, sizeof(reason), "DFU %s %s", dfuPhaseName[dfu.phase], what);
+	sim_finish(reason, 1);
+}
@@ -0,0 +1,1039 @@
+/*
+ * Fake STM32F4 HAL for the bl_sim host build.
+ *
+ * Provides every HAL and CMSIS entry point the bootloader, the CubeMX
+ * init code and Led/led.c call, with the behaviour the firmware relies
+ * on and the timing of the real part :
+ *
+ *   HAL_UART_*         host link on the machine's pseudo-terminal, DMA
+ *                      reception into the firmware's own ring, TX time
+ *                      from the configured baud rate and frame format
+ *   HAL_FLASH*_*       erase of the flash image through the machine's
+ *                      alias, datasheet erase times, option bytes read
+ *                      back from FLASH->OPTCR (programming itself is a
+ *                      plain store the machine traps)
+ *   HAL_CRC_* / DMA    the CRC unit model, also fed by memory to CRC DMA
+ *   HAL_RCC_*          clock tree from the PLL settings main.c asks for
+ *   HAL_PCD_*          USB OTG FS device core on the same pseudo-terminal
+ *                      (--transport usb) : a scripted host resets and
+ *                      enumerates the device and opens the CDC port, bulk
+ *                      OUT packets come from the machine, bulk IN goes
+ *                      straight to the host link.  With --dfu the port
+ *                      stays closed and the requests after enumeration
+ *                      come from the DfuSe host in Host/sim/bl_sim_dfu.c
+ *
+ * Interrupts are raised on the machine's lines and served through
+ * sim_hal_irq() whenever PRIMASK allows, so the firmware's callbacks
+ * run the way they do on the target.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bl_sim.h"
+
+/* Global Variable Declarations ----------------------------------------------*/
+
+static uint32_t simMsp = SIM_SRAM_BASE + 0x20000U;
+
+static UART_HandleTypeDef *logUart = NULL;
+
+/*	result of the last interrupt driven erase, reported by the flash interrupt	*/
+static uint32_t flashItError = 0xFFFFFFFFU;
+
+/*	USB : what the core reports to the firmware, each with its own due time, served in this order	*/
+typedef enum
+{
+	USB_EVENT_RESET,
+	USB_EVENT_SETUP,
+	USB_EVENT_EP0_IN,
+	USB_EVENT_EP0_OUT,
+	USB_EVENT_EP1_OUT,
+	USB_EVENT_EP1_IN,
+	USB_EVENTS
+} UsbEvent;
+
+#define USB_IDLE										UINT64_MAX
+#define USB_SCRIPT_STEPS						(sizeof(usbScript) / sizeof(usbScript[0]))
+#define USB_SCRIPT_ENUMERATION			6U
+#define USB_REPLY_LEN								4096U
+
+/*	what a host does with a new CDC device up to opening its port, the OUT data stage follows the setup	*/
+static const struct
+{
+	uint8_t setup[8];
+	uint8_t data[8];
+} usbScript[] = {
+	{ { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x40, 0x00 }, { 0 } },		/* GET_DESCRIPTOR device, first 64 bytes */
+	{ { 0x00, 0x05, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0 } },		/* SET_ADDRESS 7 */
+	{ { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x12, 0x00 }, { 0 } },		/* GET_DESCRIPTOR device */
+	{ { 0x80, 0x06, 0x00, 0x02, 0x00, 0x00, 0xFF, 0x00 }, { 0 } },		/* GET_DESCRIPTOR configuration */
+	{ { 0x80, 0x06, 0x03, 0x03, 0x09, 0x04, 0xFF, 0x00 }, { 0 } },		/* GET_DESCRIPTOR serial number */
+	{ { 0x00, 0x09, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0 } },		/* SET_CONFIGURATION 1 */
+	{ { 0x21, 0x20, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00 }, { 0x00, 0xC2, 0x01, 0x00, 0x00, 0x00, 0x08 } },		/* SET_LINE_CODING 115200 8N1 */
+	{ { 0x21, 0x22, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0 } },		/* SET_CONTROL_LINE_STATE DTR RTS */
+};
+
+/*	the request on the bus : IN data stages are collected in reply, OUT data stages are sent from data	*/
+static struct
+{
+	PCD_HandleTypeDef *hpcd;
+	uint64_t due[USB_EVENTS];
+	uint32_t step;
+	int active;
+	int fromDfu;
+	uint8_t setup[8];
+	const uint8_t *data;
+	uint8_t reply[USB_REPLY_LEN];
+	uint32_t moved;
+	int dataDone;
+	int ep0InStatus;
+	int ep0OutStatus;
+	uint8_t *ep0Buffer;
+	uint32_t ep0Count;
+	uint8_t *outBuffer;
+	uint32_t outLength;
+	uint32_t outCount;
+	int outArmed;
+	uint64_t outArmedNs;
+	uint8_t address;
+} usb;
+
+/* Static Software Interface Declarations ------------------------------------*/
+static uint32_t flash_sector_start(uint32_t sector);
+static uint32_t flash_sector_size(uint32_t sector);
+static HAL_StatusTypeDef flash_erase_sectors(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError, uint64_t *busyNs);
+static void usb_schedule(UsbEvent event, uint64_t dueNs);
+static void usb_raise(void);
+static void usb_service(void);
+static void usb_request_done(int stalled);
+static void usb_next_request(void);
+
+/* Core ----------------------------------------------------------------------*/
+
+void __enable_irq(void)
+{
+	sim_set_primask(0);
+}
+
+void __disable_irq(void)
+{
+	sim_set_primask(1);
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return sim_primask();
+}
+
+void __set_PRIMASK(uint32_t priMask)
+{
+	sim_set_primask(priMask & 1U);
+}
+
+void __WFI(void)
+{
+	sim_wait();
+}
+
+void __WFE(void)
+{
+	sim_wait();
+}
+
+uint32_t __get_MSP(void)
+{
+	return simMsp;
+}
+
+void __set_MSP(uint32_t topOfMainStack)
+{
+	/*	the host keeps running on its own stack, the value is reported when the application is entered	*/
+	simMsp = topOfMainStack;
+}
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+	HAL_MspInit();
+	return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	sim_advance_ns(SIM_TICK_CALL_NS);
+	sim_poll();
+	return sim_tick_ms();
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+	uint32_t tickstart = HAL_GetTick();
+
+	while((HAL_GetTick() - tickstart) <= Delay)
+	{
+		__WFI();
+	}
+}
+
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup)
+{
+	(void)PriorityGroup;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+/* RCC -----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+	if(RCC_PLL_ON == RCC_OscInitStruct->PLL.PLLState)
+	{
+		SIM_REG(RCC->PLLCFGR) = RCC_OscInitStruct->PLL.PLLSource								|
+														RCC_OscInitStruct->PLL.PLLM										|
+														(RCC_OscInitStruct->PLL.PLLN << RCC_PLLCFGR_PLLN_Pos)	|
+														(((RCC_OscInitStruct->PLL.PLLP >> 1U) - 1U) << RCC_PLLCFGR_PLLP_Pos)	|
+														(RCC_OscInitStruct->PLL.PLLQ << RCC_PLLCFGR_PLLQ_Pos);
+		SIM_REG(RCC->CR) |= RCC_CR_PLLON | RCC_CR_PLLRDY;
+	}
+	if(RCC_HSE_ON == RCC_OscInitStruct->HSEState)
+	{
+		SIM_REG(RCC->CR) |= RCC_CR_HSEON | RCC_CR_HSERDY;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+	uint32_t cfgr = SIM_REG(RCC->CFGR);
+
+	cfgr &= ~(RCC_CFGR_SW | RCC_CFGR_SWS | RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2);
+	cfgr |= RCC_ClkInitStruct->SYSCLKSource | (RCC_ClkInitStruct->SYSCLKSource << 2U);
+	cfgr |= RCC_ClkInitStruct->AHBCLKDivider | RCC_ClkInitStruct->APB1CLKDivider | (RCC_ClkInitStruct->APB2CLKDivider << 3U);
+	SIM_REG(RCC->CFGR) = cfgr;
+	MODIFY_REG(SIM_REG(FLASH->ACR), FLASH_ACR_LATENCY, FLatency);
+
+	SystemCoreClock = HAL_RCC_GetSysClockFreq() >> AHBPrescTable[(cfgr & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_DeInit(void)
+{
+	SIM_REG(RCC->CFGR) = 0;
+	SIM_REG(RCC->CR) &= ~(RCC_CR_PLLON | RCC_CR_PLLRDY | RCC_CR_HSEON | RCC_CR_HSERDY);
+	SystemCoreClock = HSI_VALUE;
+	return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetSysClockFreq(void)
+{
+	uint32_t pllcfgr = SIM_REG(RCC->PLLCFGR);
+	uint32_t source = (pllcfgr & RCC_PLLCFGR_PLLSRC) ? HSE_VALUE : HSI_VALUE;
+	uint32_t pllm = pllcfgr & RCC_PLLCFGR_PLLM;
+	uint32_t plln = (pllcfgr & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos;
+	uint32_t pllp = ((((pllcfgr & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) + 1U) * 2U);
+
+	switch(SIM_REG(RCC->CFGR) & RCC_CFGR_SWS)
+	{
+		case( RCC_CFGR_SWS_HSE ):	return HSE_VALUE;
+		case( RCC_CFGR_SWS_PLL ):	return (uint32_t)(((uint64_t)source * plln) / pllm / pllp);
+		default:									return HSI_VALUE;
+	}
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+	return SystemCoreClock;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return HAL_RCC_GetHCLKFreq() >> APBPrescTable[(SIM_REG(RCC->CFGR) & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+	return HAL_RCC_GetHCLKFreq() >> APBPrescTable[(SIM_REG(RCC->CFGR) & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos];
+}
+
+/* GPIO ----------------------------------------------------------------------*/
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+	(void)GPIOx;
+	(void)GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+	GPIOx->ODR &= ~GPIO_Pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	/*	BSRR is write only on the part, the outcome lands in ODR	*/
+	if(GPIO_PIN_RESET != PinState)
+	{
+		GPIOx->ODR |= GPIO_Pin;
+	}
+	else
+	{
+		GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+	}
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	GPIOx->ODR ^= GPIO_Pin;
+}
+
+/* DMA -----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+	hdma->State = HAL_DMA_STATE_READY;
+	hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma)
+{
+	hdma->State = HAL_DMA_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+	/*	memory to memory only : the source is the "peripheral" side of the stream	*/
+	const uint8_t *source = (const uint8_t *)(uintptr_t)SrcAddress;
+	uint32_t width = (DMA_PDATAALIGN_WORD == hdma->Init.PeriphDataAlignment) ? 4U :
+									 (DMA_PDATAALIGN_HALFWORD == hdma->Init.PeriphDataAlignment) ? 2U : 1U;
+
+	if((uint32_t)(uintptr_t)&CRC->DR == DstAddress)
+	{
+		/*	the CRC unit takes every beat as a word, narrower beats are zero extended	*/
+		uint32_t crc = SIM_REG(CRC->DR);
+		for(uint32_t i = 0; i < DataLength; i++)
+		{
+			uint32_t word = 0;
+			memcpy(&word, source, width);
+			crc = sim_crc_word(crc, word);
+			source += (DMA_PINC_ENABLE == hdma->Init.PeriphInc) ? width : 0U;
+		}
+		SIM_REG(CRC->DR) = crc;
+	}
+	else
+	{
+		uint8_t *destination = (uint8_t *)(uintptr_t)DstAddress;
+		for(uint32_t i = 0; i < DataLength; i++)
+		{
+			memcpy(destination, source, width);
+			source += (DMA_PINC_ENABLE == hdma->Init.PeriphInc) ? width : 0U;
+			destination += (DMA_MINC_ENABLE == hdma->Init.MemInc) ? width : 0U;
+		}
+	}
+
+	/*	the CPU polls for the end right after, so the transfer time is simply spent here	*/
+	sim_advance_cycles((uint64_t)DataLength * SIM_DMA_WORD_CYCLES);
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+	/*	transfers end inside HAL_DMA_Start, there is never one to stop	*/
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_PollForTransfer(DMA_HandleTypeDef *hdma, HAL_DMA_LevelCompleteTypeDef CompleteLevel, uint32_t Timeout)
+{
+	(void)hdma;
+	(void)CompleteLevel;
+	(void)Timeout;
+	return HAL_OK;
+}
+
+/* CRC -----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_CRC_Init(CRC_HandleTypeDef *hcrc)
+{
+	if(HAL_CRC_STATE_RESET == hcrc->State)
+	{
+		hcrc->Lock = HAL_UNLOCKED;
+		HAL_CRC_MspInit(hcrc);
+	}
+	SIM_REG(CRC->DR) = 0xFFFFFFFFU;
+	hcrc->State = HAL_CRC_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CRC_DeInit(CRC_HandleTypeDef *hcrc)
+{
+	SIM_REG(CRC->DR) = 0xFFFFFFFFU;
+	HAL_CRC_MspDeInit(hcrc);
+	hcrc->State = HAL_CRC_STATE_RESET;
+	return HAL_OK;
+}
+
+uint32_t HAL_CRC_Accumulate(CRC_HandleTypeDef *hcrc, uint32_t pBuffer[], uint32_t BufferLength)
+{
+	uint32_t crc = SIM_REG(CRC->DR);
+
+	(void)hcrc;
+	for(uint32_t i = 0; i < BufferLength; i++)
+	{
+		crc = sim_crc_word(crc, pBuffer[i]);
+	}
+	SIM_REG(CRC->DR) = crc;
+	sim_advance_cycles((uint64_t)BufferLength * SIM_DMA_WORD_CYCLES);
+	return crc;
+}
+
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef *hcrc, uint32_t pBuffer[], uint32_t BufferLength)
+{
+	SIM_REG(CRC->DR) = 0xFFFFFFFFU;
+	return HAL_CRC_Accumulate(hcrc, pBuffer, BufferLength);
+}
+
+/* FLASH ---------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	SIM_REG(FLASH->CR) &= ~FLASH_CR_LOCK;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	SIM_REG(FLASH->CR) |= FLASH_CR_LOCK;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+	int fromRam = sim_code_in_ram(__builtin_return_address(0));
+	uint64_t busyNs = 0;
+	HAL_StatusTypeDef status = flash_erase_sectors(pEraseInit, SectorError, &busyNs);
+
+	sim_flash_busy(busyNs, fromRam);
+	if(!fromRam)
+	{
+		/*	called from flash : the CPU stalls on its next fetch until the erase is over	*/
+		sim_advance_ns(busyNs);
+		return status;
+	}
+
+	/*	called from RAM : the HAL polls BSY, interrupts are taken on the way	*/
+	while(busyNs)
+	{
+		uint64_t step = (busyNs < 1000000ULL) ? busyNs : 1000000ULL;
+		sim_advance_ns(step);
+		sim_poll();
+		busyNs -= step;
+	}
+	return status;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit)
+{
+	int fromRam = sim_code_in_ram(__builtin_return_address(0));
+	uint64_t busyNs = 0;
+	HAL_StatusTypeDef status = flash_erase_sectors(pEraseInit, &flashItError, &busyNs);
+
+	if(HAL_OK != status)
+	{
+		return status;
+	}
+	sim_flash_busy(busyNs, fromRam);
+	if(fromRam)
+	{
+		/*	started from RAM : the CPU runs on, the end of operation interrupt comes when the erase is over	*/
+		sim_raise_at(SIM_IRQ_FLASH, sim_now_ns() + busyNs);
+		return status;
+	}
+
+	/*	started from flash : the CPU stalls on its next fetch until the erase is over,	*/
+	/*	while the DMA keeps filling the receive ring, the end of operation interrupt follows	*/
+	sim_advance_ns(busyNs);
+	sim_raise(SIM_IRQ_FLASH);
+	return status;
+}
+
+void HAL_FLASHEx_OBGetConfig(FLASH_OBProgramInitTypeDef *pOBInit)
+{
+	uint32_t optcr = SIM_REG(FLASH->OPTCR);
+
+	pOBInit->OptionType = OPTIONBYTE_WRP | OPTIONBYTE_RDP | OPTIONBYTE_USER | OPTIONBYTE_BOR;
+	pOBInit->WRPSector = (optcr >> FLASH_OPTCR_nWRP_Pos) & 0xFFFU;
+	pOBInit->RDPLevel = (optcr & FLASH_OPTCR_RDP) >> FLASH_OPTCR_RDP_Pos;
+	pOBInit->BORLevel = optcr & FLASH_OPTCR_BOR_LEV;
+	pOBInit->USERConfig = optcr & (FLASH_OPTCR_WDG_SW | FLASH_OPTCR_nRST_STOP | FLASH_OPTCR_nRST_STDBY);
+}
+
+void FLASH_FlushCaches(void)
+{
+	/*	no ART accelerator in front of the image : reads always see the file	*/
+}
+
+/* UART ----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+	uint32_t pclk;
+
+	if(HAL_UART_STATE_RESET == huart->gState)
+	{
+		huart->Lock = HAL_UNLOCKED;
+		HAL_UART_MspInit(huart);
+	}
+
+	pclk = ((USART1 == huart->Instance) || (USART6 == huart->Instance)) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+	huart->Instance->BRR = (UART_OVERSAMPLING_8 == huart->Init.OverSampling) ? UART_BRR_SAMPLING8(pclk, huart->Init.BaudRate)
+																																						: UART_BRR_SAMPLING16(pclk, huart->Init.BaudRate);
+	huart->Instance->CR1 = USART_CR1_UE | huart->Init.Mode | huart->Init.WordLength | huart->Init.Parity | huart->Init.OverSampling;
+	huart->Instance->SR = USART_SR_TXE | USART_SR_TC;
+
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+	if(huart == sim_link_uart())
+	{
+		sim_link_rx_stop();
+	}
+	huart->Instance->CR1 = 0;
+	HAL_UART_MspDeInit(huart);
+	huart->gState = HAL_UART_STATE_RESET;
+	huart->RxState = HAL_UART_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)Timeout;
+
+	if(HAL_UART_STATE_READY != huart->gState)
+	{
+		return HAL_BUSY;
+	}
+
+	if(huart == sim_link_uart())
+	{
+		sim_link_send(pData, Size);
+	}
+	else
+	{
+		sim_log_send(pData, Size);
+	}
+
+	/*	polled : the CPU waits on TXE for every byte, reception carries on meanwhile	*/
+	sim_advance_ns(sim_hal_byte_ns(huart) * Size);
+	sim_poll();
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	if(HAL_UART_STATE_READY != huart->gState)
+	{
+		return HAL_BUSY;
+	}
+	if((NULL == pData) || (0U == Size))
+	{
+		return HAL_ERROR;
+	}
+
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	logUart = huart;
+	sim_log_send(pData, Size);
+	sim_raise_at(SIM_IRQ_LOG_TX, sim_now_ns() + sim_hal_byte_ns(huart) * Size);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart)
+{
+	if(huart == sim_link_uart())
+	{
+		sim_link_rx_stop();
+	}
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if(HAL_UART_STATE_READY != huart->RxState)
+	{
+		return HAL_BUSY;
+	}
+	if((NULL == pData) || (0U == Size) || (NULL == huart->hdmarx))
+	{
+		return HAL_ERROR;
+	}
+
+	huart->ReceptionType = HAL_UART_RECEPTION_TOIDLE;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	huart->pRxBuffPtr = pData;
+	huart->RxXferSize = Size;
+	huart->hdmarx->Instance->NDTR = Size;
+	sim_link_rx_start(huart, pData, Size);
+	return HAL_OK;
+}
+
+uint64_t sim_hal_byte_ns(const UART_HandleTypeDef *huart)
+{
+	/*	start bit, 8 or 9 data bits (parity included) and the stop bits	*/
+	uint32_t bits = 1U + ((UART_WORDLENGTH_9B == huart->Init.WordLength) ? 9U : 8U) +
+									((UART_STOPBITS_2 == huart->Init.StopBits) ? 2U : 1U);
+	uint32_t baudRate = huart->Init.BaudRate ? huart->Init.BaudRate : 115200U;
+
+	return ((uint64_t)bits * 1000000000ULL) / baudRate;
+}
+
+/* USB OTG FS ----------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_PCD_Init(PCD_HandleTypeDef *hpcd)
+{
+	if(HAL_PCD_STATE_RESET == hpcd->State)
+	{
+		hpcd->Lock = HAL_UNLOCKED;
+		HAL_PCD_MspInit(hpcd);
+	}
+	hpcd->State = HAL_PCD_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_DeInit(PCD_HandleTypeDef *hpcd)
+{
+	(void)HAL_PCD_Stop(hpcd);
+	HAL_PCD_MspDeInit(hpcd);
+	hpcd->State = HAL_PCD_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_Start(PCD_HandleTypeDef *hpcd)
+{
+	/*	--transport uart leaves the cable unplugged : the core waits for a reset that never comes	*/
+	memset(&usb, 0, sizeof(usb));
+	for(uint32_t event = 0; event < USB_EVENTS; event++)
+	{
+		usb.due[event] = USB_IDLE;
+	}
+	usb.hpcd = hpcd;
+	if(sim_link_is_usb())
+	{
+		usb_schedule(USB_EVENT_RESET, sim_now_ns() + SIM_USB_ATTACH_NS);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_Stop(PCD_HandleTypeDef *hpcd)
+{
+	/*	soft disconnect : the host drops the device, nothing more is delivered	*/
+	(void)hpcd;
+	for(uint32_t event = 0; event < USB_EVENTS; event++)
+	{
+		usb.due[event] = USB_IDLE;
+	}
+	usb.outArmed = 0;
+	usb.active = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_SetAddress(PCD_HandleTypeDef *hpcd, uint8_t address)
+{
+	(void)hpcd;
+	usb.address = address;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Open(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint16_t ep_mps, uint8_t ep_type)
+{
+	(void)hpcd;
+	(void)ep_addr;
+	(void)ep_mps;
+	(void)ep_type;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Close(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+	(void)hpcd;
+	if(0x01U == ep_addr)
+	{
+		usb.outArmed = 0;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Receive(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len)
+{
+	const uint8_t *setup = usb.setup;
+	uint32_t length = (uint32_t)(setup[6] | (setup[7] << 8));
+	(void)hpcd;
+
+	if(0U != (ep_addr & 0x7FU))
+	{
+		/*	the data OUT endpoint : the machine hands it the next packet from the host link	*/
+		usb.outBuffer = pBuf;
+		usb.outLength = len;
+		usb.outArmed = 1;
+		usb.outArmedNs = sim_now_ns();
+		return HAL_OK;
+	}
+	if(!usb.active)
+	{
+		return HAL_OK;
+	}
+
+	/*	control OUT : a packet of the data stage of an OUT request, or the status stage of an IN request	*/
+	if(!(setup[0] & 0x80U) && length && !usb.dataDone)
+	{
+		usb.ep0Buffer = pBuf;
+		usb.ep0Count = length - usb.moved;
+		usb.ep0Count = (usb.ep0Count < len) ? usb.ep0Count : len;
+		usb.ep0Count = (usb.ep0Count < 64U) ? usb.ep0Count : 64U;
+		usb.ep0OutStatus = 0;
+		usb_schedule(USB_EVENT_EP0_OUT, sim_now_ns() + (usb.moved ? SIM_USB_PACKET_NS : SIM_USB_STAGE_NS));
+	}
+	else if((setup[0] & 0x80U) && usb.dataDone)
+	{
+		usb.ep0Count = 0;
+		usb.ep0OutStatus = 1;
+		usb_schedule(USB_EVENT_EP0_OUT, sim_now_ns() + SIM_USB_STAGE_NS);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Transmit(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len)
+{
+	const uint8_t *setup = usb.setup;
+	uint64_t stageNs = SIM_USB_STAGE_NS;
+	(void)hpcd;
+
+	if(0x81U == ep_addr)
+	{
+		/*	bulk IN : the host reads it right away, completion after the packets' bus time (a ZLP is one)	*/
+		sim_link_send(pBuf, len);
+		usb_schedule(USB_EVENT_EP1_IN, sim_now_ns() + SIM_USB_PACKET_NS * (len ? ((len + 63U) / 64U) : 1U));
+		return HAL_OK;
+	}
+	if((0U != (ep_addr & 0x7FU)) || !usb.active)
+	{
+		return HAL_OK;
+	}
+
+	/*	control IN : a short packet or the requested length ends the data stage, otherwise it is the status stage	*/
+	/*	packets of one data stage follow each other on the bus, a new stage waits for the next frame				*/
+	if((setup[0] & 0x80U) && !usb.dataDone)
+	{
+		if(usb.moved + len <= USB_REPLY_LEN)
+		{
+			memcpy(&usb.reply[usb.moved], pBuf, len);
+		}
+		stageNs = usb.moved ? SIM_USB_PACKET_NS : SIM_USB_STAGE_NS;
+		usb.moved += len;
+		if((len < 64U) || (usb.moved >= (uint32_t)(setup[6] | (setup[7] << 8))))
+		{
+			usb.dataDone = 1;
+		}
+		usb.ep0InStatus = 0;
+	}
+	else
+	{
+		usb.ep0InStatus = 1;
+	}
+	usb_schedule(USB_EVENT_EP0_IN, sim_now_ns() + stageNs);
+	return HAL_OK;
+}
+
+uint32_t HAL_PCD_EP_GetRxCount(PCD_HandleTypeDef const *hpcd, uint8_t ep_addr)
+{
+	(void)hpcd;
+	return (0U == (ep_addr & 0x7FU)) ? usb.ep0Count : usb.outCount;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_SetStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+	/*	a stalled request fails on the host, which goes on with the next one	*/
+	(void)hpcd;
+	if((0x80U == ep_addr) && usb.active)
+	{
+		if(!usb.fromDfu)
+		{
+			fprintf(stderr, "bl_sim: USB request %02X %02X stalled\n", usb.setup[0], usb.setup[1]);
+		}
+		usb_request_done(1);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_ClrStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+	(void)hpcd;
+	(void)ep_addr;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCDEx_SetRxFiFo(PCD_HandleTypeDef *hpcd, uint16_t size)
+{
+	(void)hpcd;
+	(void)size;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCDEx_SetTxFiFo(PCD_HandleTypeDef *hpcd, uint8_t fifo, uint16_t size)
+{
+	(void)hpcd;
+	(void)fifo;
+	(void)size;
+	return HAL_OK;
+}
+
+int sim_hal_usb_out_ready(uint64_t *armedNs)
+{
+	*armedNs = usb.outArmedNs;
+	return usb.outArmed;
+}
+
+void sim_hal_usb_out(const uint8_t *data, uint32_t length, uint64_t dueNs)
+{
+	usb.outCount = (length < usb.outLength) ? length : usb.outLength;
+	memcpy(usb.outBuffer, data, usb.outCount);
+	usb.outArmed = 0;
+	usb_schedule(USB_EVENT_EP1_OUT, dueNs);
+}
+
+/* Interrupts ----------------------------------------------------------------*/
+
+void sim_hal_irq(uint32_t irq)
+{
+	switch(irq)
+	{
+		case( SIM_IRQ_HOST_RX ):
+		{
+			/*	half transfer, transfer complete or idle line : the HAL passes the ring position	*/
+			UART_HandleTypeDef *huart = sim_link_uart();
+			if((NULL != huart) && (HAL_UART_STATE_BUSY_RX == huart->RxState))
+			{
+				HAL_UARTEx_RxEventCallback(huart, (uint16_t)(huart->RxXferSize - huart->hdmarx->Instance->NDTR));
+			}
+			break;
+		}
+		case( SIM_IRQ_FLASH ):
+			if(0xFFFFFFFFU == flashItError)
+			{
+				HAL_FLASH_EndOfOperationCallback(0xFFFFFFFFU);
+			}
+			else
+			{
+				HAL_FLASH_OperationErrorCallback(flashItError);
+			}
+			break;
+		case( SIM_IRQ_LOG_TX ):
+			if(NULL != logUart)
+			{
+				logUart->gState = HAL_UART_STATE_READY;
+				HAL_UART_TxCpltCallback(logUart);
+			}
+			break;
+		case( SIM_IRQ_USB ):
+			usb_service();
+			break;
+		default:
+			break;
+	}
+}
+
+/* Static Software Interface Defintions --------------------------------------*/
+
+static uint32_t flash_sector_start(uint32_t sector)
+{
+	return (sector < 4U) ? (SIM_FLASH_BASE + sector * 0x4000U) :
+				 (sector == 4U) ? (SIM_FLASH_BASE + 0x10000U) : (SIM_FLASH_BASE + 0x20000U + (sector - 5U) * 0x20000U);
+}
+
+static uint32_t flash_sector_size(uint32_t sector)
+{
+	return (sector < 4U) ? 0x4000U : (sector == 4U) ? 0x10000U : 0x20000U;
+}
+
+static HAL_StatusTypeDef flash_erase_sectors(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError, uint64_t *busyNs)
+{
+	uint32_t first = 0, count = 12U;
+
+	*SectorError = 0xFFFFFFFFU;
+	if(FLASH_TYPEERASE_SECTORS == pEraseInit->TypeErase)
+	{
+		first = pEraseInit->Sector;
+		count = pEraseInit->NbSectors;
+	}
+
+	for(uint32_t sector = first; sector < (first + count); sector++)
+	{
+		/*	a locked controller ignores the request, a write protected sector reports WRPERR	*/
+		if((sector >= 12U) || (SIM_REG(FLASH->CR) & FLASH_CR_LOCK))
+		{
+			SIM_REG(FLASH->SR) |= FLASH_SR_PGSERR;
+			*SectorError = sector;
+			return HAL_ERROR;
+		}
+		if(!(SIM_REG(FLASH->OPTCR) & (1UL << (FLASH_OPTCR_nWRP_Pos + sector))))
+		{
+			SIM_REG(FLASH->SR) |= FLASH_SR_WRPERR;
+			*SectorError = sector;
+			return HAL_ERROR;
+		}
+
+		memset(sim_flash_alias(flash_sector_start(sector)), 0xFF, flash_sector_size(sector));
+		sim_count_erase(flash_sector_size(sector));
+		*busyNs += sim_erase_ns(flash_sector_size(sector), pEraseInit->VoltageRange);
+	}
+
+	SIM_REG(FLASH->SR) |= FLASH_SR_EOP;
+	return HAL_OK;
+}
+
+static void usb_schedule(UsbEvent event, uint64_t dueNs)
+{
+	usb.due[event] = dueNs;
+	usb_raise();
+}
+
+static void usb_raise(void)
+{
+	uint64_t next = USB_IDLE;
+
+	/*	one interrupt line for the whole core, raised for the earliest event	*/
+	for(uint32_t i = 0; i < USB_EVENTS; i++)
+	{
+		next = (usb.due[i] < next) ? usb.due[i] : next;
+	}
+	if(USB_IDLE != next)
+	{
+		sim_raise_at(SIM_IRQ_USB, next);
+	}
+}
+
+static void usb_service(void)
+{
+	PCD_HandleTypeDef *hpcd = usb.hpcd;
+
+	for(;;)
+	{
+		uint32_t event = 0;
+		while((event < USB_EVENTS) && (usb.due[event] > sim_now_ns()))
+		{
+			event++;
+		}
+		if(event >= USB_EVENTS)
+		{
+			break;
+		}
+		usb.due[event] = USB_IDLE;
+
+		switch(event)
+		{
+			case( USB_EVENT_RESET ):
+				usb.step = 0;
+				HAL_PCD_ResetCallback(hpcd);
+				usb_next_request();
+				break;
+			case( USB_EVENT_SETUP ):
+				usb.moved = 0;
+				usb.dataDone = 0;
+				memcpy(hpcd->Setup, usb.setup, 8);
+				HAL_PCD_SetupStageCallback(hpcd);
+				break;
+			case( USB_EVENT_EP0_IN ):
+				HAL_PCD_DataInStageCallback(hpcd, 0);
+				if(usb.ep0InStatus)
+				{
+					usb_request_done(0);
+				}
+				break;
+			case( USB_EVENT_EP0_OUT ):
+				if(!usb.ep0OutStatus && (NULL != usb.ep0Buffer))
+				{
+					memcpy(usb.ep0Buffer, &usb.data[usb.moved], usb.ep0Count);
+					usb.moved += usb.ep0Count;
+					usb.dataDone = (usb.moved >= (uint32_t)(usb.setup[6] | (usb.setup[7] << 8)));
+				}
+				HAL_PCD_DataOutStageCallback(hpcd, 0);
+				if(usb.ep0OutStatus)
+				{
+					usb_request_done(0);
+				}
+				break;
+			case( USB_EVENT_EP1_OUT ):
+				HAL_PCD_DataOutStageCallback(hpcd, 1);
+				break;
+			case( USB_EVENT_EP1_IN ):
+				HAL_PCD_DataInStageCallback(hpcd, 1);
+				break;
+			default:
+				break;
+		}
+	}
+	usb_raise();
+}
+
+static void usb_request_done(int stalled)
+{
+	usb.active = 0;
+	if(usb.fromDfu)
+	{
+		sim_dfu_reply(usb.reply, (usb.moved < USB_REPLY_LEN) ? usb.moved : USB_REPLY_LEN, stalled);
+	}
+	usb_next_request();
+}
+
+static void usb_next_request(void)
+{
+	/*	the next request of the script a frame later, the port stays open after the last one	*/
+	/*	--dfu : enumeration only, then whatever the DfuSe host asks for after its own delay		*/
+	uint64_t delayNs = 0;
+
+	if(usb.step < (sim_dfu_active() ? USB_SCRIPT_ENUMERATION : USB_SCRIPT_STEPS))
+	{
+		memcpy(usb.setup, usbScript[usb.step].setup, 8);
+		usb.data = usbScript[usb.step].data;
+		usb.fromDfu = 0;
+		usb.step++;
+	}
+	else if(sim_dfu_request(usb.setup, &usb.data, &delayNs))
+	{
+		usb.fromDfu = 1;
+	}
+	else
+	{
+		return;
+	}
+	usb.active = 1;
+	usb_schedule(USB_EVENT_SETUP, sim_now_ns() + SIM_USB_STAGE_NS + delayNs);
+}
@@ -0,0 +1,22 @@
+/*
+ * Public half of Host/bl_dev_ed25519.key for the host test builds.
+ *
+ * The private half is published with the sources, so anyone can sign for
+ * this key : bootloader_manifest.c only takes it with -DBL_SECURE_BOOT_DEV_KEY,
+ * and only from the host build (this directory is on no target include
+ * path).  Products provision their own key, see Host/bl_manifest.py keyheader.
+ */
+
+#ifndef BOOTLOADER_MANIFEST_DEV_KEY_H__
+#define BOOTLOADER_MANIFEST_DEV_KEY_H__
+
+#if defined(__arm__) || defined(__ARMCC_VERSION)
+#error "the development key is published with the sources, it is for host builds only"
+#endif
+
+#define BL_MANIFEST_PUBLIC_KEY	{	0x8C, 0x01, 0x96, 0x48, 0x0F, 0x3B, 0xA6, 0x8F,	\
+																	0x88, 0x13, 0xDE, 0xBF, 0xA1, 0x15, 0x25, 0x29,	\
+																	0xD9, 0x44, 0x0F, 0x5A, 0x6C, 0xFD, 0x84, 0x3B,	\
+																	0xB9, 0x37, 0xB3, 0x8B, 0xFF, 0x43, 0xC9, 0x80	}
+
+#endif /*BOOTLOADER_MANIFEST_DEV_KEY_H__*/
@@ -0,0 +1,160 @@
+/*
+ * Host stand-in for the CMSIS compiler layer, used by the bl_sim build.
+ *
+ * It sits in front of Drivers/CMSIS/Include on the include path, so the
+ * real core_cm4.h, device and HAL headers compile for x86-64.  The core
+ * registers (SCB, DWT, ITM, SysTick, ...) stay at their Cortex-M
+ * addresses, where bl_sim maps plain memory.  Only the intrinsics
+ * change : barriers become compiler barriers, the bit tricks become
+ * builtins, and everything that touches the interrupt mask or sleeps
+ * calls into the simulated machine (Host/sim/bl_sim_hal.c).
+ */
+
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#ifndef   __ASM
+  #define __ASM                                  __asm
+#endif
+#ifndef   __INLINE
+  #define __INLINE                               inline
+#endif
+#ifndef   __STATIC_INLINE
+  #define __STATIC_INLINE                        static inline
+#endif
+#ifndef   __STATIC_FORCEINLINE
+  #define __STATIC_FORCEINLINE                   __attribute__((always_inline)) static inline
+#endif
+#ifndef   __NO_RETURN
+  #define __NO_RETURN                            __attribute__((__noreturn__))
+#endif
+#ifndef   __USED
+  #define __USED                                 __attribute__((used))
+#endif
+#ifndef   __WEAK
+  #define __WEAK                                 __attribute__((weak))
+#endif
+#ifndef   __PACKED
+  #define __PACKED                               __attribute__((packed, aligned(1)))
+#endif
+#ifndef   __PACKED_STRUCT
+  #define __PACKED_STRUCT                        struct __attribute__((packed, aligned(1)))
+#endif
+#ifndef   __PACKED_UNION
+  #define __PACKED_UNION                         union __attribute__((packed, aligned(1)))
+#endif
+#ifndef   __ALIGNED
+  #define __ALIGNED(x)                           __attribute__((aligned(x)))
+#endif
+#ifndef   __RESTRICT
+  #define __RESTRICT                             __restrict
+#endif
+#ifndef   __COMPILER_BARRIER
+  #define __COMPILER_BARRIER()                   __asm volatile("":::"memory")
+#endif
+
+/*	unaligned access is fine on both the Cortex-M4 and x86-64, go through memcpy to stay within C	*/
+__STATIC_FORCEINLINE uint16_t __bl_sim_read16(const void *addr) { uint16_t v; __builtin_memcpy(&v, addr, 2); return v; }
+__STATIC_FORCEINLINE uint32_t __bl_sim_read32(const void *addr) { uint32_t v; __builtin_memcpy(&v, addr, 4); return v; }
+__STATIC_FORCEINLINE void __bl_sim_write16(void *addr, uint16_t v) { __builtin_memcpy(addr, &v, 2); }
+__STATIC_FORCEINLINE void __bl_sim_write32(void *addr, uint32_t v) { __builtin_memcpy(addr, &v, 4); }
+
+#ifndef   __UNALIGNED_UINT16_READ
+  #define __UNALIGNED_UINT16_READ(addr)          __bl_sim_read16((const void *)(addr))
+#endif
+#ifndef   __UNALIGNED_UINT16_WRITE
+  #define __UNALIGNED_UINT16_WRITE(addr, val)    __bl_sim_write16((void *)(addr), (val))
+#endif
+#ifndef   __UNALIGNED_UINT32_READ
+  #define __UNALIGNED_UINT32_READ(addr)          __bl_sim_read32((const void *)(addr))
+#endif
+#ifndef   __UNALIGNED_UINT32_WRITE
+  #define __UNALIGNED_UINT32_WRITE(addr, val)    __bl_sim_write32((void *)(addr), (val))
+#endif
+
+/* ###########################  Core Function Access  ########################### */
+
+/*	implemented by the simulated machine : PRIMASK gates the simulated interrupts, WFI waits for the next event	*/
+void __enable_irq(void);
+void __disable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void __WFI(void);
+void __WFE(void);
+uint32_t __get_MSP(void);
+void __set_MSP(uint32_t topOfMainStack);
+
+__STATIC_FORCEINLINE uint32_t __get_CONTROL(void)                 { return 0U; }
+__STATIC_FORCEINLINE void     __set_CONTROL(uint32_t control)     { (void)control; }
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void)                    { return 0U; }
+__STATIC_FORCEINLINE uint32_t __get_PSP(void)                     { return 0U; }
+__STATIC_FORCEINLINE void     __set_PSP(uint32_t topOfProcStack)  { (void)topOfProcStack; }
+__STATIC_FORCEINLINE uint32_t __get_BASEPRI(void)                 { return 0U; }
+__STATIC_FORCEINLINE void     __set_BASEPRI(uint32_t basePri)     { (void)basePri; }
+__STATIC_FORCEINLINE void     __set_BASEPRI_MAX(uint32_t basePri) { (void)basePri; }
+__STATIC_FORCEINLINE uint32_t __get_FAULTMASK(void)               { return 0U; }
+__STATIC_FORCEINLINE void     __set_FAULTMASK(uint32_t faultMask) { (void)faultMask; }
+__STATIC_FORCEINLINE void     __enable_fault_irq(void)            { }
+__STATIC_FORCEINLINE void     __disable_fault_irq(void)           { }
+__STATIC_FORCEINLINE uint32_t __get_FPSCR(void)                   { return 0U; }
+__STATIC_FORCEINLINE void     __set_FPSCR(uint32_t fpscr)         { (void)fpscr; }
+
+/* ##########################  Core Instruction Access  ######################### */
+
+#define __NOP()                                  __COMPILER_BARRIER()
+#define __SEV()                                  __COMPILER_BARRIER()
+#define __BKPT(value)                            __builtin_trap()
+#define __ISB()                                  __COMPILER_BARRIER()
+#define __DSB()                                  __COMPILER_BARRIER()
+#define __DMB()                                  __COMPILER_BARRIER()
+#define __CLREX()                                __COMPILER_BARRIER()
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t value)               { return __builtin_bswap32(value); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t value)             { return ((value & 0xFF00FF00U) >> 8) | ((value & 0x00FF00FFU) << 8); }
+__STATIC_FORCEINLINE int16_t  __REVSH(int16_t value)              { return (int16_t)__builtin_bswap16((uint16_t)value); }
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t op1, uint32_t op2)   { op2 %= 32U; return op2 ? ((op1 >> op2) | (op1 << (32U - op2))) : op1; }
+__STATIC_FORCEINLINE uint8_t  __CLZ(uint32_t value)               { return value ? (uint8_t)__builtin_clz(value) : 32U; }
+
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t value)
+{
+	uint32_t result = 0;
+	for(uint32_t i = 0; i < 32U; i++)
+	{
+		result = (result << 1) | (value & 1U);
+		value >>= 1;
+	}
+	return result;
+}
+
+/*	one thread of execution : the exclusive monitor always succeeds	*/
+__STATIC_FORCEINLINE uint8_t  __LDREXB(volatile uint8_t *addr)                    { return *addr; }
+__STATIC_FORCEINLINE uint16_t __LDREXH(volatile uint16_t *addr)                   { return *addr; }
+__STATIC_FORCEINLINE uint32_t __LDREXW(volatile uint32_t *addr)                   { return *addr; }
+__STATIC_FORCEINLINE uint32_t __STREXB(uint8_t value, volatile uint8_t *addr)     { *addr = value; return 0U; }
+__STATIC_FORCEINLINE uint32_t __STREXH(uint16_t value, volatile uint16_t *addr)   { *addr = value; return 0U; }
+__STATIC_FORCEINLINE uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)   { *addr = value; return 0U; }
+
+__STATIC_FORCEINLINE int32_t __SSAT(int32_t val, uint32_t sat)
+{
+	if((sat >= 1U) && (sat <= 32U))
+	{
+		const int32_t max = (int32_t)((1U << (sat - 1U)) - 1U);
+		const int32_t min = -1 - max;
+		return (val > max) ? max : (val < min) ? min : val;
+	}
+	return val;
+}
+
+__STATIC_FORCEINLINE uint32_t __USAT(int32_t val, uint32_t sat)
+{
+	if(sat <= 31U)
+	{
+		const uint32_t max = ((1U << sat) - 1U);
+		return (val > (int32_t)max) ? max : (val < 0) ? 0U : (uint32_t)val;
+	}
+	return (uint32_t)val;
+}
+
+#endif /* __CMSIS_COMPILER_H */
@@ -0,0 +1,10 @@
+/*
+ * Host front for the CMSIS Cortex-M4 core header, used by the bl_sim build.
+ *
+ * core_cm4.h includes "cmsis_compiler.h" from its own directory, which the
+ * include path cannot override.  Pulling in the host layer first defines
+ * the same guard, so the real core header then runs on top of it.
+ */
+
+#include "cmsis_compiler.h"
+#include_next <core_cm4.h>
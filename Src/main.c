@@ -19,7 +19,9 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "crc.h"
+#include "dma.h"
 #include "usart.h"
+#include "usb_otg.h"
 #include "gpio.h"
 
 /* Private includes ----------------------------------------------------------*/
@@ -53,6 +55,7 @@
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
+static void MX_NVIC_Init(void);
 /* USER CODE BEGIN PFP */
 
 /* USER CODE END PFP */
@@ -62,29 +65,24 @@ void SystemClock_Config(void);
 
 void jump_To_Application(void)
 {
-	
-	/*	address of main stack pointer in sector 2 of flash	*/
-	uint32_t application_MSP = (*((volatile uint32_t *)0x08008000));
-	
-	/*	address of reset handler in sector 2 of flash	*/
-	uint32_t application_Reset_Handler = (*((volatile uint32_t *)0x08008004));
+	/*	newest slot whose image matches its header, nothing to start if neither does	*/
+	uint8_t bootSlot = BL_Slot_Select_Boot();
+	if(BL_SLOT_NONE == bootSlot)
+	{
+		return;
+	}
 	
 	/*	de-Init all modules to have them in initial state before starting application	(especially RCC)	*/
 	HAL_GPIO_DeInit(GPIOD, GPIO_PIN_12|GPIO_PIN_13|GPIO_PIN_14|GPIO_PIN_15);
 	HAL_CRC_DeInit(&hcrc);
+	HAL_UART_AbortReceive(&huart2);
 	HAL_UART_DeInit(&huart2);
 	HAL_UART_DeInit(&huart3);
+	BL_USB_DeInit();
 	HAL_RCC_DeInit();
 	
-	/*	using CMSIS function set MSP to the MSP address of applcation	*/
-	__set_MSP(application_MSP);
-	
-	/*	make a pointer to function to jump to application	*/
-	typedef void(*ptrToFun)(void);
-	ptrToFun application = (ptrToFun)application_Reset_Handler;
-	
-	/*	BYE	*/
-	application();
+	/*	VTOR, MSP and the jump itself are shared with the reset fast path	*/
+	BL_Boot_Start_Slot(bootSlot, BL_BOOT_PATH_COMMAND);
 	
 }
 
@@ -111,46 +109,93 @@ int main(void)
 {
   /* USER CODE BEGIN 1 */
 	
+	/*	first stamp of this reset, the DWT counter was started in SystemInit	*/
+	BL_Boot_Info_Init();
+	
+#ifdef BL_FAST_BOOT
+	/*	no pending update : start the application before the PLL, HAL tick or any UART is touched	*/
+	uint8_t fastBootSlot = BL_Boot_Fast_Path();
+	if(BL_SLOT_NONE != fastBootSlot)
+	{
+		BL_Boot_Start_Slot(fastBootSlot, BL_BOOT_PATH_FAST);
+	}
+#endif
+	
   /* USER CODE END 1 */
-
+	
   /* MCU Configuration--------------------------------------------------------*/
-
+	
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
-
+	
   /* USER CODE BEGIN Init */
-
+	BL_Boot_Stamp(BL_BOOT_STAGE_HAL_INIT);
   /* USER CODE END Init */
-
+	
   /* Configure the system clock */
   SystemClock_Config();
-
+	
   /* USER CODE BEGIN SysInit */
-
+	BL_Boot_Stamp(BL_BOOT_STAGE_CLOCK);
   /* USER CODE END SysInit */
-
+	
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_CRC_Init();
   MX_USART2_UART_Init();
   MX_USART3_UART_Init();
+  MX_USB_OTG_FS_PCD_Init();
+	
+  /* Initialize interrupts */
+  MX_NVIC_Init();
   /* USER CODE BEGIN 2 */
+	BL_Boot_Stamp(BL_BOOT_STAGE_PERIPHERALS);
+	
+	/*	debug output is logged in binary and sent by USART3 DMA, decode it with Host/bl_log.py	*/
+	BL_Log_Init(BL_DEBUG_UART);
+	
+	/*	vector table to SRAM1 : with the handlers already there, interrupts keep being taken while the flash is busy	*/
+	BL_Flash_Init();
 	
 	BL_StatusTypeDef blStatus =BL_OK;
 	
+	/*	host links : the UART receives frames from the start, USB enumerates in the background and takes over once its port is opened	*/
+	BL_UART_Init(BL_HOST_COMM_UART);
+	BL_USB_Init(BL_HOST_COMM_USB);
+	BL_Transport_Init(&BL_UART_Transport);
+	
+	/*	work out which host link rates the UART clock can hit	*/
+	BL_Baud_Init(BL_HOST_COMM_UART);
+	
+	/*	finish a slot table compaction a reset cut short, then load the latest header of each slot from the slot table,	*/
+	/*	and the open session of the update journal																																*/
+	(void)BL_Slot_Recover();
+	BL_Slot_Init();
+	BL_Journal_Init();
+	
+#ifdef BL_CRC_BENCHMARK
+	if(HAL_OK != BL_CRC_Benchmark((const uint8_t *)ADD_FLASH_START, 4096))
+	{
+		LED_Turn_On(LED_RED);
+	}
+#endif
+	
   /* USER CODE END 2 */
-
+	
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
 	
+	BL_Boot_Stamp(BL_BOOT_STAGE_READY);
 #ifdef SWO_DEBUGGING
-	printf("\r\nBootloader Initializing Done!\r\n");
+	BL_LOG("\r\nBootloader Initializing Done!\r\n");
+	BL_LOG("Reset to ready : %u cycles \r\n", BL_BOOT_INFO->stageCycles[BL_BOOT_STAGE_READY]);
 #endif
   while (1)
   {
 		
     /* USER CODE END WHILE */
-
+	
     /* USER CODE BEGIN 3 */
 	
 		LED_Turn_On(LED_GREEN);
@@ -170,12 +215,12 @@ void SystemClock_Config(void)
 {
   RCC_OscInitTypeDef RCC_OscInitStruct = {0};
   RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
+	
   /** Configure the main internal regulator output voltage
   */
   __HAL_RCC_PWR_CLK_ENABLE();
   __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
-
+	
   /** Initializes the RCC Oscillators according to the specified parameters
   * in the RCC_OscInitTypeDef structure.
   */
@@ -186,12 +231,12 @@ void SystemClock_Config(void)
   RCC_OscInitStruct.PLL.PLLM = 4;
   RCC_OscInitStruct.PLL.PLLN = 168;
   RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
-  RCC_OscInitStruct.PLL.PLLQ = 4;
+  RCC_OscInitStruct.PLL.PLLQ = 7;
   if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
   {
     Error_Handler();
   }
-
+	
   /** Initializes the CPU, AHB and APB buses clocks
   */
   RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
@@ -200,13 +245,24 @@ void SystemClock_Config(void)
   RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
   RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV4;
   RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV2;
-
+	
   if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_5) != HAL_OK)
   {
     Error_Handler();
   }
 }
 
+/**
+  * @brief NVIC Configuration.
+  * @retval None
+  */
+static void MX_NVIC_Init(void)
+{
+  /* FLASH_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(FLASH_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(FLASH_IRQn);
+}
+
 /* USER CODE BEGIN 4 */
 
 /* USER CODE END 4 */